@@ -140,7 +140,10 @@ typedef enum yaml_error_type_e {
     /** Cannot write to the output stream. */
     YAML_WRITER_ERROR,
     /** Cannot emit a YAML stream. */
-    YAML_EMITTER_ERROR
+    YAML_EMITTER_ERROR,
+
+    /** The input exceeds a limit of the parser. */
+    YAML_LIMIT_ERROR
 } yaml_error_type_t;
 
 /** The pointer position. */
@@ -157,6 +160,63 @@ typedef struct yaml_mark_s {
 
 /** @} */
 
+/**
+ * @defgroup allocator Memory Allocation
+ * @{
+ */
+
+/**
+ * The prototype of a function allocating a memory block.
+ *
+ * @param[in,out]   data    The application data from the allocator.
+ * @param[in]       size    The size of the block; it is never @c 0.
+ *
+ * @returns The block or @c NULL if it could not be allocated.
+ */
+
+typedef void *yaml_malloc_handler_t(void *data, size_t size);
+
+/**
+ * The prototype of a function resizing a memory block.
+ *
+ * @param[in,out]   data    The application data from the allocator.
+ * @param[in]       ptr     The block or @c NULL to allocate a new one.
+ * @param[in]       size    The new size of the block; it is never @c 0.
+ *
+ * @returns The resized block or @c NULL if it could not be resized, in which
+ * case @a ptr is left intact.
+ */
+
+typedef void *yaml_realloc_handler_t(void *data, void *ptr, size_t size);
+
+/**
+ * The prototype of a function releasing a memory block.
+ *
+ * @param[in,out]   data    The application data from the allocator.
+ * @param[in]       ptr     The block; it is never @c NULL.
+ */
+
+typedef void yaml_free_handler_t(void *data, void *ptr);
+
+/**
+ * A memory allocator.
+ *
+ * The library calls the C library allocator where no allocator is given.
+ */
+
+typedef struct yaml_allocator_s {
+    /** Allocate a memory block. */
+    yaml_malloc_handler_t *malloc_handler;
+    /** Resize a memory block. */
+    yaml_realloc_handler_t *realloc_handler;
+    /** Release a memory block. */
+    yaml_free_handler_t *free_handler;
+    /** The application data passed to the handlers. */
+    void *data;
+} yaml_allocator_t;
+
+/** @} */
+
 /**
  * @defgroup styles Node Styles
  * @{
@@ -333,6 +393,12 @@ typedef struct yaml_token_s {
     /** The end of the token. */
     yaml_mark_t end_mark;
 
+    /** The allocator of the strings or @c NULL for the C library. */
+    const yaml_allocator_t *allocator;
+
+    /** Does the scalar value point into the parser input (not owned)? */
+    int borrowed;
+
 } yaml_token_t;
 
 /**
@@ -475,6 +541,12 @@ typedef struct yaml_event_s {
     /** The end of the event. */
     yaml_mark_t end_mark;
 
+    /** The allocator of the strings or @c NULL for the C library. */
+    const yaml_allocator_t *allocator;
+
+    /** Does the scalar value point into the parser input (not owned)? */
+    int borrowed;
+
 } yaml_event_t;
 
 /**
@@ -810,6 +882,15 @@ typedef struct yaml_document_s {
     /** The end of the document. */
     yaml_mark_t end_mark;
 
+    /**
+     * The arena holding the tags, values, items and pairs of the nodes, or
+     * @c NULL if they are allocated one by one.
+     */
+    void *arena;
+
+    /** The allocator of the node data or @c NULL for the C library. */
+    const yaml_allocator_t *allocator;
+
 } yaml_document_t;
 
 /**
@@ -960,6 +1041,263 @@ YAML_DECLARE(int)
 yaml_document_append_mapping_pair(yaml_document_t *document,
         int mapping, int key, int value);
 
+/**
+ * A node of a compact document.
+ *
+ * The fields are packed; use the yaml_compact_node_*() functions to read
+ * them.
+ */
+
+typedef struct yaml_compact_node_s {
+    /** The node type (2 bits), the style (3 bits) and the tag number. */
+    unsigned int info;
+    /**
+     * The offset of the value in the strings, or of the first item or pair in
+     * the items.
+     */
+    unsigned int data;
+    /** The length of the value, or the number of items or pairs. */
+    unsigned int length;
+} yaml_compact_node_t;
+
+/**
+ * A compact representation of a YAML document.
+ *
+ * A node takes 12 bytes instead of the @c sizeof(yaml_node_t) of a classic
+ * node.  The node ids are 32-bit.  The items of all sequences and the keys
+ * and values of all mappings share one array.  The values and the distinct
+ * tags share one string blob.  The marks of the nodes are optional.  They
+ * are kept in a side array as the indices of the marks only (see
+ * yaml_parser_mark_resolve()).
+ *
+ * A compact document is read-only.  It is produced from a classic document by
+ * yaml_document_compact() and turned back by yaml_compact_document_expand().
+ */
+
+typedef struct yaml_compact_document_s {
+
+    /** The nodes. */
+    struct {
+        /** The beginning of the node array. */
+        yaml_compact_node_t *start;
+        /** The end of the node array. */
+        yaml_compact_node_t *end;
+    } nodes;
+
+    /** The node ids of the sequence items and of the mapping keys and values. */
+    struct {
+        /** The beginning of the item array. */
+        unsigned int *start;
+        /** The end of the item array. */
+        unsigned int *end;
+    } items;
+
+    /** The distinct tags and the scalar values, each followed by a NUL. */
+    struct {
+        /** The beginning of the blob. */
+        yaml_char_t *start;
+        /** The end of the blob. */
+        yaml_char_t *end;
+    } strings;
+
+    /** The offsets of the distinct tags in the strings. */
+    struct {
+        /** The beginning of the tag array. */
+        unsigned int *start;
+        /** The end of the tag array. */
+        unsigned int *end;
+    } tags;
+
+    /**
+     * The indices of the start and the end marks of each node, or @c NULL if
+     * the marks are not kept.
+     */
+    unsigned int *marks;
+
+    /** The version directive. */
+    yaml_version_directive_t *version_directive;
+
+    /** The list of tag directives. */
+    struct {
+        /** The beginning of the tag directives list. */
+        yaml_tag_directive_t *start;
+        /** The end of the tag directives list. */
+        yaml_tag_directive_t *end;
+    } tag_directives;
+
+    /** Is the document start indicator implicit? */
+    int start_implicit;
+    /** Is the document end indicator implicit? */
+    int end_implicit;
+
+    /** The beginning of the document. */
+    yaml_mark_t start_mark;
+    /** The end of the document. */
+    yaml_mark_t end_mark;
+
+    /** The allocator of the document data or @c NULL for the C library. */
+    const yaml_allocator_t *allocator;
+
+} yaml_compact_document_t;
+
+/**
+ * Make a compact copy of a document.
+ *
+ * The copy uses the allocator of the @a document, which is left unchanged and
+ * may be deleted afterwards.  The function fails if the document does not fit
+ * the 32-bit ids and offsets of the compact representation.
+ *
+ * @param[in]       document    A document object.
+ * @param[out]      compact     An empty compact document object.
+ * @param[in]       marks       If the indices of the node marks should be
+ *                              kept.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 on error.
+ */
+
+YAML_DECLARE(int)
+yaml_document_compact(yaml_document_t *document,
+        yaml_compact_document_t *compact, int marks);
+
+/**
+ * Make a classic copy of a compact document.
+ *
+ * The node ids are the same in both documents.  The marks of the nodes have
+ * only the @c index set, or are zero if the marks were not kept.
+ *
+ * @param[in]       compact     A compact document object.
+ * @param[out]      document    An empty document object.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 on error.
+ */
+
+YAML_DECLARE(int)
+yaml_compact_document_expand(yaml_compact_document_t *compact,
+        yaml_document_t *document);
+
+/**
+ * Delete a compact document.
+ *
+ * @param[in,out]   compact     A compact document object.
+ */
+
+YAML_DECLARE(void)
+yaml_compact_document_delete(yaml_compact_document_t *compact);
+
+/**
+ * Get the root node of a compact document.
+ *
+ * @param[in]       compact     A compact document object.
+ *
+ * @returns the node id or @c 0 if the document is empty.
+ */
+
+YAML_DECLARE(int)
+yaml_compact_document_get_root(yaml_compact_document_t *compact);
+
+/**
+ * Get the type of a node of a compact document.
+ *
+ * @param[in]       compact     A compact document object.
+ * @param[in]       node        The node id.
+ *
+ * @returns the node type or @c YAML_NO_NODE if @a node is out of range.
+ */
+
+YAML_DECLARE(yaml_node_type_t)
+yaml_compact_node_type(yaml_compact_document_t *compact, int node);
+
+/**
+ * Get the style of a node of a compact document.
+ *
+ * The style is a @c yaml_scalar_style_t, a @c yaml_sequence_style_t or a
+ * @c yaml_mapping_style_t value depending on the node type.
+ *
+ * @param[in]       compact     A compact document object.
+ * @param[in]       node        The node id.
+ *
+ * @returns the node style.
+ */
+
+YAML_DECLARE(int)
+yaml_compact_node_style(yaml_compact_document_t *compact, int node);
+
+/**
+ * Get the tag of a node of a compact document.
+ *
+ * @param[in]       compact     A compact document object.
+ * @param[in]       node        The node id.
+ *
+ * @returns the tag or @c NULL if @a node is out of range.
+ */
+
+YAML_DECLARE(const yaml_char_t *)
+yaml_compact_node_tag(yaml_compact_document_t *compact, int node);
+
+/**
+ * Get the value of a SCALAR node of a compact document.
+ *
+ * The value is followed by a NUL, which is not counted in its @a length.
+ *
+ * @param[in]       compact     A compact document object.
+ * @param[in]       node        The node id.
+ * @param[out]      length      The length of the value.
+ *
+ * @returns the value or @c NULL if @a node is not a scalar.
+ */
+
+YAML_DECLARE(const yaml_char_t *)
+yaml_compact_node_value(yaml_compact_document_t *compact, int node,
+        size_t *length);
+
+/**
+ * Get the number of items of a SEQUENCE node or of pairs of a MAPPING node of
+ * a compact document.
+ *
+ * @param[in]       compact     A compact document object.
+ * @param[in]       node        The node id.
+ *
+ * @returns the number of items or pairs, or @c 0 for other nodes.
+ */
+
+YAML_DECLARE(int)
+yaml_compact_node_size(yaml_compact_document_t *compact, int node);
+
+/**
+ * Get an item of a SEQUENCE node, or the key or the value of a pair of a
+ * MAPPING node, of a compact document.
+ *
+ * For a sequence, @a index is the number of the item.  For a mapping, the key
+ * of the pair @c k is at @a index @c 2*k and the value at @c 2*k+1.
+ *
+ * @param[in]       compact     A compact document object.
+ * @param[in]       node        The node id.
+ * @param[in]       index       The number of the item.
+ *
+ * @returns the item node id or @c 0 if @a index is out of range.
+ */
+
+YAML_DECLARE(int)
+yaml_compact_node_item(yaml_compact_document_t *compact, int node, int index);
+
+/**
+ * Get the marks of a node of a compact document.
+ *
+ * Only the @c index of the marks is set.
+ *
+ * @param[in]       compact     A compact document object.
+ * @param[in]       node        The node id.
+ * @param[out]      start_mark  The start of the node.
+ * @param[out]      end_mark    The end of the node.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 if the marks are not kept or
+ * @a node is out of range.
+ */
+
+YAML_DECLARE(int)
+yaml_compact_node_marks(yaml_compact_document_t *compact, int node,
+        yaml_mark_t *start_mark, yaml_mark_t *end_mark);
+
 /** @} */
 
 /**
@@ -1006,6 +1344,37 @@ typedef struct yaml_simple_key_s {
     yaml_mark_t mark;
 } yaml_simple_key_t;
 
+/**
+ * The states of the JSON scanner.
+ */
+
+typedef enum yaml_json_state_e {
+    /** Expect a value. */
+    YAML_JSON_VALUE_STATE,
+    /** Expect the first item of a sequence or ']'. */
+    YAML_JSON_FIRST_ITEM_STATE,
+    /** Expect the first key of a mapping or '}'. */
+    YAML_JSON_FIRST_KEY_STATE,
+    /** Expect a key. */
+    YAML_JSON_KEY_STATE,
+    /** Expect ':'. */
+    YAML_JSON_COLON_STATE,
+    /** Expect ',' or the end of a collection or the stream. */
+    YAML_JSON_NEXT_STATE
+} yaml_json_state_t;
+
+/**
+ * This structure holds information about an unclosed JSON collection.
+ */
+
+typedef struct yaml_json_level_s {
+    /** Is the collection a mapping? */
+    int mapping;
+
+    /** The position mark of the collection start. */
+    yaml_mark_t mark;
+} yaml_json_level_t;
+
 /**
  * The states of the parser.
  */
@@ -1064,6 +1433,17 @@ typedef enum yaml_parser_state_e {
     YAML_PARSE_END_STATE
 } yaml_parser_state_t;
 
+/**
+ * This structure holds a slot of the tag directive index.
+ */
+
+typedef struct yaml_tag_directive_slot_s {
+    /** The tag directive position plus one or @c 0 for an empty slot. */
+    int directive;
+    /** The length of the tag directive prefix. */
+    size_t prefix_length;
+} yaml_tag_directive_slot_t;
+
 /**
  * This structure holds aliases data.
  */
@@ -1084,6 +1464,28 @@ typedef struct yaml_alias_data_s {
  * family of functions.
  */
 
+/**
+ * The resource limits of a parser.
+ *
+ * A limit of @c 0 means unlimited.  The nesting depth, the scalar length and
+ * the document length are checked by the scanner, so they apply to tokens,
+ * events and documents alike.  The number of nodes and alias references are
+ * checked by yaml_parser_load().
+ */
+
+typedef struct yaml_parser_limits_s {
+    /** The maximum number of nested collections. */
+    size_t max_depth;
+    /** The maximum length of a scalar value in bytes. */
+    size_t max_scalar_length;
+    /** The maximum number of nodes in a document. */
+    size_t max_nodes;
+    /** The maximum length of a document in characters. */
+    size_t max_document_length;
+    /** The maximum number of alias references in a document. */
+    size_t max_alias_references;
+} yaml_parser_limits_t;
+
 typedef struct yaml_parser_s {
 
     /**
@@ -1110,6 +1512,12 @@ typedef struct yaml_parser_s {
      * @}
      */
 
+    /** The memory allocator or @c NULL for the C library allocator. */
+    const yaml_allocator_t *allocator;
+
+    /** The resource limits. */
+    yaml_parser_limits_t limits;
+
     /**
      * @name Reader stuff
      * @{
@@ -1135,8 +1543,61 @@ typedef struct yaml_parser_s {
 
         /** File input data. */
         FILE *file;
+
+        /** Pushed input data. */
+        struct {
+            /** The beginning of the buffer. */
+            unsigned char *start;
+            /** The end of the buffer. */
+            unsigned char *end;
+            /** The next octet to read. */
+            unsigned char *pointer;
+            /** The end of the fed input. */
+            unsigned char *last;
+            /** The stream offset of the beginning of the buffer. */
+            size_t offset;
+            /** Has the end of the input been fed? */
+            int done;
+            /** Did the reader run out of fed input? */
+            int blocked;
+            /** The number of unscanned octets to wait for before the next try. */
+            size_t wanted;
+            /** The number of tokens queued before the last fetch. */
+            size_t fetched;
+            /** Did the last fetch run out of input after queuing tokens? */
+            int interrupted;
+            /** The error of a token fetched ahead of the parser. */
+            struct {
+                /** The number of tokens that the parser may take first. */
+                size_t tokens;
+                /** Error type. */
+                yaml_error_type_t error;
+                /** Error description. */
+                const char *problem;
+                /** The byte about which the problem occured. */
+                size_t problem_offset;
+                /** The problematic value (@c -1 is none). */
+                int problem_value;
+                /** The problem position. */
+                yaml_mark_t problem_mark;
+                /** The error context. */
+                const char *context;
+                /** The context position. */
+                yaml_mark_t context_mark;
+            } deferred;
+        } feed;
     } input;
 
+    /** The input opened by yaml_parser_set_input_path(). */
+    struct {
+        /** The mapped file contents. */
+        void *map;
+        /** The size of the mapping. */
+        size_t map_size;
+        /** The file opened for reading. */
+        FILE *file;
+    } input_path;
+
     /** EOF flag */
     int eof;
 
@@ -1173,6 +1634,9 @@ typedef struct yaml_parser_s {
     /** The offset of the current position (in bytes). */
     size_t offset;
 
+    /** Do the buffers point directly into the input string (zero-copy)? */
+    int zerocopy;
+
     /** The mark of the current position. */
     yaml_mark_t mark;
 
@@ -1194,6 +1658,12 @@ typedef struct yaml_parser_s {
     /** The number of unclosed '[' and '{' indicators. */
     int flow_level;
 
+    /** The position index at which the current document started. */
+    size_t document_index;
+
+    /** May scalar values point into the input buffer? */
+    int borrowed_scalars;
+
     /** The tokens queue. */
     struct {
         /** The beginning of the tokens queue. */
@@ -1238,6 +1708,59 @@ typedef struct yaml_parser_s {
         yaml_simple_key_t *top;
     } simple_keys;
 
+    /**
+     * The lowest flow level that may hold a possible simple key.  The simple
+     * keys of the lower levels are all impossible.
+     */
+    size_t simple_keys_lowest;
+
+    /** Is the input scanned as JSON? */
+    int json_mode;
+
+    /** The current JSON scanner state. */
+    yaml_json_state_t json_state;
+
+    /** The stack of unclosed JSON collections. */
+    struct {
+        /** The beginning of the stack. */
+        yaml_json_level_t *start;
+        /** The end of the stack. */
+        yaml_json_level_t *end;
+        /** The top of the stack. */
+        yaml_json_level_t *top;
+    } json_levels;
+
+    /**
+     * The scratch buffers of the scalar scanners, kept from one scalar to the
+     * next: the value, the leading break, the trailing breaks and the
+     * whitespaces.
+     */
+    struct {
+        /** The beginning of the buffer. */
+        yaml_char_t *start;
+        /** The end of the buffer. */
+        yaml_char_t *end;
+    } scratch[4];
+
+    /** Should the input be scanned by a separate thread? */
+    int pipelined;
+
+    /** The scanner thread of a pipelined parser or @c NULL. */
+    struct yaml_pipeline_s *pipeline;
+
+    /** Should the starts of the lines be recorded? */
+    int line_index;
+
+    /** The indices of the line starts, from the second line on. */
+    struct {
+        /** The beginning of the stack. */
+        size_t *start;
+        /** The end of the stack. */
+        size_t *end;
+        /** The top of the stack. */
+        size_t *top;
+    } lines;
+
     /**
      * @}
      */
@@ -1280,6 +1803,14 @@ typedef struct yaml_parser_s {
         yaml_tag_directive_t *top;
     } tag_directives;
 
+    /** The hash index of the tag directives. */
+    struct {
+        /** The beginning of the slots. */
+        yaml_tag_directive_slot_t *start;
+        /** The end of the slots. */
+        yaml_tag_directive_slot_t *end;
+    } tag_directive_index;
+
     /**
      * @}
      */
@@ -1299,9 +1830,20 @@ typedef struct yaml_parser_s {
         yaml_alias_data_t *top;
     } aliases;
 
+    /** The hash index of the alias data, kept between documents. */
+    struct {
+        /** The beginning of the slots. */
+        int *start;
+        /** The end of the slots. */
+        int *end;
+    } alias_index;
+
     /** The currently parsed document. */
     yaml_document_t *document;
 
+    /** Are the loaded documents arena-backed? */
+    int document_arena;
+
     /**
      * @}
      */
@@ -1322,6 +1864,26 @@ typedef struct yaml_parser_s {
 YAML_DECLARE(int)
 yaml_parser_initialize(yaml_parser_t *parser);
 
+/**
+ * Initialize a parser with a memory allocator.
+ *
+ * The parser takes all its memory from the @a allocator, including the
+ * strings of the produced tokens, events and documents.  These objects keep
+ * a pointer to the allocator so that yaml_token_delete(),
+ * yaml_event_delete() and yaml_document_delete() release them with it.  The
+ * allocator must stay valid as long as any of these objects exist.
+ *
+ * @param[out]      parser      An empty parser object.
+ * @param[in]       allocator   A memory allocator or @c NULL for the C library
+ *                              allocator.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 on error.
+ */
+
+YAML_DECLARE(int)
+yaml_parser_initialize_with_allocator(yaml_parser_t *parser,
+        const yaml_allocator_t *allocator);
+
 /**
  * Destroy a parser.
  *
@@ -1347,6 +1909,27 @@ YAML_DECLARE(void)
 yaml_parser_set_input_string(yaml_parser_t *parser,
         const unsigned char *input, size_t size);
 
+/**
+ * Set a string input that is scanned in place.
+ *
+ * Unlike yaml_parser_set_input_string(), UTF-8 input is not copied into the
+ * parser buffers: it is validated as the scanner advances and read directly
+ * from @a input.  Only the last few characters are copied once the end of the
+ * input is reached.  UTF-16 input is accepted too, but it is decoded through
+ * the regular buffers.
+ *
+ * The @a input buffer must stay valid and unchanged while the @a parser object
+ * exists.
+ *
+ * @param[in,out]   parser  A parser object.
+ * @param[in]       input   A source data.
+ * @param[in]       size    The length of the source data in bytes.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_input_buffer_zerocopy(yaml_parser_t *parser,
+        const unsigned char *input, size_t size);
+
 /**
  * Set a file input.
  *
@@ -1361,7 +1944,72 @@ YAML_DECLARE(void)
 yaml_parser_set_input_file(yaml_parser_t *parser, FILE *file);
 
 /**
- * Set a generic input handler.
+ * Set a file input by path.
+ *
+ * A regular file is mapped into memory and scanned in place, as with
+ * yaml_parser_set_input_buffer_zerocopy().  Pipes, devices and platforms
+ * without memory mapping fall back to reading the file with stdio, as with
+ * yaml_parser_set_input_file().  The parser closes the file when it is
+ * destroyed.
+ *
+ * A mapped file must not be truncated while the @a parser object exists.
+ *
+ * @param[in,out]   parser  A parser object.
+ * @param[in]       path    The path of the file.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 if the file could not be
+ * opened (@c errno is set accordingly).
+ */
+
+YAML_DECLARE(int)
+yaml_parser_set_input_path(yaml_parser_t *parser, const char *path);
+
+/**
+ * Set a pushed input.
+ *
+ * The input is then given with yaml_parser_feed().  Until the first chunk is
+ * fed, yaml_parser_parse() and yaml_parser_scan() return @c 0 and leave the
+ * error of the parser at @c YAML_NO_ERROR.
+ *
+ * @param[in,out]   parser  A parser object.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_input_feed(yaml_parser_t *parser);
+
+/**
+ * Feed a chunk of the input to the parser.
+ *
+ * The first call switches the parser to pushed input, unless
+ * yaml_parser_set_input_feed() was called before; a parser with no input set
+ * must not be used until then.  The chunk is copied, so
+ * the application may reuse @a input as soon as the function returns.  Set
+ * @a last with the final chunk, which may be empty.
+ *
+ * With pushed input, yaml_parser_parse() and yaml_parser_scan() never wait for
+ * more input.  When they cannot proceed until more is fed, they return @c 0
+ * and leave the error of the parser at @c YAML_NO_ERROR.  The scanner is
+ * suspended at the last complete token and resumes there on the next call;
+ * only the octets of an incomplete token are scanned again, after the input
+ * that follows them has at least doubled.
+ *
+ * The input is parsed incrementally only if it is UTF-8.  UTF-16 input is
+ * parsed once @a last is set, and yaml_parser_load() requires it as well.
+ *
+ * @param[in,out]   parser  A parser object.
+ * @param[in]       input   A chunk of the input.
+ * @param[in]       size    The size of the chunk in bytes.
+ * @param[in]       last    If this is the last chunk.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 on error.
+ */
+
+YAML_DECLARE(int)
+yaml_parser_feed(yaml_parser_t *parser,
+        const unsigned char *input, size_t size, int last);
+
+/**
+ * Set a generic input handler.
  *
  * @param[in,out]   parser  A parser object.
  * @param[in]       handler A read handler.
@@ -1383,6 +2031,155 @@ yaml_parser_set_input(yaml_parser_t *parser,
 YAML_DECLARE(void)
 yaml_parser_set_encoding(yaml_parser_t *parser, yaml_encoding_t encoding);
 
+/**
+ * Allow scalar values to point into the input buffer.
+ *
+ * If enabled, the values of plain and quoted scalars that need no
+ * transformation (a single line without escape sequences) are not copied.
+ * Such tokens and events have the @c borrowed flag set and their values are
+ * @b not NUL-terminated; use the @c length field.  A borrowed value stays
+ * valid as long as both the input and the @a parser object exist, and it
+ * must not be modified or freed.
+ *
+ * Values are borrowed only where the input stays in place: for zero-copy
+ * input (see yaml_parser_set_input_buffer_zerocopy() and
+ * yaml_parser_set_input_path()) and for the part of any input that is
+ * decoded after the end of the stream has been reached.
+ *
+ * @param[in,out]   parser      A parser object.
+ * @param[in]       borrowed    If scalar values may be borrowed.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_borrowed_scalars(yaml_parser_t *parser, int borrowed);
+
+/**
+ * Load documents into arenas.
+ *
+ * If enabled, yaml_parser_load() takes the tags, the scalar values, and the
+ * sequence items and mapping pairs of the nodes from a block allocator owned
+ * by the document.  yaml_document_delete() then releases them at once
+ * instead of one by one.  The nodes of an arena-backed document may be
+ * modified with the document API as usual, but their strings and lists must
+ * not be freed or reallocated by the application.
+ *
+ * @param[in,out]   parser  A parser object.
+ * @param[in]       arena   If the loaded documents should be arena-backed.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_document_arena(yaml_parser_t *parser, int arena);
+
+/**
+ * Scan the input as JSON.
+ *
+ * If enabled, the input is expected to be a single JSON text (RFC 8259) and
+ * is scanned by a dedicated tokenizer that skips the simple key, indentation
+ * and block scalar handling of YAML.  The produced tokens, events and
+ * documents are the same as for the same input scanned as YAML, except that
+ * surrogate pairs in @c \u escapes are combined.  Any input that is not JSON
+ * is rejected with a scanner error.
+ *
+ * The mode must be set before the first token is produced.
+ *
+ * @param[in,out]   parser  A parser object.
+ * @param[in]       json    If the input should be scanned as JSON.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_json_mode(yaml_parser_t *parser, int json);
+
+/**
+ * Scan the input in a separate thread.
+ *
+ * If enabled, a thread started on the first request for a token reads,
+ * decodes and scans the input ahead of the application, which only runs the
+ * event parser, or the loader, on the tokens handed over in batches.  This
+ * pays off for large inputs when another core is idle.  The memory held by the
+ * pipeline is bounded by a few batches of tokens.
+ *
+ * The read handler is called by the scanner thread.  The tokens, events and
+ * errors are the same as without the pipeline, except that the parser object
+ * does not track the position of the scanner.  Pushed input (see
+ * yaml_parser_feed()) and builds without thread support are scanned in the
+ * calling thread.
+ *
+ * The option must be set before the first token is produced.
+ *
+ * @param[in,out]   parser      A parser object.
+ * @param[in]       pipelined   If the input should be scanned in a thread.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_pipelined(yaml_parser_t *parser, int pipelined);
+
+/**
+ * Record where the lines of the input start.
+ *
+ * If enabled, the scanner keeps the index of the first character of each
+ * line, so that yaml_parser_mark_resolve() can compute the line and the
+ * column of any position from its index alone.  An application may then keep
+ * only the @c index of the marks it stores.  The index costs one @c size_t
+ * per line of the input.
+ *
+ * The option must be set before the first token is produced.
+ * yaml_stream_load_parallel() loads the input sequentially if it is set.
+ *
+ * @param[in,out]   parser  A parser object.
+ * @param[in]       index   If the line starts should be recorded.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_line_index(yaml_parser_t *parser, int index);
+
+/**
+ * Compute the line and the column of a mark from its index.
+ *
+ * The @a mark must come from the input of the @a parser, at or before the
+ * position the scanner has reached, and the line index must be kept (see
+ * yaml_parser_set_line_index()).  With a pipelined parser, marks can be
+ * resolved once the stream end is produced or the parser fails.
+ *
+ * If the input does not end with a line break, the scanner moves the marks of
+ * the final tokens to the start of a new line.  Their index is the end of the
+ * last line, and that is where they are resolved.
+ *
+ * @param[in]       parser  A parser object.
+ * @param[in,out]   mark    A mark with the @c index set.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 if the line index is not
+ * available.
+ */
+
+YAML_DECLARE(int)
+yaml_parser_mark_resolve(yaml_parser_t *parser, yaml_mark_t *mark);
+
+/**
+ * Set the resource limits of a parser.
+ *
+ * An input exceeding a limit fails with @c YAML_LIMIT_ERROR as soon as it is
+ * detected.  There are no limits by default.
+ *
+ * @param[in,out]   parser  A parser object.
+ * @param[in]       limits  The resource limits.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_limits(yaml_parser_t *parser,
+        const yaml_parser_limits_t *limits);
+
+/**
+ * Set the maximum nesting depth of the parsed documents.
+ *
+ * This is a shorthand for setting the @c max_depth field of the limits.
+ *
+ * @param[in,out]   parser  A parser object.
+ * @param[in]       depth   The maximum number of nested collections, or @c 0.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_max_depth(yaml_parser_t *parser, int depth);
+
 /**
  * Scan the input stream and produce the next token.
  *
@@ -1401,7 +2198,8 @@ yaml_parser_set_encoding(yaml_parser_t *parser, yaml_encoding_t encoding);
  * @param[in,out]   parser      A parser object.
  * @param[out]      token       An empty token object.
  *
- * @returns @c 1 if the function succeeded, @c 0 on error.
+ * @returns @c 1 if the function succeeded, @c 0 on error or if pushed input
+ * is exhausted, as with yaml_parser_parse().
  */
 
 YAML_DECLARE(int)
@@ -1425,12 +2223,40 @@ yaml_parser_scan(yaml_parser_t *parser, yaml_token_t *token);
  * @param[in,out]   parser      A parser object.
  * @param[out]      event       An empty event object.
  *
- * @returns @c 1 if the function succeeded, @c 0 on error.
+ * @returns @c 1 if the function succeeded, @c 0 on error or if pushed input
+ * is exhausted, in which case the error of the @a parser is
+ * @c YAML_NO_ERROR (see yaml_parser_feed()).
  */
 
 YAML_DECLARE(int)
 yaml_parser_parse(yaml_parser_t *parser, yaml_event_t *event);
 
+/**
+ * Parse the input stream and produce up to @a capacity parsing events.
+ *
+ * The function produces the same events as the same number of calls of
+ * yaml_parser_parse() would, stopping after the @c YAML_STREAM_END_EVENT
+ * event.  The number of produced events is stored in @a count; it is @c 0
+ * once the end of the stream has been reached.  The calls of
+ * yaml_parser_parse_batch() and yaml_parser_parse() may be alternated.
+ *
+ * An application is responsible for freeing any buffers associated with the
+ * produced events using the yaml_event_delete() function, including the
+ * events produced before an error.
+ *
+ * @param[in,out]   parser      A parser object.
+ * @param[out]      events      An array of @a capacity event objects.
+ * @param[in]       capacity    The size of the @a events array.
+ * @param[out]      count       The number of produced events.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 on error or if pushed input
+ * is exhausted, as with yaml_parser_parse().
+ */
+
+YAML_DECLARE(int)
+yaml_parser_parse_batch(yaml_parser_t *parser, yaml_event_t *events,
+        size_t capacity, size_t *count);
+
 /**
  * Parse the input stream and produce the next YAML document.
  *
@@ -1456,6 +2282,60 @@ yaml_parser_parse(yaml_parser_t *parser, yaml_event_t *event);
 YAML_DECLARE(int)
 yaml_parser_load(yaml_parser_t *parser, yaml_document_t *document);
 
+/**
+ * The prototype of a document handler.
+ *
+ * The document handler is called by yaml_stream_load_parallel() for each
+ * loaded document, in stream order.  The handler owns the @a document and
+ * must destroy it with yaml_document_delete().
+ *
+ * @param[in,out]   data        A pointer to an application data specified by
+ *                              yaml_stream_load_parallel().
+ * @param[in,out]   document    The loaded document.
+ *
+ * @returns On success, the handler should return @c 1.  If the handler
+ * failed, the returned value should be @c 0, which stops the loading.
+ */
+
+typedef int yaml_document_handler_t(void *data, yaml_document_t *document);
+
+/**
+ * Load all documents of a stream on several threads.
+ *
+ * The input is split at the document start markers (@c ---) found at the
+ * beginning of a line, and the parts are loaded by @a threads worker threads,
+ * each with its own parser.  The documents are passed to the @a handler in
+ * stream order and with the marks of the whole stream, the same as a loop over
+ * yaml_parser_load() would produce them.
+ *
+ * The workers inherit the allocator and the document arena setting of the
+ * @a parser; the allocator must be thread-safe.  If a part fails to load, the
+ * stream is loaded sequentially from the beginning of that part, so the
+ * @a parser reports the same error as yaml_parser_load() would.  An input
+ * that cannot be decoded may be reported after more documents are delivered
+ * than yaml_parser_load() would produce, since the latter decodes ahead.
+ *
+ * Only UTF-8 input set with yaml_parser_set_input_string(),
+ * yaml_parser_set_input_buffer_zerocopy() or a mapped
+ * yaml_parser_set_input_path() is split.  Other inputs, and builds without
+ * thread support, are loaded sequentially.  After the call, the parser may
+ * only be destroyed.
+ *
+ * @param[in,out]   parser      A parser object with an unread input.
+ * @param[in]       threads     The number of worker threads.
+ * @param[in]       handler     A document handler.
+ * @param[in,out]   data        Any application data for passing to the
+ *                              document handler.
+ *
+ * @returns @c 1 if all documents were loaded and handled, @c 0 on error or if
+ * the handler failed, in which case the error of the @a parser is
+ * @c YAML_NO_ERROR.
+ */
+
+YAML_DECLARE(int)
+yaml_stream_load_parallel(yaml_parser_t *parser, int threads,
+        yaml_document_handler_t *handler, void *data);
+
 /** @} */
 
 /**
@@ -1481,6 +2361,16 @@ yaml_parser_load(yaml_parser_t *parser, yaml_document_t *document);
 
 typedef int yaml_write_handler_t(void *data, unsigned char *buffer, size_t size);
 
+/** A chunk of the output set by yaml_emitter_set_output_chunks(). */
+typedef struct yaml_output_chunk_s {
+    /** The chunk data. */
+    unsigned char *start;
+    /** The number of written bytes. */
+    size_t size;
+    /** The size of the chunk. */
+    size_t capacity;
+} yaml_output_chunk_t;
+
 /** The emitter states. */
 typedef enum yaml_emitter_state_e {
     /** Expect STREAM-START. */
@@ -1559,6 +2449,9 @@ typedef struct yaml_emitter_s {
      * @}
      */
 
+    /** The memory allocator or @c NULL for the C library allocator. */
+    const yaml_allocator_t *allocator;
+
     /**
      * @name Writer stuff
      * @{
@@ -1584,8 +2477,26 @@ typedef struct yaml_emitter_s {
 
         /** File output data. */
         FILE *file;
+
+        /** File descriptor output data. */
+        int fd;
+
+        /** Chunked output data. */
+        struct {
+            /** The beginning of the chunk list. */
+            yaml_output_chunk_t *start;
+            /** The end of the chunk list. */
+            yaml_output_chunk_t *end;
+            /** The end of the allocated chunks. */
+            yaml_output_chunk_t *last;
+            /** The end of the written chunks. */
+            yaml_output_chunk_t *top;
+        } chunks;
     } output;
 
+    /** The background writer of a file descriptor output or @c NULL. */
+    struct yaml_writer_s *writer;
+
     /** The working buffer. */
     struct {
         /** The beginning of the buffer. */
@@ -1633,6 +2544,12 @@ typedef struct yaml_emitter_s {
     /** The preferred line break. */
     yaml_break_t line_break;
 
+    /** Are the events written without looking ahead? */
+    int streaming;
+
+    /** Are the strings of borrowed events trusted to be valid UTF-8? */
+    int trusted_utf8;
+
     /** The stack of states. */
     struct {
         /** The beginning of the stack. */
@@ -1769,6 +2686,9 @@ typedef struct yaml_emitter_s {
     /** The currently emitted document. */
     yaml_document_t *document;
 
+    /** The maximum nesting depth of a dumped document, or @c 0. */
+    int max_depth;
+
     /**
      * @}
      */
@@ -1789,6 +2709,24 @@ typedef struct yaml_emitter_s {
 YAML_DECLARE(int)
 yaml_emitter_initialize(yaml_emitter_t *emitter);
 
+/**
+ * Initialize an emitter with a memory allocator.
+ *
+ * The emitter takes its own memory from the @a allocator.  The events passed
+ * to the emitter are released with their own allocators.  The allocator must
+ * stay valid until the emitter is destroyed.
+ *
+ * @param[out]      emitter     An empty emitter object.
+ * @param[in]       allocator   A memory allocator or @c NULL for the C library
+ *                              allocator.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 on error.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_initialize_with_allocator(yaml_emitter_t *emitter,
+        const yaml_allocator_t *allocator);
+
 /**
  * Destroy an emitter.
  *
@@ -1830,6 +2768,99 @@ yaml_emitter_set_output_string(yaml_emitter_t *emitter,
 YAML_DECLARE(void)
 yaml_emitter_set_output_file(yaml_emitter_t *emitter, FILE *file);
 
+/**
+ * Set a chunked output.
+ *
+ * The emitter writes the output to a list of memory chunks that it owns.  A
+ * new chunk is added when the last one is full, each one twice as large as
+ * the previous, so the written data is never moved.  The output is available
+ * through yaml_emitter_get_output_chunks() or yaml_emitter_get_output_buffer()
+ * once the emitter is flushed, which it does at the end of each document.
+ *
+ * @param[in,out]   emitter     An emitter object.
+ */
+
+YAML_DECLARE(void)
+yaml_emitter_set_output_chunks(yaml_emitter_t *emitter);
+
+/**
+ * Get the chunks written to a chunked output.
+ *
+ * The chunks stay valid until the emitter writes more output, or until
+ * yaml_emitter_get_output_buffer(), yaml_emitter_reset_output_chunks() or
+ * yaml_emitter_delete() is called.  The layout of yaml_output_chunk_t is not
+ * that of struct iovec, so the chunks are copied to an iovec array to be
+ * passed to writev().
+ *
+ * @param[in]       emitter     An emitter object with a chunked output.
+ * @param[out]      chunks      A pointer to save the first chunk.
+ * @param[out]      count       A pointer to save the number of chunks.
+ */
+
+YAML_DECLARE(void)
+yaml_emitter_get_output_chunks(yaml_emitter_t *emitter,
+        const yaml_output_chunk_t **chunks, size_t *count);
+
+/**
+ * Get the output written to a chunked output as a contiguous buffer.
+ *
+ * If the output spans several chunks, they are merged into one.  The buffer
+ * stays valid under the same conditions as the chunks.
+ *
+ * @param[in,out]   emitter     An emitter object with a chunked output.
+ * @param[out]      buffer      A pointer to save the output.
+ * @param[out]      size        A pointer to save the size of the output.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 on error.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_get_output_buffer(yaml_emitter_t *emitter,
+        const unsigned char **buffer, size_t *size);
+
+/**
+ * Discard the output written to a chunked output.
+ *
+ * The chunks are kept and filled again by the following output, so that
+ * emitting one document after another reuses the same memory.
+ *
+ * @param[in,out]   emitter     An emitter object with a chunked output.
+ */
+
+YAML_DECLARE(void)
+yaml_emitter_reset_output_chunks(yaml_emitter_t *emitter);
+
+/**
+ * Set a file descriptor output.
+ *
+ * The emitter writes its output buffer to @a fd with write(2), bypassing
+ * stdio.  The output buffer is resized to @a buffer_size bytes; @c 0 or a
+ * size below the default of 16 KiB selects the default.
+ *
+ * If @a background is set and the library is built with POSIX threads, the
+ * emitter allocates a second buffer and starts a writer thread: a full buffer
+ * is handed to the thread and the emitter goes on filling the other one.
+ * Everything handed to the thread is written when yaml_emitter_flush()
+ * returns, which the emitter calls at the end of the stream, and when the
+ * emitter is deleted.  Write errors of the thread are reported by the next
+ * flush.
+ *
+ * The application is responsible for closing @a fd after the emitter is
+ * flushed.
+ *
+ * @param[in,out]   emitter         An emitter object.
+ * @param[in]       fd              A file descriptor open for writing.
+ * @param[in]       buffer_size     The size of the output buffer.
+ * @param[in]       background      If the output is written by a separate
+ *                                  thread.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 on error.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_set_output_fd(yaml_emitter_t *emitter, int fd,
+        size_t buffer_size, int background);
+
 /**
  * Set a generic output handler.
  *
@@ -1904,6 +2935,51 @@ yaml_emitter_set_unicode(yaml_emitter_t *emitter, int unicode);
 YAML_DECLARE(void)
 yaml_emitter_set_break(yaml_emitter_t *emitter, yaml_break_t line_break);
 
+/**
+ * Set if the events should be written without looking ahead.
+ *
+ * By default, the emitter holds up to three events after the start of a
+ * collection to find out if the collection is empty or fits in a simple key.
+ * In the streaming mode every event is written as soon as it is emitted and
+ * is never copied into the event queue.  The output differs only in that a
+ * collection used as a mapping key is always written as an explicit
+ * @c ? key.
+ *
+ * @param[in,out]   emitter     An emitter object.
+ * @param[in]       streaming   If the events are written without lookahead.
+ */
+
+YAML_DECLARE(void)
+yaml_emitter_set_streaming(yaml_emitter_t *emitter, int streaming);
+
+/**
+ * Set if the strings passed to the borrowing emit functions are trusted to be
+ * valid UTF-8.
+ *
+ * Trusted strings are not checked.  Passing invalid UTF-8 then produces
+ * invalid output.
+ *
+ * @param[in,out]   emitter     An emitter object.
+ * @param[in]       trusted     If the strings are trusted.
+ */
+
+YAML_DECLARE(void)
+yaml_emitter_set_trusted_utf8(yaml_emitter_t *emitter, int trusted);
+
+/**
+ * Set the maximum nesting depth of the dumped documents.
+ *
+ * yaml_emitter_dump() fails with @c YAML_EMITTER_ERROR on a document with
+ * more nested collections than @a depth.  @c 0 means unlimited, which is the
+ * default.  The nodes are walked with a heap-allocated stack in any case.
+ *
+ * @param[in,out]   emitter     An emitter object.
+ * @param[in]       depth       The maximum number of nested collections.
+ */
+
+YAML_DECLARE(void)
+yaml_emitter_set_max_depth(yaml_emitter_t *emitter, int depth);
+
 /**
  * Emit an event.
  *
@@ -1921,6 +2997,97 @@ yaml_emitter_set_break(yaml_emitter_t *emitter, yaml_break_t line_break);
 YAML_DECLARE(int)
 yaml_emitter_emit(yaml_emitter_t *emitter, yaml_event_t *event);
 
+/**
+ * Emit an ALIAS event from a borrowed anchor.
+ *
+ * The borrowing emit functions take the same arguments as the matching event
+ * initializers, but neither copy the strings nor create an event object.  An
+ * event that can be written at once is written straight from the caller's
+ * memory.  Only an event that has to wait in the event queue is copied: the
+ * start of a collection, unless the emitter is in the streaming mode, and any
+ * event that follows it while it waits.  The strings may be reused as soon as
+ * the function returns.
+ *
+ * The strings are checked to be valid UTF-8 unless the emitter trusts them.
+ *
+ * @param[in,out]   emitter     An emitter object.
+ * @param[in]       anchor      The anchor.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 on error.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_emit_alias_borrowed(yaml_emitter_t *emitter,
+        const yaml_char_t *anchor);
+
+/**
+ * Emit a SCALAR event from borrowed strings.
+ *
+ * See yaml_emitter_emit_alias_borrowed() and yaml_scalar_event_initialize().
+ *
+ * @param[in,out]   emitter         An emitter object.
+ * @param[in]       anchor          The scalar anchor or @c NULL.
+ * @param[in]       tag             The scalar tag or @c NULL.
+ * @param[in]       value           The scalar value.
+ * @param[in]       length          The length of the scalar value or
+ *                                  @c -1.  A value with an explicit length
+ *                                  need not be NUL-terminated.
+ * @param[in]       plain_implicit  If the tag may be omitted for the plain
+ *                                  style.
+ * @param[in]       quoted_implicit If the tag may be omitted for any
+ *                                  non-plain style.
+ * @param[in]       style           The scalar style.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 on error.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_emit_scalar_borrowed(yaml_emitter_t *emitter,
+        const yaml_char_t *anchor, const yaml_char_t *tag,
+        const yaml_char_t *value, int length,
+        int plain_implicit, int quoted_implicit,
+        yaml_scalar_style_t style);
+
+/**
+ * Emit a SEQUENCE-START event from borrowed strings.
+ *
+ * See yaml_emitter_emit_alias_borrowed() and
+ * yaml_sequence_start_event_initialize().
+ *
+ * @param[in,out]   emitter     An emitter object.
+ * @param[in]       anchor      The sequence anchor or @c NULL.
+ * @param[in]       tag         The sequence tag or @c NULL.
+ * @param[in]       implicit    If the tag may be omitted.
+ * @param[in]       style       The sequence style.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 on error.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_emit_sequence_start_borrowed(yaml_emitter_t *emitter,
+        const yaml_char_t *anchor, const yaml_char_t *tag, int implicit,
+        yaml_sequence_style_t style);
+
+/**
+ * Emit a MAPPING-START event from borrowed strings.
+ *
+ * See yaml_emitter_emit_alias_borrowed() and
+ * yaml_mapping_start_event_initialize().
+ *
+ * @param[in,out]   emitter     An emitter object.
+ * @param[in]       anchor      The mapping anchor or @c NULL.
+ * @param[in]       tag         The mapping tag or @c NULL.
+ * @param[in]       implicit    If the tag may be omitted.
+ * @param[in]       style       The mapping style.
+ *
+ * @returns @c 1 if the function succeeded, @c 0 on error.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_emit_mapping_start_borrowed(yaml_emitter_t *emitter,
+        const yaml_char_t *anchor, const yaml_char_t *tag, int implicit,
+        yaml_mapping_style_t style);
+
 /**
  * Start a YAML stream.
  *
@@ -1967,6 +3134,9 @@ yaml_emitter_dump(yaml_emitter_t *emitter, yaml_document_t *document);
 /**
  * Flush the accumulated characters to the output.
  *
+ * With a background writer, the function also waits until the thread has
+ * written everything handed to it.
+ *
  * @param[in,out]   emitter     An emitter object.
  *
  * @returns @c 1 if the function succeeded, @c 0 on error.
@@ -1,6 +1,13 @@
 
 #include "yaml_private.h"
 
+#if HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 /*
  * Get the library version.
  */
@@ -23,6 +30,29 @@ yaml_get_version(int *major, int *minor, int *patch)
     *patch = YAML_VERSION_PATCH;
 }
 
+/*
+ * Check if the CPU supports AVX2.
+ */
+
+YAML_DECLARE(int)
+yaml_cpu_has_avx2(void)
+{
+#if defined(YAML_HAVE_AVX2)
+    static int has_avx2 = -1;
+
+    /* The race on the first call is benign: every thread stores the same. */
+
+    if (has_avx2 < 0) {
+        __builtin_cpu_init();
+        has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+
+    return has_avx2;
+#else
+    return 0;
+#endif
+}
+
 /*
  * Allocate a dynamic memory block.
  */
@@ -66,15 +96,98 @@ yaml_strdup(const yaml_char_t *str)
     return (yaml_char_t *)strdup((char *)str);
 }
 
+/*
+ * Allocate a dynamic memory block with an allocator.
+ */
+
+YAML_DECLARE(void *)
+yaml_malloc_with(const yaml_allocator_t *allocator, size_t size)
+{
+    if (allocator)
+        return allocator->malloc_handler(allocator->data, size ? size : 1);
+
+    return yaml_malloc(size);
+}
+
+/*
+ * Reallocate a dynamic memory block with an allocator.
+ */
+
+YAML_DECLARE(void *)
+yaml_realloc_with(const yaml_allocator_t *allocator, void *ptr, size_t size)
+{
+    if (allocator)
+        return allocator->realloc_handler(allocator->data, ptr,
+                size ? size : 1);
+
+    return yaml_realloc(ptr, size);
+}
+
+/*
+ * Free a dynamic memory block with an allocator.
+ */
+
+YAML_DECLARE(void)
+yaml_free_with(const yaml_allocator_t *allocator, void *ptr)
+{
+    if (!allocator)
+        yaml_free(ptr);
+    else if (ptr)
+        allocator->free_handler(allocator->data, ptr);
+}
+
+/*
+ * Duplicate a string with an allocator.
+ */
+
+YAML_DECLARE(yaml_char_t *)
+yaml_strdup_with(const yaml_allocator_t *allocator, const yaml_char_t *str)
+{
+    size_t length;
+    yaml_char_t *copy;
+
+    if (!str)
+        return NULL;
+
+    if (!allocator)
+        return yaml_strdup(str);
+
+    length = strlen((char *)str);
+    copy = YAML_MALLOC_WITH(allocator, length+1);
+    if (!copy)
+        return NULL;
+
+    memcpy(copy, str, length+1);
+
+    return copy;
+}
+
+/*
+ * Hash a string with FNV-1a.
+ */
+
+YAML_DECLARE(size_t)
+yaml_string_hash(const yaml_char_t *string)
+{
+    size_t hash = 2166136261u;
+
+    while (*string) {
+        hash = (hash ^ *(string++)) * 16777619u;
+    }
+
+    return hash;
+}
+
 /*
  * Extend a string.
  */
 
 YAML_DECLARE(int)
-yaml_string_extend(yaml_char_t **start,
+yaml_string_extend(const yaml_allocator_t *allocator, yaml_char_t **start,
         yaml_char_t **pointer, yaml_char_t **end)
 {
-    yaml_char_t *new_start = (yaml_char_t *)yaml_realloc((void*)*start, (*end - *start)*2);
+    yaml_char_t *new_start = (yaml_char_t *)yaml_realloc_with(allocator,
+            (void*)*start, (*end - *start)*2);
 
     if (!new_start) return 0;
 
@@ -92,7 +205,7 @@ yaml_string_extend(yaml_char_t **start,
  */
 
 YAML_DECLARE(int)
-yaml_string_join(
+yaml_string_join(const yaml_allocator_t *allocator,
         yaml_char_t **a_start, yaml_char_t **a_pointer, yaml_char_t **a_end,
         yaml_char_t **b_start, yaml_char_t **b_pointer, SHIM(yaml_char_t **b_end))
 {
@@ -101,7 +214,7 @@ yaml_string_join(
         return 1;
 
     while (*a_end - *a_pointer <= *b_pointer - *b_start) {
-        if (!yaml_string_extend(a_start, a_pointer, a_end))
+        if (!yaml_string_extend(allocator, a_start, a_pointer, a_end))
             return 0;
     }
 
@@ -116,14 +229,16 @@ yaml_string_join(
  */
 
 YAML_DECLARE(int)
-yaml_stack_extend(void **start, void **top, void **end)
+yaml_stack_extend(const yaml_allocator_t *allocator,
+        void **start, void **top, void **end)
 {
     void *new_start;
 
     if ((char *)*end - (char *)*start >= INT_MAX / 2)
 	return 0;
 
-    new_start = yaml_realloc(*start, ((char *)*end - (char *)*start)*2);
+    new_start = yaml_realloc_with(allocator, *start,
+            ((char *)*end - (char *)*start)*2);
 
     if (!new_start) return 0;
 
@@ -139,12 +254,13 @@ yaml_stack_extend(void **start, void **top, void **end)
  */
 
 YAML_DECLARE(int)
-yaml_queue_extend(void **start, void **head, void **tail, void **end)
+yaml_queue_extend(const yaml_allocator_t *allocator,
+        void **start, void **head, void **tail, void **end)
 {
     /* Check if we need to resize the queue. */
 
     if (*start == *head && *tail == *end) {
-        void *new_start = yaml_realloc(*start,
+        void *new_start = yaml_realloc_with(allocator, *start,
                 ((char *)*end - (char *)*start)*2);
 
         if (!new_start) return 0;
@@ -168,6 +284,218 @@ yaml_queue_extend(void **start, void **head, void **tail, void **end)
     return 1;
 }
 
+/*
+ * An arena block.  The allocated memory follows the header.
+ */
+
+typedef struct yaml_arena_block_s {
+    /* The next block to release (allocated earlier). */
+    struct yaml_arena_block_s *next;
+    /* The beginning of the free space. */
+    char *pointer;
+    /* The end of the block. */
+    char *end;
+} yaml_arena_block_t;
+
+/*
+ * Allocations are aligned for any data stored in the arena.
+ */
+
+typedef union {
+    void *pointer;
+    double number;
+    long integer;
+    size_t size;
+} yaml_arena_align_t;
+
+#define ARENA_ALIGN(size)                                                       \
+    (((size) + sizeof(yaml_arena_align_t) - 1)                                  \
+     & ~(sizeof(yaml_arena_align_t) - 1))
+
+#define ARENA_HEADER_SIZE   ARENA_ALIGN(sizeof(yaml_arena_block_t))
+
+/*
+ * Allocate an arena block with the given free space.
+ */
+
+static yaml_arena_block_t *
+yaml_arena_new_block(const yaml_allocator_t *allocator, size_t size)
+{
+    yaml_arena_block_t *block;
+
+    if (size > MAX_FILE_SIZE)
+        return NULL;
+
+    block = (yaml_arena_block_t *)yaml_malloc_with(allocator,
+            ARENA_HEADER_SIZE + size);
+    if (!block) return NULL;
+
+    block->next = NULL;
+    block->pointer = (char *)block + ARENA_HEADER_SIZE;
+    block->end = block->pointer + size;
+
+    return block;
+}
+
+/*
+ * Create an arena.
+ */
+
+YAML_DECLARE(int)
+yaml_arena_initialize(const yaml_allocator_t *allocator, void **arena)
+{
+    *arena = yaml_arena_new_block(allocator,
+            ARENA_BLOCK_SIZE - ARENA_HEADER_SIZE);
+
+    return *arena != NULL;
+}
+
+/*
+ * Release an arena with all its blocks.
+ */
+
+YAML_DECLARE(void)
+yaml_arena_delete(const yaml_allocator_t *allocator, void *arena)
+{
+    yaml_arena_block_t *block = (yaml_arena_block_t *)arena;
+
+    while (block) {
+        yaml_arena_block_t *next = block->next;
+        yaml_free_with(allocator, block);
+        block = next;
+    }
+}
+
+/*
+ * Allocate memory from an arena.
+ */
+
+YAML_DECLARE(void *)
+yaml_arena_malloc(const yaml_allocator_t *allocator, void **arena,
+        size_t size)
+{
+    yaml_arena_block_t *head = (yaml_arena_block_t *)*arena;
+    yaml_arena_block_t *block;
+    size_t block_size;
+    char *ptr;
+
+    if (!head)
+        return yaml_malloc_with(allocator, size);
+
+    if (size > MAX_FILE_SIZE)
+        return NULL;
+
+    size = ARENA_ALIGN(size ? size : 1);
+
+    if ((size_t)(head->end - head->pointer) >= size) {
+        ptr = head->pointer;
+        head->pointer += size;
+        return ptr;
+    }
+
+    /* Each new block is twice as large as the current one, up to a limit. */
+
+    block_size = (head->end - (char *)head) * 2;
+    if (block_size > ARENA_MAX_BLOCK_SIZE)
+        block_size = ARENA_MAX_BLOCK_SIZE;
+
+    /*
+     * A large allocation gets a block of its own, which is put behind the
+     * current block so that the free space of the latter is not lost.
+     */
+
+    if (ARENA_HEADER_SIZE + size > block_size / 2) {
+        block = yaml_arena_new_block(allocator, size);
+        if (!block) return NULL;
+        block->pointer = block->end;
+        block->next = head->next;
+        head->next = block;
+        return (char *)block + ARENA_HEADER_SIZE;
+    }
+
+    block = yaml_arena_new_block(allocator, block_size - ARENA_HEADER_SIZE);
+    if (!block) return NULL;
+    block->next = head;
+    *arena = block;
+
+    ptr = block->pointer;
+    block->pointer += size;
+
+    return ptr;
+}
+
+/*
+ * Free memory allocated from an arena.  Only heap memory is released; arena
+ * memory is released with the arena.
+ */
+
+YAML_DECLARE(void)
+yaml_arena_free(const yaml_allocator_t *allocator, void *arena, void *ptr)
+{
+    if (!arena) yaml_free_with(allocator, ptr);
+}
+
+/*
+ * Copy a string of the given length into an arena and NUL-terminate it.
+ */
+
+YAML_DECLARE(yaml_char_t *)
+yaml_arena_strndup(const yaml_allocator_t *allocator, void **arena,
+        const yaml_char_t *str, size_t length)
+{
+    yaml_char_t *copy;
+
+    if (!str || length >= MAX_FILE_SIZE)
+        return NULL;
+
+    copy = (yaml_char_t *)yaml_arena_malloc(allocator, arena, length+1);
+    if (!copy) return NULL;
+
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+/*
+ * Extend a stack allocated from an arena.
+ */
+
+YAML_DECLARE(int)
+yaml_arena_stack_extend(const yaml_allocator_t *allocator, void **arena,
+        void **start, void **top, void **end)
+{
+    yaml_arena_block_t *head = (yaml_arena_block_t *)*arena;
+    size_t size = (char *)*end - (char *)*start;
+    void *new_start;
+
+    if (!head)
+        return yaml_stack_extend(allocator, start, top, end);
+
+    if (size >= INT_MAX / 2)
+        return 0;
+
+    /* The last allocation of the current block grows in place. */
+
+    if ((char *)*end == head->pointer
+            && (size_t)(head->end - head->pointer) >= size) {
+        head->pointer += size;
+        *end = (char *)*end + size;
+        return 1;
+    }
+
+    new_start = yaml_arena_malloc(allocator, arena, size*2);
+    if (!new_start) return 0;
+
+    memcpy(new_start, *start, (char *)*top - (char *)*start);
+
+    *top = (char *)new_start + ((char *)*top - (char *)*start);
+    *end = (char *)new_start + size*2;
+    *start = new_start;
+
+    return 1;
+}
+
 
 /*
  * Create a new parser object.
@@ -175,10 +503,25 @@ yaml_queue_extend(void **start, void **head, void **tail, void **end)
 
 YAML_DECLARE(int)
 yaml_parser_initialize(yaml_parser_t *parser)
+{
+    return yaml_parser_initialize_with_allocator(parser, NULL);
+}
+
+/*
+ * Create a new parser object with a memory allocator.
+ */
+
+YAML_DECLARE(int)
+yaml_parser_initialize_with_allocator(yaml_parser_t *parser,
+        const yaml_allocator_t *allocator)
 {
     assert(parser);     /* Non-NULL parser object expected. */
+    assert(!allocator || (allocator->malloc_handler
+                && allocator->realloc_handler && allocator->free_handler));
+                        /* Complete allocator expected. */
 
     memset(parser, 0, sizeof(yaml_parser_t));
+    parser->allocator = allocator;
     if (!BUFFER_INIT(parser, parser->raw_buffer, INPUT_RAW_BUFFER_SIZE))
         goto error;
     if (!BUFFER_INIT(parser, parser->buffer, INPUT_BUFFER_SIZE))
@@ -189,6 +532,8 @@ yaml_parser_initialize(yaml_parser_t *parser)
         goto error;
     if (!STACK_INIT(parser, parser->simple_keys, yaml_simple_key_t*))
         goto error;
+    if (!STACK_INIT(parser, parser->json_levels, yaml_json_level_t*))
+        goto error;
     if (!STACK_INIT(parser, parser->states, yaml_parser_state_t*))
         goto error;
     if (!STACK_INIT(parser, parser->marks, yaml_mark_t*))
@@ -205,6 +550,7 @@ error:
     QUEUE_DEL(parser, parser->tokens);
     STACK_DEL(parser, parser->indents);
     STACK_DEL(parser, parser->simple_keys);
+    STACK_DEL(parser, parser->json_levels);
     STACK_DEL(parser, parser->states);
     STACK_DEL(parser, parser->marks);
     STACK_DEL(parser, parser->tag_directives);
@@ -219,132 +565,519 @@ error:
 YAML_DECLARE(void)
 yaml_parser_delete(yaml_parser_t *parser)
 {
+    size_t k;
+
     assert(parser); /* Non-NULL parser object expected. */
 
+    yaml_parser_stop_pipeline(parser);
+    yaml_free_with(parser->allocator, parser->lines.start);
+
+    if (parser->zerocopy) {
+        parser->raw_buffer.start = NULL;
+        parser->buffer.start = NULL;
+    }
     BUFFER_DEL(parser, parser->raw_buffer);
     BUFFER_DEL(parser, parser->buffer);
     while (!QUEUE_EMPTY(parser, parser->tokens)) {
-        yaml_token_delete(&DEQUEUE(parser, parser->tokens));
+        yaml_token_t *token = &DEQUEUE(parser, parser->tokens);
+        token->allocator = parser->allocator;
+        yaml_token_delete(token);
     }
     QUEUE_DEL(parser, parser->tokens);
     STACK_DEL(parser, parser->indents);
     STACK_DEL(parser, parser->simple_keys);
+    STACK_DEL(parser, parser->json_levels);
+    for (k = 0; k < sizeof(parser->scratch)/sizeof(*parser->scratch); k ++) {
+        yaml_free_with(parser->allocator, parser->scratch[k].start);
+    }
     STACK_DEL(parser, parser->states);
     STACK_DEL(parser, parser->marks);
     while (!STACK_EMPTY(parser, parser->tag_directives)) {
         yaml_tag_directive_t tag_directive = POP(parser, parser->tag_directives);
-        yaml_free(tag_directive.handle);
-        yaml_free(tag_directive.prefix);
+        yaml_free_with(parser->allocator, tag_directive.handle);
+        yaml_free_with(parser->allocator, tag_directive.prefix);
     }
     STACK_DEL(parser, parser->tag_directives);
+    yaml_free_with(parser->allocator, parser->tag_directive_index.start);
+    yaml_free_with(parser->allocator, parser->alias_index.start);
+#if HAVE_MMAP
+    if (parser->input_path.map) {
+        munmap(parser->input_path.map, parser->input_path.map_size);
+    }
+#endif
+    if (parser->input_path.file) {
+        fclose(parser->input_path.file);
+    }
+    if (parser->read_handler == yaml_feed_read_handler) {
+        yaml_free_with(parser->allocator, parser->input.feed.start);
+    }
 
     memset(parser, 0, sizeof(yaml_parser_t));
 }
 
 /*
- * String read handler.
+ * String read handler.
+ */
+
+YAML_DECLARE(int)
+yaml_string_read_handler(void *data, unsigned char *buffer, size_t size,
+        size_t *size_read)
+{
+    yaml_parser_t *parser = (yaml_parser_t *)data;
+
+    if (parser->input.string.current == parser->input.string.end) {
+        *size_read = 0;
+        return 1;
+    }
+
+    if (size > (size_t)(parser->input.string.end
+                - parser->input.string.current)) {
+        size = parser->input.string.end - parser->input.string.current;
+    }
+
+    memcpy(buffer, parser->input.string.current, size);
+    parser->input.string.current += size;
+    *size_read = size;
+    return 1;
+}
+
+/*
+ * File read handler.
+ */
+
+static int
+yaml_file_read_handler(void *data, unsigned char *buffer, size_t size,
+        size_t *size_read)
+{
+    yaml_parser_t *parser = (yaml_parser_t *)data;
+
+    *size_read = fread(buffer, 1, size, parser->input.file);
+    return !ferror(parser->input.file);
+}
+
+/*
+ * Pushed input read handler.  Running out of the fed input before its end is
+ * reported as a failure and flagged, so that the scanner can tell it from an
+ * input error and suspend.
+ */
+
+YAML_DECLARE(int)
+yaml_feed_read_handler(void *data, unsigned char *buffer, size_t size,
+        size_t *size_read)
+{
+    yaml_parser_t *parser = (yaml_parser_t *)data;
+    size_t available = parser->input.feed.last - parser->input.feed.pointer;
+
+    if (!available && !parser->input.feed.done) {
+        parser->input.feed.blocked = 1;
+        return 0;
+    }
+
+    if (size > available) {
+        size = available;
+    }
+
+    if (size) {
+        memcpy(buffer, parser->input.feed.pointer, size);
+        parser->input.feed.pointer += size;
+    }
+    *size_read = size;
+
+    return 1;
+}
+
+/*
+ * Set a string input.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_input_string(yaml_parser_t *parser,
+        const unsigned char *input, size_t size)
+{
+    assert(parser); /* Non-NULL parser object expected. */
+    assert(!parser->read_handler);  /* You can set the source only once. */
+    assert(input);  /* Non-NULL input string expected. */
+
+    parser->read_handler = yaml_string_read_handler;
+    parser->read_handler_data = parser;
+
+    parser->input.string.start = input;
+    parser->input.string.current = input;
+    parser->input.string.end = input+size;
+}
+
+/*
+ * Set a string input that is scanned in place.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_input_buffer_zerocopy(yaml_parser_t *parser,
+        const unsigned char *input, size_t size)
+{
+    yaml_parser_set_input_string(parser, input, size);
+
+    /*
+     * The input replaces both buffers.  The reader never writes through them
+     * while they point into the input, so casting away const is safe.
+     */
+
+    BUFFER_DEL(parser, parser->raw_buffer);
+    BUFFER_DEL(parser, parser->buffer);
+
+    parser->raw_buffer.start = (unsigned char *)input;
+    parser->raw_buffer.pointer = parser->raw_buffer.start;
+    parser->raw_buffer.last = parser->raw_buffer.start;
+    parser->raw_buffer.end = parser->raw_buffer.start+size;
+
+    parser->buffer.start = (yaml_char_t *)input;
+    parser->buffer.pointer = parser->buffer.start;
+    parser->buffer.last = parser->buffer.start;
+    parser->buffer.end = parser->buffer.start+size;
+
+    parser->zerocopy = 1;
+}
+
+/*
+ * Set a file input.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_input_file(yaml_parser_t *parser, FILE *file)
+{
+    assert(parser); /* Non-NULL parser object expected. */
+    assert(!parser->read_handler);  /* You can set the source only once. */
+    assert(file);   /* Non-NULL file object expected. */
+
+    parser->read_handler = yaml_file_read_handler;
+    parser->read_handler_data = parser;
+
+    parser->input.file = file;
+}
+
+/*
+ * Set a file input by path.
+ */
+
+YAML_DECLARE(int)
+yaml_parser_set_input_path(yaml_parser_t *parser, const char *path)
+{
+#if HAVE_MMAP
+    struct stat st;
+    int fd;
+#endif
+
+    assert(parser); /* Non-NULL parser object expected. */
+    assert(!parser->read_handler);  /* You can set the source only once. */
+    assert(path);   /* Non-NULL path expected. */
+
+#if HAVE_MMAP
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+            && (off_t)(size_t)st.st_size == st.st_size) {
+        size_t size = (size_t)st.st_size;
+        void *map = NULL;
+
+        if (size) {
+            map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+
+        if (map != MAP_FAILED) {
+            close(fd);
+#ifdef MADV_SEQUENTIAL
+            if (map) {
+                madvise(map, size, MADV_SEQUENTIAL);
+            }
+#endif
+            parser->input_path.map = map;
+            parser->input_path.map_size = size;
+            yaml_parser_set_input_buffer_zerocopy(parser,
+                    map ? (const unsigned char *)map
+                        : (const unsigned char *)"", size);
+            return 1;
+        }
+    }
+
+    /* Not a regular file or not mappable: read it with stdio. */
+
+    parser->input_path.file = fdopen(fd, "rb");
+    if (!parser->input_path.file) {
+        close(fd);
+        return 0;
+    }
+#else
+    parser->input_path.file = fopen(path, "rb");
+    if (!parser->input_path.file)
+        return 0;
+#endif
+
+    yaml_parser_set_input_file(parser, parser->input_path.file);
+
+    return 1;
+}
+
+/*
+ * Set a pushed input.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_input_feed(yaml_parser_t *parser)
+{
+    assert(parser); /* Non-NULL parser object expected. */
+    assert(!parser->read_handler);  /* You can set the source only once. */
+
+    parser->read_handler = yaml_feed_read_handler;
+    parser->read_handler_data = parser;
+    memset(&parser->input.feed, 0, sizeof(parser->input.feed));
+}
+
+/*
+ * Feed a chunk of the input.
+ */
+
+YAML_DECLARE(int)
+yaml_parser_feed(yaml_parser_t *parser,
+        const unsigned char *input, size_t size, int last)
+{
+    size_t consumed;
+
+    assert(parser); /* Non-NULL parser object expected. */
+    assert(input || !size);     /* Non-NULL input expected. */
+    assert(!parser->read_handler
+            || parser->read_handler == yaml_feed_read_handler);
+                    /* You can set the source only once. */
+
+    if (!parser->read_handler) {
+        yaml_parser_set_input_feed(parser);
+    }
+
+    assert(!parser->input.feed.done);   /* No input after the last chunk. */
+
+    /*
+     * Drop the octets that the scanner is done with.  The rest is kept, since
+     * an incomplete token is scanned again from its start.  The scanned
+     * offset is only known for UTF-8, so other input is kept whole.
+     */
+
+    if (parser->encoding == YAML_UTF8_ENCODING) {
+        consumed = SCANNED_OFFSET(parser) - parser->input.feed.offset;
+        if (consumed && consumed >= (size_t)(parser->input.feed.last
+                    - parser->input.feed.start) / 2) {
+            memmove(parser->input.feed.start,
+                    parser->input.feed.start + consumed,
+                    parser->input.feed.last - parser->input.feed.start
+                    - consumed);
+            parser->input.feed.pointer -= consumed;
+            parser->input.feed.last -= consumed;
+            parser->input.feed.offset += consumed;
+        }
+    }
+
+    /* Append the chunk, growing the buffer geometrically. */
+
+    if ((size_t)(parser->input.feed.end - parser->input.feed.last) < size)
+    {
+        size_t length = parser->input.feed.last - parser->input.feed.start;
+        size_t capacity = parser->input.feed.end - parser->input.feed.start;
+        unsigned char *buffer;
+
+        if (size > (size_t)-1 - length) {
+            parser->error = YAML_MEMORY_ERROR;
+            return 0;
+        }
+        if (capacity < INPUT_RAW_BUFFER_SIZE) {
+            capacity = INPUT_RAW_BUFFER_SIZE;
+        }
+        while (capacity < length + size) {
+            capacity = capacity <= (size_t)-1 / 2 ? capacity * 2 : length + size;
+        }
+
+        buffer = (unsigned char *)yaml_realloc_with(parser->allocator,
+                parser->input.feed.start, capacity);
+        if (!buffer) {
+            parser->error = YAML_MEMORY_ERROR;
+            return 0;
+        }
+
+        parser->input.feed.pointer = buffer
+            + (parser->input.feed.pointer - parser->input.feed.start);
+        parser->input.feed.last = buffer + length;
+        parser->input.feed.start = buffer;
+        parser->input.feed.end = buffer + capacity;
+    }
+
+    if (size) {
+        memcpy(parser->input.feed.last, input, size);
+        parser->input.feed.last += size;
+    }
+    parser->input.feed.done = last;
+
+    return 1;
+}
+
+/*
+ * Set a generic input.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_input(yaml_parser_t *parser,
+        yaml_read_handler_t *handler, void *data)
+{
+    assert(parser); /* Non-NULL parser object expected. */
+    assert(!parser->read_handler);  /* You can set the source only once. */
+    assert(handler);    /* Non-NULL read handler expected. */
+
+    parser->read_handler = handler;
+    parser->read_handler_data = data;
+}
+
+/*
+ * Set the source encoding.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_encoding(yaml_parser_t *parser, yaml_encoding_t encoding)
+{
+    assert(parser); /* Non-NULL parser object expected. */
+    assert(!parser->encoding); /* Encoding is already set or detected. */
+
+    parser->encoding = encoding;
+}
+
+/*
+ * Allow borrowed scalar values.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_borrowed_scalars(yaml_parser_t *parser, int borrowed)
+{
+    assert(parser); /* Non-NULL parser object expected. */
+
+    parser->borrowed_scalars = (borrowed != 0);
+}
+
+/*
+ * Load arena-backed documents.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_set_document_arena(yaml_parser_t *parser, int arena)
+{
+    assert(parser); /* Non-NULL parser object expected. */
+
+    parser->document_arena = (arena != 0);
+}
+
+/*
+ * Set the JSON mode.
  */
 
-static int
-yaml_string_read_handler(void *data, unsigned char *buffer, size_t size,
-        size_t *size_read)
+YAML_DECLARE(void)
+yaml_parser_set_json_mode(yaml_parser_t *parser, int json)
 {
-    yaml_parser_t *parser = (yaml_parser_t *)data;
-
-    if (parser->input.string.current == parser->input.string.end) {
-        *size_read = 0;
-        return 1;
-    }
-
-    if (size > (size_t)(parser->input.string.end
-                - parser->input.string.current)) {
-        size = parser->input.string.end - parser->input.string.current;
-    }
+    assert(parser); /* Non-NULL parser object expected. */
+    assert(!parser->stream_start_produced);
+                    /* The input is not scanned yet. */
 
-    memcpy(buffer, parser->input.string.current, size);
-    parser->input.string.current += size;
-    *size_read = size;
-    return 1;
+    parser->json_mode = (json != 0);
 }
 
 /*
- * File read handler.
+ * Scan the input in a separate thread.
  */
 
-static int
-yaml_file_read_handler(void *data, unsigned char *buffer, size_t size,
-        size_t *size_read)
+YAML_DECLARE(void)
+yaml_parser_set_pipelined(yaml_parser_t *parser, int pipelined)
 {
-    yaml_parser_t *parser = (yaml_parser_t *)data;
+    assert(parser); /* Non-NULL parser object expected. */
+    assert(!parser->stream_start_produced && !parser->pipeline);
+                    /* The input is not scanned yet. */
 
-    *size_read = fread(buffer, 1, size, parser->input.file);
-    return !ferror(parser->input.file);
+    parser->pipelined = (pipelined != 0);
 }
 
 /*
- * Set a string input.
+ * Record where the lines of the input start.
  */
 
 YAML_DECLARE(void)
-yaml_parser_set_input_string(yaml_parser_t *parser,
-        const unsigned char *input, size_t size)
+yaml_parser_set_line_index(yaml_parser_t *parser, int index)
 {
     assert(parser); /* Non-NULL parser object expected. */
-    assert(!parser->read_handler);  /* You can set the source only once. */
-    assert(input);  /* Non-NULL input string expected. */
-
-    parser->read_handler = yaml_string_read_handler;
-    parser->read_handler_data = parser;
+    assert(!parser->stream_start_produced && !parser->pipeline);
+                    /* The input is not scanned yet. */
 
-    parser->input.string.start = input;
-    parser->input.string.current = input;
-    parser->input.string.end = input+size;
+    parser->line_index = (index != 0);
 }
 
 /*
- * Set a file input.
+ * Compute the line and the column of a mark from its index.
  */
 
-YAML_DECLARE(void)
-yaml_parser_set_input_file(yaml_parser_t *parser, FILE *file)
+YAML_DECLARE(int)
+yaml_parser_mark_resolve(yaml_parser_t *parser, yaml_mark_t *mark)
 {
+    yaml_parser_t *scanner = parser;
+    size_t low = 0, high;
+
     assert(parser); /* Non-NULL parser object expected. */
-    assert(!parser->read_handler);  /* You can set the source only once. */
-    assert(file);   /* Non-NULL file object expected. */
+    assert(mark);   /* Non-NULL mark object expected. */
 
-    parser->read_handler = yaml_file_read_handler;
-    parser->read_handler_data = parser;
+    /* A pipelined parser leaves the index to the scanner thread. */
 
-    parser->input.file = file;
+    if (parser->pipeline) {
+        scanner = yaml_parser_pipeline_scanner(parser);
+        if (!scanner)
+            return 0;
+    }
+
+    if (!scanner->line_index)
+        return 0;
+
+    /* Find the number of lines that start at or before the mark. */
+
+    high = scanner->lines.top - scanner->lines.start;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (scanner->lines.start[middle] <= mark->index)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    mark->line = low;
+    mark->column = mark->index - (low ? scanner->lines.start[low-1] : 0);
+
+    return 1;
 }
 
 /*
- * Set a generic input.
+ * Set the resource limits.
  */
 
 YAML_DECLARE(void)
-yaml_parser_set_input(yaml_parser_t *parser,
-        yaml_read_handler_t *handler, void *data)
+yaml_parser_set_limits(yaml_parser_t *parser,
+        const yaml_parser_limits_t *limits)
 {
     assert(parser); /* Non-NULL parser object expected. */
-    assert(!parser->read_handler);  /* You can set the source only once. */
-    assert(handler);    /* Non-NULL read handler expected. */
+    assert(limits); /* Non-NULL limits expected. */
 
-    parser->read_handler = handler;
-    parser->read_handler_data = data;
+    parser->limits = *limits;
 }
 
 /*
- * Set the source encoding.
+ * Set the maximum nesting depth.
  */
 
 YAML_DECLARE(void)
-yaml_parser_set_encoding(yaml_parser_t *parser, yaml_encoding_t encoding)
+yaml_parser_set_max_depth(yaml_parser_t *parser, int depth)
 {
     assert(parser); /* Non-NULL parser object expected. */
-    assert(!parser->encoding); /* Encoding is already set or detected. */
+    assert(depth >= 0); /* Non-negative depth expected. */
 
-    parser->encoding = encoding;
+    parser->limits.max_depth = depth;
 }
 
 /*
@@ -353,10 +1086,25 @@ yaml_parser_set_encoding(yaml_parser_t *parser, yaml_encoding_t encoding)
 
 YAML_DECLARE(int)
 yaml_emitter_initialize(yaml_emitter_t *emitter)
+{
+    return yaml_emitter_initialize_with_allocator(emitter, NULL);
+}
+
+/*
+ * Create a new emitter object with a memory allocator.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_initialize_with_allocator(yaml_emitter_t *emitter,
+        const yaml_allocator_t *allocator)
 {
     assert(emitter);    /* Non-NULL emitter object expected. */
+    assert(!allocator || (allocator->malloc_handler
+                && allocator->realloc_handler && allocator->free_handler));
+                        /* Complete allocator expected. */
 
     memset(emitter, 0, sizeof(yaml_emitter_t));
+    emitter->allocator = allocator;
     if (!BUFFER_INIT(emitter, emitter->buffer, OUTPUT_BUFFER_SIZE))
         goto error;
     if (!BUFFER_INIT(emitter, emitter->raw_buffer, OUTPUT_RAW_BUFFER_SIZE))
@@ -384,6 +1132,9 @@ error:
     return 0;
 }
 
+static int
+yaml_chunks_write_handler(void *data, unsigned char *buffer, size_t size);
+
 /*
  * Destroy an emitter object.
  */
@@ -393,6 +1144,15 @@ yaml_emitter_delete(yaml_emitter_t *emitter)
 {
     assert(emitter);    /* Non-NULL emitter object expected. */
 
+    yaml_emitter_stop_writer(emitter);
+    if (emitter->write_handler == yaml_chunks_write_handler) {
+        yaml_output_chunk_t *chunk;
+        for (chunk = emitter->output.chunks.start;
+                chunk != emitter->output.chunks.last; chunk ++) {
+            yaml_free_with(emitter->allocator, chunk->start);
+        }
+        STACK_DEL(emitter, emitter->output.chunks);
+    }
     BUFFER_DEL(emitter, emitter->buffer);
     BUFFER_DEL(emitter, emitter->raw_buffer);
     STACK_DEL(emitter, emitter->states);
@@ -403,11 +1163,11 @@ yaml_emitter_delete(yaml_emitter_t *emitter)
     STACK_DEL(emitter, emitter->indents);
     while (!STACK_EMPTY(empty, emitter->tag_directives)) {
         yaml_tag_directive_t tag_directive = POP(emitter, emitter->tag_directives);
-        yaml_free(tag_directive.handle);
-        yaml_free(tag_directive.prefix);
+        yaml_free_with(emitter->allocator, tag_directive.handle);
+        yaml_free_with(emitter->allocator, tag_directive.prefix);
     }
     STACK_DEL(emitter, emitter->tag_directives);
-    yaml_free(emitter->anchors);
+    yaml_free_with(emitter->allocator, emitter->anchors);
 
     memset(emitter, 0, sizeof(yaml_emitter_t));
 }
@@ -449,6 +1209,89 @@ yaml_file_write_handler(void *data, unsigned char *buffer, size_t size)
 
     return (fwrite(buffer, 1, size, emitter->output.file) == size);
 }
+/*
+ * Add a chunk to a chunked output, twice as large as the previous one.
+ */
+
+static int
+yaml_emitter_add_chunk(yaml_emitter_t *emitter)
+{
+    yaml_output_chunk_t chunk;
+    size_t capacity = OUTPUT_BUFFER_SIZE;
+
+    /* Refill a chunk kept by yaml_emitter_reset_output_chunks(). */
+
+    if (emitter->output.chunks.top != emitter->output.chunks.last) {
+        emitter->output.chunks.top ++;
+        return 1;
+    }
+
+    if (!emitter->output.chunks.start) {
+        if (!STACK_INIT(emitter, emitter->output.chunks, yaml_output_chunk_t*))
+            return 0;
+        emitter->output.chunks.last = emitter->output.chunks.top;
+    }
+
+    if (emitter->output.chunks.top != emitter->output.chunks.start) {
+        capacity = emitter->output.chunks.top[-1].capacity;
+        if (capacity <= ((size_t)-1)/2) {
+            capacity *= 2;
+        }
+    }
+
+    chunk.start = YAML_MALLOC_WITH(emitter->allocator, capacity);
+    if (!chunk.start) {
+        emitter->error = YAML_MEMORY_ERROR;
+        return 0;
+    }
+    chunk.size = 0;
+    chunk.capacity = capacity;
+
+    if (!PUSH(emitter, emitter->output.chunks, chunk)) {
+        yaml_free_with(emitter->allocator, chunk.start);
+        return 0;
+    }
+    emitter->output.chunks.last = emitter->output.chunks.top;
+
+    return 1;
+}
+
+/*
+ * Chunked write handler.
+ */
+
+static int
+yaml_chunks_write_handler(void *data, unsigned char *buffer, size_t size)
+{
+    yaml_emitter_t *emitter = (yaml_emitter_t *)data;
+
+    while (size)
+    {
+        yaml_output_chunk_t *chunk;
+        size_t length;
+
+        if (emitter->output.chunks.top == emitter->output.chunks.start
+                || emitter->output.chunks.top[-1].size
+                == emitter->output.chunks.top[-1].capacity) {
+            if (!yaml_emitter_add_chunk(emitter))
+                return 0;
+        }
+
+        chunk = emitter->output.chunks.top - 1;
+        length = chunk->capacity - chunk->size;
+        if (length > size) {
+            length = size;
+        }
+
+        memcpy(chunk->start + chunk->size, buffer, length);
+        chunk->size += length;
+        buffer += length;
+        size -= length;
+    }
+
+    return 1;
+}
+
 /*
  * Set a string output.
  */
@@ -487,6 +1330,168 @@ yaml_emitter_set_output_file(yaml_emitter_t *emitter, FILE *file)
     emitter->output.file = file;
 }
 
+/*
+ * Set a chunked output.
+ */
+
+YAML_DECLARE(void)
+yaml_emitter_set_output_chunks(yaml_emitter_t *emitter)
+{
+    assert(emitter);    /* Non-NULL emitter object expected. */
+    assert(!emitter->write_handler);    /* You can set the output only once. */
+
+    emitter->write_handler = yaml_chunks_write_handler;
+    emitter->write_handler_data = emitter;
+
+    memset(&emitter->output.chunks, 0, sizeof(emitter->output.chunks));
+}
+
+/*
+ * Get the chunks of a chunked output.
+ */
+
+YAML_DECLARE(void)
+yaml_emitter_get_output_chunks(yaml_emitter_t *emitter,
+        const yaml_output_chunk_t **chunks, size_t *count)
+{
+    assert(emitter);    /* Non-NULL emitter object expected. */
+    assert(emitter->write_handler == yaml_chunks_write_handler);
+                        /* Chunked output expected. */
+    assert(chunks && count);    /* Non-NULL output pointers expected. */
+
+    *chunks = emitter->output.chunks.start;
+    *count = emitter->output.chunks.top - emitter->output.chunks.start;
+}
+
+/*
+ * Get a chunked output as a contiguous buffer.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_get_output_buffer(yaml_emitter_t *emitter,
+        const unsigned char **buffer, size_t *size)
+{
+    yaml_output_chunk_t merged;
+    yaml_output_chunk_t *chunk;
+
+    assert(emitter);    /* Non-NULL emitter object expected. */
+    assert(emitter->write_handler == yaml_chunks_write_handler);
+                        /* Chunked output expected. */
+    assert(buffer && size);     /* Non-NULL output pointers expected. */
+
+    if (emitter->output.chunks.top == emitter->output.chunks.start) {
+        *buffer = (const unsigned char *)"";
+        *size = 0;
+        return 1;
+    }
+
+    /*
+     * Merge the chunks into one that is as large as all of them together, so
+     * that the following output still fits without new allocations.
+     */
+
+    if (emitter->output.chunks.top - emitter->output.chunks.start > 1)
+    {
+        merged.size = 0;
+        merged.capacity = 0;
+        for (chunk = emitter->output.chunks.start;
+                chunk != emitter->output.chunks.last; chunk ++) {
+            merged.capacity += chunk->capacity;
+        }
+
+        merged.start = YAML_MALLOC_WITH(emitter->allocator, merged.capacity);
+        if (!merged.start) {
+            emitter->error = YAML_MEMORY_ERROR;
+            return 0;
+        }
+
+        for (chunk = emitter->output.chunks.start;
+                chunk != emitter->output.chunks.last; chunk ++) {
+            if (chunk < emitter->output.chunks.top) {
+                memcpy(merged.start + merged.size, chunk->start, chunk->size);
+                merged.size += chunk->size;
+            }
+            yaml_free_with(emitter->allocator, chunk->start);
+        }
+
+        emitter->output.chunks.start[0] = merged;
+        emitter->output.chunks.top = emitter->output.chunks.start + 1;
+        emitter->output.chunks.last = emitter->output.chunks.top;
+    }
+
+    *buffer = emitter->output.chunks.start->start;
+    *size = emitter->output.chunks.start->size;
+
+    return 1;
+}
+
+/*
+ * Discard the output of a chunked output, keeping the chunks.
+ */
+
+YAML_DECLARE(void)
+yaml_emitter_reset_output_chunks(yaml_emitter_t *emitter)
+{
+    yaml_output_chunk_t *chunk;
+
+    assert(emitter);    /* Non-NULL emitter object expected. */
+    assert(emitter->write_handler == yaml_chunks_write_handler);
+                        /* Chunked output expected. */
+
+    for (chunk = emitter->output.chunks.start;
+            chunk != emitter->output.chunks.top; chunk ++) {
+        chunk->size = 0;
+    }
+    emitter->output.chunks.top = emitter->output.chunks.start;
+}
+
+/*
+ * Set a file descriptor output.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_set_output_fd(yaml_emitter_t *emitter, int fd,
+        size_t buffer_size, int background)
+{
+    assert(emitter);    /* Non-NULL emitter object expected. */
+    assert(!emitter->write_handler);    /* You can set the output only once. */
+    assert(fd >= 0);    /* Valid file descriptor expected. */
+
+#if HAVE_UNISTD_H
+    if (buffer_size > OUTPUT_BUFFER_SIZE
+            && buffer_size <= (((size_t)-1) - 2) / 2)
+    {
+        /* The buffers are still empty since the output is not set. */
+
+        BUFFER_DEL(emitter, emitter->buffer);
+        BUFFER_DEL(emitter, emitter->raw_buffer);
+        if (!BUFFER_INIT(emitter, emitter->buffer, buffer_size)
+                || !BUFFER_INIT(emitter, emitter->raw_buffer,
+                    buffer_size*2+2))
+            return 0;
+    }
+
+    emitter->write_handler = yaml_fd_write_handler;
+    emitter->write_handler_data = emitter;
+
+    emitter->output.fd = fd;
+
+    if (background)
+        return yaml_emitter_start_writer(emitter);
+
+    return 1;
+#else
+    (void)fd;
+    (void)buffer_size;
+    (void)background;
+
+    emitter->error = YAML_WRITER_ERROR;
+    emitter->problem = "file descriptor output is not supported";
+
+    return 0;
+#endif
+}
+
 /*
  * Set a generic output handler.
  */
@@ -576,6 +1581,43 @@ yaml_emitter_set_break(yaml_emitter_t *emitter, yaml_break_t line_break)
     emitter->line_break = line_break;
 }
 
+/*
+ * Set the streaming mode.
+ */
+
+YAML_DECLARE(void)
+yaml_emitter_set_streaming(yaml_emitter_t *emitter, int streaming)
+{
+    assert(emitter);    /* Non-NULL emitter object expected. */
+
+    emitter->streaming = (streaming != 0);
+}
+
+/*
+ * Trust the strings of borrowed events.
+ */
+
+YAML_DECLARE(void)
+yaml_emitter_set_trusted_utf8(yaml_emitter_t *emitter, int trusted)
+{
+    assert(emitter);    /* Non-NULL emitter object expected. */
+
+    emitter->trusted_utf8 = (trusted != 0);
+}
+
+/*
+ * Set the maximum nesting depth of the dumped documents.
+ */
+
+YAML_DECLARE(void)
+yaml_emitter_set_max_depth(yaml_emitter_t *emitter, int depth)
+{
+    assert(emitter);    /* Non-NULL emitter object expected. */
+    assert(depth >= 0); /* Non-negative depth expected. */
+
+    emitter->max_depth = depth;
+}
+
 /*
  * Destroy a token object.
  */
@@ -588,25 +1630,26 @@ yaml_token_delete(yaml_token_t *token)
     switch (token->type)
     {
         case YAML_TAG_DIRECTIVE_TOKEN:
-            yaml_free(token->data.tag_directive.handle);
-            yaml_free(token->data.tag_directive.prefix);
+            yaml_free_with(token->allocator, token->data.tag_directive.handle);
+            yaml_free_with(token->allocator, token->data.tag_directive.prefix);
             break;
 
         case YAML_ALIAS_TOKEN:
-            yaml_free(token->data.alias.value);
+            yaml_free_with(token->allocator, token->data.alias.value);
             break;
 
         case YAML_ANCHOR_TOKEN:
-            yaml_free(token->data.anchor.value);
+            yaml_free_with(token->allocator, token->data.anchor.value);
             break;
 
         case YAML_TAG_TOKEN:
-            yaml_free(token->data.tag.handle);
-            yaml_free(token->data.tag.suffix);
+            yaml_free_with(token->allocator, token->data.tag.handle);
+            yaml_free_with(token->allocator, token->data.tag.suffix);
             break;
 
         case YAML_SCALAR_TOKEN:
-            yaml_free(token->data.scalar.value);
+            if (!token->borrowed)
+                yaml_free_with(token->allocator, token->data.scalar.value);
             break;
 
         default:
@@ -622,7 +1665,7 @@ yaml_token_delete(yaml_token_t *token)
  * Check 'reader.c' for more details on UTF-8 encoding.
  */
 
-static int
+YAML_DECLARE(int)
 yaml_check_utf8(const yaml_char_t *start, size_t length)
 {
     const yaml_char_t *end = start+length;
@@ -707,7 +1750,8 @@ yaml_document_start_event_initialize(yaml_event_t *event,
 {
     struct {
         yaml_error_type_t error;
-    } context;
+        const yaml_allocator_t *allocator;
+    } context = { YAML_NO_ERROR, NULL };
     yaml_mark_t mark = { 0, 0, 0 };
     yaml_version_directive_t *version_directive_copy = NULL;
     struct {
@@ -766,7 +1810,7 @@ error:
         yaml_free(value.handle);
         yaml_free(value.prefix);
     }
-    STACK_DEL(context, tag_directives_copy);
+    STACK_DEL(&context, tag_directives_copy);
     yaml_free(value.handle);
     yaml_free(value.prefix);
 
@@ -991,34 +2035,35 @@ yaml_event_delete(yaml_event_t *event)
     switch (event->type)
     {
         case YAML_DOCUMENT_START_EVENT:
-            yaml_free(event->data.document_start.version_directive);
+            yaml_free_with(event->allocator, event->data.document_start.version_directive);
             for (tag_directive = event->data.document_start.tag_directives.start;
                     tag_directive != event->data.document_start.tag_directives.end;
                     tag_directive++) {
-                yaml_free(tag_directive->handle);
-                yaml_free(tag_directive->prefix);
+                yaml_free_with(event->allocator, tag_directive->handle);
+                yaml_free_with(event->allocator, tag_directive->prefix);
             }
-            yaml_free(event->data.document_start.tag_directives.start);
+            yaml_free_with(event->allocator, event->data.document_start.tag_directives.start);
             break;
 
         case YAML_ALIAS_EVENT:
-            yaml_free(event->data.alias.anchor);
+            yaml_free_with(event->allocator, event->data.alias.anchor);
             break;
 
         case YAML_SCALAR_EVENT:
-            yaml_free(event->data.scalar.anchor);
-            yaml_free(event->data.scalar.tag);
-            yaml_free(event->data.scalar.value);
+            yaml_free_with(event->allocator, event->data.scalar.anchor);
+            yaml_free_with(event->allocator, event->data.scalar.tag);
+            if (!event->borrowed)
+                yaml_free_with(event->allocator, event->data.scalar.value);
             break;
 
         case YAML_SEQUENCE_START_EVENT:
-            yaml_free(event->data.sequence_start.anchor);
-            yaml_free(event->data.sequence_start.tag);
+            yaml_free_with(event->allocator, event->data.sequence_start.anchor);
+            yaml_free_with(event->allocator, event->data.sequence_start.tag);
             break;
 
         case YAML_MAPPING_START_EVENT:
-            yaml_free(event->data.mapping_start.anchor);
-            yaml_free(event->data.mapping_start.tag);
+            yaml_free_with(event->allocator, event->data.mapping_start.anchor);
+            yaml_free_with(event->allocator, event->data.mapping_start.tag);
             break;
 
         default:
@@ -1041,7 +2086,8 @@ yaml_document_initialize(yaml_document_t *document,
 {
     struct {
         yaml_error_type_t error;
-    } context;
+        const yaml_allocator_t *allocator;
+    } context = { YAML_NO_ERROR, NULL };
     struct {
         yaml_node_t *start;
         yaml_node_t *end;
@@ -1126,33 +2172,40 @@ yaml_document_delete(yaml_document_t *document)
 
     assert(document);   /* Non-NULL document object is expected. */
 
-    while (!STACK_EMPTY(&context, document->nodes)) {
-        yaml_node_t node = POP(&context, document->nodes);
-        yaml_free(node.tag);
-        switch (node.type) {
-            case YAML_SCALAR_NODE:
-                yaml_free(node.data.scalar.value);
-                break;
-            case YAML_SEQUENCE_NODE:
-                STACK_DEL(&context, node.data.sequence.items);
-                break;
-            case YAML_MAPPING_NODE:
-                STACK_DEL(&context, node.data.mapping.pairs);
-                break;
-            default:
-                assert(0);  /* Should not happen. */
+    /* The node data of an arena-backed document goes with the arena. */
+
+    if (document->arena) {
+        yaml_arena_delete(document->allocator, document->arena);
+    }
+    else {
+        while (!STACK_EMPTY(&context, document->nodes)) {
+            yaml_node_t node = POP(&context, document->nodes);
+            yaml_free_with(document->allocator, node.tag);
+            switch (node.type) {
+                case YAML_SCALAR_NODE:
+                    yaml_free_with(document->allocator, node.data.scalar.value);
+                    break;
+                case YAML_SEQUENCE_NODE:
+                    STACK_DEL(document, node.data.sequence.items);
+                    break;
+                case YAML_MAPPING_NODE:
+                    STACK_DEL(document, node.data.mapping.pairs);
+                    break;
+                default:
+                    assert(0);  /* Should not happen. */
+            }
         }
     }
-    STACK_DEL(&context, document->nodes);
+    STACK_DEL(document, document->nodes);
 
-    yaml_free(document->version_directive);
+    yaml_free_with(document->allocator, document->version_directive);
     for (tag_directive = document->tag_directives.start;
             tag_directive != document->tag_directives.end;
             tag_directive++) {
-        yaml_free(tag_directive->handle);
-        yaml_free(tag_directive->prefix);
+        yaml_free_with(document->allocator, tag_directive->handle);
+        yaml_free_with(document->allocator, tag_directive->prefix);
     }
-    yaml_free(document->tag_directives.start);
+    yaml_free_with(document->allocator, document->tag_directives.start);
 
     memset(document, 0, sizeof(yaml_document_t));
 }
@@ -1198,6 +2251,7 @@ yaml_document_add_scalar(yaml_document_t *document,
 {
     struct {
         yaml_error_type_t error;
+        const yaml_allocator_t *allocator;
     } context;
     yaml_mark_t mark = { 0, 0, 0 };
     yaml_char_t *tag_copy = NULL;
@@ -1207,12 +2261,15 @@ yaml_document_add_scalar(yaml_document_t *document,
     assert(document);   /* Non-NULL document object is expected. */
     assert(value);      /* Non-NULL value is expected. */
 
+    context.allocator = document->allocator;
+
     if (!tag) {
         tag = (yaml_char_t *)YAML_DEFAULT_SCALAR_TAG;
     }
 
     if (!yaml_check_utf8(tag, strlen((char *)tag))) goto error;
-    tag_copy = yaml_strdup(tag);
+    tag_copy = yaml_arena_strndup(document->allocator, &document->arena,
+            tag, strlen((char *)tag));
     if (!tag_copy) goto error;
 
     if (length < 0) {
@@ -1220,10 +2277,9 @@ yaml_document_add_scalar(yaml_document_t *document,
     }
 
     if (!yaml_check_utf8(value, length)) goto error;
-    value_copy = YAML_MALLOC(length+1);
+    value_copy = yaml_arena_strndup(document->allocator, &document->arena,
+            value, length);
     if (!value_copy) goto error;
-    memcpy(value_copy, value, length);
-    value_copy[length] = '\0';
 
     SCALAR_NODE_INIT(node, tag_copy, value_copy, length, style, mark, mark);
     if (!PUSH(&context, document->nodes, node)) goto error;
@@ -1231,8 +2287,8 @@ yaml_document_add_scalar(yaml_document_t *document,
     return document->nodes.top - document->nodes.start;
 
 error:
-    yaml_free(tag_copy);
-    yaml_free(value_copy);
+    yaml_arena_free(document->allocator, document->arena, tag_copy);
+    yaml_arena_free(document->allocator, document->arena, value_copy);
 
     return 0;
 }
@@ -1247,6 +2303,7 @@ yaml_document_add_sequence(yaml_document_t *document,
 {
     struct {
         yaml_error_type_t error;
+        const yaml_allocator_t *allocator;
     } context;
     yaml_mark_t mark = { 0, 0, 0 };
     yaml_char_t *tag_copy = NULL;
@@ -1259,15 +2316,19 @@ yaml_document_add_sequence(yaml_document_t *document,
 
     assert(document);   /* Non-NULL document object is expected. */
 
+    context.allocator = document->allocator;
+
     if (!tag) {
         tag = (yaml_char_t *)YAML_DEFAULT_SEQUENCE_TAG;
     }
 
     if (!yaml_check_utf8(tag, strlen((char *)tag))) goto error;
-    tag_copy = yaml_strdup(tag);
+    tag_copy = yaml_arena_strndup(document->allocator, &document->arena,
+            tag, strlen((char *)tag));
     if (!tag_copy) goto error;
 
-    if (!STACK_INIT(&context, items, yaml_node_item_t*)) goto error;
+    if (!ARENA_STACK_INIT(&context, document->arena, items, yaml_node_item_t*))
+        goto error;
 
     SEQUENCE_NODE_INIT(node, tag_copy, items.start, items.end,
             style, mark, mark);
@@ -1276,8 +2337,8 @@ yaml_document_add_sequence(yaml_document_t *document,
     return document->nodes.top - document->nodes.start;
 
 error:
-    STACK_DEL(&context, items);
-    yaml_free(tag_copy);
+    ARENA_STACK_DEL(document, document->arena, items);
+    yaml_arena_free(document->allocator, document->arena, tag_copy);
 
     return 0;
 }
@@ -1292,6 +2353,7 @@ yaml_document_add_mapping(yaml_document_t *document,
 {
     struct {
         yaml_error_type_t error;
+        const yaml_allocator_t *allocator;
     } context;
     yaml_mark_t mark = { 0, 0, 0 };
     yaml_char_t *tag_copy = NULL;
@@ -1304,15 +2366,19 @@ yaml_document_add_mapping(yaml_document_t *document,
 
     assert(document);   /* Non-NULL document object is expected. */
 
+    context.allocator = document->allocator;
+
     if (!tag) {
         tag = (yaml_char_t *)YAML_DEFAULT_MAPPING_TAG;
     }
 
     if (!yaml_check_utf8(tag, strlen((char *)tag))) goto error;
-    tag_copy = yaml_strdup(tag);
+    tag_copy = yaml_arena_strndup(document->allocator, &document->arena,
+            tag, strlen((char *)tag));
     if (!tag_copy) goto error;
 
-    if (!STACK_INIT(&context, pairs, yaml_node_pair_t*)) goto error;
+    if (!ARENA_STACK_INIT(&context, document->arena, pairs, yaml_node_pair_t*))
+        goto error;
 
     MAPPING_NODE_INIT(node, tag_copy, pairs.start, pairs.end,
             style, mark, mark);
@@ -1321,8 +2387,8 @@ yaml_document_add_mapping(yaml_document_t *document,
     return document->nodes.top - document->nodes.start;
 
 error:
-    STACK_DEL(&context, pairs);
-    yaml_free(tag_copy);
+    ARENA_STACK_DEL(document, document->arena, pairs);
+    yaml_arena_free(document->allocator, document->arena, tag_copy);
 
     return 0;
 }
@@ -1337,6 +2403,7 @@ yaml_document_append_sequence_item(yaml_document_t *document,
 {
     struct {
         yaml_error_type_t error;
+        const yaml_allocator_t *allocator;
     } context;
 
     assert(document);       /* Non-NULL document is required. */
@@ -1348,7 +2415,9 @@ yaml_document_append_sequence_item(yaml_document_t *document,
     assert(item > 0 && document->nodes.start + item <= document->nodes.top);
                             /* Valid item id is required. */
 
-    if (!PUSH(&context,
+    context.allocator = document->allocator;
+
+    if (!ARENA_PUSH(&context, document->arena,
                 document->nodes.start[sequence-1].data.sequence.items, item))
         return 0;
 
@@ -1365,6 +2434,7 @@ yaml_document_append_mapping_pair(yaml_document_t *document,
 {
     struct {
         yaml_error_type_t error;
+        const yaml_allocator_t *allocator;
     } context;
 
     yaml_node_pair_t pair;
@@ -1380,10 +2450,12 @@ yaml_document_append_mapping_pair(yaml_document_t *document,
     assert(value > 0 && document->nodes.start + value <= document->nodes.top);
                             /* Valid value id is required. */
 
+    context.allocator = document->allocator;
+
     pair.key = key;
     pair.value = value;
 
-    if (!PUSH(&context,
+    if (!ARENA_PUSH(&context, document->arena,
                 document->nodes.start[mapping-1].data.mapping.pairs, pair))
         return 0;
 
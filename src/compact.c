@@ -0,0 +1,607 @@
+
+#include "yaml_private.h"
+
+/*
+ * API functions.
+ */
+
+YAML_DECLARE(int)
+yaml_document_compact(yaml_document_t *document,
+        yaml_compact_document_t *compact, int marks);
+
+YAML_DECLARE(int)
+yaml_compact_document_expand(yaml_compact_document_t *compact,
+        yaml_document_t *document);
+
+YAML_DECLARE(void)
+yaml_compact_document_delete(yaml_compact_document_t *compact);
+
+YAML_DECLARE(int)
+yaml_compact_document_get_root(yaml_compact_document_t *compact);
+
+YAML_DECLARE(yaml_node_type_t)
+yaml_compact_node_type(yaml_compact_document_t *compact, int node);
+
+YAML_DECLARE(int)
+yaml_compact_node_style(yaml_compact_document_t *compact, int node);
+
+YAML_DECLARE(const yaml_char_t *)
+yaml_compact_node_tag(yaml_compact_document_t *compact, int node);
+
+YAML_DECLARE(const yaml_char_t *)
+yaml_compact_node_value(yaml_compact_document_t *compact, int node,
+        size_t *length);
+
+YAML_DECLARE(int)
+yaml_compact_node_size(yaml_compact_document_t *compact, int node);
+
+YAML_DECLARE(int)
+yaml_compact_node_item(yaml_compact_document_t *compact, int node, int index);
+
+YAML_DECLARE(int)
+yaml_compact_node_marks(yaml_compact_document_t *compact, int node,
+        yaml_mark_t *start_mark, yaml_mark_t *end_mark);
+
+/*
+ * Node lookup.
+ */
+
+static yaml_compact_node_t *
+yaml_compact_document_node(yaml_compact_document_t *compact, int node);
+
+/*
+ * The packing of the node information: the type in the lowest 2 bits, the
+ * style in the next 3 bits, and the tag number in the rest.
+ */
+
+#define COMPACT_TYPE_BITS   2
+
+#define COMPACT_STYLE_BITS  3
+
+#define COMPACT_TAG_SHIFT   (COMPACT_TYPE_BITS + COMPACT_STYLE_BITS)
+
+#define COMPACT_MAX_TAGS    (UINT_MAX >> COMPACT_TAG_SHIFT)
+
+#define COMPACT_INFO(type,style,tag)                                            \
+    ((unsigned int)(type)                                                       \
+     | ((unsigned int)(style) << COMPACT_TYPE_BITS)                             \
+     | ((unsigned int)(tag) << COMPACT_TAG_SHIFT))
+
+#define COMPACT_TYPE(info)                                                      \
+    ((yaml_node_type_t)((info) & ((1U << COMPACT_TYPE_BITS) - 1)))
+
+#define COMPACT_STYLE(info)                                                     \
+    ((int)(((info) >> COMPACT_TYPE_BITS) & ((1U << COMPACT_STYLE_BITS) - 1)))
+
+#define COMPACT_TAG(info)                                                       \
+    ((info) >> COMPACT_TAG_SHIFT)
+
+/*
+ * Make a compact copy of a document.
+ *
+ * The first pass numbers the distinct tags and measures the items and the
+ * strings, so that every array is allocated once.  The second pass copies
+ * the data.
+ */
+
+YAML_DECLARE(int)
+yaml_document_compact(yaml_document_t *document,
+        yaml_compact_document_t *compact, int marks)
+{
+    const yaml_allocator_t *allocator;
+    size_t count, items = 0, strings = 0, tags = 0, buckets;
+    unsigned int *table = NULL;
+    size_t *first = NULL;
+    yaml_node_t *node;
+    yaml_compact_node_t *compact_node;
+    unsigned int *item;
+    yaml_char_t *string;
+    yaml_tag_directive_t *tag_directive;
+    size_t k;
+
+    assert(document);   /* Non-NULL document object is expected. */
+    assert(compact);    /* Non-NULL compact document object is expected. */
+
+    memset(compact, 0, sizeof(yaml_compact_document_t));
+    allocator = compact->allocator = document->allocator;
+    count = document->nodes.top - document->nodes.start;
+
+    /*
+     * The tags are numbered with an open addressing hash table that holds the
+     * tag numbers plus one.  It is sized for a distinct tag per node.
+     */
+
+    for (buckets = 16; buckets < 2*count; buckets *= 2) {
+    }
+
+    table = (unsigned int *)yaml_malloc_with(allocator,
+            buckets * sizeof(unsigned int));
+    first = (size_t *)yaml_malloc_with(allocator,
+            (count ? count : 1) * sizeof(size_t));
+    compact->nodes.start = (yaml_compact_node_t *)yaml_malloc_with(allocator,
+            (count ? count : 1) * sizeof(yaml_compact_node_t));
+    if (!table || !first || !compact->nodes.start)
+        goto error;
+    memset(table, 0, buckets * sizeof(unsigned int));
+    compact->nodes.end = compact->nodes.start + count;
+
+    /* Number the tags and measure the items and the strings. */
+
+    for (node = document->nodes.start, compact_node = compact->nodes.start;
+            node != document->nodes.top; node ++, compact_node ++)
+    {
+        size_t hash = 5381;
+        size_t length;
+        int style = 0;
+
+        for (length = 0; node->tag[length]; length ++) {
+            hash = hash * 33 + node->tag[length];
+        }
+
+        for (k = hash & (buckets - 1); table[k];  k = (k + 1) & (buckets - 1)) {
+            if (strcmp((char *)node->tag,
+                        (char *)document->nodes.start[first[table[k]-1]].tag)
+                    == 0)
+                break;
+        }
+
+        if (!table[k]) {
+            if (tags == COMPACT_MAX_TAGS)
+                goto error;
+            first[tags] = node - document->nodes.start;
+            table[k] = (unsigned int)++ tags;
+            strings += length + 1;
+        }
+
+        switch (node->type) {
+            case YAML_SCALAR_NODE:
+                if (node->data.scalar.length >= UINT_MAX)
+                    goto error;
+                strings += node->data.scalar.length + 1;
+                style = node->data.scalar.style;
+                break;
+            case YAML_SEQUENCE_NODE:
+                items += node->data.sequence.items.top
+                    - node->data.sequence.items.start;
+                style = node->data.sequence.style;
+                break;
+            case YAML_MAPPING_NODE:
+                items += 2 * (node->data.mapping.pairs.top
+                        - node->data.mapping.pairs.start);
+                style = node->data.mapping.style;
+                break;
+            default:
+                assert(0);      /* Should not happen. */
+        }
+
+        if (items > UINT_MAX || strings > UINT_MAX)
+            goto error;
+
+        compact_node->info = COMPACT_INFO(node->type, style, table[k]-1);
+    }
+
+    compact->items.start = (unsigned int *)yaml_malloc_with(allocator,
+            (items ? items : 1) * sizeof(unsigned int));
+    compact->strings.start = YAML_MALLOC_WITH(allocator, strings ? strings : 1);
+    compact->tags.start = (unsigned int *)yaml_malloc_with(allocator,
+            (tags ? tags : 1) * sizeof(unsigned int));
+    if (!compact->items.start || !compact->strings.start
+            || !compact->tags.start)
+        goto error;
+    compact->items.end = compact->items.start + items;
+    compact->strings.end = compact->strings.start + strings;
+    compact->tags.end = compact->tags.start + tags;
+
+    if (marks) {
+        compact->marks = (unsigned int *)yaml_malloc_with(allocator,
+                (count ? 2*count : 1) * sizeof(unsigned int));
+        if (!compact->marks)
+            goto error;
+    }
+
+    /* Copy the tags. */
+
+    string = compact->strings.start;
+
+    for (k = 0; k < tags; k ++) {
+        const yaml_char_t *tag = document->nodes.start[first[k]].tag;
+        size_t length = strlen((char *)tag);
+
+        compact->tags.start[k] = (unsigned int)(string - compact->strings.start);
+        memcpy(string, tag, length + 1);
+        string += length + 1;
+    }
+
+    /* Copy the values, the items and the marks. */
+
+    item = compact->items.start;
+
+    for (node = document->nodes.start, compact_node = compact->nodes.start;
+            node != document->nodes.top; node ++, compact_node ++)
+    {
+        switch (node->type) {
+            case YAML_SCALAR_NODE:
+                compact_node->data =
+                    (unsigned int)(string - compact->strings.start);
+                compact_node->length = (unsigned int)node->data.scalar.length;
+                memcpy(string, node->data.scalar.value,
+                        node->data.scalar.length);
+                string += node->data.scalar.length;
+                *(string++) = '\0';
+                break;
+            case YAML_SEQUENCE_NODE:
+            {
+                yaml_node_item_t *id;
+
+                compact_node->data = (unsigned int)(item - compact->items.start);
+                compact_node->length = (unsigned int)
+                    (node->data.sequence.items.top
+                     - node->data.sequence.items.start);
+                for (id = node->data.sequence.items.start;
+                        id != node->data.sequence.items.top; id ++) {
+                    *(item++) = (unsigned int)*id;
+                }
+                break;
+            }
+            case YAML_MAPPING_NODE:
+            {
+                yaml_node_pair_t *pair;
+
+                compact_node->data = (unsigned int)(item - compact->items.start);
+                compact_node->length = (unsigned int)
+                    (node->data.mapping.pairs.top
+                     - node->data.mapping.pairs.start);
+                for (pair = node->data.mapping.pairs.start;
+                        pair != node->data.mapping.pairs.top; pair ++) {
+                    *(item++) = (unsigned int)pair->key;
+                    *(item++) = (unsigned int)pair->value;
+                }
+                break;
+            }
+            default:
+                assert(0);      /* Should not happen. */
+        }
+
+        if (compact->marks) {
+            if (node->start_mark.index > UINT_MAX
+                    || node->end_mark.index > UINT_MAX)
+                goto error;
+            k = 2 * (node - document->nodes.start);
+            compact->marks[k] = (unsigned int)node->start_mark.index;
+            compact->marks[k+1] = (unsigned int)node->end_mark.index;
+        }
+    }
+
+    /* Copy the directives. */
+
+    if (document->version_directive) {
+        compact->version_directive = YAML_MALLOC_STATIC_WITH(allocator,
+                yaml_version_directive_t);
+        if (!compact->version_directive)
+            goto error;
+        *compact->version_directive = *document->version_directive;
+    }
+
+    if (document->tag_directives.start != document->tag_directives.end) {
+        compact->tag_directives.start = (yaml_tag_directive_t *)
+            yaml_malloc_with(allocator, (document->tag_directives.end
+                        - document->tag_directives.start)
+                    * sizeof(yaml_tag_directive_t));
+        if (!compact->tag_directives.start)
+            goto error;
+        compact->tag_directives.end = compact->tag_directives.start;
+        for (tag_directive = document->tag_directives.start;
+                tag_directive != document->tag_directives.end;
+                tag_directive ++) {
+            yaml_tag_directive_t value;
+            value.handle = yaml_strdup_with(allocator, tag_directive->handle);
+            value.prefix = yaml_strdup_with(allocator, tag_directive->prefix);
+            if (!value.handle || !value.prefix) {
+                yaml_free_with(allocator, value.handle);
+                yaml_free_with(allocator, value.prefix);
+                goto error;
+            }
+            *(compact->tag_directives.end++) = value;
+        }
+    }
+
+    compact->start_implicit = document->start_implicit;
+    compact->end_implicit = document->end_implicit;
+    compact->start_mark = document->start_mark;
+    compact->end_mark = document->end_mark;
+
+    yaml_free_with(allocator, table);
+    yaml_free_with(allocator, first);
+
+    return 1;
+
+error:
+    yaml_free_with(allocator, table);
+    yaml_free_with(allocator, first);
+    yaml_compact_document_delete(compact);
+
+    return 0;
+}
+
+/*
+ * Make a classic copy of a compact document.
+ */
+
+YAML_DECLARE(int)
+yaml_compact_document_expand(yaml_compact_document_t *compact,
+        yaml_document_t *document)
+{
+    yaml_compact_node_t *node;
+    int id;
+
+    assert(compact);    /* Non-NULL compact document object is expected. */
+    assert(document);   /* Non-NULL document object is expected. */
+
+    if (!yaml_document_initialize(document, compact->version_directive,
+                compact->tag_directives.start, compact->tag_directives.end,
+                compact->start_implicit, compact->end_implicit))
+        return 0;
+
+    document->start_mark = compact->start_mark;
+    document->end_mark = compact->end_mark;
+
+    /* Add the nodes in order, so that they keep their ids. */
+
+    for (node = compact->nodes.start; node != compact->nodes.end; node ++)
+    {
+        const yaml_char_t *tag = compact->strings.start
+            + compact->tags.start[COMPACT_TAG(node->info)];
+        int style = COMPACT_STYLE(node->info);
+
+        switch (COMPACT_TYPE(node->info)) {
+            case YAML_SCALAR_NODE:
+                if (node->length > INT_MAX)
+                    goto error;
+                id = yaml_document_add_scalar(document, tag,
+                        compact->strings.start + node->data,
+                        (int)node->length, (yaml_scalar_style_t)style);
+                break;
+            case YAML_SEQUENCE_NODE:
+                id = yaml_document_add_sequence(document, tag,
+                        (yaml_sequence_style_t)style);
+                break;
+            case YAML_MAPPING_NODE:
+                id = yaml_document_add_mapping(document, tag,
+                        (yaml_mapping_style_t)style);
+                break;
+            default:
+                id = 0;
+        }
+        if (!id)
+            goto error;
+
+        if (compact->marks) {
+            yaml_node_t *added = document->nodes.start + id - 1;
+            added->start_mark.index = compact->marks[2*(id-1)];
+            added->end_mark.index = compact->marks[2*(id-1)+1];
+        }
+    }
+
+    /* Link the collections once all nodes exist. */
+
+    for (node = compact->nodes.start, id = 1; node != compact->nodes.end;
+            node ++, id ++)
+    {
+        const unsigned int *item = compact->items.start + node->data;
+        unsigned int k;
+
+        switch (COMPACT_TYPE(node->info)) {
+            case YAML_SEQUENCE_NODE:
+                for (k = 0; k < node->length; k ++) {
+                    if (!yaml_document_append_sequence_item(document, id,
+                                (int)item[k]))
+                        goto error;
+                }
+                break;
+            case YAML_MAPPING_NODE:
+                for (k = 0; k < node->length; k ++) {
+                    if (!yaml_document_append_mapping_pair(document, id,
+                                (int)item[2*k], (int)item[2*k+1]))
+                        goto error;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    return 1;
+
+error:
+    yaml_document_delete(document);
+
+    return 0;
+}
+
+/*
+ * Destroy a compact document object.
+ */
+
+YAML_DECLARE(void)
+yaml_compact_document_delete(yaml_compact_document_t *compact)
+{
+    yaml_tag_directive_t *tag_directive;
+
+    assert(compact);    /* Non-NULL compact document object is expected. */
+
+    yaml_free_with(compact->allocator, compact->nodes.start);
+    yaml_free_with(compact->allocator, compact->items.start);
+    yaml_free_with(compact->allocator, compact->strings.start);
+    yaml_free_with(compact->allocator, compact->tags.start);
+    yaml_free_with(compact->allocator, compact->marks);
+
+    yaml_free_with(compact->allocator, compact->version_directive);
+    for (tag_directive = compact->tag_directives.start;
+            tag_directive != compact->tag_directives.end;
+            tag_directive++) {
+        yaml_free_with(compact->allocator, tag_directive->handle);
+        yaml_free_with(compact->allocator, tag_directive->prefix);
+    }
+    yaml_free_with(compact->allocator, compact->tag_directives.start);
+
+    memset(compact, 0, sizeof(yaml_compact_document_t));
+}
+
+/*
+ * Get a node of a compact document or NULL if the id is out of range.
+ */
+
+static yaml_compact_node_t *
+yaml_compact_document_node(yaml_compact_document_t *compact, int node)
+{
+    assert(compact);    /* Non-NULL compact document object is expected. */
+
+    if (node > 0 && compact->nodes.start + node <= compact->nodes.end) {
+        return compact->nodes.start + node - 1;
+    }
+    return NULL;
+}
+
+/*
+ * Get the root node.
+ */
+
+YAML_DECLARE(int)
+yaml_compact_document_get_root(yaml_compact_document_t *compact)
+{
+    assert(compact);    /* Non-NULL compact document object is expected. */
+
+    return compact->nodes.start != compact->nodes.end;
+}
+
+/*
+ * Get the type of a node.
+ */
+
+YAML_DECLARE(yaml_node_type_t)
+yaml_compact_node_type(yaml_compact_document_t *compact, int node)
+{
+    yaml_compact_node_t *compact_node = yaml_compact_document_node(compact, node);
+
+    return compact_node ? COMPACT_TYPE(compact_node->info) : YAML_NO_NODE;
+}
+
+/*
+ * Get the style of a node.
+ */
+
+YAML_DECLARE(int)
+yaml_compact_node_style(yaml_compact_document_t *compact, int node)
+{
+    yaml_compact_node_t *compact_node = yaml_compact_document_node(compact, node);
+
+    return compact_node ? COMPACT_STYLE(compact_node->info) : 0;
+}
+
+/*
+ * Get the tag of a node.
+ */
+
+YAML_DECLARE(const yaml_char_t *)
+yaml_compact_node_tag(yaml_compact_document_t *compact, int node)
+{
+    yaml_compact_node_t *compact_node = yaml_compact_document_node(compact, node);
+
+    if (!compact_node)
+        return NULL;
+
+    return compact->strings.start
+        + compact->tags.start[COMPACT_TAG(compact_node->info)];
+}
+
+/*
+ * Get the value of a scalar node.
+ */
+
+YAML_DECLARE(const yaml_char_t *)
+yaml_compact_node_value(yaml_compact_document_t *compact, int node,
+        size_t *length)
+{
+    yaml_compact_node_t *compact_node = yaml_compact_document_node(compact, node);
+
+    assert(length);     /* Non-NULL length is expected. */
+
+    if (!compact_node || COMPACT_TYPE(compact_node->info) != YAML_SCALAR_NODE)
+        return NULL;
+
+    *length = compact_node->length;
+
+    return compact->strings.start + compact_node->data;
+}
+
+/*
+ * Get the number of items or pairs of a collection node.
+ */
+
+YAML_DECLARE(int)
+yaml_compact_node_size(yaml_compact_document_t *compact, int node)
+{
+    yaml_compact_node_t *compact_node = yaml_compact_document_node(compact, node);
+
+    if (!compact_node || COMPACT_TYPE(compact_node->info) == YAML_SCALAR_NODE)
+        return 0;
+
+    return (int)compact_node->length;
+}
+
+/*
+ * Get an item of a sequence, or a key or a value of a mapping.
+ */
+
+YAML_DECLARE(int)
+yaml_compact_node_item(yaml_compact_document_t *compact, int node, int index)
+{
+    yaml_compact_node_t *compact_node = yaml_compact_document_node(compact, node);
+    unsigned int size;
+
+    if (!compact_node || index < 0)
+        return 0;
+
+    switch (COMPACT_TYPE(compact_node->info)) {
+        case YAML_SEQUENCE_NODE:
+            size = compact_node->length;
+            break;
+        case YAML_MAPPING_NODE:
+            size = 2 * compact_node->length;
+            break;
+        default:
+            return 0;
+    }
+
+    if ((unsigned int)index >= size)
+        return 0;
+
+    return (int)compact->items.start[compact_node->data + index];
+}
+
+/*
+ * Get the marks of a node.
+ */
+
+YAML_DECLARE(int)
+yaml_compact_node_marks(yaml_compact_document_t *compact, int node,
+        yaml_mark_t *start_mark, yaml_mark_t *end_mark)
+{
+    yaml_compact_node_t *compact_node = yaml_compact_document_node(compact, node);
+    size_t k;
+
+    assert(start_mark); /* Non-NULL start mark is expected. */
+    assert(end_mark);   /* Non-NULL end mark is expected. */
+
+    if (!compact_node || !compact->marks)
+        return 0;
+
+    k = 2 * (compact_node - compact->nodes.start);
+    memset(start_mark, 0, sizeof(yaml_mark_t));
+    memset(end_mark, 0, sizeof(yaml_mark_t));
+    start_mark->index = compact->marks[k];
+    end_mark->index = compact->marks[k+1];
+
+    return 1;
+}
+
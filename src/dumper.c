@@ -14,6 +14,24 @@ yaml_emitter_close(yaml_emitter_t *emitter);
 YAML_DECLARE(int)
 yaml_emitter_dump(yaml_emitter_t *emitter, yaml_document_t *document);
 
+/*
+ * Document dumping context.
+ *
+ * Both passes walk the node graph with an explicit stack of the open
+ * collections, so the depth of a document does not consume the C stack.
+ */
+
+struct dumper_level {
+    int index;
+    size_t child;
+};
+
+struct dumper_ctx {
+    struct dumper_level *start;
+    struct dumper_level *end;
+    struct dumper_level *top;
+};
+
 /*
  * Clean up functions.
  */
@@ -25,19 +43,32 @@ yaml_emitter_delete_document_and_anchors(yaml_emitter_t *emitter);
  * Anchor functions.
  */
 
-static void
-yaml_emitter_anchor_node(yaml_emitter_t *emitter, int index);
+static int
+yaml_emitter_anchor_nodes(yaml_emitter_t *emitter, struct dumper_ctx *ctx);
+
+static int
+yaml_emitter_anchor_node(yaml_emitter_t *emitter, struct dumper_ctx *ctx,
+        int index);
+
+static int
+yaml_emitter_next_child(yaml_emitter_t *emitter, struct dumper_level *level);
 
 static yaml_char_t *
 yaml_emitter_generate_anchor(yaml_emitter_t *emitter, int anchor_id);
 
+static yaml_char_t *
+yaml_emitter_node_tag(yaml_emitter_t *emitter, yaml_node_t *node);
 
 /*
  * Serialize functions.
  */
 
 static int
-yaml_emitter_dump_node(yaml_emitter_t *emitter, int index);
+yaml_emitter_dump_nodes(yaml_emitter_t *emitter, struct dumper_ctx *ctx);
+
+static int
+yaml_emitter_dump_node(yaml_emitter_t *emitter, struct dumper_ctx *ctx,
+        int index);
 
 static int
 yaml_emitter_dump_alias(yaml_emitter_t *emitter, yaml_char_t *anchor);
@@ -47,12 +78,12 @@ yaml_emitter_dump_scalar(yaml_emitter_t *emitter, yaml_node_t *node,
         yaml_char_t *anchor);
 
 static int
-yaml_emitter_dump_sequence(yaml_emitter_t *emitter, yaml_node_t *node,
-        yaml_char_t *anchor);
+yaml_emitter_dump_sequence(yaml_emitter_t *emitter, struct dumper_ctx *ctx,
+        int index, yaml_char_t *anchor);
 
 static int
-yaml_emitter_dump_mapping(yaml_emitter_t *emitter, yaml_node_t *node,
-        yaml_char_t *anchor);
+yaml_emitter_dump_mapping(yaml_emitter_t *emitter, struct dumper_ctx *ctx,
+        int index, yaml_char_t *anchor);
 
 /*
  * Issue a STREAM-START event.
@@ -111,6 +142,7 @@ yaml_emitter_close(yaml_emitter_t *emitter)
 YAML_DECLARE(int)
 yaml_emitter_dump(yaml_emitter_t *emitter, yaml_document_t *document)
 {
+    struct dumper_ctx ctx = { NULL, NULL, NULL };
     yaml_event_t event;
     yaml_mark_t mark = { 0, 0, 0 };
 
@@ -131,19 +163,26 @@ yaml_emitter_dump(yaml_emitter_t *emitter, yaml_document_t *document)
 
     assert(emitter->opened);    /* Emitter should be opened. */
 
-    emitter->anchors = (yaml_anchors_t*)yaml_malloc(sizeof(*(emitter->anchors))
+    emitter->anchors = (yaml_anchors_t*)yaml_malloc_with(emitter->allocator,
+            sizeof(*(emitter->anchors))
             * (document->nodes.top - document->nodes.start));
-    if (!emitter->anchors) goto error;
+    if (!emitter->anchors) {
+        emitter->error = YAML_MEMORY_ERROR;
+        goto error;
+    }
     memset(emitter->anchors, 0, sizeof(*(emitter->anchors))
             * (document->nodes.top - document->nodes.start));
 
     DOCUMENT_START_EVENT_INIT(event, document->version_directive,
             document->tag_directives.start, document->tag_directives.end,
             document->start_implicit, mark, mark);
+    event.allocator = document->allocator;
     if (!yaml_emitter_emit(emitter, &event)) goto error;
 
-    yaml_emitter_anchor_node(emitter, 1);
-    if (!yaml_emitter_dump_node(emitter, 1)) goto error;
+    if (!STACK_INIT(emitter, ctx, struct dumper_level*)) goto error;
+    if (!yaml_emitter_anchor_nodes(emitter, &ctx)) goto error;
+    if (!yaml_emitter_dump_nodes(emitter, &ctx)) goto error;
+    STACK_DEL(emitter, ctx);
 
     DOCUMENT_END_EVENT_INIT(event, document->end_implicit, mark, mark);
     if (!yaml_emitter_emit(emitter, &event)) goto error;
@@ -154,6 +193,7 @@ yaml_emitter_dump(yaml_emitter_t *emitter, yaml_document_t *document)
 
 error:
 
+    STACK_DEL(emitter, ctx);
     yaml_emitter_delete_document_and_anchors(emitter);
 
     return 0;
@@ -174,25 +214,32 @@ yaml_emitter_delete_document_and_anchors(yaml_emitter_t *emitter)
         return;
     }
 
-    for (index = 0; emitter->document->nodes.start + index
-            < emitter->document->nodes.top; index ++) {
-        yaml_node_t node = emitter->document->nodes.start[index];
-        if (!emitter->anchors[index].serialized) {
-            yaml_free(node.tag);
-            if (node.type == YAML_SCALAR_NODE) {
-                yaml_free(node.data.scalar.value);
+    if (emitter->document->arena) {
+        yaml_arena_delete(emitter->document->allocator,
+                emitter->document->arena);
+    }
+    else {
+        for (index = 0; emitter->document->nodes.start + index
+                < emitter->document->nodes.top; index ++) {
+            yaml_node_t node = emitter->document->nodes.start[index];
+            if (!emitter->anchors[index].serialized) {
+                yaml_free_with(emitter->document->allocator, node.tag);
+                if (node.type == YAML_SCALAR_NODE) {
+                    yaml_free_with(emitter->document->allocator,
+                            node.data.scalar.value);
+                }
+            }
+            if (node.type == YAML_SEQUENCE_NODE) {
+                STACK_DEL(emitter->document, node.data.sequence.items);
+            }
+            if (node.type == YAML_MAPPING_NODE) {
+                STACK_DEL(emitter->document, node.data.mapping.pairs);
             }
-        }
-        if (node.type == YAML_SEQUENCE_NODE) {
-            STACK_DEL(emitter, node.data.sequence.items);
-        }
-        if (node.type == YAML_MAPPING_NODE) {
-            STACK_DEL(emitter, node.data.mapping.pairs);
         }
     }
 
-    STACK_DEL(emitter, emitter->document->nodes);
-    yaml_free(emitter->anchors);
+    STACK_DEL(emitter->document, emitter->document->nodes);
+    yaml_free_with(emitter->allocator, emitter->anchors);
 
     emitter->anchors = NULL;
     emitter->last_anchor_id = 0;
@@ -200,41 +247,87 @@ yaml_emitter_delete_document_and_anchors(yaml_emitter_t *emitter)
 }
 
 /*
- * Check the references of a node and assign the anchor id if needed.
+ * Check the references of all nodes reachable from the root node.
  */
 
-static void
-yaml_emitter_anchor_node(yaml_emitter_t *emitter, int index)
+static int
+yaml_emitter_anchor_nodes(yaml_emitter_t *emitter, struct dumper_ctx *ctx)
+{
+    int index;
+
+    if (!yaml_emitter_anchor_node(emitter, ctx, 1)) return 0;
+
+    while (!STACK_EMPTY(emitter, *ctx)) {
+        index = yaml_emitter_next_child(emitter, ctx->top - 1);
+        if (!index) {
+            (void)POP(emitter, *ctx);
+            continue;
+        }
+        if (!yaml_emitter_anchor_node(emitter, ctx, index)) return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Check the references of a node and assign the anchor id if needed.  The
+ * children of a collection are checked when it is visited for the first
+ * time.
+ */
+
+static int
+yaml_emitter_anchor_node(yaml_emitter_t *emitter, struct dumper_ctx *ctx,
+        int index)
 {
     yaml_node_t *node = emitter->document->nodes.start + index - 1;
-    yaml_node_item_t *item;
-    yaml_node_pair_t *pair;
+    struct dumper_level level;
 
     emitter->anchors[index-1].references ++;
 
     if (emitter->anchors[index-1].references == 1) {
-        switch (node->type) {
-            case YAML_SEQUENCE_NODE:
-                for (item = node->data.sequence.items.start;
-                        item < node->data.sequence.items.top; item ++) {
-                    yaml_emitter_anchor_node(emitter, *item);
-                }
-                break;
-            case YAML_MAPPING_NODE:
-                for (pair = node->data.mapping.pairs.start;
-                        pair < node->data.mapping.pairs.top; pair ++) {
-                    yaml_emitter_anchor_node(emitter, pair->key);
-                    yaml_emitter_anchor_node(emitter, pair->value);
-                }
-                break;
-            default:
-                break;
+        if (node->type == YAML_SEQUENCE_NODE
+                || node->type == YAML_MAPPING_NODE) {
+            if (emitter->max_depth
+                    && ctx->top - ctx->start >= emitter->max_depth) {
+                emitter->error = YAML_EMITTER_ERROR;
+                emitter->problem = "exceeded the maximum nesting depth";
+                return 0;
+            }
+            level.index = index;
+            level.child = 0;
+            if (!PUSH(emitter, *ctx, level)) return 0;
         }
     }
 
     else if (emitter->anchors[index-1].references == 2) {
         emitter->anchors[index-1].anchor = (++ emitter->last_anchor_id);
     }
+
+    return 1;
+}
+
+/*
+ * Get the next child of an open collection: the items of a sequence, or the
+ * keys and values of a mapping in turn.  Return 0 when there are no more.
+ */
+
+static int
+yaml_emitter_next_child(yaml_emitter_t *emitter, struct dumper_level *level)
+{
+    yaml_node_t *node = emitter->document->nodes.start + level->index - 1;
+    yaml_node_pair_t *pair;
+
+    if (node->type == YAML_SEQUENCE_NODE) {
+        if (node->data.sequence.items.start + level->child
+                >= node->data.sequence.items.top)
+            return 0;
+        return node->data.sequence.items.start[level->child ++];
+    }
+
+    pair = node->data.mapping.pairs.start + level->child / 2;
+    if (pair >= node->data.mapping.pairs.top)
+        return 0;
+    return (level->child ++ % 2) ? pair->value : pair->key;
 }
 
 /*
@@ -245,11 +338,15 @@ yaml_emitter_anchor_node(yaml_emitter_t *emitter, int index)
 #define ANCHOR_TEMPLATE_LENGTH  16
 
 static yaml_char_t *
-yaml_emitter_generate_anchor(SHIM(yaml_emitter_t *emitter), int anchor_id)
+yaml_emitter_generate_anchor(yaml_emitter_t *emitter, int anchor_id)
 {
-    yaml_char_t *anchor = YAML_MALLOC(ANCHOR_TEMPLATE_LENGTH);
+    yaml_char_t *anchor = YAML_MALLOC_WITH(emitter->document->allocator,
+            ANCHOR_TEMPLATE_LENGTH);
 
-    if (!anchor) return NULL;
+    if (!anchor) {
+        emitter->error = YAML_MEMORY_ERROR;
+        return NULL;
+    }
 
     sprintf((char *)anchor, ANCHOR_TEMPLATE, anchor_id);
 
@@ -257,11 +354,72 @@ yaml_emitter_generate_anchor(SHIM(yaml_emitter_t *emitter), int anchor_id)
 }
 
 /*
- * Serialize a node.
+ * Get the tag of a node for an event.
+ *
+ * The events take over the strings of the nodes, except for arena-backed
+ * documents whose strings stay in the arena.  Their tags are copied and their
+ * scalar values are borrowed.
+ */
+
+static yaml_char_t *
+yaml_emitter_node_tag(yaml_emitter_t *emitter, yaml_node_t *node)
+{
+    yaml_char_t *tag;
+
+    if (!emitter->document->arena)
+        return node->tag;
+
+    tag = yaml_strdup_with(emitter->document->allocator, node->tag);
+    if (!tag) {
+        emitter->error = YAML_MEMORY_ERROR;
+    }
+
+    return tag;
+}
+
+/*
+ * Serialize the node tree, closing each collection once all of its children
+ * are serialized.
  */
 
 static int
-yaml_emitter_dump_node(yaml_emitter_t *emitter, int index)
+yaml_emitter_dump_nodes(yaml_emitter_t *emitter, struct dumper_ctx *ctx)
+{
+    yaml_event_t event;
+    yaml_mark_t mark  = { 0, 0, 0 };
+    yaml_node_t *node;
+    int index;
+
+    if (!yaml_emitter_dump_node(emitter, ctx, 1)) return 0;
+
+    while (!STACK_EMPTY(emitter, *ctx)) {
+        index = yaml_emitter_next_child(emitter, ctx->top - 1);
+        if (index) {
+            if (!yaml_emitter_dump_node(emitter, ctx, index)) return 0;
+            continue;
+        }
+
+        node = emitter->document->nodes.start + POP(emitter, *ctx).index - 1;
+        if (node->type == YAML_SEQUENCE_NODE) {
+            SEQUENCE_END_EVENT_INIT(event, mark, mark);
+        }
+        else {
+            MAPPING_END_EVENT_INIT(event, mark, mark);
+        }
+        if (!yaml_emitter_emit(emitter, &event)) return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Serialize a node.  The children of a collection are serialized by the
+ * caller.
+ */
+
+static int
+yaml_emitter_dump_node(yaml_emitter_t *emitter, struct dumper_ctx *ctx,
+        int index)
 {
     yaml_node_t *node = emitter->document->nodes.start + index - 1;
     int anchor_id = emitter->anchors[index-1].anchor;
@@ -282,9 +440,9 @@ yaml_emitter_dump_node(yaml_emitter_t *emitter, int index)
         case YAML_SCALAR_NODE:
             return yaml_emitter_dump_scalar(emitter, node, anchor);
         case YAML_SEQUENCE_NODE:
-            return yaml_emitter_dump_sequence(emitter, node, anchor);
+            return yaml_emitter_dump_sequence(emitter, ctx, index, anchor);
         case YAML_MAPPING_NODE:
-            return yaml_emitter_dump_mapping(emitter, node, anchor);
+            return yaml_emitter_dump_mapping(emitter, ctx, index, anchor);
         default:
             assert(0);      /* Could not happen. */
             break;
@@ -304,6 +462,7 @@ yaml_emitter_dump_alias(yaml_emitter_t *emitter, yaml_char_t *anchor)
     yaml_mark_t mark  = { 0, 0, 0 };
 
     ALIAS_EVENT_INIT(event, anchor, mark, mark);
+    event.allocator = emitter->document->allocator;
 
     return yaml_emitter_emit(emitter, &event);
 }
@@ -324,71 +483,87 @@ yaml_emitter_dump_scalar(yaml_emitter_t *emitter, yaml_node_t *node,
     int quoted_implicit = (strcmp((char *)node->tag,
                 YAML_DEFAULT_SCALAR_TAG) == 0);
 
-    SCALAR_EVENT_INIT(event, anchor, node->tag, node->data.scalar.value,
+    yaml_char_t *tag = yaml_emitter_node_tag(emitter, node);
+
+    if (!tag) {
+        yaml_free_with(emitter->document->allocator, anchor);
+        return 0;
+    }
+
+    SCALAR_EVENT_INIT(event, anchor, tag, node->data.scalar.value,
             node->data.scalar.length, plain_implicit, quoted_implicit,
             node->data.scalar.style, mark, mark);
+    event.borrowed = (emitter->document->arena != NULL);
+    event.allocator = emitter->document->allocator;
 
     return yaml_emitter_emit(emitter, &event);
 }
 
 /*
- * Serialize a sequence.
+ * Start serializing a sequence.
  */
 
 static int
-yaml_emitter_dump_sequence(yaml_emitter_t *emitter, yaml_node_t *node,
-        yaml_char_t *anchor)
+yaml_emitter_dump_sequence(yaml_emitter_t *emitter, struct dumper_ctx *ctx,
+        int index, yaml_char_t *anchor)
 {
+    yaml_node_t *node = emitter->document->nodes.start + index - 1;
+    struct dumper_level level;
     yaml_event_t event;
     yaml_mark_t mark  = { 0, 0, 0 };
 
     int implicit = (strcmp((char *)node->tag, YAML_DEFAULT_SEQUENCE_TAG) == 0);
 
-    yaml_node_item_t *item;
+    yaml_char_t *tag = yaml_emitter_node_tag(emitter, node);
 
-    SEQUENCE_START_EVENT_INIT(event, anchor, node->tag, implicit,
-            node->data.sequence.style, mark, mark);
-    if (!yaml_emitter_emit(emitter, &event)) return 0;
-
-    for (item = node->data.sequence.items.start;
-            item < node->data.sequence.items.top; item ++) {
-        if (!yaml_emitter_dump_node(emitter, *item)) return 0;
+    if (!tag) {
+        yaml_free_with(emitter->document->allocator, anchor);
+        return 0;
     }
 
-    SEQUENCE_END_EVENT_INIT(event, mark, mark);
+    SEQUENCE_START_EVENT_INIT(event, anchor, tag, implicit,
+            node->data.sequence.style, mark, mark);
+    event.allocator = emitter->document->allocator;
     if (!yaml_emitter_emit(emitter, &event)) return 0;
 
+    level.index = index;
+    level.child = 0;
+    if (!PUSH(emitter, *ctx, level)) return 0;
+
     return 1;
 }
 
 /*
- * Serialize a mapping.
+ * Start serializing a mapping.
  */
 
 static int
-yaml_emitter_dump_mapping(yaml_emitter_t *emitter, yaml_node_t *node,
-        yaml_char_t *anchor)
+yaml_emitter_dump_mapping(yaml_emitter_t *emitter, struct dumper_ctx *ctx,
+        int index, yaml_char_t *anchor)
 {
+    yaml_node_t *node = emitter->document->nodes.start + index - 1;
+    struct dumper_level level;
     yaml_event_t event;
     yaml_mark_t mark  = { 0, 0, 0 };
 
     int implicit = (strcmp((char *)node->tag, YAML_DEFAULT_MAPPING_TAG) == 0);
 
-    yaml_node_pair_t *pair;
+    yaml_char_t *tag = yaml_emitter_node_tag(emitter, node);
 
-    MAPPING_START_EVENT_INIT(event, anchor, node->tag, implicit,
-            node->data.mapping.style, mark, mark);
-    if (!yaml_emitter_emit(emitter, &event)) return 0;
-
-    for (pair = node->data.mapping.pairs.start;
-            pair < node->data.mapping.pairs.top; pair ++) {
-        if (!yaml_emitter_dump_node(emitter, pair->key)) return 0;
-        if (!yaml_emitter_dump_node(emitter, pair->value)) return 0;
+    if (!tag) {
+        yaml_free_with(emitter->document->allocator, anchor);
+        return 0;
     }
 
-    MAPPING_END_EVENT_INIT(event, mark, mark);
+    MAPPING_START_EVENT_INIT(event, anchor, tag, implicit,
+            node->data.mapping.style, mark, mark);
+    event.allocator = emitter->document->allocator;
     if (!yaml_emitter_emit(emitter, &event)) return 0;
 
+    level.index = index;
+    level.child = 0;
+    if (!PUSH(emitter, *ctx, level)) return 0;
+
     return 1;
 }
 
@@ -7,7 +7,7 @@
 
 #define FLUSH(emitter)                                                          \
     ((emitter->buffer.pointer+5 < emitter->buffer.end)                          \
-     || yaml_emitter_flush(emitter))
+     || yaml_emitter_flush_buffer(emitter))
 
 /*
  * Put a character to the output buffer.
@@ -61,6 +61,231 @@
           emitter->line ++,                                                     \
           1)))
 
+/*
+ * Bulk analysis and writing kernels.
+ *
+ * An inner run is made of the characters in [#x21-#x7E] except ',', '?', ':',
+ * '#', '[', ']', '{' and '}'.  Past the first character of a scalar, they
+ * change none of the analysis flags.  A text run is made of the characters in
+ * [#x21-#x7E] except '\'', '"' and '\\', which every scalar writer copies
+ * unchanged.
+ */
+
+#define IS_INNER_RUN_OCTET(octet)                                               \
+    ((octet) > 0x20 && (octet) < 0x7F && (octet) != ',' && (octet) != '?'      \
+     && (octet) != ':' && (octet) != '#'                                        \
+     && ((octet) | 0x20) != '{' && ((octet) | 0x20) != '}')
+
+#define IS_TEXT_RUN_OCTET(octet)                                                \
+    ((octet) > 0x20 && (octet) < 0x7F && (octet) != '\''                       \
+     && (octet) != '"' && (octet) != '\\')
+
+static size_t
+yaml_emitter_inner_span_scalar(const yaml_char_t *start, const yaml_char_t *end)
+{
+    const yaml_char_t *pointer = start;
+
+    while (pointer != end && IS_INNER_RUN_OCTET(*pointer))
+        pointer ++;
+
+    return pointer - start;
+}
+
+static size_t
+yaml_emitter_text_span_scalar(const yaml_char_t *start, const yaml_char_t *end)
+{
+    const yaml_char_t *pointer = start;
+
+    while (pointer != end && IS_TEXT_RUN_OCTET(*pointer))
+        pointer ++;
+
+    return pointer - start;
+}
+
+#if defined(YAML_HAVE_SSE2)
+
+/*
+ * SSE2 versions: classify 16 octets at a time.  Octets above #x7F are
+ * negative as signed chars, and '|' #x20 maps '[' and ']' to '{' and '}'
+ * while leaving the other stop characters of an inner run in place.
+ */
+
+static size_t
+yaml_emitter_inner_span_sse2(const yaml_char_t *start, const yaml_char_t *end)
+{
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i question = _mm_set1_epi8('?');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i hash = _mm_set1_epi8('#');
+    const __m128i left = _mm_set1_epi8('{');
+    const __m128i right = _mm_set1_epi8('}');
+    const yaml_char_t *pointer = start;
+
+    while (end - pointer >= 16) {
+        __m128i octets = _mm_loadu_si128((const __m128i *)pointer);
+        __m128i folded = _mm_or_si128(octets, space);
+        __m128i stops = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(folded, comma),
+                        _mm_cmpeq_epi8(folded, question)),
+                    _mm_or_si128(_mm_cmpeq_epi8(folded, colon),
+                        _mm_cmpeq_epi8(folded, hash))),
+                _mm_or_si128(_mm_cmpeq_epi8(folded, left),
+                    _mm_cmpeq_epi8(folded, right)));
+        __m128i allowed = _mm_andnot_si128(
+                _mm_or_si128(stops, _mm_cmpeq_epi8(octets, del)),
+                _mm_cmpgt_epi8(octets, space));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(allowed) ^ 0xFFFF;
+        if (mask)
+            return (pointer - start) + YAML_CTZ(mask);
+        pointer += 16;
+    }
+
+    return (pointer - start) + yaml_emitter_inner_span_scalar(pointer, end);
+}
+
+static size_t
+yaml_emitter_text_span_sse2(const yaml_char_t *start, const yaml_char_t *end)
+{
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    const __m128i apostrophe = _mm_set1_epi8('\'');
+    const __m128i quotation = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const yaml_char_t *pointer = start;
+
+    while (end - pointer >= 16) {
+        __m128i octets = _mm_loadu_si128((const __m128i *)pointer);
+        __m128i stops = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(octets, apostrophe),
+                    _mm_cmpeq_epi8(octets, quotation)),
+                _mm_or_si128(_mm_cmpeq_epi8(octets, backslash),
+                    _mm_cmpeq_epi8(octets, del)));
+        __m128i allowed = _mm_andnot_si128(stops,
+                _mm_cmpgt_epi8(octets, space));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(allowed) ^ 0xFFFF;
+        if (mask)
+            return (pointer - start) + YAML_CTZ(mask);
+        pointer += 16;
+    }
+
+    return (pointer - start) + yaml_emitter_text_span_scalar(pointer, end);
+}
+
+#endif
+
+#if defined(YAML_HAVE_AVX2)
+
+/*
+ * AVX2 versions: classify 32 octets at a time.
+ */
+
+YAML_TARGET_AVX2 static size_t
+yaml_emitter_inner_span_avx2(const yaml_char_t *start, const yaml_char_t *end)
+{
+    const __m256i space = _mm256_set1_epi8(0x20);
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i question = _mm256_set1_epi8('?');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i hash = _mm256_set1_epi8('#');
+    const __m256i left = _mm256_set1_epi8('{');
+    const __m256i right = _mm256_set1_epi8('}');
+    const yaml_char_t *pointer = start;
+
+    while (end - pointer >= 32) {
+        __m256i octets = _mm256_loadu_si256((const __m256i *)pointer);
+        __m256i folded = _mm256_or_si256(octets, space);
+        __m256i stops = _mm256_or_si256(
+                _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(folded, comma),
+                        _mm256_cmpeq_epi8(folded, question)),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(folded, colon),
+                        _mm256_cmpeq_epi8(folded, hash))),
+                _mm256_or_si256(_mm256_cmpeq_epi8(folded, left),
+                    _mm256_cmpeq_epi8(folded, right)));
+        __m256i allowed = _mm256_andnot_si256(
+                _mm256_or_si256(stops, _mm256_cmpeq_epi8(octets, del)),
+                _mm256_cmpgt_epi8(octets, space));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(allowed);
+        if (mask)
+            return (pointer - start) + YAML_CTZ(mask);
+        pointer += 32;
+    }
+
+    return (pointer - start) + yaml_emitter_inner_span_scalar(pointer, end);
+}
+
+YAML_TARGET_AVX2 static size_t
+yaml_emitter_text_span_avx2(const yaml_char_t *start, const yaml_char_t *end)
+{
+    const __m256i space = _mm256_set1_epi8(0x20);
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    const __m256i apostrophe = _mm256_set1_epi8('\'');
+    const __m256i quotation = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const yaml_char_t *pointer = start;
+
+    while (end - pointer >= 32) {
+        __m256i octets = _mm256_loadu_si256((const __m256i *)pointer);
+        __m256i stops = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(octets, apostrophe),
+                    _mm256_cmpeq_epi8(octets, quotation)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(octets, backslash),
+                    _mm256_cmpeq_epi8(octets, del)));
+        __m256i allowed = _mm256_andnot_si256(stops,
+                _mm256_cmpgt_epi8(octets, space));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(allowed);
+        if (mask)
+            return (pointer - start) + YAML_CTZ(mask);
+        pointer += 32;
+    }
+
+    return (pointer - start) + yaml_emitter_text_span_scalar(pointer, end);
+}
+
+#endif
+
+/*
+ * Return the length of the inner run at the beginning of the range using the
+ * best implementation available on this CPU.
+ */
+
+static size_t
+yaml_emitter_inner_span(const yaml_char_t *start, const yaml_char_t *end)
+{
+#if defined(YAML_HAVE_AVX2)
+    if (yaml_cpu_has_avx2())
+        return yaml_emitter_inner_span_avx2(start, end);
+#endif
+#if defined(YAML_HAVE_SSE2)
+    return yaml_emitter_inner_span_sse2(start, end);
+#else
+    return yaml_emitter_inner_span_scalar(start, end);
+#endif
+}
+
+/*
+ * Return the length of the text run at the beginning of the range using the
+ * best implementation available on this CPU.
+ */
+
+static size_t
+yaml_emitter_text_span(const yaml_char_t *start, const yaml_char_t *end)
+{
+#if defined(YAML_HAVE_AVX2)
+    if (yaml_cpu_has_avx2())
+        return yaml_emitter_text_span_avx2(start, end);
+#endif
+#if defined(YAML_HAVE_SSE2)
+    return yaml_emitter_text_span_sse2(start, end);
+#else
+    return yaml_emitter_text_span_scalar(start, end);
+#endif
+}
+
 /*
  * API functions.
  */
@@ -68,10 +293,34 @@
 YAML_DECLARE(int)
 yaml_emitter_emit(yaml_emitter_t *emitter, yaml_event_t *event);
 
+YAML_DECLARE(int)
+yaml_emitter_emit_alias_borrowed(yaml_emitter_t *emitter,
+        const yaml_char_t *anchor);
+
+YAML_DECLARE(int)
+yaml_emitter_emit_scalar_borrowed(yaml_emitter_t *emitter,
+        const yaml_char_t *anchor, const yaml_char_t *tag,
+        const yaml_char_t *value, int length,
+        int plain_implicit, int quoted_implicit,
+        yaml_scalar_style_t style);
+
+YAML_DECLARE(int)
+yaml_emitter_emit_sequence_start_borrowed(yaml_emitter_t *emitter,
+        const yaml_char_t *anchor, const yaml_char_t *tag, int implicit,
+        yaml_sequence_style_t style);
+
+YAML_DECLARE(int)
+yaml_emitter_emit_mapping_start_borrowed(yaml_emitter_t *emitter,
+        const yaml_char_t *anchor, const yaml_char_t *tag, int implicit,
+        yaml_mapping_style_t style);
+
 /*
  * Utility functions.
  */
 
+static int
+yaml_emitter_emit_borrowed(yaml_emitter_t *emitter, yaml_event_t *event);
+
 static int
 yaml_emitter_set_emitter_error(yaml_emitter_t *emitter, const char *problem);
 
@@ -163,7 +412,7 @@ static int
 yaml_emitter_check_empty_mapping(yaml_emitter_t *emitter);
 
 static int
-yaml_emitter_check_simple_key(yaml_emitter_t *emitter);
+yaml_emitter_check_simple_key(yaml_emitter_t *emitter, yaml_event_t *event);
 
 static int
 yaml_emitter_select_scalar_style(yaml_emitter_t *emitter, yaml_event_t *event);
@@ -219,6 +468,9 @@ yaml_emitter_write_bom(yaml_emitter_t *emitter);
 static int
 yaml_emitter_write_indent(yaml_emitter_t *emitter);
 
+static int
+yaml_emitter_write_text(yaml_emitter_t *emitter, yaml_string_t *string);
+
 static int
 yaml_emitter_write_indicator(yaml_emitter_t *emitter,
         const char *indicator, int need_whitespace,
@@ -280,6 +532,17 @@ yaml_emitter_set_emitter_error(yaml_emitter_t *emitter, const char *problem)
 YAML_DECLARE(int)
 yaml_emitter_emit(yaml_emitter_t *emitter, yaml_event_t *event)
 {
+    int result;
+
+    /* In the streaming mode, write the event without queueing it. */
+
+    if (emitter->streaming && QUEUE_EMPTY(emitter, emitter->events)) {
+        result = (yaml_emitter_analyze_event(emitter, event)
+                && yaml_emitter_state_machine(emitter, event));
+        yaml_event_delete(event);
+        return result;
+    }
+
     if (!ENQUEUE(emitter, emitter->events, *event)) {
         yaml_event_delete(event);
         return 0;
@@ -296,6 +559,189 @@ yaml_emitter_emit(yaml_emitter_t *emitter, yaml_event_t *event)
     return 1;
 }
 
+/*
+ * Emit an ALIAS event from a borrowed anchor.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_emit_alias_borrowed(yaml_emitter_t *emitter,
+        const yaml_char_t *anchor)
+{
+    yaml_event_t event;
+    yaml_mark_t mark = { 0, 0, 0 };
+
+    assert(emitter);    /* Non-NULL emitter object is expected. */
+    assert(anchor);     /* Non-NULL anchor is expected. */
+
+    ALIAS_EVENT_INIT(event, (yaml_char_t *)anchor, mark, mark);
+
+    return yaml_emitter_emit_borrowed(emitter, &event);
+}
+
+/*
+ * Emit a SCALAR event from borrowed strings.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_emit_scalar_borrowed(yaml_emitter_t *emitter,
+        const yaml_char_t *anchor, const yaml_char_t *tag,
+        const yaml_char_t *value, int length,
+        int plain_implicit, int quoted_implicit,
+        yaml_scalar_style_t style)
+{
+    yaml_event_t event;
+    yaml_mark_t mark = { 0, 0, 0 };
+
+    assert(emitter);    /* Non-NULL emitter object is expected. */
+    assert(value);      /* Non-NULL value is expected. */
+
+    if (length < 0) {
+        length = strlen((char *)value);
+    }
+
+    SCALAR_EVENT_INIT(event, (yaml_char_t *)anchor, (yaml_char_t *)tag,
+            (yaml_char_t *)value, length, plain_implicit, quoted_implicit,
+            style, mark, mark);
+
+    return yaml_emitter_emit_borrowed(emitter, &event);
+}
+
+/*
+ * Emit a SEQUENCE-START event from borrowed strings.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_emit_sequence_start_borrowed(yaml_emitter_t *emitter,
+        const yaml_char_t *anchor, const yaml_char_t *tag, int implicit,
+        yaml_sequence_style_t style)
+{
+    yaml_event_t event;
+    yaml_mark_t mark = { 0, 0, 0 };
+
+    assert(emitter);    /* Non-NULL emitter object is expected. */
+
+    SEQUENCE_START_EVENT_INIT(event, (yaml_char_t *)anchor,
+            (yaml_char_t *)tag, implicit, style, mark, mark);
+
+    return yaml_emitter_emit_borrowed(emitter, &event);
+}
+
+/*
+ * Emit a MAPPING-START event from borrowed strings.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_emit_mapping_start_borrowed(yaml_emitter_t *emitter,
+        const yaml_char_t *anchor, const yaml_char_t *tag, int implicit,
+        yaml_mapping_style_t style)
+{
+    yaml_event_t event;
+    yaml_mark_t mark = { 0, 0, 0 };
+
+    assert(emitter);    /* Non-NULL emitter object is expected. */
+
+    MAPPING_START_EVENT_INIT(event, (yaml_char_t *)anchor,
+            (yaml_char_t *)tag, implicit, style, mark, mark);
+
+    return yaml_emitter_emit_borrowed(emitter, &event);
+}
+
+/*
+ * Emit an event whose strings belong to the caller.
+ *
+ * The event is written at once if nothing is queued and the event does not
+ * need to wait for the following events.  Otherwise its strings are copied
+ * and the event is queued as usual.
+ */
+
+static int
+yaml_emitter_emit_borrowed(yaml_emitter_t *emitter, yaml_event_t *event)
+{
+    yaml_char_t **anchor = NULL;
+    yaml_char_t **tag = NULL;
+    yaml_char_t **value = NULL;
+    size_t length = 0;
+    yaml_char_t *anchor_copy = NULL;
+    yaml_char_t *tag_copy = NULL;
+    yaml_char_t *value_copy = NULL;
+
+    switch (event->type)
+    {
+        case YAML_ALIAS_EVENT:
+            anchor = &event->data.alias.anchor;
+            break;
+
+        case YAML_SCALAR_EVENT:
+            anchor = &event->data.scalar.anchor;
+            tag = &event->data.scalar.tag;
+            value = &event->data.scalar.value;
+            length = event->data.scalar.length;
+            break;
+
+        case YAML_SEQUENCE_START_EVENT:
+            anchor = &event->data.sequence_start.anchor;
+            tag = &event->data.sequence_start.tag;
+            break;
+
+        case YAML_MAPPING_START_EVENT:
+            anchor = &event->data.mapping_start.anchor;
+            tag = &event->data.mapping_start.tag;
+            break;
+
+        default:
+            assert(0);      /* Could not happen. */
+            break;
+    }
+
+    if (!emitter->trusted_utf8
+            && ((*anchor && !yaml_check_utf8(*anchor,
+                        strlen((char *)*anchor)))
+                || (tag && *tag && !yaml_check_utf8(*tag,
+                        strlen((char *)*tag)))
+                || (value && !yaml_check_utf8(*value, length))))
+        return yaml_emitter_set_emitter_error(emitter,
+                "found invalid UTF-8 in an event");
+
+    if (QUEUE_EMPTY(emitter, emitter->events)
+            && (emitter->streaming
+                || event->type == YAML_ALIAS_EVENT
+                || event->type == YAML_SCALAR_EVENT))
+        return (yaml_emitter_analyze_event(emitter, event)
+                && yaml_emitter_state_machine(emitter, event));
+
+    if (*anchor) {
+        anchor_copy = yaml_strdup_with(emitter->allocator, *anchor);
+        if (!anchor_copy) goto error;
+    }
+
+    if (tag && *tag) {
+        tag_copy = yaml_strdup_with(emitter->allocator, *tag);
+        if (!tag_copy) goto error;
+    }
+
+    if (value) {
+        value_copy = YAML_MALLOC_WITH(emitter->allocator, length+1);
+        if (!value_copy) goto error;
+        memcpy(value_copy, *value, length);
+        value_copy[length] = '\0';
+    }
+
+    *anchor = anchor_copy;
+    if (tag) *tag = tag_copy;
+    if (value) *value = value_copy;
+    event->allocator = emitter->allocator;
+
+    return yaml_emitter_emit(emitter, event);
+
+error:
+    yaml_free_with(emitter->allocator, anchor_copy);
+    yaml_free_with(emitter->allocator, tag_copy);
+    yaml_free_with(emitter->allocator, value_copy);
+    emitter->error = YAML_MEMORY_ERROR;
+
+    return 0;
+}
+
 /*
  * Check if we need to accumulate more events before emitting.
  *
@@ -315,6 +761,9 @@ yaml_emitter_need_more_events(yaml_emitter_t *emitter)
     if (QUEUE_EMPTY(emitter, emitter->events))
         return 1;
 
+    if (emitter->streaming)
+        return 0;
+
     switch (emitter->events.head->type) {
         case YAML_DOCUMENT_START_EVENT:
             accumulate = 1;
@@ -377,8 +826,8 @@ yaml_emitter_append_tag_directive(yaml_emitter_t *emitter,
         }
     }
 
-    copy.handle = yaml_strdup(value.handle);
-    copy.prefix = yaml_strdup(value.prefix);
+    copy.handle = yaml_strdup_with(emitter->allocator, value.handle);
+    copy.prefix = yaml_strdup_with(emitter->allocator, value.prefix);
     if (!copy.handle || !copy.prefix) {
         emitter->error = YAML_MEMORY_ERROR;
         goto error;
@@ -390,8 +839,8 @@ yaml_emitter_append_tag_directive(yaml_emitter_t *emitter,
     return 1;
 
 error:
-    yaml_free(copy.handle);
-    yaml_free(copy.prefix);
+    yaml_free_with(emitter->allocator, copy.handle);
+    yaml_free_with(emitter->allocator, copy.prefix);
     return 0;
 }
 
@@ -718,7 +1167,7 @@ yaml_emitter_emit_document_end(yaml_emitter_t *emitter,
         }
         else if (!emitter->open_ended)
             emitter->open_ended = 1;
-        if (!yaml_emitter_flush(emitter))
+        if (!yaml_emitter_flush_buffer(emitter))
             return 0;
 
         emitter->state = YAML_EMIT_DOCUMENT_START_STATE;
@@ -726,8 +1175,8 @@ yaml_emitter_emit_document_end(yaml_emitter_t *emitter,
         while (!STACK_EMPTY(emitter, emitter->tag_directives)) {
             yaml_tag_directive_t tag_directive = POP(emitter,
                     emitter->tag_directives);
-            yaml_free(tag_directive.handle);
-            yaml_free(tag_directive.prefix);
+            yaml_free_with(emitter->allocator, tag_directive.handle);
+            yaml_free_with(emitter->allocator, tag_directive.prefix);
         }
 
         return 1;
@@ -830,7 +1279,7 @@ yaml_emitter_emit_flow_mapping_key(yaml_emitter_t *emitter,
             return 0;
     }
 
-    if (!emitter->canonical && yaml_emitter_check_simple_key(emitter))
+    if (!emitter->canonical && yaml_emitter_check_simple_key(emitter, event))
     {
         if (!PUSH(emitter, emitter->states,
                     YAML_EMIT_FLOW_MAPPING_SIMPLE_VALUE_STATE))
@@ -893,6 +1342,16 @@ yaml_emitter_emit_block_sequence_item(yaml_emitter_t *emitter,
     if (event->type == YAML_SEQUENCE_END_EVENT)
     {
         emitter->indent = POP(emitter, emitter->indents);
+
+        /* An empty sequence gets here only in the streaming mode. */
+
+        if (first) {
+            if (!yaml_emitter_write_indicator(emitter, "[", 1, 1, 0))
+                return 0;
+            if (!yaml_emitter_write_indicator(emitter, "]", 0, 0, 0))
+                return 0;
+        }
+
         emitter->state = POP(emitter, emitter->states);
 
         return 1;
@@ -926,6 +1385,16 @@ yaml_emitter_emit_block_mapping_key(yaml_emitter_t *emitter,
     if (event->type == YAML_MAPPING_END_EVENT)
     {
         emitter->indent = POP(emitter, emitter->indents);
+
+        /* An empty mapping gets here only in the streaming mode. */
+
+        if (first) {
+            if (!yaml_emitter_write_indicator(emitter, "{", 1, 1, 0))
+                return 0;
+            if (!yaml_emitter_write_indicator(emitter, "}", 0, 0, 0))
+                return 0;
+        }
+
         emitter->state = POP(emitter, emitter->states);
 
         return 1;
@@ -934,7 +1403,7 @@ yaml_emitter_emit_block_mapping_key(yaml_emitter_t *emitter,
     if (!yaml_emitter_write_indent(emitter))
         return 0;
 
-    if (yaml_emitter_check_simple_key(emitter))
+    if (yaml_emitter_check_simple_key(emitter, event))
     {
         if (!PUSH(emitter, emitter->states,
                     YAML_EMIT_BLOCK_MAPPING_SIMPLE_VALUE_STATE))
@@ -1140,13 +1609,13 @@ yaml_emitter_check_empty_mapping(yaml_emitter_t *emitter)
 }
 
 /*
- * Check if the next node can be expressed as a simple key.
+ * Check if the next node can be expressed as a simple key.  Without the
+ * following events, a collection is never known to be empty.
  */
 
 static int
-yaml_emitter_check_simple_key(yaml_emitter_t *emitter)
+yaml_emitter_check_simple_key(yaml_emitter_t *emitter, yaml_event_t *event)
 {
-    yaml_event_t *event = emitter->events.head;
     size_t length = 0;
 
     switch (event->type)
@@ -1536,18 +2005,35 @@ yaml_emitter_analyze_scalar(yaml_emitter_t *emitter,
         return 1;
     }
 
-    if ((CHECK_AT(string, '-', 0)
-                && CHECK_AT(string, '-', 1)
-                && CHECK_AT(string, '-', 2))
-            || (CHECK_AT(string, '.', 0)
-                && CHECK_AT(string, '.', 1)
-                && CHECK_AT(string, '.', 2))) {
+    /* A word followed by an inner run needs no further analysis. */
+
+    if (IS_ALPHA(string) && !CHECK(string, '-')
+            && yaml_emitter_inner_span(string.start+1, string.end)
+                == length-1)
+    {
+        emitter->scalar_data.multiline = 0;
+        emitter->scalar_data.flow_plain_allowed = 1;
+        emitter->scalar_data.block_plain_allowed = 1;
+        emitter->scalar_data.single_quoted_allowed = 1;
+        emitter->scalar_data.block_allowed = 1;
+
+        return 1;
+    }
+
+    if (length >= 3
+            && ((CHECK_AT(string, '-', 0)
+                    && CHECK_AT(string, '-', 1)
+                    && CHECK_AT(string, '-', 2))
+                || (CHECK_AT(string, '.', 0)
+                    && CHECK_AT(string, '.', 1)
+                    && CHECK_AT(string, '.', 2)))) {
         block_indicators = 1;
         flow_indicators = 1;
     }
 
     preceded_by_whitespace = 1;
-    followed_by_whitespace = IS_BLANKZ_AT(string, WIDTH(string));
+    followed_by_whitespace = (string.pointer+WIDTH(string) == string.end
+            || IS_BLANKZ_AT(string, WIDTH(string)));
 
     while (string.pointer != string.end)
     {
@@ -1643,8 +2129,21 @@ yaml_emitter_analyze_scalar(yaml_emitter_t *emitter,
 
         preceded_by_whitespace = IS_BLANKZ(string);
         MOVE(string);
+
+        /* Skip the following inner run at once. */
+
+        if (string.pointer != string.end
+                && IS_INNER_RUN_OCTET(*string.pointer)) {
+            string.pointer += yaml_emitter_inner_span(string.pointer,
+                    string.end);
+            preceded_by_whitespace = 0;
+            previous_space = 0;
+            previous_break = 0;
+        }
+
         if (string.pointer != string.end) {
-            followed_by_whitespace = IS_BLANKZ_AT(string, WIDTH(string));
+            followed_by_whitespace = (string.pointer+WIDTH(string)
+                    == string.end || IS_BLANKZ_AT(string, WIDTH(string)));
         }
     }
 
@@ -1915,6 +2414,39 @@ yaml_emitter_write_tag_content(yaml_emitter_t *emitter,
     return 1;
 }
 
+/*
+ * Copy the character at the string pointer into the buffer, or the whole text
+ * run that starts there.
+ */
+
+static int
+yaml_emitter_write_text(yaml_emitter_t *emitter, yaml_string_t *string)
+{
+    size_t length;
+    size_t chunk;
+
+    if (!IS_TEXT_RUN_OCTET(*string->pointer))
+        return WRITE(emitter, *string);
+
+    length = yaml_emitter_text_span(string->pointer, string->end);
+
+    while (length)
+    {
+        if (!FLUSH(emitter)) return 0;
+        chunk = emitter->buffer.end - emitter->buffer.pointer;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(emitter->buffer.pointer, string->pointer, chunk);
+        emitter->buffer.pointer += chunk;
+        string->pointer += chunk;
+        emitter->column += (int)chunk;
+        length -= chunk;
+    }
+
+    return 1;
+}
+
 static int
 yaml_emitter_write_plain_scalar(yaml_emitter_t *emitter,
         yaml_char_t *value, size_t length, int allow_breaks)
@@ -1945,6 +2477,7 @@ yaml_emitter_write_plain_scalar(yaml_emitter_t *emitter,
         {
             if (allow_breaks && !spaces
                     && emitter->column > emitter->best_width
+                    && string.pointer+1 != string.end
                     && !IS_SPACE_AT(string, 1)) {
                 if (!yaml_emitter_write_indent(emitter)) return 0;
                 MOVE(string);
@@ -1968,7 +2501,7 @@ yaml_emitter_write_plain_scalar(yaml_emitter_t *emitter,
             if (breaks) {
                 if (!yaml_emitter_write_indent(emitter)) return 0;
             }
-            if (!WRITE(emitter, string)) return 0;
+            if (!yaml_emitter_write_text(emitter, &string)) return 0;
             emitter->indention = 0;
             spaces = 0;
             breaks = 0;
@@ -2028,7 +2561,7 @@ yaml_emitter_write_single_quoted_scalar(yaml_emitter_t *emitter,
             if (CHECK(string, '\'')) {
                 if (!PUT(emitter, '\'')) return 0;
             }
-            if (!WRITE(emitter, string)) return 0;
+            if (!yaml_emitter_write_text(emitter, &string)) return 0;
             emitter->indention = 0;
             spaces = 0;
             breaks = 0;
@@ -2189,7 +2722,7 @@ yaml_emitter_write_double_quoted_scalar(yaml_emitter_t *emitter,
         }
         else
         {
-            if (!WRITE(emitter, string)) return 0;
+            if (!yaml_emitter_write_text(emitter, &string)) return 0;
             spaces = 0;
         }
     }
@@ -2291,7 +2824,7 @@ yaml_emitter_write_literal_scalar(yaml_emitter_t *emitter,
             if (breaks) {
                 if (!yaml_emitter_write_indent(emitter)) return 0;
             }
-            if (!WRITE(emitter, string)) return 0;
+            if (!yaml_emitter_write_text(emitter, &string)) return 0;
             emitter->indention = 0;
             breaks = 0;
         }
@@ -2324,10 +2857,12 @@ yaml_emitter_write_folded_scalar(yaml_emitter_t *emitter,
         {
             if (!breaks && !leading_spaces && CHECK(string, '\n')) {
                 int k = 0;
-                while (IS_BREAK_AT(string, k)) {
+                while (string.pointer+k != string.end
+                        && IS_BREAK_AT(string, k)) {
                     k += WIDTH_AT(string, k);
                 }
-                if (!IS_BLANKZ_AT(string, k)) {
+                if (string.pointer+k != string.end
+                        && !IS_BLANKZ_AT(string, k)) {
                     if (!PUT_BREAK(emitter)) return 0;
                 }
             }
@@ -2341,13 +2876,14 @@ yaml_emitter_write_folded_scalar(yaml_emitter_t *emitter,
                 if (!yaml_emitter_write_indent(emitter)) return 0;
                 leading_spaces = IS_BLANK(string);
             }
-            if (!breaks && IS_SPACE(string) && !IS_SPACE_AT(string, 1)
+            if (!breaks && IS_SPACE(string) && string.pointer+1 != string.end
+                    && !IS_SPACE_AT(string, 1)
                     && emitter->column > emitter->best_width) {
                 if (!yaml_emitter_write_indent(emitter)) return 0;
                 MOVE(string);
             }
             else {
-                if (!WRITE(emitter, string)) return 0;
+                if (!yaml_emitter_write_text(emitter, &string)) return 0;
             }
             emitter->indention = 0;
             breaks = 0;
@@ -21,6 +21,10 @@ yaml_parser_set_composer_error_context(yaml_parser_t *parser,
         const char *context, yaml_mark_t context_mark,
         const char *problem, yaml_mark_t problem_mark);
 
+static int
+yaml_parser_set_limit_error(yaml_parser_t *parser,
+        const char *problem, yaml_mark_t problem_mark);
+
 
 /*
  * Alias handling.
@@ -30,6 +34,20 @@ static int
 yaml_parser_register_anchor(yaml_parser_t *parser,
         int index, yaml_char_t *anchor);
 
+static int *
+yaml_parser_find_anchor(yaml_parser_t *parser, const yaml_char_t *anchor);
+
+static int
+yaml_parser_extend_alias_index(yaml_parser_t *parser);
+
+/*
+ * Node data.
+ */
+
+static int
+yaml_parser_load_tag(yaml_parser_t *parser, yaml_char_t **tag,
+        const char *default_tag);
+
 /*
  * Clean up functions.
  */
@@ -44,8 +62,17 @@ struct loader_ctx {
     int *start;
     int *end;
     int *top;
+    size_t references;
 };
 
+/*
+ * Resource limits.
+ */
+
+static int
+yaml_parser_check_limits(yaml_parser_t *parser, yaml_event_t *event,
+        struct loader_ctx *ctx);
+
 /*
  * Composer functions.
  */
@@ -92,6 +119,7 @@ yaml_parser_load(yaml_parser_t *parser, yaml_document_t *document)
     assert(document);   /* Non-NULL document object is expected. */
 
     memset(document, 0, sizeof(yaml_document_t));
+    document->allocator = parser->allocator;
     if (!STACK_INIT(parser, document->nodes, yaml_node_t*))
         goto error;
 
@@ -110,8 +138,17 @@ yaml_parser_load(yaml_parser_t *parser, yaml_document_t *document)
         return 1;
     }
 
-    if (!STACK_INIT(parser, parser->aliases, yaml_alias_data_t*))
+    if (!STACK_INIT(parser, parser->aliases, yaml_alias_data_t*)) {
+        yaml_event_delete(&event);
+        goto error;
+    }
+
+    if (parser->document_arena
+            && !yaml_arena_initialize(parser->allocator, &document->arena)) {
+        parser->error = YAML_MEMORY_ERROR;
+        yaml_event_delete(&event);
         goto error;
+    }
 
     parser->document = document;
 
@@ -164,6 +201,54 @@ yaml_parser_set_composer_error_context(yaml_parser_t *parser,
     return 0;
 }
 
+/*
+ * Set limit error.
+ */
+
+static int
+yaml_parser_set_limit_error(yaml_parser_t *parser,
+        const char *problem, yaml_mark_t problem_mark)
+{
+    parser->error = YAML_LIMIT_ERROR;
+    parser->problem = problem;
+    parser->problem_mark = problem_mark;
+
+    return 0;
+}
+
+/*
+ * Check that the node of an event fits in the limits of the document.
+ */
+
+static int
+yaml_parser_check_limits(yaml_parser_t *parser, yaml_event_t *event,
+        struct loader_ctx *ctx)
+{
+    yaml_parser_limits_t *limits = &parser->limits;
+
+    if (event->type == YAML_ALIAS_EVENT) {
+        if (limits->max_alias_references
+                && ctx->references >= limits->max_alias_references)
+            return yaml_parser_set_limit_error(parser,
+                    "exceeded the maximum number of alias references",
+                    event->start_mark);
+        return 1;
+    }
+
+    if (limits->max_nodes
+            && (size_t)(parser->document->nodes.top
+                - parser->document->nodes.start) >= limits->max_nodes)
+        return yaml_parser_set_limit_error(parser,
+                "exceeded the maximum number of nodes", event->start_mark);
+
+    if (event->type != YAML_SCALAR_EVENT && limits->max_depth
+            && (size_t)(ctx->top - ctx->start) >= limits->max_depth)
+        return yaml_parser_set_limit_error(parser,
+                "exceeded the maximum nesting depth", event->start_mark);
+
+    return 1;
+}
+
 /*
  * Delete the stack of aliases.
  */
@@ -172,9 +257,17 @@ static void
 yaml_parser_delete_aliases(yaml_parser_t *parser)
 {
     while (!STACK_EMPTY(parser, parser->aliases)) {
-        yaml_free(POP(parser, parser->aliases).anchor);
+        yaml_free_with(parser->allocator, POP(parser, parser->aliases).anchor);
     }
     STACK_DEL(parser, parser->aliases);
+
+    /* Keep the slots of the index for the next document. */
+
+    if (parser->alias_index.start) {
+        memset(parser->alias_index.start, 0,
+                (parser->alias_index.end - parser->alias_index.start)
+                * sizeof(*parser->alias_index.start));
+    }
 }
 
 /*
@@ -184,7 +277,7 @@ yaml_parser_delete_aliases(yaml_parser_t *parser)
 static int
 yaml_parser_load_document(yaml_parser_t *parser, yaml_event_t *event)
 {
-    struct loader_ctx ctx = { NULL, NULL, NULL };
+    struct loader_ctx ctx = { NULL, NULL, NULL, 0 };
 
     assert(event->type == YAML_DOCUMENT_START_EVENT);
                         /* DOCUMENT-START is expected. */
@@ -265,7 +358,7 @@ yaml_parser_register_anchor(yaml_parser_t *parser,
         int index, yaml_char_t *anchor)
 {
     yaml_alias_data_t data;
-    yaml_alias_data_t *alias_data;
+    int *slot;
 
     if (!anchor) return 1;
 
@@ -273,18 +366,130 @@ yaml_parser_register_anchor(yaml_parser_t *parser,
     data.index = index;
     data.mark = parser->document->nodes.start[index-1].start_mark;
 
-    for (alias_data = parser->aliases.start;
-            alias_data != parser->aliases.top; alias_data ++) {
-        if (strcmp((char *)alias_data->anchor, (char *)anchor) == 0) {
-            yaml_free(anchor);
-            return yaml_parser_set_composer_error_context(parser,
-                    "found duplicate anchor; first occurrence",
-                    alias_data->mark, "second occurrence", data.mark);
-        }
+    if (!yaml_parser_extend_alias_index(parser)) {
+        yaml_free_with(parser->allocator, anchor);
+        return 0;
+    }
+
+    slot = yaml_parser_find_anchor(parser, anchor);
+    if (*slot) {
+        yaml_alias_data_t *alias_data = parser->aliases.start + *slot - 1;
+        yaml_free_with(parser->allocator, anchor);
+        return yaml_parser_set_composer_error_context(parser,
+                "found duplicate anchor; first occurrence",
+                alias_data->mark, "second occurrence", data.mark);
     }
 
     if (!PUSH(parser, parser->aliases, data)) {
-        yaml_free(anchor);
+        yaml_free_with(parser->allocator, anchor);
+        return 0;
+    }
+
+    *slot = parser->aliases.top - parser->aliases.start;
+
+    return 1;
+}
+
+/*
+ * Find the slot of an anchor in the alias index.
+ *
+ * The index is an open addressing hash table with linear probing.  A slot
+ * holds the position of the alias data plus one, or 0 if it is empty.  The
+ * function returns the slot of the anchor or the empty slot where the anchor
+ * belongs.  The index must have an empty slot.
+ */
+
+static int *
+yaml_parser_find_anchor(yaml_parser_t *parser, const yaml_char_t *anchor)
+{
+    size_t mask = parser->alias_index.end - parser->alias_index.start - 1;
+    size_t hash = yaml_string_hash(anchor);
+
+    for (hash &= mask; parser->alias_index.start[hash]; hash = (hash+1) & mask)
+    {
+        yaml_alias_data_t *alias_data = parser->aliases.start
+            + parser->alias_index.start[hash] - 1;
+        if (strcmp((char *)alias_data->anchor, (char *)anchor) == 0)
+            break;
+    }
+
+    return parser->alias_index.start + hash;
+}
+
+/*
+ * Make sure the alias index has room for one more anchor.
+ *
+ * The index is kept at most half full; when it grows, the registered anchors
+ * are rehashed.
+ */
+
+static int
+yaml_parser_extend_alias_index(yaml_parser_t *parser)
+{
+    size_t size = parser->alias_index.end - parser->alias_index.start;
+    size_t count = parser->aliases.top - parser->aliases.start;
+    int *start;
+
+    if ((count+1)*2 <= size)
+        return 1;
+
+    size = size ? size*2 : INITIAL_ALIAS_INDEX_SIZE;
+    if (size >= INT_MAX / sizeof(*start)) {
+        parser->error = YAML_MEMORY_ERROR;
+        return 0;
+    }
+
+    start = (int *)yaml_malloc_with(parser->allocator, size*sizeof(*start));
+    if (!start) {
+        parser->error = YAML_MEMORY_ERROR;
+        return 0;
+    }
+    memset(start, 0, size*sizeof(*start));
+
+    yaml_free_with(parser->allocator, parser->alias_index.start);
+    parser->alias_index.start = start;
+    parser->alias_index.end = start + size;
+
+    for (count = 0; parser->aliases.start + count != parser->aliases.top;
+            count ++) {
+        *yaml_parser_find_anchor(parser, parser->aliases.start[count].anchor)
+            = count + 1;
+    }
+
+    return 1;
+}
+
+/*
+ * Resolve the tag of a node.
+ *
+ * A missing or non-specific tag is replaced with the default tag.  The tag of
+ * an arena-backed document is moved into the arena.
+ */
+
+static int
+yaml_parser_load_tag(yaml_parser_t *parser, yaml_char_t **tag,
+        const char *default_tag)
+{
+    void **arena = &parser->document->arena;
+    yaml_char_t *copy;
+
+    if (!*tag || strcmp((char *)*tag, "!") == 0) {
+        copy = yaml_arena_strndup(parser->allocator, arena,
+                (yaml_char_t *)default_tag, strlen(default_tag));
+    }
+    else if (*arena) {
+        copy = yaml_arena_strndup(parser->allocator, arena,
+                *tag, strlen((char *)*tag));
+    }
+    else {
+        return 1;
+    }
+
+    yaml_free_with(parser->allocator, *tag);
+    *tag = copy;
+
+    if (!copy) {
+        parser->error = YAML_MEMORY_ERROR;
         return 0;
     }
 
@@ -314,7 +519,8 @@ yaml_parser_load_node_add(yaml_parser_t *parser, struct loader_ctx *ctx,
         case YAML_SEQUENCE_NODE:
             if (!STACK_LIMIT(parser, parent->data.sequence.items, INT_MAX-1))
                 return 0;
-            if (!PUSH(parser, parent->data.sequence.items, index))
+            if (!ARENA_PUSH(parser, parser->document->arena,
+                        parent->data.sequence.items, index))
                 return 0;
             break;
         case YAML_MAPPING_NODE: {
@@ -331,7 +537,8 @@ yaml_parser_load_node_add(yaml_parser_t *parser, struct loader_ctx *ctx,
             pair.value = 0;
             if (!STACK_LIMIT(parser, parent->data.mapping.pairs, INT_MAX-1))
                 return 0;
-            if (!PUSH(parser, parent->data.mapping.pairs, pair))
+            if (!ARENA_PUSH(parser, parser->document->arena,
+                        parent->data.mapping.pairs, pair))
                 return 0;
 
             break;
@@ -352,17 +559,20 @@ yaml_parser_load_alias(yaml_parser_t *parser, yaml_event_t *event,
         struct loader_ctx *ctx)
 {
     yaml_char_t *anchor = event->data.alias.anchor;
-    yaml_alias_data_t *alias_data;
-
-    for (alias_data = parser->aliases.start;
-            alias_data != parser->aliases.top; alias_data ++) {
-        if (strcmp((char *)alias_data->anchor, (char *)anchor) == 0) {
-            yaml_free(anchor);
-            return yaml_parser_load_node_add(parser, ctx, alias_data->index);
+    int *slot;
+
+    if (parser->alias_index.start) {
+        slot = yaml_parser_find_anchor(parser, anchor);
+        if (*slot) {
+            int index = parser->aliases.start[*slot-1].index;
+            yaml_free_with(parser->allocator, anchor);
+            if (!yaml_parser_check_limits(parser, event, ctx)) return 0;
+            ctx->references ++;
+            return yaml_parser_load_node_add(parser, ctx, index);
         }
     }
 
-    yaml_free(anchor);
+    yaml_free_with(parser->allocator, anchor);
     return yaml_parser_set_composer_error(parser, "found undefined alias",
             event->start_mark);
 }
@@ -377,17 +587,36 @@ yaml_parser_load_scalar(yaml_parser_t *parser, yaml_event_t *event,
 {
     yaml_node_t node;
     int index;
+    void **arena = &parser->document->arena;
     yaml_char_t *tag = event->data.scalar.tag;
+    yaml_char_t *value = event->data.scalar.value;
+
+    /*
+     * The node owns its value.  A borrowed value is copied, and the value of
+     * an arena-backed document is moved into the arena.
+     */
+
+    if (*arena || event->borrowed) {
+        value = yaml_arena_strndup(parser->allocator, arena,
+                event->data.scalar.value, event->data.scalar.length);
+        if (!event->borrowed)
+            yaml_free_with(parser->allocator, event->data.scalar.value);
+        if (!value) {
+            parser->error = YAML_MEMORY_ERROR;
+            yaml_free_with(parser->allocator, tag);
+            yaml_free_with(parser->allocator, event->data.scalar.anchor);
+            return 0;
+        }
+    }
 
-    if (!STACK_LIMIT(parser, parser->document->nodes, INT_MAX-1)) goto error;
+    if (!yaml_parser_load_tag(parser, &tag, YAML_DEFAULT_SCALAR_TAG))
+        goto error;
 
-    if (!tag || strcmp((char *)tag, "!") == 0) {
-        yaml_free(tag);
-        tag = yaml_strdup((yaml_char_t *)YAML_DEFAULT_SCALAR_TAG);
-        if (!tag) goto error;
-    }
+    if (!yaml_parser_check_limits(parser, event, ctx)) goto error;
+
+    if (!STACK_LIMIT(parser, parser->document->nodes, INT_MAX-1)) goto error;
 
-    SCALAR_NODE_INIT(node, tag, event->data.scalar.value,
+    SCALAR_NODE_INIT(node, tag, value,
             event->data.scalar.length, event->data.scalar.style,
             event->start_mark, event->end_mark);
 
@@ -401,9 +630,9 @@ yaml_parser_load_scalar(yaml_parser_t *parser, yaml_event_t *event,
     return yaml_parser_load_node_add(parser, ctx, index);
 
 error:
-    yaml_free(tag);
-    yaml_free(event->data.scalar.anchor);
-    yaml_free(event->data.scalar.value);
+    yaml_arena_free(parser->allocator, *arena, tag);
+    yaml_arena_free(parser->allocator, *arena, value);
+    yaml_free_with(parser->allocator, event->data.scalar.anchor);
     return 0;
 }
 
@@ -422,17 +651,17 @@ yaml_parser_load_sequence(yaml_parser_t *parser, yaml_event_t *event,
         yaml_node_item_t *top;
     } items = { NULL, NULL, NULL };
     int index;
+    void **arena = &parser->document->arena;
     yaml_char_t *tag = event->data.sequence_start.tag;
 
-    if (!STACK_LIMIT(parser, parser->document->nodes, INT_MAX-1)) goto error;
+    if (!yaml_parser_load_tag(parser, &tag, YAML_DEFAULT_SEQUENCE_TAG))
+        goto error;
 
-    if (!tag || strcmp((char *)tag, "!") == 0) {
-        yaml_free(tag);
-        tag = yaml_strdup((yaml_char_t *)YAML_DEFAULT_SEQUENCE_TAG);
-        if (!tag) goto error;
-    }
+    if (!yaml_parser_check_limits(parser, event, ctx)) goto error;
 
-    if (!STACK_INIT(parser, items, yaml_node_item_t*)) goto error;
+    if (!STACK_LIMIT(parser, parser->document->nodes, INT_MAX-1)) goto error;
+
+    if (!ARENA_STACK_INIT(parser, *arena, items, yaml_node_item_t*)) goto error;
 
     SEQUENCE_NODE_INIT(node, tag, items.start, items.end,
             event->data.sequence_start.style,
@@ -453,8 +682,9 @@ yaml_parser_load_sequence(yaml_parser_t *parser, yaml_event_t *event,
     return 1;
 
 error:
-    yaml_free(tag);
-    yaml_free(event->data.sequence_start.anchor);
+    ARENA_STACK_DEL(parser, *arena, items);
+    yaml_arena_free(parser->allocator, *arena, tag);
+    yaml_free_with(parser->allocator, event->data.sequence_start.anchor);
     return 0;
 }
 
@@ -490,17 +720,17 @@ yaml_parser_load_mapping(yaml_parser_t *parser, yaml_event_t *event,
         yaml_node_pair_t *top;
     } pairs = { NULL, NULL, NULL };
     int index;
+    void **arena = &parser->document->arena;
     yaml_char_t *tag = event->data.mapping_start.tag;
 
-    if (!STACK_LIMIT(parser, parser->document->nodes, INT_MAX-1)) goto error;
+    if (!yaml_parser_load_tag(parser, &tag, YAML_DEFAULT_MAPPING_TAG))
+        goto error;
 
-    if (!tag || strcmp((char *)tag, "!") == 0) {
-        yaml_free(tag);
-        tag = yaml_strdup((yaml_char_t *)YAML_DEFAULT_MAPPING_TAG);
-        if (!tag) goto error;
-    }
+    if (!yaml_parser_check_limits(parser, event, ctx)) goto error;
+
+    if (!STACK_LIMIT(parser, parser->document->nodes, INT_MAX-1)) goto error;
 
-    if (!STACK_INIT(parser, pairs, yaml_node_pair_t*)) goto error;
+    if (!ARENA_STACK_INIT(parser, *arena, pairs, yaml_node_pair_t*)) goto error;
 
     MAPPING_NODE_INIT(node, tag, pairs.start, pairs.end,
             event->data.mapping_start.style,
@@ -521,8 +751,9 @@ yaml_parser_load_mapping(yaml_parser_t *parser, yaml_event_t *event,
     return 1;
 
 error:
-    yaml_free(tag);
-    yaml_free(event->data.mapping_start.anchor);
+    ARENA_STACK_DEL(parser, *arena, pairs);
+    yaml_arena_free(parser->allocator, *arena, tag);
+    yaml_free_with(parser->allocator, event->data.mapping_start.anchor);
     return 0;
 }
 
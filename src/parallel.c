@@ -0,0 +1,1008 @@
+
+#include "yaml_private.h"
+
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/*
+ * API functions.
+ */
+
+YAML_DECLARE(int)
+yaml_stream_load_parallel(yaml_parser_t *parser, int threads,
+        yaml_document_handler_t *handler, void *data);
+
+YAML_DECLARE(int)
+yaml_parser_start_pipeline(yaml_parser_t *parser);
+
+YAML_DECLARE(void)
+yaml_parser_stop_pipeline(yaml_parser_t *parser);
+
+YAML_DECLARE(int)
+yaml_parser_fetch_pipelined(yaml_parser_t *parser);
+
+YAML_DECLARE(yaml_parser_t *)
+yaml_parser_pipeline_scanner(yaml_parser_t *parser);
+
+/*
+ * Sequential loading.
+ */
+
+static int
+yaml_stream_load_sequential(yaml_parser_t *parser,
+        yaml_document_handler_t *handler, void *data);
+
+#if HAVE_PTHREAD
+
+/*
+ * A part of the stream loaded by a worker.
+ */
+
+typedef struct yaml_shard_s {
+
+    /** The input of the part. */
+    const unsigned char *start;
+
+    /** The size of the input. */
+    size_t size;
+
+    /** The offset of the part in the stream. */
+    size_t offset;
+
+    /** The mark of the part in the stream.  The column is always 0. */
+    yaml_mark_t mark;
+
+    /** Is the part loaded? */
+    int loaded;
+
+    /** Did the part fail to load? */
+    int failed;
+
+    /** The loaded documents. */
+    struct {
+        /** The beginning of the stack. */
+        yaml_document_t *start;
+        /** The end of the stack. */
+        yaml_document_t *end;
+        /** The top of the stack. */
+        yaml_document_t *top;
+    } documents;
+
+} yaml_shard_t;
+
+/*
+ * The state shared by the workers and the delivering thread.
+ */
+
+typedef struct yaml_parallel_s {
+
+    /** The application parser. */
+    yaml_parser_t *parser;
+
+    /** The parts of the stream. */
+    struct {
+        /** The beginning of the stack. */
+        yaml_shard_t *start;
+        /** The end of the stack. */
+        yaml_shard_t *end;
+        /** The top of the stack. */
+        yaml_shard_t *top;
+    } shards;
+
+    /** The first part not taken by a worker. */
+    size_t next;
+
+    /** The number of delivered parts. */
+    size_t delivered;
+
+    /** The number of parts the workers may load ahead. */
+    size_t window;
+
+    /** Should the workers stop? */
+    int stop;
+
+    /** The lock of the fields above, except for the shards input. */
+    pthread_mutex_t mutex;
+
+    /** Signaled when a part is loaded. */
+    pthread_cond_t loaded;
+
+    /** Signaled when a part is delivered or the workers should stop. */
+    pthread_cond_t consumed;
+
+} yaml_parallel_t;
+
+/*
+ * Stream splitting.
+ */
+
+static int
+yaml_stream_split(yaml_parallel_t *parallel,
+        const unsigned char *input, size_t size);
+
+/*
+ * Part loading.
+ */
+
+static int
+yaml_shard_load(yaml_parallel_t *parallel, yaml_shard_t *shard,
+        yaml_document_handler_t *handler, void *data);
+
+static void
+yaml_shard_translate_mark(yaml_mark_t *mark, yaml_mark_t base);
+
+static void
+yaml_shard_translate_document(yaml_document_t *document, yaml_mark_t base);
+
+static void
+yaml_shard_set_error(yaml_parser_t *parser, yaml_parser_t *shard_parser,
+        yaml_shard_t *shard);
+
+static void *
+yaml_parallel_worker(void *data);
+
+/*
+ * The number of tokens handed over at once, and the number of batches the
+ * scanner thread may fill ahead of the parser.
+ */
+
+#define PIPELINE_BATCH_SIZE     256
+
+#define PIPELINE_BATCHES        4
+
+/*
+ * The scanner thread of a pipelined parser.
+ *
+ * The thread owns a parser object that holds the input and the state of the
+ * reader and the scanner.  It fills the batches in a ring, and the application
+ * parser takes them in the same order.  A batch is only touched by the thread
+ * between being taken and being filled, so the tokens are copied without
+ * holding the lock.
+ */
+
+struct yaml_pipeline_s {
+
+    /** The scanner thread. */
+    pthread_t thread;
+
+    /** The mutex protecting the counters and the flags. */
+    pthread_mutex_t mutex;
+
+    /** Signaled when a batch is filled or the scanner is done. */
+    pthread_cond_t filled;
+
+    /** Signaled when a batch is taken or the thread should stop. */
+    pthread_cond_t taken;
+
+    /** The parser used by the thread. */
+    yaml_parser_t scanner;
+
+    /** The batches of tokens. */
+    yaml_token_t batches[PIPELINE_BATCHES][PIPELINE_BATCH_SIZE];
+
+    /** The number of tokens in each batch. */
+    size_t sizes[PIPELINE_BATCHES];
+
+    /** The number of batches filled so far. */
+    size_t filled_count;
+
+    /** The number of batches taken so far. */
+    size_t taken_count;
+
+    /** Has the scanner produced STREAM-END or failed? */
+    int done;
+
+    /** Should the thread exit? */
+    int stop;
+
+};
+
+static void
+yaml_pipeline_swap_reader(yaml_parser_t *a, yaml_parser_t *b);
+
+static void *
+yaml_pipeline_thread(void *data);
+
+#endif
+
+/*
+ * Load all documents of a stream.
+ */
+
+YAML_DECLARE(int)
+yaml_stream_load_parallel(yaml_parser_t *parser, int threads,
+        yaml_document_handler_t *handler, void *data)
+{
+#if HAVE_PTHREAD
+    yaml_parallel_t parallel;
+    pthread_t *workers = NULL;
+    int workers_count = 0;
+    const unsigned char *input;
+    size_t size;
+    size_t index;
+    yaml_shard_t *shard;
+    yaml_shard_t fallback;
+    int result = 1;
+    int stopped = 0;
+#endif
+
+    assert(parser);     /* Non-NULL parser object is expected. */
+    assert(handler);    /* Non-NULL document handler is expected. */
+    assert(!parser->stream_start_produced);
+                        /* An unread input is expected. */
+
+#if HAVE_PTHREAD
+
+    /*
+     * Only UTF-8 strings and buffers are split.  A JSON text is one document,
+     * and the line index is kept by a single scanner.
+     */
+
+    if (threads < 2 || parser->json_mode || parser->line_index
+            || parser->read_handler != yaml_string_read_handler
+            || (parser->encoding != YAML_ANY_ENCODING
+                && parser->encoding != YAML_UTF8_ENCODING))
+        return yaml_stream_load_sequential(parser, handler, data);
+
+    input = parser->input.string.start;
+    size = parser->input.string.end - parser->input.string.start;
+
+    if (size < 2*PARALLEL_SHARD_SIZE || (size >= 2
+                && (memcmp(input, BOM_UTF16LE, 2) == 0
+                    || memcmp(input, BOM_UTF16BE, 2) == 0)))
+        return yaml_stream_load_sequential(parser, handler, data);
+
+    memset(&parallel, 0, sizeof(parallel));
+    parallel.parser = parser;
+    parallel.window = PARALLEL_WINDOW * (size_t)threads;
+
+    if (!STACK_INIT(parser, parallel.shards, yaml_shard_t*))
+        return 0;
+
+    if (!yaml_stream_split(&parallel, input, size)) {
+        STACK_DEL(parser, parallel.shards);
+        return 0;
+    }
+
+    if (parallel.shards.top - parallel.shards.start < 2) {
+        STACK_DEL(parser, parallel.shards);
+        return yaml_stream_load_sequential(parser, handler, data);
+    }
+
+    if ((size_t)threads > (size_t)(parallel.shards.top - parallel.shards.start))
+        threads = parallel.shards.top - parallel.shards.start;
+
+    /* Start the workers.  If none can be started, load sequentially. */
+
+    if (pthread_mutex_init(&parallel.mutex, NULL) != 0) {
+        STACK_DEL(parser, parallel.shards);
+        return yaml_stream_load_sequential(parser, handler, data);
+    }
+    pthread_cond_init(&parallel.loaded, NULL);
+    pthread_cond_init(&parallel.consumed, NULL);
+
+    workers = (pthread_t *)yaml_malloc_with(parser->allocator,
+            threads*sizeof(*workers));
+    if (workers) {
+        while (workers_count < threads
+                && pthread_create(workers + workers_count, NULL,
+                    yaml_parallel_worker, &parallel) == 0) {
+            workers_count ++;
+        }
+    }
+
+    /* Deliver the documents in order as the parts are loaded. */
+
+    index = 0;
+    if (workers_count) {
+        for (; parallel.shards.start + index != parallel.shards.top;
+                index ++) {
+            yaml_document_t *document;
+
+            shard = parallel.shards.start + index;
+
+            pthread_mutex_lock(&parallel.mutex);
+            while (!shard->loaded) {
+                pthread_cond_wait(&parallel.loaded, &parallel.mutex);
+            }
+            pthread_mutex_unlock(&parallel.mutex);
+
+            if (shard->failed)
+                break;
+
+            for (document = shard->documents.start;
+                    document != shard->documents.top; document ++) {
+                yaml_document_t copy = *document;
+                memset(document, 0, sizeof(yaml_document_t));
+                if (!handler(data, &copy)) {
+                    stopped = 1;
+                    break;
+                }
+            }
+            if (stopped)
+                break;
+
+            pthread_mutex_lock(&parallel.mutex);
+            parallel.delivered = index+1;
+            pthread_cond_broadcast(&parallel.consumed);
+            pthread_mutex_unlock(&parallel.mutex);
+        }
+    }
+
+    /* Stop the workers. */
+
+    pthread_mutex_lock(&parallel.mutex);
+    parallel.stop = 1;
+    pthread_cond_broadcast(&parallel.consumed);
+    pthread_mutex_unlock(&parallel.mutex);
+
+    while (workers_count) {
+        pthread_join(workers[--workers_count], NULL);
+    }
+
+    /*
+     * Load the rest of the stream sequentially from a part that failed.  The
+     * part may have been cut in the middle of a construct that the rest of
+     * the stream completes, or it has a genuine error to report.
+     */
+
+    if (stopped) {
+        result = 0;
+    }
+    else if (parallel.shards.start + index != parallel.shards.top) {
+        shard = parallel.shards.start + index;
+        memset(&fallback, 0, sizeof(fallback));
+        fallback.start = shard->start;
+        fallback.size = size - shard->offset;
+        fallback.offset = shard->offset;
+        fallback.mark = shard->mark;
+        result = yaml_shard_load(&parallel, &fallback, handler, data);
+    }
+
+    /* Clean up. */
+
+    for (shard = parallel.shards.start; shard != parallel.shards.top;
+            shard ++) {
+        while (!STACK_EMPTY(parser, shard->documents)) {
+            yaml_document_delete(&POP(parser, shard->documents));
+        }
+        STACK_DEL(parser, shard->documents);
+    }
+    STACK_DEL(parser, parallel.shards);
+    yaml_free_with(parser->allocator, workers);
+    pthread_cond_destroy(&parallel.consumed);
+    pthread_cond_destroy(&parallel.loaded);
+    pthread_mutex_destroy(&parallel.mutex);
+
+    return result;
+
+#else
+    (void)threads;
+
+    return yaml_stream_load_sequential(parser, handler, data);
+#endif
+}
+
+/*
+ * Load all documents of a stream with the application parser.
+ */
+
+static int
+yaml_stream_load_sequential(yaml_parser_t *parser,
+        yaml_document_handler_t *handler, void *data)
+{
+    yaml_document_t document;
+
+    while (1) {
+        if (!yaml_parser_load(parser, &document))
+            return 0;
+        if (!yaml_document_get_root_node(&document)) {
+            yaml_document_delete(&document);
+            return 1;
+        }
+        if (!handler(data, &document))
+            return 0;
+    }
+}
+
+#if HAVE_PTHREAD
+
+/*
+ * Split a stream into parts of at least PARALLEL_SHARD_SIZE bytes.
+ *
+ * A part starts at a document start marker (---) in the first column.  The
+ * scanner treats such a line as a document start everywhere: block scalars
+ * are indented by at least one space, and plain and quoted scalars end or
+ * fail there.  So every part that loads on its own loads exactly as within
+ * the stream, and a cut in the middle of a construct makes the part fail,
+ * which is caught by the sequential fallback.
+ *
+ * Directives belong to the next document and are moved to the next part
+ * together with the marker, but only after a document end marker (...),
+ * where the stream allows them.  The line breaks and the characters are
+ * counted as the reader and the scanner count them, to place the parts in
+ * the stream.
+ */
+
+static int
+yaml_stream_split(yaml_parallel_t *parallel,
+        const unsigned char *input, size_t size)
+{
+    yaml_parser_t *parser = parallel->parser;
+    const unsigned char *pointer = input;
+    const unsigned char *end = input + size;
+    const unsigned char *directives = NULL;
+    yaml_mark_t directives_mark = { 0, 0, 0 };
+    yaml_mark_t mark = { 0, 0, 0 };
+    int document_end = 1;
+    yaml_shard_t shard;
+
+    memset(&shard, 0, sizeof(shard));
+    shard.start = input;
+
+    /* The byte order mark is not a character. */
+
+    if (size >= 3 && memcmp(input, BOM_UTF8, 3) == 0) {
+        pointer += 3;
+    }
+
+    while (pointer != end)
+    {
+        const unsigned char *line = pointer;
+        yaml_mark_t line_mark = mark;
+        size_t rest = end - pointer;
+
+        /* Classify the line. */
+
+        if (rest >= 3 && (memcmp(line, "---", 3) == 0
+                    || memcmp(line, "...", 3) == 0)
+                && (rest == 3 || line[3] == ' ' || line[3] == '\t'
+                    || line[3] == '\r' || line[3] == '\n'))
+        {
+            if (line[0] == '-') {
+                const unsigned char *boundary = directives ? directives : line;
+                yaml_mark_t boundary_mark
+                    = directives ? directives_mark : line_mark;
+
+                if ((size_t)(boundary - shard.start) >= PARALLEL_SHARD_SIZE) {
+                    shard.size = boundary - shard.start;
+                    if (!PUSH(parser, parallel->shards, shard))
+                        return 0;
+                    shard.start = boundary;
+                    shard.offset = boundary - input;
+                    shard.mark = boundary_mark;
+                }
+                document_end = 0;
+            }
+            else {
+                document_end = 1;
+            }
+            directives = NULL;
+        }
+        else if (line[0] == '%' && document_end) {
+            if (!directives) {
+                directives = line;
+                directives_mark = line_mark;
+            }
+        }
+        else {
+            const unsigned char *blank = line;
+            while (blank != end && (*blank == ' ' || *blank == '\t')) {
+                blank ++;
+            }
+            if (blank != end && *blank != '#' && *blank != '\r'
+                    && *blank != '\n') {
+                document_end = 0;
+                directives = NULL;
+            }
+        }
+
+        /* Move to the next line. */
+
+        while (pointer != end)
+        {
+            unsigned char octet = *pointer;
+
+            if (octet == '\n') {
+                pointer ++;
+                mark.index ++;
+                mark.line ++;
+                break;
+            }
+            if (octet == '\r') {
+                pointer ++;
+                mark.index ++;
+                if (pointer != end && *pointer == '\n') {
+                    pointer ++;
+                    mark.index ++;
+                }
+                mark.line ++;
+                break;
+            }
+            if (octet == 0xC2 && end - pointer >= 2 && pointer[1] == 0x85) {
+                pointer += 2;                       /* NEL (#x85) */
+                mark.index ++;
+                mark.line ++;
+                break;
+            }
+            if (octet == 0xE2 && end - pointer >= 3 && pointer[1] == 0x80
+                    && (pointer[2] == 0xA8 || pointer[2] == 0xA9)) {
+                pointer += 3;                       /* LS (#x2028), PS (#x2029) */
+                mark.index ++;
+                mark.line ++;
+                break;
+            }
+            if ((octet & 0xC0) != 0x80) {
+                mark.index ++;
+            }
+            pointer ++;
+        }
+    }
+
+    shard.size = end - shard.start;
+
+    return PUSH(parser, parallel->shards, shard);
+}
+
+/*
+ * Load the documents of a part.
+ *
+ * Without a handler, the documents are kept in the part and a failure is
+ * recorded there.  With a handler, the documents are delivered and an error is
+ * reported in the application parser.
+ */
+
+static int
+yaml_shard_load(yaml_parallel_t *parallel, yaml_shard_t *shard,
+        yaml_document_handler_t *handler, void *data)
+{
+    struct {
+        yaml_error_type_t error;
+        const yaml_allocator_t *allocator;
+    } context;
+    yaml_parser_t parser;
+    yaml_document_t document;
+
+    context.error = YAML_NO_ERROR;
+    context.allocator = parallel->parser->allocator;
+
+    if (!handler && !STACK_INIT(&context, shard->documents, yaml_document_t*))
+        goto error;
+
+    if (!yaml_parser_initialize_with_allocator(&parser, context.allocator)) {
+        if (handler) {
+            parallel->parser->error = YAML_MEMORY_ERROR;
+        }
+        goto error;
+    }
+    yaml_parser_set_input_buffer_zerocopy(&parser, shard->start, shard->size);
+    yaml_parser_set_document_arena(&parser, parallel->parser->document_arena);
+    yaml_parser_set_limits(&parser, &parallel->parser->limits);
+
+    while (1)
+    {
+        if (!yaml_parser_load(&parser, &document)) {
+            if (handler) {
+                yaml_shard_set_error(parallel->parser, &parser, shard);
+            }
+            yaml_parser_delete(&parser);
+            goto error;
+        }
+
+        if (!yaml_document_get_root_node(&document)) {
+            yaml_document_delete(&document);
+            break;
+        }
+
+        yaml_shard_translate_document(&document, shard->mark);
+
+        if (handler) {
+            if (!handler(data, &document)) {
+                yaml_parser_delete(&parser);
+                return 0;
+            }
+        }
+        else if (!PUSH(&context, shard->documents, document)) {
+            yaml_document_delete(&document);
+            yaml_parser_delete(&parser);
+            goto error;
+        }
+    }
+
+    yaml_parser_delete(&parser);
+
+    return 1;
+
+error:
+
+    shard->failed = 1;
+
+    return 0;
+}
+
+/*
+ * Move a mark of a part to the stream.
+ */
+
+static void
+yaml_shard_translate_mark(yaml_mark_t *mark, yaml_mark_t base)
+{
+    mark->index += base.index;
+    mark->line += base.line;
+}
+
+/*
+ * Move the marks of a document of a part to the stream.
+ */
+
+static void
+yaml_shard_translate_document(yaml_document_t *document, yaml_mark_t base)
+{
+    yaml_node_t *node;
+
+    if (!base.index)
+        return;
+
+    yaml_shard_translate_mark(&document->start_mark, base);
+    yaml_shard_translate_mark(&document->end_mark, base);
+
+    for (node = document->nodes.start; node != document->nodes.top; node ++) {
+        yaml_shard_translate_mark(&node->start_mark, base);
+        yaml_shard_translate_mark(&node->end_mark, base);
+    }
+}
+
+/*
+ * Report the error of a part parser in the application parser.
+ */
+
+static void
+yaml_shard_set_error(yaml_parser_t *parser, yaml_parser_t *shard_parser,
+        yaml_shard_t *shard)
+{
+    parser->error = shard_parser->error;
+    parser->problem = shard_parser->problem;
+    parser->problem_offset = shard_parser->problem_offset;
+    parser->problem_value = shard_parser->problem_value;
+    parser->problem_mark = shard_parser->problem_mark;
+    parser->context = shard_parser->context;
+    parser->context_mark = shard_parser->context_mark;
+
+    if (parser->error == YAML_READER_ERROR) {
+        parser->problem_offset += shard->offset;
+    }
+    else if (parser->error != YAML_MEMORY_ERROR) {
+        yaml_shard_translate_mark(&parser->problem_mark, shard->mark);
+        if (parser->context) {
+            yaml_shard_translate_mark(&parser->context_mark, shard->mark);
+        }
+    }
+}
+
+/*
+ * Load parts until all are taken or the delivering thread stops the workers.
+ */
+
+static void *
+yaml_parallel_worker(void *data)
+{
+    yaml_parallel_t *parallel = (yaml_parallel_t *)data;
+    size_t count = parallel->shards.top - parallel->shards.start;
+
+    pthread_mutex_lock(&parallel->mutex);
+
+    while (!parallel->stop && parallel->next < count)
+    {
+        yaml_shard_t *shard;
+
+        /* Do not run too far ahead of the delivered parts. */
+
+        if (parallel->next >= parallel->delivered + parallel->window) {
+            pthread_cond_wait(&parallel->consumed, &parallel->mutex);
+            continue;
+        }
+
+        shard = parallel->shards.start + parallel->next ++;
+
+        pthread_mutex_unlock(&parallel->mutex);
+        yaml_shard_load(parallel, shard, NULL, NULL);
+        pthread_mutex_lock(&parallel->mutex);
+
+        shard->loaded = 1;
+        pthread_cond_broadcast(&parallel->loaded);
+    }
+
+    pthread_mutex_unlock(&parallel->mutex);
+
+    return NULL;
+}
+
+/*
+ * Swap the input and the reader state of two parsers.  Each parser keeps
+ * owning the buffers it holds.
+ */
+
+static void
+yaml_pipeline_swap_reader(yaml_parser_t *a, yaml_parser_t *b)
+{
+    yaml_parser_t t;
+
+    memcpy(&t, a, sizeof(yaml_parser_t));
+
+    a->read_handler = b->read_handler;
+    a->read_handler_data = b->read_handler_data == b ?
+        (void *)a : b->read_handler_data;
+    a->input = b->input;
+    a->input_path = b->input_path;
+    a->eof = b->eof;
+    a->buffer = b->buffer;
+    a->unread = b->unread;
+    a->raw_buffer = b->raw_buffer;
+    a->encoding = b->encoding;
+    a->offset = b->offset;
+    a->zerocopy = b->zerocopy;
+
+    b->read_handler = t.read_handler;
+    b->read_handler_data = t.read_handler_data == a ?
+        (void *)b : t.read_handler_data;
+    b->input = t.input;
+    b->input_path = t.input_path;
+    b->eof = t.eof;
+    b->buffer = t.buffer;
+    b->unread = t.unread;
+    b->raw_buffer = t.raw_buffer;
+    b->encoding = t.encoding;
+    b->offset = t.offset;
+    b->zerocopy = t.zerocopy;
+}
+
+/*
+ * The scanner thread: fill batches of tokens until the end of the stream, an
+ * error, or until asked to stop.
+ */
+
+static void *
+yaml_pipeline_thread(void *data)
+{
+    struct yaml_pipeline_s *pipeline = (struct yaml_pipeline_s *)data;
+    int done = 0;
+
+    while (!done)
+    {
+        yaml_token_t *batch;
+        size_t size = 0;
+
+        pthread_mutex_lock(&pipeline->mutex);
+        while (pipeline->filled_count - pipeline->taken_count
+                    == PIPELINE_BATCHES && !pipeline->stop) {
+            pthread_cond_wait(&pipeline->taken, &pipeline->mutex);
+        }
+        if (pipeline->stop) {
+            pthread_mutex_unlock(&pipeline->mutex);
+            break;
+        }
+        batch = pipeline->batches[pipeline->filled_count % PIPELINE_BATCHES];
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        while (size < PIPELINE_BATCH_SIZE) {
+            if (!yaml_parser_scan(&pipeline->scanner, batch + size)) {
+                done = 1;
+                break;
+            }
+            if (batch[size++].type == YAML_STREAM_END_TOKEN) {
+                done = 1;
+                break;
+            }
+        }
+
+        pthread_mutex_lock(&pipeline->mutex);
+        if (size) {
+            pipeline->sizes[pipeline->filled_count % PIPELINE_BATCHES] = size;
+            pipeline->filled_count ++;
+        }
+        pipeline->done = done;
+        pthread_cond_signal(&pipeline->filled);
+        pthread_mutex_unlock(&pipeline->mutex);
+    }
+
+    return NULL;
+}
+
+#endif
+
+/*
+ * Start the scanner thread of a pipelined parser.  The input and the state of
+ * the reader are moved to the parser of the thread.  If threads are not
+ * available, the input is pushed, or the thread cannot be created, the input
+ * is scanned in the calling thread.
+ */
+
+YAML_DECLARE(int)
+yaml_parser_start_pipeline(yaml_parser_t *parser)
+{
+#if HAVE_PTHREAD
+    struct yaml_pipeline_s *pipeline;
+    yaml_parser_t *scanner;
+
+    assert(parser);     /* Non-NULL parser object is expected. */
+    assert(!parser->pipeline);  /* The pipeline is started once. */
+
+    parser->pipelined = 0;
+
+    if (parser->read_handler == yaml_feed_read_handler)
+        return 1;
+
+    pipeline = (struct yaml_pipeline_s *)yaml_malloc_with(parser->allocator,
+            sizeof(struct yaml_pipeline_s));
+    if (!pipeline) {
+        parser->error = YAML_MEMORY_ERROR;
+        return 0;
+    }
+    memset(pipeline, 0, sizeof(struct yaml_pipeline_s));
+    scanner = &pipeline->scanner;
+
+    if (!yaml_parser_initialize_with_allocator(scanner, parser->allocator)) {
+        yaml_free_with(parser->allocator, pipeline);
+        parser->error = YAML_MEMORY_ERROR;
+        return 0;
+    }
+
+    if (pthread_mutex_init(&pipeline->mutex, NULL) != 0) {
+        yaml_parser_delete(scanner);
+        yaml_free_with(parser->allocator, pipeline);
+        return 1;
+    }
+    pthread_cond_init(&pipeline->filled, NULL);
+    pthread_cond_init(&pipeline->taken, NULL);
+
+    /* Move the input to the parser of the thread. */
+
+    yaml_pipeline_swap_reader(parser, scanner);
+
+    scanner->limits = parser->limits;
+    scanner->borrowed_scalars = parser->borrowed_scalars;
+    scanner->json_mode = parser->json_mode;
+    scanner->line_index = parser->line_index;
+
+    if (pthread_create(&pipeline->thread, NULL, yaml_pipeline_thread,
+                pipeline) != 0) {
+        yaml_pipeline_swap_reader(parser, scanner);
+        pthread_cond_destroy(&pipeline->taken);
+        pthread_cond_destroy(&pipeline->filled);
+        pthread_mutex_destroy(&pipeline->mutex);
+        yaml_parser_delete(scanner);
+        yaml_free_with(parser->allocator, pipeline);
+        return 1;
+    }
+
+    parser->pipeline = pipeline;
+#else
+    parser->pipelined = 0;
+#endif
+
+    return 1;
+}
+
+/*
+ * Stop the scanner thread and release the pipeline with the tokens that were
+ * not taken.
+ */
+
+YAML_DECLARE(void)
+yaml_parser_stop_pipeline(yaml_parser_t *parser)
+{
+#if HAVE_PTHREAD
+    struct yaml_pipeline_s *pipeline = parser->pipeline;
+
+    if (!pipeline)
+        return;
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->stop = 1;
+    pthread_cond_signal(&pipeline->taken);
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    pthread_join(pipeline->thread, NULL);
+
+    while (pipeline->taken_count != pipeline->filled_count) {
+        size_t index = pipeline->taken_count ++ % PIPELINE_BATCHES;
+        size_t k;
+
+        for (k = 0; k < pipeline->sizes[index]; k ++) {
+            yaml_token_delete(pipeline->batches[index] + k);
+        }
+    }
+
+    pthread_cond_destroy(&pipeline->taken);
+    pthread_cond_destroy(&pipeline->filled);
+    pthread_mutex_destroy(&pipeline->mutex);
+    yaml_parser_delete(&pipeline->scanner);
+    yaml_free_with(parser->allocator, pipeline);
+    parser->pipeline = NULL;
+#else
+    (void)parser;
+#endif
+}
+
+/*
+ * Move the next batch of tokens from the scanner thread to the token queue.
+ * When the scanner is done, report its error.
+ */
+
+YAML_DECLARE(int)
+yaml_parser_fetch_pipelined(yaml_parser_t *parser)
+{
+#if HAVE_PTHREAD
+    struct yaml_pipeline_s *pipeline = parser->pipeline;
+    yaml_parser_t *scanner = &pipeline->scanner;
+    yaml_token_t *batch;
+    size_t size, k;
+
+    pthread_mutex_lock(&pipeline->mutex);
+    while (pipeline->taken_count == pipeline->filled_count
+            && !pipeline->done) {
+        pthread_cond_wait(&pipeline->filled, &pipeline->mutex);
+    }
+    if (pipeline->taken_count == pipeline->filled_count) {
+        pthread_mutex_unlock(&pipeline->mutex);
+        parser->error = scanner->error;
+        parser->problem = scanner->problem;
+        parser->problem_offset = scanner->problem_offset;
+        parser->problem_value = scanner->problem_value;
+        parser->problem_mark = scanner->problem_mark;
+        parser->context = scanner->context;
+        parser->context_mark = scanner->context_mark;
+        return 0;
+    }
+    batch = pipeline->batches[pipeline->taken_count % PIPELINE_BATCHES];
+    size = pipeline->sizes[pipeline->taken_count % PIPELINE_BATCHES];
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    for (k = 0; k < size; k ++) {
+        if (!ENQUEUE(parser, parser->tokens, batch[k]))
+            break;
+    }
+    for (; k < size; k ++) {
+        yaml_token_delete(batch + k);
+    }
+
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->taken_count ++;
+    pthread_cond_signal(&pipeline->taken);
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    /* The first batch starts with STREAM-START. */
+
+    parser->stream_start_produced = 1;
+
+    return !parser->error;
+#else
+    (void)parser;
+
+    return 0;
+#endif
+}
+
+/*
+ * Get the parser of the scanner thread if the thread is done with it.
+ */
+
+YAML_DECLARE(yaml_parser_t *)
+yaml_parser_pipeline_scanner(yaml_parser_t *parser)
+{
+#if HAVE_PTHREAD
+    struct yaml_pipeline_s *pipeline = parser->pipeline;
+    int done;
+
+    pthread_mutex_lock(&pipeline->mutex);
+    done = pipeline->done;
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    return done ? &pipeline->scanner : NULL;
+#else
+    (void)parser;
+
+    return NULL;
+#endif
+}
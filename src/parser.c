@@ -67,6 +67,10 @@
 YAML_DECLARE(int)
 yaml_parser_parse(yaml_parser_t *parser, yaml_event_t *event);
 
+YAML_DECLARE(int)
+yaml_parser_parse_batch(yaml_parser_t *parser, yaml_event_t *events,
+        size_t capacity, size_t *count);
+
 /*
  * Error handling.
  */
@@ -162,6 +166,13 @@ static int
 yaml_parser_append_tag_directive(yaml_parser_t *parser,
         yaml_tag_directive_t value, int allow_duplicates, yaml_mark_t mark);
 
+static yaml_tag_directive_slot_t *
+yaml_parser_find_tag_directive(yaml_parser_t *parser,
+        const yaml_char_t *handle);
+
+static int
+yaml_parser_extend_tag_directive_index(yaml_parser_t *parser);
+
 /*
  * Get the next event.
  */
@@ -183,9 +194,64 @@ yaml_parser_parse(yaml_parser_t *parser, yaml_event_t *event)
         return 1;
     }
 
+    /* With pushed input, make sure that the next step will not wait. */
+
+    if (parser->read_handler == yaml_feed_read_handler
+            && !yaml_parser_fetch_ahead(parser))
+        return 0;
+
     /* Generate the next event. */
 
-    return yaml_parser_state_machine(parser, event);
+    if (!yaml_parser_state_machine(parser, event))
+        return 0;
+
+    event->allocator = parser->allocator;
+
+    return 1;
+}
+
+/*
+ * Get the next events.
+ */
+
+YAML_DECLARE(int)
+yaml_parser_parse_batch(yaml_parser_t *parser, yaml_event_t *events,
+        size_t capacity, size_t *count)
+{
+    yaml_event_t *event = events;
+
+    assert(parser);     /* Non-NULL parser object is expected. */
+    assert(events || !capacity);
+                        /* Non-NULL events array is expected. */
+    assert(count);      /* Non-NULL count is expected. */
+
+    *count = 0;
+
+    /* Run the state machine until the array is full or the stream ends. */
+
+    while (event != events + capacity && !parser->stream_end_produced
+            && !parser->error && parser->state != YAML_PARSE_END_STATE)
+    {
+        memset(event, 0, sizeof(yaml_event_t));
+
+        if (parser->read_handler == yaml_feed_read_handler
+                && !yaml_parser_fetch_ahead(parser)) {
+            *count = event - events;
+            return 0;
+        }
+
+        if (!yaml_parser_state_machine(parser, event)) {
+            *count = event - events;
+            return 0;
+        }
+
+        event->allocator = parser->allocator;
+        event ++;
+    }
+
+    *count = event - events;
+
+    return 1;
 }
 
 /*
@@ -420,13 +486,13 @@ yaml_parser_parse_document_start(yaml_parser_t *parser, yaml_event_t *event,
     }
 
 error:
-    yaml_free(version_directive);
+    yaml_free_with(parser->allocator, version_directive);
     while (tag_directives.start != tag_directives.end) {
-        yaml_free(tag_directives.end[-1].handle);
-        yaml_free(tag_directives.end[-1].prefix);
+        yaml_free_with(parser->allocator, tag_directives.end[-1].handle);
+        yaml_free_with(parser->allocator, tag_directives.end[-1].prefix);
         tag_directives.end --;
     }
-    yaml_free(tag_directives.start);
+    yaml_free_with(parser->allocator, tag_directives.start);
     return 0;
 }
 
@@ -486,8 +552,14 @@ yaml_parser_parse_document_end(yaml_parser_t *parser, yaml_event_t *event)
 
     while (!STACK_EMPTY(parser, parser->tag_directives)) {
         yaml_tag_directive_t tag_directive = POP(parser, parser->tag_directives);
-        yaml_free(tag_directive.handle);
-        yaml_free(tag_directive.prefix);
+        yaml_free_with(parser->allocator, tag_directive.handle);
+        yaml_free_with(parser->allocator, tag_directive.prefix);
+    }
+    if (parser->tag_directive_index.start) {
+        memset(parser->tag_directive_index.start, 0,
+                (parser->tag_directive_index.end
+                 - parser->tag_directive_index.start)
+                * sizeof(*parser->tag_directive_index.start));
     }
 
     parser->state = YAML_PARSE_DOCUMENT_START_STATE;
@@ -594,30 +666,31 @@ yaml_parser_parse_node(yaml_parser_t *parser, yaml_event_t *event,
         if (tag_handle) {
             if (!*tag_handle) {
                 tag = tag_suffix;
-                yaml_free(tag_handle);
+                yaml_free_with(parser->allocator, tag_handle);
                 tag_handle = tag_suffix = NULL;
             }
             else {
-                yaml_tag_directive_t *tag_directive;
-                for (tag_directive = parser->tag_directives.start;
-                        tag_directive != parser->tag_directives.top;
-                        tag_directive ++) {
-                    if (strcmp((char *)tag_directive->handle, (char *)tag_handle) == 0) {
-                        size_t prefix_len = strlen((char *)tag_directive->prefix);
-                        size_t suffix_len = strlen((char *)tag_suffix);
-                        tag = YAML_MALLOC(prefix_len+suffix_len+1);
-                        if (!tag) {
-                            parser->error = YAML_MEMORY_ERROR;
-                            goto error;
-                        }
-                        memcpy(tag, tag_directive->prefix, prefix_len);
-                        memcpy(tag+prefix_len, tag_suffix, suffix_len);
-                        tag[prefix_len+suffix_len] = '\0';
-                        yaml_free(tag_handle);
-                        yaml_free(tag_suffix);
-                        tag_handle = tag_suffix = NULL;
-                        break;
+                yaml_tag_directive_slot_t *slot = NULL;
+                if (parser->tag_directive_index.start) {
+                    slot = yaml_parser_find_tag_directive(parser, tag_handle);
+                }
+                if (slot && slot->directive) {
+                    yaml_char_t *prefix = parser->tag_directives.start
+                        [slot->directive-1].prefix;
+                    size_t prefix_len = slot->prefix_length;
+                    size_t suffix_len = strlen((char *)tag_suffix);
+                    tag = YAML_MALLOC_WITH(parser->allocator,
+                            prefix_len+suffix_len+1);
+                    if (!tag) {
+                        parser->error = YAML_MEMORY_ERROR;
+                        goto error;
                     }
+                    memcpy(tag, prefix, prefix_len);
+                    memcpy(tag+prefix_len, tag_suffix, suffix_len);
+                    tag[prefix_len+suffix_len] = '\0';
+                    yaml_free_with(parser->allocator, tag_handle);
+                    yaml_free_with(parser->allocator, tag_suffix);
+                    tag_handle = tag_suffix = NULL;
                 }
                 if (!tag) {
                     yaml_parser_set_parser_error_context(parser,
@@ -653,6 +726,7 @@ yaml_parser_parse_node(yaml_parser_t *parser, yaml_event_t *event,
                         token->data.scalar.value, token->data.scalar.length,
                         plain_implicit, quoted_implicit,
                         token->data.scalar.style, start_mark, end_mark);
+                event->borrowed = token->borrowed;
                 SKIP_TOKEN(parser);
                 return 1;
             }
@@ -685,7 +759,7 @@ yaml_parser_parse_node(yaml_parser_t *parser, yaml_event_t *event,
                 return 1;
             }
             else if (anchor || tag) {
-                yaml_char_t *value = YAML_MALLOC(1);
+                yaml_char_t *value = YAML_MALLOC_WITH(parser->allocator, 1);
                 if (!value) {
                     parser->error = YAML_MEMORY_ERROR;
                     goto error;
@@ -708,10 +782,10 @@ yaml_parser_parse_node(yaml_parser_t *parser, yaml_event_t *event,
     }
 
 error:
-    yaml_free(anchor);
-    yaml_free(tag_handle);
-    yaml_free(tag_suffix);
-    yaml_free(tag);
+    yaml_free_with(parser->allocator, anchor);
+    yaml_free_with(parser->allocator, tag_handle);
+    yaml_free_with(parser->allocator, tag_suffix);
+    yaml_free_with(parser->allocator, tag);
 
     return 0;
 }
@@ -1208,7 +1282,7 @@ yaml_parser_process_empty_scalar(yaml_parser_t *parser, yaml_event_t *event,
 {
     yaml_char_t *value;
 
-    value = YAML_MALLOC(1);
+    value = YAML_MALLOC_WITH(parser->allocator, 1);
     if (!value) {
         parser->error = YAML_MEMORY_ERROR;
         return 0;
@@ -1269,7 +1343,8 @@ yaml_parser_process_directives(yaml_parser_t *parser,
                         "found incompatible YAML document", token->start_mark);
                 goto error;
             }
-            version_directive = YAML_MALLOC_STATIC(yaml_version_directive_t);
+            version_directive = YAML_MALLOC_STATIC_WITH(parser->allocator,
+                    yaml_version_directive_t);
             if (!version_directive) {
                 parser->error = YAML_MEMORY_ERROR;
                 goto error;
@@ -1320,15 +1395,15 @@ yaml_parser_process_directives(yaml_parser_t *parser,
     }
 
     if (!version_directive_ref)
-        yaml_free(version_directive);
+        yaml_free_with(parser->allocator, version_directive);
     return 1;
 
 error:
-    yaml_free(version_directive);
+    yaml_free_with(parser->allocator, version_directive);
     while (!STACK_EMPTY(parser, tag_directives)) {
         yaml_tag_directive_t tag_directive = POP(parser, tag_directives);
-        yaml_free(tag_directive.handle);
-        yaml_free(tag_directive.prefix);
+        yaml_free_with(parser->allocator, tag_directive.handle);
+        yaml_free_with(parser->allocator, tag_directive.prefix);
     }
     STACK_DEL(parser, tag_directives);
     return 0;
@@ -1342,21 +1417,22 @@ static int
 yaml_parser_append_tag_directive(yaml_parser_t *parser,
         yaml_tag_directive_t value, int allow_duplicates, yaml_mark_t mark)
 {
-    yaml_tag_directive_t *tag_directive;
+    yaml_tag_directive_slot_t *slot;
     yaml_tag_directive_t copy = { NULL, NULL };
 
-    for (tag_directive = parser->tag_directives.start;
-            tag_directive != parser->tag_directives.top; tag_directive ++) {
-        if (strcmp((char *)value.handle, (char *)tag_directive->handle) == 0) {
-            if (allow_duplicates)
-                return 1;
-            return yaml_parser_set_parser_error(parser,
-                    "found duplicate %TAG directive", mark);
-        }
+    if (!yaml_parser_extend_tag_directive_index(parser))
+        return 0;
+
+    slot = yaml_parser_find_tag_directive(parser, value.handle);
+    if (slot->directive) {
+        if (allow_duplicates)
+            return 1;
+        return yaml_parser_set_parser_error(parser,
+                "found duplicate %TAG directive", mark);
     }
 
-    copy.handle = yaml_strdup(value.handle);
-    copy.prefix = yaml_strdup(value.prefix);
+    copy.handle = yaml_strdup_with(parser->allocator, value.handle);
+    copy.prefix = yaml_strdup_with(parser->allocator, value.prefix);
     if (!copy.handle || !copy.prefix) {
         parser->error = YAML_MEMORY_ERROR;
         goto error;
@@ -1365,11 +1441,87 @@ yaml_parser_append_tag_directive(yaml_parser_t *parser,
     if (!PUSH(parser, parser->tag_directives, copy))
         goto error;
 
+    slot->directive = parser->tag_directives.top - parser->tag_directives.start;
+    slot->prefix_length = strlen((char *)copy.prefix);
+
     return 1;
 
 error:
-    yaml_free(copy.handle);
-    yaml_free(copy.prefix);
+    yaml_free_with(parser->allocator, copy.handle);
+    yaml_free_with(parser->allocator, copy.prefix);
     return 0;
 }
 
+/*
+ * Find the slot of a tag handle in the tag directive index.
+ *
+ * Like the anchor index of the loader, the index is an open addressing hash
+ * table with linear probing that is kept at most half full.  The function
+ * returns the slot of the handle or the empty slot where it belongs.
+ */
+
+static yaml_tag_directive_slot_t *
+yaml_parser_find_tag_directive(yaml_parser_t *parser,
+        const yaml_char_t *handle)
+{
+    yaml_tag_directive_slot_t *slots = parser->tag_directive_index.start;
+    size_t mask = parser->tag_directive_index.end - slots - 1;
+    size_t hash;
+
+    for (hash = yaml_string_hash(handle) & mask; slots[hash].directive;
+            hash = (hash+1) & mask) {
+        yaml_tag_directive_t *tag_directive = parser->tag_directives.start
+            + slots[hash].directive - 1;
+        if (strcmp((char *)tag_directive->handle, (char *)handle) == 0)
+            break;
+    }
+
+    return slots + hash;
+}
+
+/*
+ * Make sure the tag directive index has room for one more tag directive.
+ */
+
+static int
+yaml_parser_extend_tag_directive_index(yaml_parser_t *parser)
+{
+    size_t size = parser->tag_directive_index.end
+        - parser->tag_directive_index.start;
+    size_t count = parser->tag_directives.top - parser->tag_directives.start;
+    yaml_tag_directive_slot_t *start;
+
+    if ((count+1)*2 <= size)
+        return 1;
+
+    size = size ? size*2 : INITIAL_TAG_DIRECTIVE_INDEX_SIZE;
+    if (size >= INT_MAX / sizeof(*start)) {
+        parser->error = YAML_MEMORY_ERROR;
+        return 0;
+    }
+
+    start = (yaml_tag_directive_slot_t *)yaml_malloc_with(parser->allocator,
+            size*sizeof(*start));
+    if (!start) {
+        parser->error = YAML_MEMORY_ERROR;
+        return 0;
+    }
+    memset(start, 0, size*sizeof(*start));
+
+    yaml_free_with(parser->allocator, parser->tag_directive_index.start);
+    parser->tag_directive_index.start = start;
+    parser->tag_directive_index.end = start + size;
+
+    for (count = 0; parser->tag_directives.start + count
+            != parser->tag_directives.top; count ++) {
+        yaml_tag_directive_t *tag_directive = parser->tag_directives.start
+            + count;
+        yaml_tag_directive_slot_t *slot = yaml_parser_find_tag_directive(
+                parser, tag_directive->handle);
+        slot->directive = count + 1;
+        slot->prefix_length = strlen((char *)tag_directive->prefix);
+    }
+
+    return 1;
+}
+
@@ -15,6 +15,12 @@ yaml_parser_update_raw_buffer(yaml_parser_t *parser);
 static int
 yaml_parser_determine_encoding(yaml_parser_t *parser);
 
+static int
+yaml_parser_stop_zerocopy(yaml_parser_t *parser, size_t size);
+
+static size_t
+yaml_parser_ascii_span(const unsigned char *start, const unsigned char *end);
+
 YAML_DECLARE(int)
 yaml_parser_update_buffer(yaml_parser_t *parser, size_t length);
 
@@ -34,14 +40,6 @@ yaml_parser_set_reader_error(yaml_parser_t *parser, const char *problem,
     return 0;
 }
 
-/*
- * Byte order marks.
- */
-
-#define BOM_UTF8    "\xef\xbb\xbf"
-#define BOM_UTF16LE "\xff\xfe"
-#define BOM_UTF16BE "\xfe\xff"
-
 /*
  * Determine the input stream encoding by checking the BOM symbol. If no BOM is
  * found, the UTF-8 encoding is assumed. Return 1 on success, 0 on failure.
@@ -95,6 +93,25 @@ yaml_parser_update_raw_buffer(yaml_parser_t *parser)
 {
     size_t size_read = 0;
 
+    /*
+     * For zero-copy input, the raw buffer is a window on the input string.
+     * Extend it by as many bytes as the read handler would have returned.
+     */
+
+    if (parser->zerocopy) {
+        size_read = INPUT_RAW_BUFFER_SIZE
+            - (parser->raw_buffer.last - parser->raw_buffer.pointer);
+        if (!size_read || parser->eof)
+            return 1;
+        if (size_read > (size_t)(parser->raw_buffer.end - parser->raw_buffer.last))
+            size_read = parser->raw_buffer.end - parser->raw_buffer.last;
+        parser->raw_buffer.last += size_read;
+        if (!size_read) {
+            parser->eof = 1;
+        }
+        return 1;
+    }
+
     /* Return if the raw buffer is full. */
 
     if (parser->raw_buffer.start == parser->raw_buffer.pointer
@@ -131,6 +148,180 @@ yaml_parser_update_raw_buffer(yaml_parser_t *parser)
     return 1;
 }
 
+/*
+ * Stop reading the input string in place and allocate the buffers.
+ *
+ * The undecoded part of the raw window is moved into the raw buffer, so that
+ * the string read handler picks up where the window ended.  The unread part
+ * of the working buffer is copied into a new buffer of `size` octets.
+ */
+
+static int
+yaml_parser_stop_zerocopy(yaml_parser_t *parser, size_t size)
+{
+    const unsigned char *raw = parser->raw_buffer.pointer;
+    size_t raw_size = parser->raw_buffer.last - parser->raw_buffer.pointer;
+    const yaml_char_t *unread = parser->buffer.pointer;
+    size_t unread_size = parser->buffer.last - parser->buffer.pointer;
+
+    memset(&parser->raw_buffer, 0, sizeof(parser->raw_buffer));
+    memset(&parser->buffer, 0, sizeof(parser->buffer));
+    parser->zerocopy = 0;
+
+    if (!parser->eof || raw_size) {
+        if (!BUFFER_INIT(parser, parser->raw_buffer, INPUT_RAW_BUFFER_SIZE))
+            return 0;
+        memcpy(parser->raw_buffer.start, raw, raw_size);
+        parser->raw_buffer.last += raw_size;
+        parser->input.string.current = raw + raw_size;
+    }
+
+    if (!BUFFER_INIT(parser, parser->buffer, size))
+        return 0;
+    memcpy(parser->buffer.start, unread, unread_size);
+    parser->buffer.last += unread_size;
+
+    return 1;
+}
+
+/*
+ * Check if an octet is an allowed ASCII character, i.e. #x9, #xA, #xD or
+ * [#x20-#x7E].  Such octets decode to themselves in UTF-8.
+ */
+
+#define IS_ASCII_ALLOWED(octet)                                                 \
+    (((octet) >= 0x20 && (octet) <= 0x7E)                                       \
+     || (octet) == 0x09 || (octet) == 0x0A || (octet) == 0x0D)
+
+/*
+ * Return the number of allowed ASCII octets at the beginning of the range.
+ *
+ * The portable version tests a machine word at a time and only looks at the
+ * individual octets of a word that contains something else than [#x20-#x7E].
+ */
+
+static size_t
+yaml_parser_ascii_span_scalar(const unsigned char *start,
+        const unsigned char *end)
+{
+    const size_t ones = (size_t)-1 / 255;
+    const unsigned char *pointer = start;
+
+    while (end - pointer >= (ptrdiff_t)sizeof(size_t)) {
+        size_t word, tilde;
+        memcpy(&word, pointer, sizeof(size_t));
+        tilde = word ^ (ones * 0x7F);
+        if (((word | ((word - ones * 0x20) & ~word)
+                        | ((tilde - ones) & ~tilde)) & (ones * 0x80)) == 0) {
+            pointer += sizeof(size_t);
+            continue;
+        }
+        break;
+    }
+
+    while (pointer != end && IS_ASCII_ALLOWED(*pointer))
+        pointer ++;
+
+    return pointer - start;
+}
+
+#if defined(YAML_HAVE_SSE2)
+
+/*
+ * SSE2 version: classify 16 octets at a time.
+ */
+
+static size_t
+yaml_parser_ascii_span_sse2(const unsigned char *start,
+        const unsigned char *end)
+{
+    const __m128i space_1 = _mm_set1_epi8(0x1F);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    const __m128i tab = _mm_set1_epi8(0x09);
+    const __m128i lf = _mm_set1_epi8(0x0A);
+    const __m128i cr = _mm_set1_epi8(0x0D);
+    const unsigned char *pointer = start;
+
+    while (end - pointer >= 16) {
+        __m128i octets = _mm_loadu_si128((const __m128i *)pointer);
+
+        /* Octets above #x7F are negative as signed chars. */
+
+        __m128i allowed = _mm_andnot_si128(_mm_cmpeq_epi8(octets, del),
+                _mm_cmpgt_epi8(octets, space_1));
+        unsigned int mask;
+
+        allowed = _mm_or_si128(allowed, _mm_or_si128(_mm_cmpeq_epi8(octets, tab),
+                    _mm_or_si128(_mm_cmpeq_epi8(octets, lf),
+                        _mm_cmpeq_epi8(octets, cr))));
+        mask = (unsigned int)_mm_movemask_epi8(allowed) ^ 0xFFFF;
+        if (mask)
+            return (pointer - start) + YAML_CTZ(mask);
+        pointer += 16;
+    }
+
+    return (pointer - start) + yaml_parser_ascii_span_scalar(pointer, end);
+}
+
+#endif
+
+#if defined(YAML_HAVE_AVX2)
+
+/*
+ * AVX2 version: classify 32 octets at a time.
+ */
+
+YAML_TARGET_AVX2 static size_t
+yaml_parser_ascii_span_avx2(const unsigned char *start,
+        const unsigned char *end)
+{
+    const __m256i space_1 = _mm256_set1_epi8(0x1F);
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    const __m256i tab = _mm256_set1_epi8(0x09);
+    const __m256i lf = _mm256_set1_epi8(0x0A);
+    const __m256i cr = _mm256_set1_epi8(0x0D);
+    const unsigned char *pointer = start;
+
+    while (end - pointer >= 32) {
+        __m256i octets = _mm256_loadu_si256((const __m256i *)pointer);
+        __m256i allowed = _mm256_andnot_si256(_mm256_cmpeq_epi8(octets, del),
+                _mm256_cmpgt_epi8(octets, space_1));
+        unsigned int mask;
+
+        allowed = _mm256_or_si256(allowed,
+                _mm256_or_si256(_mm256_cmpeq_epi8(octets, tab),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(octets, lf),
+                        _mm256_cmpeq_epi8(octets, cr))));
+        mask = ~(unsigned int)_mm256_movemask_epi8(allowed);
+        if (mask)
+            return (pointer - start) + YAML_CTZ(mask);
+        pointer += 32;
+    }
+
+    return (pointer - start) + yaml_parser_ascii_span_scalar(pointer, end);
+}
+
+#endif
+
+/*
+ * Return the number of allowed ASCII octets at the beginning of the range
+ * using the best implementation available on this CPU.
+ */
+
+static size_t
+yaml_parser_ascii_span(const unsigned char *start, const unsigned char *end)
+{
+#if defined(YAML_HAVE_AVX2)
+    if (yaml_cpu_has_avx2())
+        return yaml_parser_ascii_span_avx2(start, end);
+#endif
+#if defined(YAML_HAVE_SSE2)
+    return yaml_parser_ascii_span_sse2(start, end);
+#else
+    return yaml_parser_ascii_span_scalar(start, end);
+#endif
+}
+
 /*
  * Ensure that the buffer contains at least `length` characters.
  * Return 1 on success, 0 on failure.
@@ -162,9 +353,29 @@ yaml_parser_update_buffer(yaml_parser_t *parser, size_t length)
             return 0;
     }
 
+    /*
+     * Zero-copy input is read in place only if it is UTF-8.  The working
+     * buffer starts right after the BOM.
+     */
+
+    if (parser->zerocopy) {
+        if (parser->encoding != YAML_UTF8_ENCODING) {
+            if (!yaml_parser_stop_zerocopy(parser, INPUT_BUFFER_SIZE))
+                return 0;
+        }
+        else if (parser->buffer.last == parser->buffer.start) {
+            parser->buffer.start = parser->raw_buffer.pointer;
+            parser->buffer.pointer = parser->raw_buffer.pointer;
+            parser->buffer.last = parser->raw_buffer.pointer;
+        }
+    }
+
     /* Move the unread characters to the beginning of the buffer. */
 
-    if (parser->buffer.start < parser->buffer.pointer
+    if (parser->zerocopy) {
+        /* The characters are read in place. */
+    }
+    else if (parser->buffer.start < parser->buffer.pointer
             && parser->buffer.pointer < parser->buffer.last) {
         size_t size = parser->buffer.last - parser->buffer.pointer;
         memmove(parser->buffer.start, parser->buffer.pointer, size);
@@ -199,6 +410,27 @@ yaml_parser_update_buffer(yaml_parser_t *parser, size_t length)
             size_t k;
             size_t raw_unread = parser->raw_buffer.last - parser->raw_buffer.pointer;
 
+            /*
+             * Copy a run of allowed ASCII characters in bulk.  Each octet is a
+             * character of its own, so `unread` grows by the run length.
+             */
+
+            if (parser->encoding == YAML_UTF8_ENCODING
+                    && parser->raw_buffer.pointer[0] < 0x80) {
+                size_t run = yaml_parser_ascii_span(parser->raw_buffer.pointer,
+                        parser->raw_buffer.last);
+                if (run) {
+                    if (!parser->zerocopy) {
+                        memcpy(parser->buffer.last, parser->raw_buffer.pointer, run);
+                    }
+                    parser->buffer.last += run;
+                    parser->raw_buffer.pointer += run;
+                    parser->offset += run;
+                    parser->unread += run;
+                    continue;
+                }
+            }
+
             /* Decode the next character. */
 
             switch (parser->encoding)
@@ -424,8 +656,12 @@ yaml_parser_update_buffer(yaml_parser_t *parser, size_t length)
 
             /* Finally put the character into the buffer. */
 
+            /* Zero-copy input: the character is already there. */
+            if (parser->zerocopy) {
+                parser->buffer.last += width;
+            }
             /* 0000 0000-0000 007F -> 0xxxxxxx */
-            if (value <= 0x7F) {
+            else if (value <= 0x7F) {
                 *(parser->buffer.last++) = value;
             }
             /* 0000 0080-0000 07FF -> 110xxxxx 10xxxxxx */
@@ -453,6 +689,11 @@ yaml_parser_update_buffer(yaml_parser_t *parser, size_t length)
         /* On EOF, put NUL into the buffer and return. */
 
         if (parser->eof) {
+            if (parser->zerocopy) {
+                if (!yaml_parser_stop_zerocopy(parser,
+                            parser->buffer.last - parser->buffer.pointer + 1))
+                    return 0;
+            }
             *(parser->buffer.last++) = '\0';
             parser->unread ++;
             return 1;
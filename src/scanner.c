@@ -488,6 +488,16 @@
         ? 1                                                                     \
         : yaml_parser_update_buffer(parser, (length)))
 
+/*
+ * Record the start of the current line in the line index, if it is kept.  A
+ * line is recorded once, even if its start is scanned again.
+ */
+
+#define INDEX_LINE(parser,mark)                                                 \
+    ((parser)->line_index                                                       \
+     && (mark).line > (size_t)((parser)->lines.top - (parser)->lines.start)     \
+     && yaml_parser_index_line((parser), (mark).index))
+
 /*
  * Advance the buffer pointer.
  */
@@ -503,12 +513,14 @@
       (parser->mark.index += 2,                                                 \
        parser->mark.column = 0,                                                 \
        parser->mark.line ++,                                                    \
+       INDEX_LINE(parser,parser->mark),                                         \
        parser->unread -= 2,                                                     \
        parser->buffer.pointer += 2) :                                           \
       IS_BREAK(parser->buffer) ?                                                \
       (parser->mark.index ++,                                                   \
        parser->mark.column = 0,                                                 \
        parser->mark.line ++,                                                    \
+       INDEX_LINE(parser,parser->mark),                                         \
        parser->unread --,                                                       \
        parser->buffer.pointer += WIDTH(parser->buffer)) : 0)
 
@@ -537,6 +549,7 @@
       parser->mark.index += 2,                                                  \
       parser->mark.column = 0,                                                  \
       parser->mark.line ++,                                                     \
+      INDEX_LINE(parser,parser->mark),                                          \
       parser->unread -= 2) :                                                    \
      (CHECK_AT(parser->buffer,'\r',0)                                           \
       || CHECK_AT(parser->buffer,'\n',0)) ?         /* CR|LF -> LF */           \
@@ -545,6 +558,7 @@
       parser->mark.index ++,                                                    \
       parser->mark.column = 0,                                                  \
       parser->mark.line ++,                                                     \
+      INDEX_LINE(parser,parser->mark),                                          \
       parser->unread --) :                                                      \
      (CHECK_AT(parser->buffer,'\xC2',0)                                         \
       && CHECK_AT(parser->buffer,'\x85',1)) ?       /* NEL -> LF */             \
@@ -553,6 +567,7 @@
       parser->mark.index ++,                                                    \
       parser->mark.column = 0,                                                  \
       parser->mark.line ++,                                                     \
+      INDEX_LINE(parser,parser->mark),                                          \
       parser->unread --) :                                                      \
      (CHECK_AT(parser->buffer,'\xE2',0) &&                                      \
       CHECK_AT(parser->buffer,'\x80',1) &&                                      \
@@ -564,9 +579,222 @@
       parser->mark.index ++,                                                    \
       parser->mark.column = 0,                                                  \
       parser->mark.line ++,                                                     \
+      INDEX_LINE(parser,parser->mark),                                          \
       parser->unread --) : 0),                                                  \
     1) : 0)
 
+/*
+ * Advance the buffer pointer over a run of ASCII characters.
+ */
+
+#define SKIP_ASCII(parser,length)                                               \
+     (parser->mark.index += (length),                                           \
+      parser->mark.column += (length),                                          \
+      parser->unread -= (length),                                               \
+      parser->buffer.pointer += (length))
+
+/*
+ * Bulk scanning kernels.
+ *
+ * The decoded buffer holds only #x9, #xA, #xD, [#x20-#x7E], UTF-8 sequences
+ * and the final NUL, so a run of octets in [#x20-#x7E] is a run of characters
+ * of width 1 and the mark can be advanced arithmetically.
+ *
+ * A plain run is made of the characters in [#x21-#x7E] except ':', ',', '[',
+ * ']', '{' and '}', which never end a plain scalar.  A comment run is made of
+ * tabs and the characters in [#x20-#x7E], which never end a comment.
+ */
+
+#define IS_PLAIN_RUN_OCTET(octet)                                               \
+    ((octet) > 0x20 && (octet) < 0x7F && (octet) != ':' && (octet) != ','      \
+     && ((octet) | 0x20) != '{' && ((octet) | 0x20) != '}')
+
+#define IS_COMMENT_RUN_OCTET(octet)                                             \
+    (((octet) >= 0x20 && (octet) < 0x7F) || (octet) == '\t')
+
+static size_t
+yaml_parser_plain_span_scalar(const yaml_char_t *start, const yaml_char_t *end)
+{
+    const yaml_char_t *pointer = start;
+
+    while (pointer != end && IS_PLAIN_RUN_OCTET(*pointer))
+        pointer ++;
+
+    return pointer - start;
+}
+
+static size_t
+yaml_parser_comment_span_scalar(const yaml_char_t *start, const yaml_char_t *end)
+{
+    const yaml_char_t *pointer = start;
+
+    while (pointer != end && IS_COMMENT_RUN_OCTET(*pointer))
+        pointer ++;
+
+    return pointer - start;
+}
+
+#if defined(YAML_HAVE_SSE2)
+
+/*
+ * SSE2 versions: classify 16 octets at a time.  Octets above #x7F are
+ * negative as signed chars, and '|' #x20 maps '[' and ']' to '{' and '}'.
+ */
+
+static size_t
+yaml_parser_plain_span_sse2(const yaml_char_t *start, const yaml_char_t *end)
+{
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i left = _mm_set1_epi8('{');
+    const __m128i right = _mm_set1_epi8('}');
+    const yaml_char_t *pointer = start;
+
+    while (end - pointer >= 16) {
+        __m128i octets = _mm_loadu_si128((const __m128i *)pointer);
+        __m128i folded = _mm_or_si128(octets, space);
+        __m128i stops = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(octets, colon),
+                    _mm_cmpeq_epi8(octets, comma)),
+                _mm_or_si128(_mm_cmpeq_epi8(folded, left),
+                    _mm_cmpeq_epi8(folded, right)));
+        __m128i allowed = _mm_andnot_si128(
+                _mm_or_si128(stops, _mm_cmpeq_epi8(octets, del)),
+                _mm_cmpgt_epi8(octets, space));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(allowed) ^ 0xFFFF;
+        if (mask)
+            return (pointer - start) + YAML_CTZ(mask);
+        pointer += 16;
+    }
+
+    return (pointer - start) + yaml_parser_plain_span_scalar(pointer, end);
+}
+
+static size_t
+yaml_parser_comment_span_sse2(const yaml_char_t *start, const yaml_char_t *end)
+{
+    const __m128i space_1 = _mm_set1_epi8(0x1F);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const yaml_char_t *pointer = start;
+
+    while (end - pointer >= 16) {
+        __m128i octets = _mm_loadu_si128((const __m128i *)pointer);
+        __m128i allowed = _mm_or_si128(_mm_cmpeq_epi8(octets, tab),
+                _mm_andnot_si128(_mm_cmpeq_epi8(octets, del),
+                    _mm_cmpgt_epi8(octets, space_1)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(allowed) ^ 0xFFFF;
+        if (mask)
+            return (pointer - start) + YAML_CTZ(mask);
+        pointer += 16;
+    }
+
+    return (pointer - start) + yaml_parser_comment_span_scalar(pointer, end);
+}
+
+#endif
+
+#if defined(YAML_HAVE_AVX2)
+
+/*
+ * AVX2 versions: classify 32 octets at a time.
+ */
+
+YAML_TARGET_AVX2 static size_t
+yaml_parser_plain_span_avx2(const yaml_char_t *start, const yaml_char_t *end)
+{
+    const __m256i space = _mm256_set1_epi8(0x20);
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i left = _mm256_set1_epi8('{');
+    const __m256i right = _mm256_set1_epi8('}');
+    const yaml_char_t *pointer = start;
+
+    while (end - pointer >= 32) {
+        __m256i octets = _mm256_loadu_si256((const __m256i *)pointer);
+        __m256i folded = _mm256_or_si256(octets, space);
+        __m256i stops = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(octets, colon),
+                    _mm256_cmpeq_epi8(octets, comma)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(folded, left),
+                    _mm256_cmpeq_epi8(folded, right)));
+        __m256i allowed = _mm256_andnot_si256(
+                _mm256_or_si256(stops, _mm256_cmpeq_epi8(octets, del)),
+                _mm256_cmpgt_epi8(octets, space));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(allowed);
+        if (mask)
+            return (pointer - start) + YAML_CTZ(mask);
+        pointer += 32;
+    }
+
+    return (pointer - start) + yaml_parser_plain_span_scalar(pointer, end);
+}
+
+YAML_TARGET_AVX2 static size_t
+yaml_parser_comment_span_avx2(const yaml_char_t *start, const yaml_char_t *end)
+{
+    const __m256i space_1 = _mm256_set1_epi8(0x1F);
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const yaml_char_t *pointer = start;
+
+    while (end - pointer >= 32) {
+        __m256i octets = _mm256_loadu_si256((const __m256i *)pointer);
+        __m256i allowed = _mm256_or_si256(_mm256_cmpeq_epi8(octets, tab),
+                _mm256_andnot_si256(_mm256_cmpeq_epi8(octets, del),
+                    _mm256_cmpgt_epi8(octets, space_1)));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(allowed);
+        if (mask)
+            return (pointer - start) + YAML_CTZ(mask);
+        pointer += 32;
+    }
+
+    return (pointer - start) + yaml_parser_comment_span_scalar(pointer, end);
+}
+
+#endif
+
+/*
+ * Return the length of the plain run at the beginning of the range using the
+ * best implementation available on this CPU.
+ */
+
+static size_t
+yaml_parser_plain_span(const yaml_char_t *start, const yaml_char_t *end)
+{
+#if defined(YAML_HAVE_AVX2)
+    if (yaml_cpu_has_avx2())
+        return yaml_parser_plain_span_avx2(start, end);
+#endif
+#if defined(YAML_HAVE_SSE2)
+    return yaml_parser_plain_span_sse2(start, end);
+#else
+    return yaml_parser_plain_span_scalar(start, end);
+#endif
+}
+
+/*
+ * Return the length of the comment run at the beginning of the range using
+ * the best implementation available on this CPU.
+ */
+
+static size_t
+yaml_parser_comment_span(const yaml_char_t *start, const yaml_char_t *end)
+{
+#if defined(YAML_HAVE_AVX2)
+    if (yaml_cpu_has_avx2())
+        return yaml_parser_comment_span_avx2(start, end);
+#endif
+#if defined(YAML_HAVE_SSE2)
+    return yaml_parser_comment_span_sse2(start, end);
+#else
+    return yaml_parser_comment_span_scalar(start, end);
+#endif
+}
+
 /*
  * Public API declarations.
  */
@@ -582,6 +810,40 @@ static int
 yaml_parser_set_scanner_error(yaml_parser_t *parser, const char *context,
         yaml_mark_t context_mark, const char *problem);
 
+static int
+yaml_parser_set_limit_error(yaml_parser_t *parser, const char *problem,
+        yaml_mark_t problem_mark);
+
+/*
+ * Resource limits.
+ */
+
+static int
+yaml_parser_check_depth(yaml_parser_t *parser, yaml_mark_t mark);
+
+static int
+yaml_parser_check_scalar_length(yaml_parser_t *parser, yaml_token_t *token);
+
+static int
+yaml_parser_check_scalar_limits(yaml_parser_t *parser, size_t length,
+        yaml_mark_t start_mark);
+
+/*
+ * Check the limits in the middle of a scalar, if any limit is set.
+ */
+
+#define SCALAR_LIMITS(parser,length,start_mark)                                 \
+    (!((parser)->limits.max_scalar_length                                      \
+       || (parser)->limits.max_document_length)                                \
+     || yaml_parser_check_scalar_limits((parser),(length),(start_mark)))
+
+/*
+ * Line index.
+ */
+
+static int
+yaml_parser_index_line(yaml_parser_t *parser, size_t index);
+
 /*
  * High-level token API.
  */
@@ -592,6 +854,12 @@ yaml_parser_fetch_more_tokens(yaml_parser_t *parser);
 static int
 yaml_parser_fetch_next_token(yaml_parser_t *parser);
 
+static int
+yaml_parser_fetch_fed_token(yaml_parser_t *parser);
+
+YAML_DECLARE(int)
+yaml_parser_fetch_ahead(yaml_parser_t *parser);
+
 /*
  * Potential simple keys.
  */
@@ -719,6 +987,18 @@ static int
 yaml_parser_scan_uri_escapes(yaml_parser_t *parser, int directive,
         yaml_mark_t start_mark, yaml_string_t *string);
 
+static int
+yaml_parser_take_scratch(yaml_parser_t *parser, int index,
+        yaml_string_t *string, int clear);
+
+static void
+yaml_parser_give_scratch(yaml_parser_t *parser, int index,
+        yaml_string_t *string);
+
+static int
+yaml_parser_copy_scratch(yaml_parser_t *parser, yaml_string_t *string,
+        yaml_char_t **value, size_t *length);
+
 static int
 yaml_parser_scan_block_scalar(yaml_parser_t *parser, yaml_token_t *token,
         int literal);
@@ -735,6 +1015,46 @@ yaml_parser_scan_flow_scalar(yaml_parser_t *parser, yaml_token_t *token,
 static int
 yaml_parser_scan_plain_scalar(yaml_parser_t *parser, yaml_token_t *token);
 
+static int
+yaml_parser_borrow_flow_scalar(yaml_parser_t *parser, yaml_token_t *token,
+        int single);
+
+static int
+yaml_parser_borrow_plain_scalar(yaml_parser_t *parser, yaml_token_t *token);
+
+/*
+ * JSON scanning.
+ */
+
+static int
+yaml_parser_fetch_json_token(yaml_parser_t *parser);
+
+static int
+yaml_parser_fetch_json_value(yaml_parser_t *parser);
+
+static int
+yaml_parser_fetch_json_collection_end(yaml_parser_t *parser);
+
+static int
+yaml_parser_fetch_json_indicator(yaml_parser_t *parser,
+        yaml_token_type_t type);
+
+static int
+yaml_parser_fetch_json_scalar(yaml_parser_t *parser);
+
+static int
+yaml_parser_scan_json_string(yaml_parser_t *parser, yaml_token_t *token);
+
+static int
+yaml_parser_scan_json_code_unit(yaml_parser_t *parser, yaml_mark_t start_mark,
+        unsigned int *value);
+
+static int
+yaml_parser_scan_json_plain(yaml_parser_t *parser, yaml_token_t *token);
+
+static int
+yaml_parser_set_json_error(yaml_parser_t *parser, const char *problem);
+
 /*
  * Get the next token.
  */
@@ -765,6 +1085,7 @@ yaml_parser_scan(yaml_parser_t *parser, yaml_token_t *token)
     /* Fetch the next token from the queue. */
 
     *token = DEQUEUE(parser, parser->tokens);
+    token->allocator = parser->allocator;
     parser->token_available = 0;
     parser->tokens_parsed ++;
 
@@ -792,6 +1113,114 @@ yaml_parser_set_scanner_error(yaml_parser_t *parser, const char *context,
     return 0;
 }
 
+/*
+ * Set the limit error and return 0.
+ */
+
+static int
+yaml_parser_set_limit_error(yaml_parser_t *parser, const char *problem,
+        yaml_mark_t problem_mark)
+{
+    parser->error = YAML_LIMIT_ERROR;
+    parser->problem = problem;
+    parser->problem_mark = problem_mark;
+
+    return 0;
+}
+
+/*
+ * Check that a new collection does not exceed the maximum nesting depth.  The
+ * open collections are the block indentation levels and the flow levels.
+ */
+
+static int
+yaml_parser_check_depth(yaml_parser_t *parser, yaml_mark_t mark)
+{
+    if (parser->limits.max_depth
+            && (size_t)(parser->indents.top - parser->indents.start)
+                + parser->flow_level >= parser->limits.max_depth)
+        return yaml_parser_set_limit_error(parser,
+                "exceeded the maximum nesting depth", mark);
+
+    return 1;
+}
+
+/*
+ * Check the length of a SCALAR token.  The scanners that copy the value also
+ * check it while scanning, see yaml_parser_check_scalar_limits().
+ */
+
+static int
+yaml_parser_check_scalar_length(yaml_parser_t *parser, yaml_token_t *token)
+{
+    if (parser->limits.max_scalar_length
+            && token->data.scalar.length > parser->limits.max_scalar_length)
+        return yaml_parser_set_limit_error(parser,
+                "exceeded the maximum scalar length", token->start_mark);
+
+    return 1;
+}
+
+/*
+ * Check the length of a scalar and of the current document while the scalar
+ * is scanned, so that the memory spent on an oversized scalar stays bounded
+ * by the limits.  The value scanned so far is a prefix of the final value and
+ * the mark only moves forward, so the outcome is the same as checking the
+ * finished token.
+ */
+
+static int
+yaml_parser_check_scalar_limits(yaml_parser_t *parser, size_t length,
+        yaml_mark_t start_mark)
+{
+    if (parser->limits.max_scalar_length
+            && length > parser->limits.max_scalar_length)
+        return yaml_parser_set_limit_error(parser,
+                "exceeded the maximum scalar length", start_mark);
+
+    if (parser->limits.max_document_length
+            && parser->mark.index - parser->document_index
+                > parser->limits.max_document_length)
+        return yaml_parser_set_limit_error(parser,
+                "exceeded the maximum document length", parser->mark);
+
+    return 1;
+}
+
+/*
+ * Push the start of a line to the line index.  If the index cannot grow, it
+ * is dropped rather than failing the scan.
+ */
+
+static int
+yaml_parser_index_line(yaml_parser_t *parser, size_t index)
+{
+    if (parser->lines.top == parser->lines.end)
+    {
+        size_t size = parser->lines.end - parser->lines.start;
+        size_t top = parser->lines.top - parser->lines.start;
+        size_t *lines;
+
+        size = size ? size * 2 : INITIAL_STACK_SIZE;
+        lines = (size_t *)yaml_realloc_with(parser->allocator,
+                parser->lines.start, size * sizeof(size_t));
+        if (!lines) {
+            yaml_free_with(parser->allocator, parser->lines.start);
+            parser->lines.start = parser->lines.end = parser->lines.top = NULL;
+            parser->line_index = 0;
+            return 0;
+        }
+
+        parser->lines.start = lines;
+        parser->lines.top = lines + top;
+        parser->lines.end = lines + size;
+    }
+
+    *(parser->lines.top++) = index;
+
+    return 1;
+}
+
 /*
  * Ensure that the tokens queue contains at least one token which can be
  * returned to the Parser.
@@ -802,6 +1231,19 @@ yaml_parser_fetch_more_tokens(yaml_parser_t *parser)
 {
     int need_more_tokens;
 
+    /* A pipelined parser takes the tokens from the scanner thread. */
+
+    if (parser->pipelined && !yaml_parser_start_pipeline(parser))
+        return 0;
+
+    if (parser->pipeline) {
+        if (parser->tokens.head == parser->tokens.tail
+                && !yaml_parser_fetch_pipelined(parser))
+            return 0;
+        parser->token_available = 1;
+        return 1;
+    }
+
     /* While we need more tokens to fetch, do it. */
 
     while (1)
@@ -818,25 +1260,41 @@ yaml_parser_fetch_more_tokens(yaml_parser_t *parser)
 
             need_more_tokens = 1;
         }
-        else
+        else if (!parser->json_mode)
         {
             yaml_simple_key_t *simple_key;
 
-            /* Check if any potential simple key may occupy the head position. */
+            /*
+             * Check if any potential simple key may occupy the head position.
+             * The keys of the lower flow levels come first in the stream, so
+             * only the lowest possible key needs to be checked.  An error that
+             * was put aside while fetching ahead is left to the key.
+             */
 
-            if (!yaml_parser_stale_simple_keys(parser))
+            if ((parser->read_handler != yaml_feed_read_handler
+                        || !parser->input.feed.deferred.error)
+                    && !yaml_parser_stale_simple_keys(parser))
                 return 0;
 
-            for (simple_key = parser->simple_keys.start;
-                    simple_key != parser->simple_keys.top; simple_key++) {
-                if (simple_key->possible
-                        && simple_key->token_number == parser->tokens_parsed) {
-                    need_more_tokens = 1;
-                    break;
-                }
+            simple_key = parser->simple_keys.start + parser->simple_keys_lowest;
+
+            if (simple_key != parser->simple_keys.top
+                    && simple_key->token_number == parser->tokens_parsed) {
+                need_more_tokens = 1;
             }
         }
 
+        /*
+         * The tokens queued by the fetch that failed ahead of the parser are
+         * not given out, as the scanner would have stopped before them.
+         */
+
+        if (parser->read_handler == yaml_feed_read_handler
+                && parser->input.feed.deferred.error
+                && parser->tokens_parsed >= parser->input.feed.deferred.tokens) {
+            need_more_tokens = 1;
+        }
+
         /* We are finished. */
 
         if (!need_more_tokens)
@@ -844,8 +1302,22 @@ yaml_parser_fetch_more_tokens(yaml_parser_t *parser)
 
         /* Fetch the next token. */
 
-        if (!yaml_parser_fetch_next_token(parser))
-            return 0;
+        if (parser->read_handler == yaml_feed_read_handler) {
+            if (!yaml_parser_fetch_fed_token(parser))
+                return 0;
+        }
+        else {
+            if (!yaml_parser_fetch_next_token(parser))
+                return 0;
+        }
+
+        /* Check the length of the current document. */
+
+        if (parser->limits.max_document_length
+                && parser->mark.index - parser->document_index
+                    > parser->limits.max_document_length)
+            return yaml_parser_set_limit_error(parser,
+                    "exceeded the maximum document length", parser->mark);
     }
 
     parser->token_available = 1;
@@ -854,58 +1326,291 @@ yaml_parser_fetch_more_tokens(yaml_parser_t *parser)
 }
 
 /*
- * The dispatcher for token fetchers.
+ * Fetch the next token from pushed input.
+ *
+ * The scanner cannot suspend in the middle of a token, so the state it had
+ * before the token is saved, and if the fed input runs out, the state is
+ * restored and the reader is rewound to the start of the token.  The function
+ * then returns 0 with no error set.  The same octets are scanned again only
+ * after the input that follows them has doubled, which keeps the total work
+ * linear in the size of the input.
  */
 
 static int
-yaml_parser_fetch_next_token(yaml_parser_t *parser)
+yaml_parser_fetch_fed_token(yaml_parser_t *parser)
 {
-    /* Ensure that the buffer is initialized. */
-
-    if (!CACHE(parser, 1))
+    size_t offset = SCANNED_OFFSET(parser);
+    size_t unscanned = parser->input.feed.last - parser->input.feed.start
+        - (offset - parser->input.feed.offset);
+    yaml_mark_t mark = parser->mark;
+    int simple_key_allowed = parser->simple_key_allowed;
+    yaml_encoding_t encoding = parser->encoding;
+    yaml_simple_key_t simple_key = { 0, 0, 0, { 0, 0, 0 } };
+    size_t simple_keys_lowest = parser->simple_keys_lowest;
+    size_t tokens = parser->tokens.tail - parser->tokens.head;
+    size_t fetched = parser->input.feed.interrupted ?
+        parser->input.feed.fetched : parser->tokens_parsed + tokens;
+    yaml_mark_t zero_mark = { 0, 0, 0 };
+
+    /* Report the error that the scanner ran into while fetching ahead. */
+
+    if (parser->input.feed.deferred.error) {
+        parser->error = parser->input.feed.deferred.error;
+        parser->problem = parser->input.feed.deferred.problem;
+        parser->problem_offset = parser->input.feed.deferred.problem_offset;
+        parser->problem_value = parser->input.feed.deferred.problem_value;
+        parser->problem_mark = parser->input.feed.deferred.problem_mark;
+        parser->context = parser->input.feed.deferred.context;
+        parser->context_mark = parser->input.feed.deferred.context_mark;
+        parser->input.feed.deferred.error = YAML_NO_ERROR;
         return 0;
+    }
 
-    /* Check if we just started scanning.  Fetch STREAM-START then. */
+    if (!parser->input.feed.done)
+    {
+        /* Only UTF-8 input can be rewound; wait for the rest of the others. */
 
-    if (!parser->stream_start_produced)
-        return yaml_parser_fetch_stream_start(parser);
+        if (encoding && encoding != YAML_UTF8_ENCODING)
+            return 0;
 
-    /* Eat whitespaces and comments until we reach the next token. */
+        if (unscanned < parser->input.feed.wanted)
+            return 0;
+    }
 
-    if (!yaml_parser_scan_to_next_token(parser))
-        return 0;
+    if (!STACK_EMPTY(parser, parser->simple_keys)) {
+        simple_key = *(parser->simple_keys.top-1);
+    }
 
-    /* Remove obsolete potential simple keys. */
+    /*
+     * Other inputs fetch the next token as soon as the parser reaches a
+     * potential simple key, so a failure of this fetch stops the parser there.
+     */
 
-    if (!yaml_parser_stale_simple_keys(parser))
-        return 0;
+    if (!parser->input.feed.interrupted && !parser->json_mode
+            && parser->simple_keys.start + simple_keys_lowest
+                != parser->simple_keys.top) {
+        yaml_simple_key_t *lowest = parser->simple_keys.start + simple_keys_lowest;
+        if (lowest->possible && lowest->token_number < fetched) {
+            fetched = lowest->token_number;
+        }
+    }
 
-    /* Check the indentation level against the current column. */
+    if (yaml_parser_fetch_next_token(parser)) {
+        parser->input.feed.wanted = 0;
+        parser->input.feed.fetched = fetched;
+        parser->input.feed.interrupted = 0;
+        return 1;
+    }
 
-    if (!yaml_parser_unroll_indent(parser, parser->mark.column))
+    if (parser->error != YAML_READER_ERROR || !parser->input.feed.blocked) {
+        parser->input.feed.fetched = fetched;
+        parser->input.feed.interrupted = 0;
         return 0;
+    }
+
+    /* Forget the error and restore the state of the scanner. */
+
+    parser->error = YAML_NO_ERROR;
+    parser->problem = NULL;
+    parser->problem_offset = 0;
+    parser->problem_value = 0;
+    parser->problem_mark = zero_mark;
+    parser->context = NULL;
+    parser->context_mark = zero_mark;
+
+    parser->mark = mark;
+    parser->simple_key_allowed = simple_key_allowed;
+    parser->encoding = encoding;
+    if (!STACK_EMPTY(parser, parser->simple_keys)) {
+        *(parser->simple_keys.top-1) = simple_key;
+    }
+    parser->simple_keys_lowest = simple_keys_lowest;
 
     /*
-     * Ensure that the buffer contains at least 4 characters.  4 is the length
-     * of the longest indicators ('--- ' and '... ').
+     * The JSON scanner puts KEY in front of a key before scanning it.  The
+     * BLOCK-END tokens of the YAML scanner depend only on the complete input
+     * before the token, so they are kept, and the next fetch counts as the
+     * same one.
      */
 
-    if (!CACHE(parser, 4))
-        return 0;
-
-    /* Is it the end of the stream? */
+    if (parser->json_mode) {
+        parser->tokens.tail = parser->tokens.head + tokens;
+    }
+    else if ((size_t)(parser->tokens.tail - parser->tokens.head) != tokens) {
+        parser->input.feed.fetched = fetched;
+        parser->input.feed.interrupted = 1;
+    }
 
-    if (IS_Z(parser->buffer))
-        return yaml_parser_fetch_stream_end(parser);
+    /* Rewind the reader. */
 
-    /* Is it a directive? */
+    parser->raw_buffer.pointer = parser->raw_buffer.start;
+    parser->raw_buffer.last = parser->raw_buffer.start;
+    parser->buffer.pointer = parser->buffer.start;
+    parser->buffer.last = parser->buffer.start;
+    parser->unread = 0;
+    parser->offset = offset;
+    parser->eof = 0;
 
-    if (parser->mark.column == 0 && CHECK(parser->buffer, '%'))
-        return yaml_parser_fetch_directive(parser);
+    parser->input.feed.pointer = parser->input.feed.start
+        + (offset - parser->input.feed.offset);
+    parser->input.feed.blocked = 0;
+    parser->input.feed.wanted = unscanned * 2 > unscanned ?
+        unscanned * 2 : unscanned + 1;
 
-    /* Is it the document start indicator? */
+    return 0;
+}
 
-    if (parser->mark.column == 0
+/*
+ * With pushed input, the event parser must not run out of tokens in the middle
+ * of a production.  Fetch tokens until the queue holds the end of the stream
+ * or enough tokens that no KEY may be put in front of them.
+ *
+ * An error found on the way is put aside until the parser needs the token that
+ * failed, so the events before it are produced first, as with other inputs.
+ * The tokens queued by the failing fetch itself are never given out.
+ */
+
+#define PUSH_LOOKAHEAD  8
+
+YAML_DECLARE(int)
+yaml_parser_fetch_ahead(yaml_parser_t *parser)
+{
+    while (!parser->input.feed.deferred.error)
+    {
+        size_t needed = PUSH_LOOKAHEAD;
+        size_t stable = parser->tokens.tail - parser->tokens.head;
+        yaml_token_t *token;
+
+        /* A key may go stale with the last fetch, even with STREAM-END. */
+
+        if (!parser->json_mode && !yaml_parser_stale_simple_keys(parser))
+            break;
+
+        if (stable && (parser->tokens.tail-1)->type == YAML_STREAM_END_TOKEN)
+            break;
+
+        /* Directives and document ends are all taken by a single step. */
+
+        for (token = parser->tokens.head; token != parser->tokens.tail
+                && (token->type == YAML_DOCUMENT_END_TOKEN
+                    || token->type == YAML_VERSION_DIRECTIVE_TOKEN
+                    || token->type == YAML_TAG_DIRECTIVE_TOKEN); token ++) {
+            needed ++;
+        }
+
+        /* The tokens from the lowest potential simple key on may move. */
+
+        if (!parser->json_mode)
+        {
+            yaml_simple_key_t *simple_key;
+
+            simple_key = parser->simple_keys.start + parser->simple_keys_lowest;
+
+            if (simple_key != parser->simple_keys.top
+                    && simple_key->token_number - parser->tokens_parsed
+                        < stable) {
+                stable = simple_key->token_number - parser->tokens_parsed;
+            }
+        }
+
+        if (stable >= needed)
+            break;
+
+        if (!yaml_parser_fetch_fed_token(parser)) {
+            if (!parser->error)
+                return 0;
+            break;
+        }
+
+        if (parser->limits.max_document_length
+                && parser->mark.index - parser->document_index
+                    > parser->limits.max_document_length) {
+            yaml_parser_set_limit_error(parser,
+                    "exceeded the maximum document length", parser->mark);
+            break;
+        }
+    }
+
+    if (parser->error) {
+        yaml_mark_t zero_mark = { 0, 0, 0 };
+        parser->input.feed.deferred.tokens = parser->input.feed.fetched;
+        parser->input.feed.deferred.error = parser->error;
+        parser->input.feed.deferred.problem = parser->problem;
+        parser->input.feed.deferred.problem_offset = parser->problem_offset;
+        parser->input.feed.deferred.problem_value = parser->problem_value;
+        parser->input.feed.deferred.problem_mark = parser->problem_mark;
+        parser->input.feed.deferred.context = parser->context;
+        parser->input.feed.deferred.context_mark = parser->context_mark;
+        parser->error = YAML_NO_ERROR;
+        parser->problem = NULL;
+        parser->problem_offset = 0;
+        parser->problem_value = 0;
+        parser->problem_mark = zero_mark;
+        parser->context = NULL;
+        parser->context_mark = zero_mark;
+    }
+
+    return 1;
+}
+
+/*
+ * The dispatcher for token fetchers.
+ */
+
+static int
+yaml_parser_fetch_next_token(yaml_parser_t *parser)
+{
+    /* Ensure that the buffer is initialized. */
+
+    if (!CACHE(parser, 1))
+        return 0;
+
+    /* Check if we just started scanning.  Fetch STREAM-START then. */
+
+    if (!parser->stream_start_produced)
+        return yaml_parser_fetch_stream_start(parser);
+
+    /* JSON input has a scanner of its own. */
+
+    if (parser->json_mode)
+        return yaml_parser_fetch_json_token(parser);
+
+    /* Eat whitespaces and comments until we reach the next token. */
+
+    if (!yaml_parser_scan_to_next_token(parser))
+        return 0;
+
+    /* Remove obsolete potential simple keys. */
+
+    if (!yaml_parser_stale_simple_keys(parser))
+        return 0;
+
+    /* Check the indentation level against the current column. */
+
+    if (!yaml_parser_unroll_indent(parser, parser->mark.column))
+        return 0;
+
+    /*
+     * Ensure that the buffer contains at least 4 characters.  4 is the length
+     * of the longest indicators ('--- ' and '... ').
+     */
+
+    if (!CACHE(parser, 4))
+        return 0;
+
+    /* Is it the end of the stream? */
+
+    if (IS_Z(parser->buffer))
+        return yaml_parser_fetch_stream_end(parser);
+
+    /* Is it a directive? */
+
+    if (parser->mark.column == 0 && CHECK(parser->buffer, '%'))
+        return yaml_parser_fetch_directive(parser);
+
+    /* Is it the document start indicator? */
+
+    if (parser->mark.column == 0
             && CHECK_AT(parser->buffer, '-', 0)
             && CHECK_AT(parser->buffer, '-', 1)
             && CHECK_AT(parser->buffer, '-', 2)
@@ -1058,11 +1763,20 @@ yaml_parser_stale_simple_keys(yaml_parser_t *parser)
 {
     yaml_simple_key_t *simple_key;
 
-    /* Check for a potential simple key for each flow level. */
+    /*
+     * Check for a potential simple key for each flow level, starting with the
+     * lowest one that may hold a possible key.  A key of a lower level starts
+     * before the keys of the higher levels, so the check stops at the first
+     * possible key that is still valid.
+     */
 
-    for (simple_key = parser->simple_keys.start;
-            simple_key != parser->simple_keys.top; simple_key ++)
+    for (simple_key = parser->simple_keys.start + parser->simple_keys_lowest;
+            simple_key != parser->simple_keys.top;
+            simple_key ++, parser->simple_keys_lowest ++)
     {
+        if (!simple_key->possible)
+            continue;
+
         /*
          * The specification requires that a simple key
          *
@@ -1070,9 +1784,8 @@ yaml_parser_stale_simple_keys(yaml_parser_t *parser)
          *  - is shorter than 1024 characters.
          */
 
-        if (simple_key->possible
-                && (simple_key->mark.line < parser->mark.line
-                    || simple_key->mark.index+1024 < parser->mark.index)) {
+        if (simple_key->mark.line < parser->mark.line
+                || simple_key->mark.index+1024 < parser->mark.index) {
 
             /* Check if the potential simple key to be removed is required. */
 
@@ -1084,6 +1797,9 @@ yaml_parser_stale_simple_keys(yaml_parser_t *parser)
 
             simple_key->possible = 0;
         }
+        else {
+            break;
+        }
     }
 
     return 1;
@@ -1122,6 +1838,11 @@ yaml_parser_save_simple_key(yaml_parser_t *parser)
         if (!yaml_parser_remove_simple_key(parser)) return 0;
 
         *(parser->simple_keys.top-1) = simple_key;
+
+        if (parser->simple_keys_lowest >
+                (size_t)(parser->simple_keys.top - parser->simple_keys.start) - 1)
+            parser->simple_keys_lowest =
+                (parser->simple_keys.top - parser->simple_keys.start) - 1;
     }
 
     return 1;
@@ -1163,6 +1884,9 @@ yaml_parser_increase_flow_level(yaml_parser_t *parser)
 {
     yaml_simple_key_t empty_simple_key = { 0, 0, 0, { 0, 0, 0 } };
 
+    if (!yaml_parser_check_depth(parser, parser->mark))
+        return 0;
+
     /* Reset the simple key on the next level. */
 
     if (!PUSH(parser, parser->simple_keys, empty_simple_key))
@@ -1190,6 +1914,11 @@ yaml_parser_decrease_flow_level(yaml_parser_t *parser)
     if (parser->flow_level) {
         parser->flow_level --;
         (void)POP(parser, parser->simple_keys);
+
+        if (parser->simple_keys_lowest >
+                (size_t)(parser->simple_keys.top - parser->simple_keys.start))
+            parser->simple_keys_lowest =
+                parser->simple_keys.top - parser->simple_keys.start;
     }
 
     return 1;
@@ -1220,6 +1949,9 @@ yaml_parser_roll_indent(yaml_parser_t *parser, ptrdiff_t column,
          * indentation level.
          */
 
+        if (!yaml_parser_check_depth(parser, mark))
+            return 0;
+
         if (!PUSH(parser, parser->indents, parser->indent))
             return 0;
 
@@ -1298,6 +2030,10 @@ yaml_parser_fetch_stream_start(yaml_parser_t *parser)
 
     parser->indent = -1;
 
+    /* The first document starts here. */
+
+    parser->document_index = parser->mark.index;
+
     /* Initialize the simple key stack. */
 
     if (!PUSH(parser, parser->simple_keys, simple_key))
@@ -1389,6 +2125,7 @@ yaml_parser_fetch_directive(yaml_parser_t *parser)
     /* Append the token to the queue. */
 
     if (!ENQUEUE(parser, parser->tokens, token)) {
+        token.allocator = parser->allocator;
         yaml_token_delete(&token);
         return 0;
     }
@@ -1419,6 +2156,10 @@ yaml_parser_fetch_document_indicator(yaml_parser_t *parser,
 
     parser->simple_key_allowed = 0;
 
+    /* The next document starts at the indicator. */
+
+    parser->document_index = parser->mark.index;
+
     /* Consume the token. */
 
     start_mark = parser->mark;
@@ -1782,6 +2523,7 @@ yaml_parser_fetch_anchor(yaml_parser_t *parser, yaml_token_type_t type)
         return 0;
 
     if (!ENQUEUE(parser, parser->tokens, token)) {
+        token.allocator = parser->allocator;
         yaml_token_delete(&token);
         return 0;
     }
@@ -1812,6 +2554,7 @@ yaml_parser_fetch_tag(yaml_parser_t *parser)
         return 0;
 
     if (!ENQUEUE(parser, parser->tokens, token)) {
+        token.allocator = parser->allocator;
         yaml_token_delete(&token);
         return 0;
     }
@@ -1842,7 +2585,9 @@ yaml_parser_fetch_block_scalar(yaml_parser_t *parser, int literal)
     if (!yaml_parser_scan_block_scalar(parser, &token, literal))
         return 0;
 
-    if (!ENQUEUE(parser, parser->tokens, token)) {
+    if (!yaml_parser_check_scalar_length(parser, &token)
+            || !ENQUEUE(parser, parser->tokens, token)) {
+        token.allocator = parser->allocator;
         yaml_token_delete(&token);
         return 0;
     }
@@ -1873,7 +2618,9 @@ yaml_parser_fetch_flow_scalar(yaml_parser_t *parser, int single)
     if (!yaml_parser_scan_flow_scalar(parser, &token, single))
         return 0;
 
-    if (!ENQUEUE(parser, parser->tokens, token)) {
+    if (!yaml_parser_check_scalar_length(parser, &token)
+            || !ENQUEUE(parser, parser->tokens, token)) {
+        token.allocator = parser->allocator;
         yaml_token_delete(&token);
         return 0;
     }
@@ -1904,7 +2651,9 @@ yaml_parser_fetch_plain_scalar(yaml_parser_t *parser)
     if (!yaml_parser_scan_plain_scalar(parser, &token))
         return 0;
 
-    if (!ENQUEUE(parser, parser->tokens, token)) {
+    if (!yaml_parser_check_scalar_length(parser, &token)
+            || !ENQUEUE(parser, parser->tokens, token)) {
+        token.allocator = parser->allocator;
         yaml_token_delete(&token);
         return 0;
     }
@@ -1945,7 +2694,13 @@ yaml_parser_scan_to_next_token(yaml_parser_t *parser)
         while (CHECK(parser->buffer,' ') ||
                 ((parser->flow_level || !parser->simple_key_allowed) &&
                  CHECK(parser->buffer, '\t'))) {
-            SKIP(parser);
+            size_t length = 1;
+            while (parser->buffer.pointer + length != parser->buffer.last
+                    && (parser->buffer.pointer[length] == ' '
+                        || ((parser->flow_level || !parser->simple_key_allowed)
+                            && parser->buffer.pointer[length] == '\t')))
+                length ++;
+            SKIP_ASCII(parser, length);
             if (!CACHE(parser, 1)) return 0;
         }
 
@@ -1953,7 +2708,12 @@ yaml_parser_scan_to_next_token(yaml_parser_t *parser)
 
         if (CHECK(parser->buffer, '#')) {
             while (!IS_BREAKZ(parser->buffer)) {
-                SKIP(parser);
+                size_t length = yaml_parser_comment_span(parser->buffer.pointer,
+                        parser->buffer.last);
+                if (length)
+                    SKIP_ASCII(parser, length);
+                else
+                    SKIP(parser);
                 if (!CACHE(parser, 1)) return 0;
             }
         }
@@ -2087,14 +2847,14 @@ yaml_parser_scan_directive(yaml_parser_t *parser, yaml_token_t *token)
         SKIP_LINE(parser);
     }
 
-    yaml_free(name);
+    yaml_free_with(parser->allocator, name);
 
     return 1;
 
 error:
-    yaml_free(prefix);
-    yaml_free(handle);
-    yaml_free(name);
+    yaml_free_with(parser->allocator, prefix);
+    yaml_free_with(parser->allocator, handle);
+    yaml_free_with(parser->allocator, name);
     return 0;
 }
 
@@ -2312,8 +3072,8 @@ yaml_parser_scan_tag_directive_value(yaml_parser_t *parser,
     return 1;
 
 error:
-    yaml_free(handle_value);
-    yaml_free(prefix_value);
+    yaml_free_with(parser->allocator, handle_value);
+    yaml_free_with(parser->allocator, prefix_value);
     return 0;
 }
 
@@ -2400,8 +3160,11 @@ yaml_parser_scan_tag(yaml_parser_t *parser, yaml_token_t *token)
     {
         /* Set the handle to '' */
 
-        handle = YAML_MALLOC(1);
-        if (!handle) goto error;
+        handle = YAML_MALLOC_WITH(parser->allocator, 1);
+        if (!handle) {
+            parser->error = YAML_MEMORY_ERROR;
+            goto error;
+        }
         handle[0] = '\0';
 
         /* Eat '!<' */
@@ -2451,9 +3214,12 @@ yaml_parser_scan_tag(yaml_parser_t *parser, yaml_token_t *token)
 
             /* Set the handle to '!'. */
 
-            yaml_free(handle);
-            handle = YAML_MALLOC(2);
-            if (!handle) goto error;
+            yaml_free_with(parser->allocator, handle);
+            handle = YAML_MALLOC_WITH(parser->allocator, 2);
+            if (!handle) {
+                parser->error = YAML_MEMORY_ERROR;
+                goto error;
+            }
             handle[0] = '!';
             handle[1] = '\0';
 
@@ -2491,8 +3257,8 @@ yaml_parser_scan_tag(yaml_parser_t *parser, yaml_token_t *token)
     return 1;
 
 error:
-    yaml_free(handle);
-    yaml_free(suffix);
+    yaml_free_with(parser->allocator, handle);
+    yaml_free_with(parser->allocator, suffix);
     return 0;
 }
 
@@ -2579,7 +3345,8 @@ yaml_parser_scan_tag_uri(yaml_parser_t *parser, int uri_char, int directive,
     /* Resize the string to include the head. */
 
     while ((size_t)(string.end - string.start) <= length) {
-        if (!yaml_string_extend(&string.start, &string.pointer, &string.end)) {
+        if (!yaml_string_extend(parser->allocator,
+                    &string.start, &string.pointer, &string.end)) {
             parser->error = YAML_MEMORY_ERROR;
             goto error;
         }
@@ -2733,6 +3500,88 @@ yaml_parser_scan_uri_escapes(yaml_parser_t *parser, int directive,
     return 1;
 }
 
+/*
+ * The scratch buffers of the scalar scanners.  A buffer that has grown beyond
+ * MAX_SCRATCH_SIZE is released rather than kept.
+ */
+
+#define SCRATCH_STRING          0
+#define SCRATCH_LEADING_BREAK   1
+#define SCRATCH_TRAILING_BREAKS 2
+#define SCRATCH_WHITESPACES     3
+
+#define MAX_SCRATCH_SIZE        65536
+
+/*
+ * Take a scratch buffer of the parser, allocating it on the first use.  The
+ * scanners test the breaks for emptiness by their first octet, so only that
+ * octet is cleared rather than the whole buffer.
+ */
+
+static int
+yaml_parser_take_scratch(yaml_parser_t *parser, int index,
+        yaml_string_t *string, int clear)
+{
+    if (!parser->scratch[index].start)
+        return STRING_INIT(parser, *string, INITIAL_STRING_SIZE);
+
+    string->start = parser->scratch[index].start;
+    string->end = parser->scratch[index].end;
+    string->pointer = string->start;
+    parser->scratch[index].start = NULL;
+    parser->scratch[index].end = NULL;
+
+    if (clear) {
+        string->start[0] = '\0';
+    }
+
+    return 1;
+}
+
+/*
+ * Return a scratch buffer to the parser.
+ */
+
+static void
+yaml_parser_give_scratch(yaml_parser_t *parser, int index,
+        yaml_string_t *string)
+{
+    if (!string->start)
+        return;
+
+    if (string->end - string->start > MAX_SCRATCH_SIZE) {
+        STRING_DEL(parser, *string);
+        return;
+    }
+
+    parser->scratch[index].start = string->start;
+    parser->scratch[index].end = string->end;
+    string->start = string->pointer = string->end = NULL;
+}
+
+/*
+ * Copy the value accumulated in a scratch buffer to a NUL-terminated string
+ * of the exact size.
+ */
+
+static int
+yaml_parser_copy_scratch(yaml_parser_t *parser, yaml_string_t *string,
+        yaml_char_t **value, size_t *length)
+{
+    *length = string->pointer - string->start;
+
+    *value = YAML_MALLOC_WITH(parser->allocator, *length+1);
+    if (!*value) {
+        parser->error = YAML_MEMORY_ERROR;
+        return 0;
+    }
+
+    memcpy(*value, string->start, *length);
+    (*value)[*length] = '\0';
+
+    return 1;
+}
+
 /*
  * Scan a block scalar.
  */
@@ -2751,10 +3600,15 @@ yaml_parser_scan_block_scalar(yaml_parser_t *parser, yaml_token_t *token,
     int indent = 0;
     int leading_blank = 0;
     int trailing_blank = 0;
+    yaml_char_t *value;
+    size_t length;
 
-    if (!STRING_INIT(parser, string, INITIAL_STRING_SIZE)) goto error;
-    if (!STRING_INIT(parser, leading_break, INITIAL_STRING_SIZE)) goto error;
-    if (!STRING_INIT(parser, trailing_breaks, INITIAL_STRING_SIZE)) goto error;
+    if (!yaml_parser_take_scratch(parser, SCRATCH_STRING, &string, 0))
+        goto error;
+    if (!yaml_parser_take_scratch(parser, SCRATCH_LEADING_BREAK,
+                &leading_break, 1)) goto error;
+    if (!yaml_parser_take_scratch(parser, SCRATCH_TRAILING_BREAKS,
+                &trailing_breaks, 1)) goto error;
 
     /* Eat the indicator '|' or '>'. */
 
@@ -2911,6 +3765,8 @@ yaml_parser_scan_block_scalar(yaml_parser_t *parser, yaml_token_t *token,
 
         while (!IS_BREAKZ(parser->buffer)) {
             if (!READ(parser, string)) goto error;
+            if (!SCALAR_LIMITS(parser, string.pointer - string.start,
+                        start_mark)) goto error;
             if (!CACHE(parser, 1)) goto error;
         }
 
@@ -2937,19 +3793,23 @@ yaml_parser_scan_block_scalar(yaml_parser_t *parser, yaml_token_t *token,
 
     /* Create a token. */
 
-    SCALAR_TOKEN_INIT(*token, string.start, string.pointer-string.start,
+    if (!yaml_parser_copy_scratch(parser, &string, &value, &length))
+        goto error;
+
+    SCALAR_TOKEN_INIT(*token, value, length,
             literal ? YAML_LITERAL_SCALAR_STYLE : YAML_FOLDED_SCALAR_STYLE,
             start_mark, end_mark);
 
-    STRING_DEL(parser, leading_break);
-    STRING_DEL(parser, trailing_breaks);
+    yaml_parser_give_scratch(parser, SCRATCH_STRING, &string);
+    yaml_parser_give_scratch(parser, SCRATCH_LEADING_BREAK, &leading_break);
+    yaml_parser_give_scratch(parser, SCRATCH_TRAILING_BREAKS, &trailing_breaks);
 
     return 1;
 
 error:
-    STRING_DEL(parser, string);
-    STRING_DEL(parser, leading_break);
-    STRING_DEL(parser, trailing_breaks);
+    yaml_parser_give_scratch(parser, SCRATCH_STRING, &string);
+    yaml_parser_give_scratch(parser, SCRATCH_LEADING_BREAK, &leading_break);
+    yaml_parser_give_scratch(parser, SCRATCH_TRAILING_BREAKS, &trailing_breaks);
 
     return 0;
 }
@@ -3001,6 +3861,7 @@ yaml_parser_scan_block_scalar_breaks(yaml_parser_t *parser,
 
         if (!CACHE(parser, 2)) return 0;
         if (!READ_LINE(parser, *breaks)) return 0;
+        if (!SCALAR_LIMITS(parser, 0, start_mark)) return 0;
         *end_mark = parser->mark;
     }
 
@@ -3018,96 +3879,370 @@ yaml_parser_scan_block_scalar_breaks(yaml_parser_t *parser,
 }
 
 /*
- * Scan a quoted scalar.
+ * Borrowing scalars.
+ *
+ * A scalar that needs no transformation is a run of bytes in the input
+ * buffer.  If the buffer stays in place until the parser is deleted, the
+ * token value may point into it instead of being copied.  This is the case
+ * for zero-copy input and for everything decoded after the end of the input
+ * has been reached.
+ *
+ * The borrowing scanners look ahead only through the characters that are
+ * already in the buffer and mirror the regular scanners.  They give up,
+ * without consuming anything, if the scalar needs to be folded, contains an
+ * escape sequence or an error, or runs past the decoded characters; the
+ * regular scanner then takes over.
+ */
+
+#define BUFFER_IS_STABLE(parser)                                                \
+    ((parser)->zerocopy                                                         \
+     || ((parser)->eof                                                          \
+         && (parser)->raw_buffer.pointer == (parser)->raw_buffer.last))
+
+/*
+ * Check that the characters to look at are decoded.  At the end of the input
+ * the buffer is NUL-terminated and the regular scanner does not wait either.
+ */
+
+#define BORROW_CACHE(parser,unread,length)                                      \
+    ((unread) >= (length)                                                       \
+     || ((parser)->eof                                                          \
+         && (parser)->raw_buffer.pointer == (parser)->raw_buffer.last))
+
+#define BORROW_SKIP(buffer,unread,mark)                                         \
+     ((mark).index ++,                                                          \
+      (mark).column ++,                                                         \
+      (unread) --,                                                              \
+      (buffer).pointer += WIDTH(buffer))
+
+#define BORROW_SKIP_LINE(buffer,unread,mark)                                    \
+     (IS_CRLF(buffer) ?                                                         \
+      ((mark).index += 2,                                                       \
+       (mark).column = 0,                                                       \
+       (mark).line ++,                                                          \
+       (unread) -= 2,                                                           \
+       (buffer).pointer += 2) :                                                 \
+      ((mark).index ++,                                                         \
+       (mark).column = 0,                                                       \
+       (mark).line ++,                                                          \
+       (unread) --,                                                             \
+       (buffer).pointer += WIDTH(buffer)))
+
+/*
+ * Borrow a single-line quoted scalar without escape sequences.
  */
 
 static int
-yaml_parser_scan_flow_scalar(yaml_parser_t *parser, yaml_token_t *token,
+yaml_parser_borrow_flow_scalar(yaml_parser_t *parser, yaml_token_t *token,
         int single)
 {
-    yaml_mark_t start_mark;
-    yaml_mark_t end_mark;
-    yaml_string_t string = NULL_STRING;
-    yaml_string_t leading_break = NULL_STRING;
-    yaml_string_t trailing_breaks = NULL_STRING;
-    yaml_string_t whitespaces = NULL_STRING;
-    int leading_blanks;
+    yaml_string_t buffer = NULL_STRING;
+    size_t unread = parser->unread;
+    yaml_mark_t mark = parser->mark;
+    yaml_char_t *start;
+    yaml_char_t *end;
 
-    if (!STRING_INIT(parser, string, INITIAL_STRING_SIZE)) goto error;
-    if (!STRING_INIT(parser, leading_break, INITIAL_STRING_SIZE)) goto error;
-    if (!STRING_INIT(parser, trailing_breaks, INITIAL_STRING_SIZE)) goto error;
-    if (!STRING_INIT(parser, whitespaces, INITIAL_STRING_SIZE)) goto error;
+    if (!BUFFER_IS_STABLE(parser))
+        return 0;
 
-    /* Eat the left quote. */
+    buffer.pointer = parser->buffer.pointer;
 
-    start_mark = parser->mark;
+    /* Skip the left quote. */
 
-    SKIP(parser);
+    BORROW_SKIP(buffer, unread, mark);
 
-    /* Consume the content of the quoted scalar. */
+    start = buffer.pointer;
+
+    /* Find the right quote on the same line. */
 
     while (1)
     {
-        /* Check that there are no document indicators at the beginning of the line. */
+        if (!BORROW_CACHE(parser, unread, 2))
+            return 0;
 
-        if (!CACHE(parser, 4)) goto error;
+        if (IS_Z(buffer) || IS_BREAK(buffer))
+            return 0;
 
-        if (parser->mark.column == 0 &&
-            ((CHECK_AT(parser->buffer, '-', 0) &&
-              CHECK_AT(parser->buffer, '-', 1) &&
-              CHECK_AT(parser->buffer, '-', 2)) ||
-             (CHECK_AT(parser->buffer, '.', 0) &&
-              CHECK_AT(parser->buffer, '.', 1) &&
-              CHECK_AT(parser->buffer, '.', 2))) &&
-            IS_BLANKZ_AT(parser->buffer, 3))
-        {
-            yaml_parser_set_scanner_error(parser, "while scanning a quoted scalar",
-                    start_mark, "found unexpected document indicator");
-            goto error;
+        if (CHECK(buffer, single ? '\'' : '"')) {
+            if (single && CHECK_AT(buffer, '\'', 1))
+                return 0;
+            break;
         }
 
-        /* Check for EOF. */
+        if (!single && CHECK(buffer, '\\'))
+            return 0;
 
-        if (IS_Z(parser->buffer)) {
-            yaml_parser_set_scanner_error(parser, "while scanning a quoted scalar",
-                    start_mark, "found unexpected end of stream");
-            goto error;
-        }
+        BORROW_SKIP(buffer, unread, mark);
+    }
 
-        /* Consume non-blank characters. */
+    end = buffer.pointer;
 
-        if (!CACHE(parser, 2)) goto error;
+    /* Skip the right quote. */
 
-        leading_blanks = 0;
+    BORROW_SKIP(buffer, unread, mark);
 
-        while (!IS_BLANKZ(parser->buffer))
-        {
-            /* Check for an escaped single quote. */
+    SCALAR_TOKEN_INIT(*token, start, end-start,
+            single ? YAML_SINGLE_QUOTED_SCALAR_STYLE : YAML_DOUBLE_QUOTED_SCALAR_STYLE,
+            parser->mark, mark);
+    token->borrowed = 1;
 
-            if (single && CHECK_AT(parser->buffer, '\'', 0)
-                    && CHECK_AT(parser->buffer, '\'', 1))
-            {
-                if (!STRING_EXTEND(parser, string)) goto error;
-                *(string.pointer++) = '\'';
-                SKIP(parser);
-                SKIP(parser);
-            }
+    parser->buffer.pointer = buffer.pointer;
+    parser->unread = unread;
+    parser->mark = mark;
 
-            /* Check for the right quote. */
+    return 1;
+}
 
-            else if (CHECK(parser->buffer, single ? '\'' : '"'))
-            {
-                break;
-            }
+/*
+ * Borrow a plain scalar that does not need to be folded.
+ */
 
-            /* Check for an escaped line break. */
+static int
+yaml_parser_borrow_plain_scalar(yaml_parser_t *parser, yaml_token_t *token)
+{
+    yaml_string_t buffer = NULL_STRING;
+    size_t unread = parser->unread;
+    yaml_mark_t mark = parser->mark;
+    yaml_mark_t end_mark = parser->mark;
+    yaml_char_t *start;
+    yaml_char_t *end;
+    size_t length;
+    int leading_blanks = 0;
+    int indent = parser->indent+1;
 
-            else if (!single && CHECK(parser->buffer, '\\')
-                    && IS_BREAK_AT(parser->buffer, 1))
-            {
-                if (!CACHE(parser, 3)) goto error;
-                SKIP(parser);
-                SKIP_LINE(parser);
+    if (!BUFFER_IS_STABLE(parser))
+        return 0;
+
+    buffer.pointer = parser->buffer.pointer;
+    start = end = buffer.pointer;
+
+    while (1)
+    {
+        /* Check for a document indicator. */
+
+        if (!BORROW_CACHE(parser, unread, 4))
+            return 0;
+
+        if (mark.column == 0 &&
+            ((CHECK_AT(buffer, '-', 0) &&
+              CHECK_AT(buffer, '-', 1) &&
+              CHECK_AT(buffer, '-', 2)) ||
+             (CHECK_AT(buffer, '.', 0) &&
+              CHECK_AT(buffer, '.', 1) &&
+              CHECK_AT(buffer, '.', 2))) &&
+            IS_BLANKZ_AT(buffer, 3)) break;
+
+        /* Check for a comment. */
+
+        if (CHECK(buffer, '#'))
+            break;
+
+        /* Skip non-blank characters. */
+
+        while (!IS_BLANKZ(buffer))
+        {
+            /* Leave errors to the regular scanner. */
+
+            if (parser->flow_level
+                    && CHECK(buffer, ':')
+                    && (
+                        CHECK_AT(buffer, ',', 1)
+                        || CHECK_AT(buffer, '?', 1)
+                        || CHECK_AT(buffer, '[', 1)
+                        || CHECK_AT(buffer, ']', 1)
+                        || CHECK_AT(buffer, '{', 1)
+                        || CHECK_AT(buffer, '}', 1)
+                    ))
+                return 0;
+
+            /* Check for indicators that may end a plain scalar. */
+
+            if ((CHECK(buffer, ':') && IS_BLANKZ_AT(buffer, 1))
+                    || (parser->flow_level &&
+                        (CHECK(buffer, ',')
+                         || CHECK(buffer, '[')
+                         || CHECK(buffer, ']') || CHECK(buffer, '{')
+                         || CHECK(buffer, '}'))))
+                break;
+
+            /*
+             * Line breaks followed by more content are folded.  Whitespaces
+             * within a line are kept as they are.
+             */
+
+            if (leading_blanks)
+                return 0;
+
+            BORROW_SKIP(buffer, unread, mark);
+
+            length = yaml_parser_plain_span(buffer.pointer, parser->buffer.last);
+            mark.index += length;
+            mark.column += length;
+            unread -= length;
+            buffer.pointer += length;
+
+            end = buffer.pointer;
+            end_mark = mark;
+
+            if (!BORROW_CACHE(parser, unread, 2))
+                return 0;
+        }
+
+        /* Is it the end? */
+
+        if (!(IS_BLANK(buffer) || IS_BREAK(buffer)))
+            break;
+
+        /* Skip blank characters. */
+
+        while (IS_BLANK(buffer) || IS_BREAK(buffer))
+        {
+            if (IS_BLANK(buffer))
+            {
+                if (leading_blanks && (int)mark.column < indent
+                        && IS_TAB(buffer))
+                    return 0;
+
+                BORROW_SKIP(buffer, unread, mark);
+            }
+            else
+            {
+                if (!BORROW_CACHE(parser, unread, 2))
+                    return 0;
+
+                BORROW_SKIP_LINE(buffer, unread, mark);
+                (void)INDEX_LINE(parser, mark);
+                leading_blanks = 1;
+            }
+
+            if (!BORROW_CACHE(parser, unread, 1))
+                return 0;
+        }
+
+        /* Check indentation level. */
+
+        if (!parser->flow_level && (int)mark.column < indent)
+            break;
+    }
+
+    SCALAR_TOKEN_INIT(*token, start, end-start,
+            YAML_PLAIN_SCALAR_STYLE, parser->mark, end_mark);
+    token->borrowed = 1;
+
+    parser->buffer.pointer = buffer.pointer;
+    parser->unread = unread;
+    parser->mark = mark;
+
+    /* Note that we change the 'simple_key_allowed' flag. */
+
+    if (leading_blanks) {
+        parser->simple_key_allowed = 1;
+    }
+
+    return 1;
+}
+
+/*
+ * Scan a quoted scalar.
+ */
+
+static int
+yaml_parser_scan_flow_scalar(yaml_parser_t *parser, yaml_token_t *token,
+        int single)
+{
+    yaml_mark_t start_mark;
+    yaml_mark_t end_mark;
+    yaml_string_t string = NULL_STRING;
+    yaml_string_t leading_break = NULL_STRING;
+    yaml_string_t trailing_breaks = NULL_STRING;
+    yaml_string_t whitespaces = NULL_STRING;
+    int leading_blanks;
+    yaml_char_t *value;
+    size_t length;
+
+    if (parser->borrowed_scalars
+            && yaml_parser_borrow_flow_scalar(parser, token, single))
+        return 1;
+
+    if (!yaml_parser_take_scratch(parser, SCRATCH_STRING, &string, 0))
+        goto error;
+    if (!yaml_parser_take_scratch(parser, SCRATCH_LEADING_BREAK,
+                &leading_break, 1)) goto error;
+    if (!yaml_parser_take_scratch(parser, SCRATCH_TRAILING_BREAKS,
+                &trailing_breaks, 1)) goto error;
+    if (!yaml_parser_take_scratch(parser, SCRATCH_WHITESPACES,
+                &whitespaces, 1)) goto error;
+
+    /* Eat the left quote. */
+
+    start_mark = parser->mark;
+
+    SKIP(parser);
+
+    /* Consume the content of the quoted scalar. */
+
+    while (1)
+    {
+        /* Check that there are no document indicators at the beginning of the line. */
+
+        if (!CACHE(parser, 4)) goto error;
+
+        if (parser->mark.column == 0 &&
+            ((CHECK_AT(parser->buffer, '-', 0) &&
+              CHECK_AT(parser->buffer, '-', 1) &&
+              CHECK_AT(parser->buffer, '-', 2)) ||
+             (CHECK_AT(parser->buffer, '.', 0) &&
+              CHECK_AT(parser->buffer, '.', 1) &&
+              CHECK_AT(parser->buffer, '.', 2))) &&
+            IS_BLANKZ_AT(parser->buffer, 3))
+        {
+            yaml_parser_set_scanner_error(parser, "while scanning a quoted scalar",
+                    start_mark, "found unexpected document indicator");
+            goto error;
+        }
+
+        /* Check for EOF. */
+
+        if (IS_Z(parser->buffer)) {
+            yaml_parser_set_scanner_error(parser, "while scanning a quoted scalar",
+                    start_mark, "found unexpected end of stream");
+            goto error;
+        }
+
+        /* Consume non-blank characters. */
+
+        if (!CACHE(parser, 2)) goto error;
+
+        leading_blanks = 0;
+
+        while (!IS_BLANKZ(parser->buffer))
+        {
+            /* Check for an escaped single quote. */
+
+            if (single && CHECK_AT(parser->buffer, '\'', 0)
+                    && CHECK_AT(parser->buffer, '\'', 1))
+            {
+                if (!STRING_EXTEND(parser, string)) goto error;
+                *(string.pointer++) = '\'';
+                SKIP(parser);
+                SKIP(parser);
+            }
+
+            /* Check for the right quote. */
+
+            else if (CHECK(parser->buffer, single ? '\'' : '"'))
+            {
+                break;
+            }
+
+            /* Check for an escaped line break. */
+
+            else if (!single && CHECK(parser->buffer, '\\')
+                    && IS_BREAK_AT(parser->buffer, 1))
+            {
+                if (!CACHE(parser, 3)) goto error;
+                SKIP(parser);
+                SKIP_LINE(parser);
                 leading_blanks = 1;
                 break;
             }
@@ -3282,6 +4417,9 @@ yaml_parser_scan_flow_scalar(yaml_parser_t *parser, yaml_token_t *token,
                 if (!READ(parser, string)) goto error;
             }
 
+            if (!SCALAR_LIMITS(parser, string.pointer - string.start,
+                        start_mark)) goto error;
+
             if (!CACHE(parser, 2)) goto error;
         }
 
@@ -3329,6 +4467,8 @@ yaml_parser_scan_flow_scalar(yaml_parser_t *parser, yaml_token_t *token,
                     if (!READ_LINE(parser, trailing_breaks)) goto error;
                 }
             }
+            if (!SCALAR_LIMITS(parser, string.pointer - string.start,
+                        start_mark)) goto error;
             if (!CACHE(parser, 1)) goto error;
         }
 
@@ -3371,21 +4511,25 @@ yaml_parser_scan_flow_scalar(yaml_parser_t *parser, yaml_token_t *token,
 
     /* Create a token. */
 
-    SCALAR_TOKEN_INIT(*token, string.start, string.pointer-string.start,
+    if (!yaml_parser_copy_scratch(parser, &string, &value, &length))
+        goto error;
+
+    SCALAR_TOKEN_INIT(*token, value, length,
             single ? YAML_SINGLE_QUOTED_SCALAR_STYLE : YAML_DOUBLE_QUOTED_SCALAR_STYLE,
             start_mark, end_mark);
 
-    STRING_DEL(parser, leading_break);
-    STRING_DEL(parser, trailing_breaks);
-    STRING_DEL(parser, whitespaces);
+    yaml_parser_give_scratch(parser, SCRATCH_STRING, &string);
+    yaml_parser_give_scratch(parser, SCRATCH_LEADING_BREAK, &leading_break);
+    yaml_parser_give_scratch(parser, SCRATCH_TRAILING_BREAKS, &trailing_breaks);
+    yaml_parser_give_scratch(parser, SCRATCH_WHITESPACES, &whitespaces);
 
     return 1;
 
 error:
-    STRING_DEL(parser, string);
-    STRING_DEL(parser, leading_break);
-    STRING_DEL(parser, trailing_breaks);
-    STRING_DEL(parser, whitespaces);
+    yaml_parser_give_scratch(parser, SCRATCH_STRING, &string);
+    yaml_parser_give_scratch(parser, SCRATCH_LEADING_BREAK, &leading_break);
+    yaml_parser_give_scratch(parser, SCRATCH_TRAILING_BREAKS, &trailing_breaks);
+    yaml_parser_give_scratch(parser, SCRATCH_WHITESPACES, &whitespaces);
 
     return 0;
 }
@@ -3403,13 +4547,24 @@ yaml_parser_scan_plain_scalar(yaml_parser_t *parser, yaml_token_t *token)
     yaml_string_t leading_break = NULL_STRING;
     yaml_string_t trailing_breaks = NULL_STRING;
     yaml_string_t whitespaces = NULL_STRING;
+    yaml_string_t run = NULL_STRING;
     int leading_blanks = 0;
     int indent = parser->indent+1;
+    yaml_char_t *value;
+    size_t length;
 
-    if (!STRING_INIT(parser, string, INITIAL_STRING_SIZE)) goto error;
-    if (!STRING_INIT(parser, leading_break, INITIAL_STRING_SIZE)) goto error;
-    if (!STRING_INIT(parser, trailing_breaks, INITIAL_STRING_SIZE)) goto error;
-    if (!STRING_INIT(parser, whitespaces, INITIAL_STRING_SIZE)) goto error;
+    if (parser->borrowed_scalars
+            && yaml_parser_borrow_plain_scalar(parser, token))
+        return 1;
+
+    if (!yaml_parser_take_scratch(parser, SCRATCH_STRING, &string, 0))
+        goto error;
+    if (!yaml_parser_take_scratch(parser, SCRATCH_LEADING_BREAK,
+                &leading_break, 1)) goto error;
+    if (!yaml_parser_take_scratch(parser, SCRATCH_TRAILING_BREAKS,
+                &trailing_breaks, 1)) goto error;
+    if (!yaml_parser_take_scratch(parser, SCRATCH_WHITESPACES,
+                &whitespaces, 1)) goto error;
 
     start_mark = end_mark = parser->mark;
 
@@ -3505,12 +4660,24 @@ yaml_parser_scan_plain_scalar(yaml_parser_t *parser, yaml_token_t *token)
                 }
             }
 
-            /* Copy the character. */
+            /* Copy the character and the plain run that follows it. */
 
             if (!READ(parser, string)) goto error;
 
+            run.start = parser->buffer.pointer;
+            run.pointer = run.start + yaml_parser_plain_span(run.start,
+                    parser->buffer.last);
+            if (run.pointer != run.start) {
+                size_t length = run.pointer - run.start;
+                if (!JOIN(parser, string, run)) goto error;
+                SKIP_ASCII(parser, length);
+            }
+
             end_mark = parser->mark;
 
+            if (!SCALAR_LIMITS(parser, string.pointer - string.start,
+                        start_mark)) goto error;
+
             if (!CACHE(parser, 2)) goto error;
         }
 
@@ -3562,6 +4729,8 @@ yaml_parser_scan_plain_scalar(yaml_parser_t *parser, yaml_token_t *token)
                     if (!READ_LINE(parser, trailing_breaks)) goto error;
                 }
             }
+            if (!SCALAR_LIMITS(parser, string.pointer - string.start,
+                        start_mark)) goto error;
             if (!CACHE(parser, 1)) goto error;
         }
 
@@ -3573,7 +4742,10 @@ yaml_parser_scan_plain_scalar(yaml_parser_t *parser, yaml_token_t *token)
 
     /* Create a token. */
 
-    SCALAR_TOKEN_INIT(*token, string.start, string.pointer-string.start,
+    if (!yaml_parser_copy_scratch(parser, &string, &value, &length))
+        goto error;
+
+    SCALAR_TOKEN_INIT(*token, value, length,
             YAML_PLAIN_SCALAR_STYLE, start_mark, end_mark);
 
     /* Note that we change the 'simple_key_allowed' flag. */
@@ -3582,17 +4754,619 @@ yaml_parser_scan_plain_scalar(yaml_parser_t *parser, yaml_token_t *token)
         parser->simple_key_allowed = 1;
     }
 
-    STRING_DEL(parser, leading_break);
-    STRING_DEL(parser, trailing_breaks);
-    STRING_DEL(parser, whitespaces);
+    yaml_parser_give_scratch(parser, SCRATCH_STRING, &string);
+    yaml_parser_give_scratch(parser, SCRATCH_LEADING_BREAK, &leading_break);
+    yaml_parser_give_scratch(parser, SCRATCH_TRAILING_BREAKS, &trailing_breaks);
+    yaml_parser_give_scratch(parser, SCRATCH_WHITESPACES, &whitespaces);
+
+    return 1;
+
+error:
+    yaml_parser_give_scratch(parser, SCRATCH_STRING, &string);
+    yaml_parser_give_scratch(parser, SCRATCH_LEADING_BREAK, &leading_break);
+    yaml_parser_give_scratch(parser, SCRATCH_TRAILING_BREAKS, &trailing_breaks);
+    yaml_parser_give_scratch(parser, SCRATCH_WHITESPACES, &whitespaces);
+
+    return 0;
+}
+
+/*
+ * JSON scanning.
+ *
+ * In the JSON mode, the tokens are produced by a scanner that follows the
+ * JSON grammar instead of the YAML one.  Since every key is a string that
+ * follows '{' or ',', the KEY token is known before the key is scanned, and
+ * there is no need to keep track of simple keys or indentation levels.  The
+ * tokens are the same as those the YAML scanner produces for the same input.
+ */
+
+/*
+ * Fetch the next JSON token.
+ */
+
+static int
+yaml_parser_fetch_json_token(yaml_parser_t *parser)
+{
+    yaml_json_level_t *level = NULL;
+
+    /* Eat whitespaces. */
+
+    while (1)
+    {
+        if (!CACHE(parser, 2)) return 0;
+
+        if (CHECK(parser->buffer, ' ') || CHECK(parser->buffer, '\t'))
+            SKIP(parser);
+        else if (CHECK(parser->buffer, '\r') || CHECK(parser->buffer, '\n'))
+            SKIP_LINE(parser);
+        else
+            break;
+    }
+
+    if (!STACK_EMPTY(parser, parser->json_levels))
+        level = parser->json_levels.top-1;
+
+    /* Is it the end of the stream? */
+
+    if (IS_Z(parser->buffer))
+    {
+        if (level || parser->json_state != YAML_JSON_NEXT_STATE)
+            return yaml_parser_set_json_error(parser,
+                    "found unexpected end of stream");
+
+        return yaml_parser_fetch_stream_end(parser);
+    }
+
+    switch (parser->json_state)
+    {
+        case YAML_JSON_FIRST_ITEM_STATE:
+            if (CHECK(parser->buffer, ']'))
+                return yaml_parser_fetch_json_collection_end(parser);
+            return yaml_parser_fetch_json_value(parser);
+
+        case YAML_JSON_VALUE_STATE:
+            return yaml_parser_fetch_json_value(parser);
+
+        case YAML_JSON_FIRST_KEY_STATE:
+            if (CHECK(parser->buffer, '}'))
+                return yaml_parser_fetch_json_collection_end(parser);
+            /* Fall through. */
+
+        case YAML_JSON_KEY_STATE:
+            if (!CHECK(parser->buffer, '"'))
+                return yaml_parser_set_json_error(parser,
+                        "did not find expected key");
+            if (!yaml_parser_fetch_json_indicator(parser, YAML_KEY_TOKEN))
+                return 0;
+            if (!yaml_parser_fetch_json_scalar(parser))
+                return 0;
+            parser->json_state = YAML_JSON_COLON_STATE;
+            return 1;
+
+        case YAML_JSON_COLON_STATE:
+            if (!CHECK(parser->buffer, ':'))
+                return yaml_parser_set_json_error(parser,
+                        "did not find expected ':'");
+            parser->json_state = YAML_JSON_VALUE_STATE;
+            return yaml_parser_fetch_json_indicator(parser, YAML_VALUE_TOKEN);
+
+        case YAML_JSON_NEXT_STATE:
+            if (!level)
+                return yaml_parser_set_json_error(parser,
+                        "did not find expected <stream end>");
+            if (CHECK(parser->buffer, ',')) {
+                parser->json_state = level->mapping ?
+                    YAML_JSON_KEY_STATE : YAML_JSON_VALUE_STATE;
+                return yaml_parser_fetch_json_indicator(parser,
+                        YAML_FLOW_ENTRY_TOKEN);
+            }
+            if (CHECK(parser->buffer, level->mapping ? '}' : ']'))
+                return yaml_parser_fetch_json_collection_end(parser);
+            return yaml_parser_set_json_error(parser, level->mapping ?
+                    "did not find expected ',' or '}'" :
+                    "did not find expected ',' or ']'");
+    }
+
+    return 0;
+}
+
+/*
+ * Fetch a JSON value: a collection start or a scalar.
+ */
+
+static int
+yaml_parser_fetch_json_value(yaml_parser_t *parser)
+{
+    yaml_json_level_t level;
+
+    if (CHECK(parser->buffer, '[') || CHECK(parser->buffer, '{'))
+    {
+        level.mapping = CHECK(parser->buffer, '{');
+        level.mark = parser->mark;
+
+        if (!yaml_parser_check_depth(parser, parser->mark))
+            return 0;
+
+        if (parser->flow_level == INT_MAX) {
+            parser->error = YAML_MEMORY_ERROR;
+            return 0;
+        }
+
+        if (!PUSH(parser, parser->json_levels, level))
+            return 0;
+
+        parser->flow_level ++;
+        parser->json_state = level.mapping ?
+            YAML_JSON_FIRST_KEY_STATE : YAML_JSON_FIRST_ITEM_STATE;
+
+        return yaml_parser_fetch_json_indicator(parser, level.mapping ?
+                YAML_FLOW_MAPPING_START_TOKEN : YAML_FLOW_SEQUENCE_START_TOKEN);
+    }
+
+    if (CHECK(parser->buffer, '"') || CHECK(parser->buffer, '-')
+            || IS_DIGIT(parser->buffer) || CHECK(parser->buffer, 't')
+            || CHECK(parser->buffer, 'f') || CHECK(parser->buffer, 'n'))
+    {
+        if (!yaml_parser_fetch_json_scalar(parser))
+            return 0;
+
+        parser->json_state = YAML_JSON_NEXT_STATE;
+
+        return 1;
+    }
+
+    return yaml_parser_set_json_error(parser,
+            "did not find expected node content");
+}
+
+/*
+ * Fetch the end of the innermost JSON collection.
+ */
+
+static int
+yaml_parser_fetch_json_collection_end(yaml_parser_t *parser)
+{
+    yaml_json_level_t level = POP(parser, parser->json_levels);
+
+    parser->flow_level --;
+    parser->json_state = YAML_JSON_NEXT_STATE;
+
+    return yaml_parser_fetch_json_indicator(parser, level.mapping ?
+            YAML_FLOW_MAPPING_END_TOKEN : YAML_FLOW_SEQUENCE_END_TOKEN);
+}
+
+/*
+ * Produce a token of a single-character indicator, or a KEY token in front of
+ * the current character.
+ */
+
+static int
+yaml_parser_fetch_json_indicator(yaml_parser_t *parser,
+        yaml_token_type_t type)
+{
+    yaml_mark_t start_mark = parser->mark;
+    yaml_token_t token;
+
+    if (type != YAML_KEY_TOKEN)
+        SKIP(parser);
+
+    TOKEN_INIT(token, type, start_mark, parser->mark);
+
+    if (!ENQUEUE(parser, parser->tokens, token))
+        return 0;
+
+    return 1;
+}
+
+/*
+ * Produce a SCALAR token for a string, a number or a literal.
+ */
+
+static int
+yaml_parser_fetch_json_scalar(yaml_parser_t *parser)
+{
+    yaml_token_t token;
+
+    if (CHECK(parser->buffer, '"')) {
+        if (!yaml_parser_scan_json_string(parser, &token))
+            return 0;
+    }
+    else {
+        if (!yaml_parser_scan_json_plain(parser, &token))
+            return 0;
+    }
+
+    if (!yaml_parser_check_scalar_length(parser, &token)
+            || !ENQUEUE(parser, parser->tokens, token)) {
+        token.allocator = parser->allocator;
+        yaml_token_delete(&token);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Scan a JSON string.
+ */
+
+static int
+yaml_parser_scan_json_string(yaml_parser_t *parser, yaml_token_t *token)
+{
+    yaml_mark_t start_mark = parser->mark;
+    yaml_string_t string = NULL_STRING;
+
+    /* Eat the left quote. */
+
+    SKIP(parser);
+
+    /* Borrow the value if it has no escape sequences. */
+
+    if (parser->borrowed_scalars && BUFFER_IS_STABLE(parser))
+    {
+        yaml_string_t buffer = NULL_STRING;
+        size_t unread = parser->unread;
+        yaml_mark_t mark = parser->mark;
+
+        buffer.pointer = parser->buffer.pointer;
+
+        while (BORROW_CACHE(parser, unread, 1)
+                && *buffer.pointer >= 0x20 && !CHECK(buffer, '\\')
+                && !CHECK(buffer, '"')) {
+            BORROW_SKIP(buffer, unread, mark);
+        }
+
+        if (BORROW_CACHE(parser, unread, 1) && CHECK(buffer, '"'))
+        {
+            yaml_char_t *start = parser->buffer.pointer;
+
+            BORROW_SKIP(buffer, unread, mark);
+
+            SCALAR_TOKEN_INIT(*token, start, buffer.pointer-1-start,
+                    YAML_DOUBLE_QUOTED_SCALAR_STYLE, start_mark, mark);
+            token->borrowed = 1;
+
+            parser->buffer.pointer = buffer.pointer;
+            parser->unread = unread;
+            parser->mark = mark;
+
+            return 1;
+        }
+    }
+
+    if (!STRING_INIT(parser, string, INITIAL_STRING_SIZE)) goto error;
+
+    /* Consume the content of the string. */
+
+    while (1)
+    {
+        if (!CACHE(parser, 2)) goto error;
+
+        /* Check for the right quote. */
+
+        if (CHECK(parser->buffer, '"'))
+            break;
+
+        /* Check for EOF and control characters. */
+
+        if (IS_Z(parser->buffer)) {
+            yaml_parser_set_scanner_error(parser, "while scanning a quoted scalar",
+                    start_mark, "found unexpected end of stream");
+            goto error;
+        }
+
+        if (*parser->buffer.pointer < 0x20) {
+            yaml_parser_set_scanner_error(parser, "while scanning a quoted scalar",
+                    start_mark, "found unexpected control character");
+            goto error;
+        }
+
+        /* Check for a Unicode escape sequence. */
+
+        if (CHECK(parser->buffer, '\\') && CHECK_AT(parser->buffer, 'u', 1))
+        {
+            unsigned int value;
+
+            if (!yaml_parser_scan_json_code_unit(parser, start_mark, &value))
+                goto error;
+
+            /* A high surrogate must be followed by a low one. */
+
+            if (value >= 0xD800 && value <= 0xDBFF)
+            {
+                unsigned int low = 0;
+
+                if (!CACHE(parser, 2)) goto error;
+
+                if (CHECK_AT(parser->buffer, '\\', 0)
+                        && CHECK_AT(parser->buffer, 'u', 1)) {
+                    if (!yaml_parser_scan_json_code_unit(parser, start_mark, &low))
+                        goto error;
+                }
+
+                if (low < 0xDC00 || low > 0xDFFF) {
+                    yaml_parser_set_scanner_error(parser, "while parsing a quoted scalar",
+                            start_mark, "found invalid Unicode character escape code");
+                    goto error;
+                }
+
+                value = 0x10000 + ((value - 0xD800) << 10) + (low - 0xDC00);
+            }
+            else if (value >= 0xDC00 && value <= 0xDFFF) {
+                yaml_parser_set_scanner_error(parser, "while parsing a quoted scalar",
+                        start_mark, "found invalid Unicode character escape code");
+                goto error;
+            }
+
+            /* Write the character. */
+
+            if (!STRING_EXTEND(parser, string)) goto error;
+
+            if (value <= 0x7F) {
+                *(string.pointer++) = value;
+            }
+            else if (value <= 0x7FF) {
+                *(string.pointer++) = 0xC0 + (value >> 6);
+                *(string.pointer++) = 0x80 + (value & 0x3F);
+            }
+            else if (value <= 0xFFFF) {
+                *(string.pointer++) = 0xE0 + (value >> 12);
+                *(string.pointer++) = 0x80 + ((value >> 6) & 0x3F);
+                *(string.pointer++) = 0x80 + (value & 0x3F);
+            }
+            else {
+                *(string.pointer++) = 0xF0 + (value >> 18);
+                *(string.pointer++) = 0x80 + ((value >> 12) & 0x3F);
+                *(string.pointer++) = 0x80 + ((value >> 6) & 0x3F);
+                *(string.pointer++) = 0x80 + (value & 0x3F);
+            }
+        }
+
+        /* Check for an escape sequence. */
+
+        else if (CHECK(parser->buffer, '\\'))
+        {
+            if (!STRING_EXTEND(parser, string)) goto error;
+
+            switch (parser->buffer.pointer[1])
+            {
+                case '"':
+                    *(string.pointer++) = '"';
+                    break;
+
+                case '\\':
+                    *(string.pointer++) = '\\';
+                    break;
+
+                case '/':
+                    *(string.pointer++) = '/';
+                    break;
+
+                case 'b':
+                    *(string.pointer++) = '\x08';
+                    break;
+
+                case 'f':
+                    *(string.pointer++) = '\x0C';
+                    break;
+
+                case 'n':
+                    *(string.pointer++) = '\x0A';
+                    break;
+
+                case 'r':
+                    *(string.pointer++) = '\x0D';
+                    break;
+
+                case 't':
+                    *(string.pointer++) = '\x09';
+                    break;
+
+                default:
+                    yaml_parser_set_scanner_error(parser, "while parsing a quoted scalar",
+                            start_mark, "found unknown escape character");
+                    goto error;
+            }
+
+            SKIP(parser);
+            SKIP(parser);
+        }
+
+        /* It is a non-escaped character. */
+
+        else
+        {
+            if (!READ(parser, string)) goto error;
+        }
+
+        if (!SCALAR_LIMITS(parser, string.pointer - string.start, start_mark))
+            goto error;
+    }
+
+    /* Eat the right quote. */
+
+    SKIP(parser);
+
+    SCALAR_TOKEN_INIT(*token, string.start, string.pointer-string.start,
+            YAML_DOUBLE_QUOTED_SCALAR_STYLE, start_mark, parser->mark);
+
+    return 1;
+
+error:
+    STRING_DEL(parser, string);
+
+    return 0;
+}
+
+/*
+ * Scan a '\uXXXX' escape sequence.
+ */
+
+static int
+yaml_parser_scan_json_code_unit(yaml_parser_t *parser, yaml_mark_t start_mark,
+        unsigned int *value)
+{
+    int k;
+
+    if (!CACHE(parser, 6)) return 0;
+
+    *value = 0;
+
+    for (k = 2; k < 6; k ++) {
+        if (!IS_HEX_AT(parser->buffer, k)) {
+            return yaml_parser_set_scanner_error(parser, "while parsing a quoted scalar",
+                    start_mark, "did not find expected hexdecimal number");
+        }
+        *value = (*value << 4) + AS_HEX_AT(parser->buffer, k);
+    }
+
+    for (k = 0; k < 6; k ++) {
+        SKIP(parser);
+    }
+
+    return 1;
+}
+
+/*
+ * Scan a JSON number or one of the literals 'true', 'false' and 'null'.
+ */
+
+#define JSON_ACCEPT(parser,string,borrow)                                       \
+    ((borrow) ? (SKIP(parser), 1) : READ(parser,string))
+
+static int
+yaml_parser_scan_json_plain(yaml_parser_t *parser, yaml_token_t *token)
+{
+    yaml_mark_t start_mark = parser->mark;
+    yaml_string_t string = NULL_STRING;
+    yaml_char_t *start = parser->buffer.pointer;
+    int borrow = (parser->borrowed_scalars && BUFFER_IS_STABLE(parser));
+
+    if (!borrow) {
+        if (!STRING_INIT(parser, string, INITIAL_STRING_SIZE)) goto error;
+    }
+
+    if (!CACHE(parser, 5)) goto error;
+
+    if (CHECK(parser->buffer, 't') || CHECK(parser->buffer, 'f')
+            || CHECK(parser->buffer, 'n'))
+    {
+        /* Check the literal. */
+
+        const char *literal = CHECK(parser->buffer, 't') ? "true" :
+            CHECK(parser->buffer, 'f') ? "false" : "null";
+        size_t k;
+
+        for (k = 0; literal[k]; k ++) {
+            if (!CHECK_AT(parser->buffer, literal[k], k)) {
+                yaml_parser_set_scanner_error(parser, "while scanning a plain scalar",
+                        start_mark, "did not find expected 'true', 'false' or 'null'");
+                goto error;
+            }
+        }
+
+        for (k = 0; literal[k]; k ++) {
+            if (!JSON_ACCEPT(parser, string, borrow)) goto error;
+        }
+    }
+    else
+    {
+        /* Check the number: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? */
+
+        int part;
+
+        if (CHECK(parser->buffer, '-')) {
+            if (!JSON_ACCEPT(parser, string, borrow)) goto error;
+        }
+
+        for (part = 0; part < 3; part ++)
+        {
+            int digits = 0;
+
+            if (!CACHE(parser, 1)) goto error;
+
+            if (part == 1) {
+                if (!CHECK(parser->buffer, '.'))
+                    continue;
+                if (!JSON_ACCEPT(parser, string, borrow)) goto error;
+            }
+
+            if (part == 2) {
+                if (!CHECK(parser->buffer, 'e') && !CHECK(parser->buffer, 'E'))
+                    continue;
+                if (!JSON_ACCEPT(parser, string, borrow)) goto error;
+                if (!CACHE(parser, 1)) goto error;
+                if (CHECK(parser->buffer, '+') || CHECK(parser->buffer, '-')) {
+                    if (!JSON_ACCEPT(parser, string, borrow)) goto error;
+                }
+            }
+
+            /* The integer part has no leading zeros. */
+
+            if (part == 0 && CHECK(parser->buffer, '0')) {
+                if (!JSON_ACCEPT(parser, string, borrow)) goto error;
+                continue;
+            }
+
+            while (1) {
+                if (!CACHE(parser, 1)) goto error;
+                if (!IS_DIGIT(parser->buffer))
+                    break;
+                if (!JSON_ACCEPT(parser, string, borrow)) goto error;
+                if (!SCALAR_LIMITS(parser,
+                            parser->mark.index - start_mark.index,
+                            start_mark)) goto error;
+                digits ++;
+            }
+
+            if (!digits) {
+                yaml_parser_set_scanner_error(parser, "while scanning a plain scalar",
+                        start_mark, "did not find expected digit");
+                goto error;
+            }
+        }
+    }
+
+    /*
+     * The scalar is ASCII.  Zero-copy input may have been moved into a buffer
+     * at its end, but the input itself stays in place.
+     */
+
+    if (borrow) {
+        SCALAR_TOKEN_INIT(*token, start, parser->mark.index-start_mark.index,
+                YAML_PLAIN_SCALAR_STYLE, start_mark, parser->mark);
+        token->borrowed = 1;
+    }
+    else {
+        SCALAR_TOKEN_INIT(*token, string.start, string.pointer-string.start,
+                YAML_PLAIN_SCALAR_STYLE, start_mark, parser->mark);
+    }
 
     return 1;
 
 error:
     STRING_DEL(parser, string);
-    STRING_DEL(parser, leading_break);
-    STRING_DEL(parser, trailing_breaks);
-    STRING_DEL(parser, whitespaces);
 
     return 0;
 }
+
+/*
+ * Set a scanner error at the current position, in the context of the
+ * innermost unclosed collection.
+ */
+
+static int
+yaml_parser_set_json_error(yaml_parser_t *parser, const char *problem)
+{
+    yaml_json_level_t *level;
+
+    if (STACK_EMPTY(parser, parser->json_levels))
+        return yaml_parser_set_scanner_error(parser,
+                "while scanning for the next token", parser->mark, problem);
+
+    level = parser->json_levels.top-1;
+
+    return yaml_parser_set_scanner_error(parser, level->mapping ?
+            "while scanning a flow mapping" : "while scanning a flow sequence",
+            level->mark, problem);
+}
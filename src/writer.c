@@ -1,6 +1,59 @@
 
 #include "yaml_private.h"
 
+#include <errno.h>
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#if HAVE_PTHREAD && HAVE_UNISTD_H
+#include <pthread.h>
+#endif
+
+/*
+ * The background writer of a file descriptor output.
+ *
+ * The emitter fills its output buffer while the thread writes the previous
+ * one.  On a flush, the emitter waits for the thread to finish, hands it the
+ * filled buffer and takes the spare one.
+ */
+
+struct yaml_writer_s {
+#if HAVE_PTHREAD && HAVE_UNISTD_H
+    /** The writer thread. */
+    pthread_t thread;
+
+    /** The mutex protecting the fields below. */
+    pthread_mutex_t mutex;
+
+    /** Signaled when a buffer is handed to the thread or it should stop. */
+    pthread_cond_t ready;
+
+    /** Signaled when the thread has written a buffer. */
+    pthread_cond_t written;
+#endif
+
+    /** The file descriptor. */
+    int fd;
+
+    /** The buffer being written or @c NULL if the thread is idle. */
+    unsigned char *pending;
+
+    /** The number of bytes to write from the pending buffer. */
+    size_t pending_size;
+
+    /** The buffer the emitter takes on the next flush. */
+    yaml_char_t *spare;
+
+    /** If the thread should exit. */
+    int stop;
+
+    /** If a write failed. */
+    int failed;
+
+};
+
 /*
  * Declarations.
  */
@@ -8,9 +61,27 @@
 static int
 yaml_emitter_set_writer_error(yaml_emitter_t *emitter, const char *problem);
 
+static int
+yaml_write_fd(int fd, const unsigned char *buffer, size_t size);
+
+static int
+yaml_emitter_wait_writer(yaml_emitter_t *emitter);
+
 YAML_DECLARE(int)
 yaml_emitter_flush(yaml_emitter_t *emitter);
 
+YAML_DECLARE(int)
+yaml_emitter_flush_buffer(yaml_emitter_t *emitter);
+
+YAML_DECLARE(int)
+yaml_fd_write_handler(void *data, unsigned char *buffer, size_t size);
+
+YAML_DECLARE(int)
+yaml_emitter_start_writer(yaml_emitter_t *emitter);
+
+YAML_DECLARE(void)
+yaml_emitter_stop_writer(yaml_emitter_t *emitter);
+
 /*
  * Set the writer error and return 0.
  */
@@ -25,11 +96,232 @@ yaml_emitter_set_writer_error(yaml_emitter_t *emitter, const char *problem)
 }
 
 /*
- * Flush the output buffer.
+ * Write the whole buffer to a file descriptor, resuming after short writes and
+ * interrupted calls.
+ */
+
+static int
+yaml_write_fd(int fd, const unsigned char *buffer, size_t size)
+{
+#if HAVE_UNISTD_H
+    while (size)
+    {
+        ssize_t written = write(fd, buffer, size);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+
+        buffer += written;
+        size -= (size_t)written;
+    }
+
+    return 1;
+#else
+    (void)fd;
+    (void)buffer;
+
+    return !size;
+#endif
+}
+
+/*
+ * File descriptor write handler.
+ */
+
+YAML_DECLARE(int)
+yaml_fd_write_handler(void *data, unsigned char *buffer, size_t size)
+{
+    yaml_emitter_t *emitter = (yaml_emitter_t *)data;
+
+    return yaml_write_fd(emitter->output.fd, buffer, size);
+}
+
+#if HAVE_PTHREAD && HAVE_UNISTD_H
+
+/*
+ * The writer thread: write the buffers handed by the emitter until asked to
+ * stop.  The pending buffer is written before stopping.
+ */
+
+static void *
+yaml_writer_thread(void *data)
+{
+    struct yaml_writer_s *writer = (struct yaml_writer_s *)data;
+
+    pthread_mutex_lock(&writer->mutex);
+
+    while (1)
+    {
+        unsigned char *buffer;
+        size_t size;
+        int written;
+
+        while (!writer->pending && !writer->stop) {
+            pthread_cond_wait(&writer->ready, &writer->mutex);
+        }
+
+        if (!writer->pending)
+            break;
+
+        buffer = writer->pending;
+        size = writer->pending_size;
+
+        pthread_mutex_unlock(&writer->mutex);
+        written = yaml_write_fd(writer->fd, buffer, size);
+        pthread_mutex_lock(&writer->mutex);
+
+        if (!written) {
+            writer->failed = 1;
+        }
+        writer->pending = NULL;
+        pthread_cond_signal(&writer->written);
+    }
+
+    pthread_mutex_unlock(&writer->mutex);
+
+    return NULL;
+}
+
+#endif
+
+/*
+ * Start the background writer.  If threads are not available or the thread
+ * cannot be created, the output is written synchronously.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_start_writer(yaml_emitter_t *emitter)
+{
+#if HAVE_PTHREAD && HAVE_UNISTD_H
+    struct yaml_writer_s *writer;
+
+    assert(emitter);    /* Non-NULL emitter object is expected. */
+    assert(!emitter->writer);   /* The writer is started once. */
+
+    writer = (struct yaml_writer_s *)yaml_malloc_with(emitter->allocator,
+            sizeof(struct yaml_writer_s));
+    if (!writer) {
+        emitter->error = YAML_MEMORY_ERROR;
+        return 0;
+    }
+    memset(writer, 0, sizeof(struct yaml_writer_s));
+    writer->fd = emitter->output.fd;
+
+    writer->spare = (yaml_char_t *)yaml_malloc_with(emitter->allocator,
+            emitter->buffer.end - emitter->buffer.start);
+    if (!writer->spare) {
+        yaml_free_with(emitter->allocator, writer);
+        emitter->error = YAML_MEMORY_ERROR;
+        return 0;
+    }
+
+    if (pthread_mutex_init(&writer->mutex, NULL) != 0) {
+        yaml_free_with(emitter->allocator, writer->spare);
+        yaml_free_with(emitter->allocator, writer);
+        return 1;
+    }
+    pthread_cond_init(&writer->ready, NULL);
+    pthread_cond_init(&writer->written, NULL);
+
+    if (pthread_create(&writer->thread, NULL, yaml_writer_thread, writer)
+            != 0) {
+        pthread_cond_destroy(&writer->written);
+        pthread_cond_destroy(&writer->ready);
+        pthread_mutex_destroy(&writer->mutex);
+        yaml_free_with(emitter->allocator, writer->spare);
+        yaml_free_with(emitter->allocator, writer);
+        return 1;
+    }
+
+    emitter->writer = writer;
+#else
+    (void)emitter;
+#endif
+
+    return 1;
+}
+
+/*
+ * Let the background writer finish the pending buffer and release it.
+ */
+
+YAML_DECLARE(void)
+yaml_emitter_stop_writer(yaml_emitter_t *emitter)
+{
+#if HAVE_PTHREAD && HAVE_UNISTD_H
+    struct yaml_writer_s *writer = emitter->writer;
+
+    if (!writer)
+        return;
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->stop = 1;
+    pthread_cond_signal(&writer->ready);
+    pthread_mutex_unlock(&writer->mutex);
+
+    pthread_join(writer->thread, NULL);
+
+    pthread_cond_destroy(&writer->written);
+    pthread_cond_destroy(&writer->ready);
+    pthread_mutex_destroy(&writer->mutex);
+    yaml_free_with(emitter->allocator, writer->spare);
+    yaml_free_with(emitter->allocator, writer);
+    emitter->writer = NULL;
+#else
+    (void)emitter;
+#endif
+}
+
+/*
+ * Wait until the background writer is idle and check for write errors.
+ */
+
+static int
+yaml_emitter_wait_writer(yaml_emitter_t *emitter)
+{
+#if HAVE_PTHREAD && HAVE_UNISTD_H
+    struct yaml_writer_s *writer = emitter->writer;
+    int failed;
+
+    if (!writer)
+        return 1;
+
+    pthread_mutex_lock(&writer->mutex);
+    while (writer->pending) {
+        pthread_cond_wait(&writer->written, &writer->mutex);
+    }
+    failed = writer->failed;
+    pthread_mutex_unlock(&writer->mutex);
+
+    if (failed)
+        return yaml_emitter_set_writer_error(emitter, "write error");
+#else
+    (void)emitter;
+#endif
+
+    return 1;
+}
+
+/*
+ * Flush the output buffer and wait for the background writer.
  */
 
 YAML_DECLARE(int)
 yaml_emitter_flush(yaml_emitter_t *emitter)
+{
+    return yaml_emitter_flush_buffer(emitter)
+        && yaml_emitter_wait_writer(emitter);
+}
+
+/*
+ * Hand the output buffer to the write handler or the background writer.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_flush_buffer(yaml_emitter_t *emitter)
 {
     int low, high;
 
@@ -50,6 +342,34 @@ yaml_emitter_flush(yaml_emitter_t *emitter)
 
     if (emitter->encoding == YAML_UTF8_ENCODING)
     {
+#if HAVE_PTHREAD && HAVE_UNISTD_H
+        struct yaml_writer_s *writer = emitter->writer;
+
+        if (writer)
+        {
+            yaml_char_t *buffer = emitter->buffer.start;
+            size_t size = emitter->buffer.end - emitter->buffer.start;
+
+            if (!yaml_emitter_wait_writer(emitter))
+                return 0;
+
+            /* Swap the buffers and let the thread write the filled one. */
+
+            pthread_mutex_lock(&writer->mutex);
+            writer->pending = buffer;
+            writer->pending_size = emitter->buffer.last - buffer;
+            emitter->buffer.start = writer->spare;
+            writer->spare = buffer;
+            pthread_cond_signal(&writer->ready);
+            pthread_mutex_unlock(&writer->mutex);
+
+            emitter->buffer.end = emitter->buffer.start + size;
+            emitter->buffer.last = emitter->buffer.start;
+            emitter->buffer.pointer = emitter->buffer.start;
+            return 1;
+        }
+#endif
+
         if (emitter->write_handler(emitter->write_handler_data,
                     emitter->buffer.start,
                     emitter->buffer.last - emitter->buffer.start)) {
@@ -24,6 +24,131 @@ yaml_free(void *ptr);
 YAML_DECLARE(yaml_char_t *)
 yaml_strdup(const yaml_char_t *);
 
+/*
+ * The _with variants take the allocator of the object that owns the memory;
+ * a NULL allocator stands for the C library.
+ */
+
+YAML_DECLARE(void *)
+yaml_malloc_with(const yaml_allocator_t *allocator, size_t size);
+
+YAML_DECLARE(void *)
+yaml_realloc_with(const yaml_allocator_t *allocator, void *ptr, size_t size);
+
+YAML_DECLARE(void)
+yaml_free_with(const yaml_allocator_t *allocator, void *ptr);
+
+YAML_DECLARE(yaml_char_t *)
+yaml_strdup_with(const yaml_allocator_t *allocator, const yaml_char_t *);
+
+/*
+ * Check if a string is a valid UTF-8 sequence.
+ */
+
+YAML_DECLARE(int)
+yaml_check_utf8(const yaml_char_t *start, size_t length);
+
+/*
+ * Hashing of NUL-terminated strings for the lookup indexes.
+ */
+
+YAML_DECLARE(size_t)
+yaml_string_hash(const yaml_char_t *string);
+
+/*
+ * Arena management.
+ *
+ * An arena hands out memory from large blocks and releases all of it at once.
+ * The functions take the address of the arena since a new block may be added.
+ * A NULL arena stands for the regular heap, so that the same code serves both
+ * kinds of documents.
+ */
+
+YAML_DECLARE(int)
+yaml_arena_initialize(const yaml_allocator_t *allocator, void **arena);
+
+YAML_DECLARE(void)
+yaml_arena_delete(const yaml_allocator_t *allocator, void *arena);
+
+YAML_DECLARE(void *)
+yaml_arena_malloc(const yaml_allocator_t *allocator, void **arena,
+        size_t size);
+
+YAML_DECLARE(void)
+yaml_arena_free(const yaml_allocator_t *allocator, void *arena, void *ptr);
+
+YAML_DECLARE(yaml_char_t *)
+yaml_arena_strndup(const yaml_allocator_t *allocator, void **arena,
+        const yaml_char_t *str, size_t length);
+
+YAML_DECLARE(int)
+yaml_arena_stack_extend(const yaml_allocator_t *allocator, void **arena,
+        void **start, void **top, void **end);
+
+/*
+ * SIMD support.
+ *
+ * SSE2 kernels are used whenever the compiler targets SSE2.  AVX2 kernels are
+ * compiled with a function-level target attribute and selected at runtime, so
+ * the library still runs on CPUs without AVX2.  Define YAML_NO_SIMD to build
+ * the portable code paths only.
+ */
+
+#if !defined(YAML_NO_SIMD) && defined(__SSE2__)
+#define YAML_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if !defined(YAML_NO_SIMD) && (defined(__x86_64__) || defined(__i386__))    \
+    && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define YAML_HAVE_AVX2 1
+#define YAML_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define YAML_CTZ(value) ((unsigned int)__builtin_ctz(value))
+#endif
+
+/*
+ * Check if the CPU supports AVX2.
+ */
+
+YAML_DECLARE(int)
+yaml_cpu_has_avx2(void);
+
+/*
+ * Byte order marks.
+ */
+
+#define BOM_UTF8    "\xef\xbb\xbf"
+#define BOM_UTF16LE "\xff\xfe"
+#define BOM_UTF16BE "\xfe\xff"
+
+/*
+ * Reader: The read handler of string inputs.
+ */
+
+YAML_DECLARE(int)
+yaml_string_read_handler(void *data, unsigned char *buffer, size_t size,
+        size_t *size_read);
+
+/*
+ * Reader: The read handler of pushed inputs.
+ */
+
+YAML_DECLARE(int)
+yaml_feed_read_handler(void *data, unsigned char *buffer, size_t size,
+        size_t *size_read);
+
+/*
+ * Reader: The stream offset of the first unscanned octet.  The working buffer
+ * holds the decoded input in UTF-8, so this is exact for UTF-8 input only.
+ */
+
+#define SCANNED_OFFSET(parser)                                                  \
+    ((parser)->offset - ((parser)->buffer.last - (parser)->buffer.pointer))
+
 /*
  * Reader: Ensure that the buffer contains at least `length` characters.
  */
@@ -31,6 +156,52 @@ yaml_strdup(const yaml_char_t *);
 YAML_DECLARE(int)
 yaml_parser_update_buffer(yaml_parser_t *parser, size_t length);
 
+/*
+ * Writer: Hand the output buffer to the write handler or the background
+ * writer without waiting for the latter.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_flush_buffer(yaml_emitter_t *emitter);
+
+/*
+ * Writer: The write handler of file descriptor outputs.
+ */
+
+YAML_DECLARE(int)
+yaml_fd_write_handler(void *data, unsigned char *buffer, size_t size);
+
+/*
+ * Writer: Start and stop the background writer of a file descriptor output.
+ */
+
+YAML_DECLARE(int)
+yaml_emitter_start_writer(yaml_emitter_t *emitter);
+
+YAML_DECLARE(void)
+yaml_emitter_stop_writer(yaml_emitter_t *emitter);
+
+/*
+ * Parallel: Start and stop the scanner thread of a pipelined parser, and take
+ * the next batch of tokens from it.
+ */
+
+YAML_DECLARE(int)
+yaml_parser_start_pipeline(yaml_parser_t *parser);
+
+YAML_DECLARE(void)
+yaml_parser_stop_pipeline(yaml_parser_t *parser);
+
+YAML_DECLARE(int)
+yaml_parser_fetch_pipelined(yaml_parser_t *parser);
+
+/*
+ * Parallel: The parser of the scanner thread, once it is done, or NULL.
+ */
+
+YAML_DECLARE(yaml_parser_t *)
+yaml_parser_pipeline_scanner(yaml_parser_t *parser);
+
 /*
  * Scanner: Ensure that the token stack contains at least one token ready.
  */
@@ -38,6 +209,14 @@ yaml_parser_update_buffer(yaml_parser_t *parser, size_t length);
 YAML_DECLARE(int)
 yaml_parser_fetch_more_tokens(yaml_parser_t *parser);
 
+/*
+ * Scanner: With pushed input, fetch enough tokens for the next step of the
+ * event parser.
+ */
+
+YAML_DECLARE(int)
+yaml_parser_fetch_ahead(yaml_parser_t *parser);
+
 /*
  * The size of the input raw buffer.
  */
@@ -85,12 +264,37 @@ yaml_parser_fetch_more_tokens(yaml_parser_t *parser);
 #define INITIAL_QUEUE_SIZE  16
 #define INITIAL_STRING_SIZE 16
 
+/*
+ * The initial number of slots of the hash indexes.  They must be powers of
+ * two.
+ */
+
+#define INITIAL_ALIAS_INDEX_SIZE            64
+#define INITIAL_TAG_DIRECTIVE_INDEX_SIZE    8
+
+/*
+ * The minimal size of the parts of a stream loaded in parallel, and the
+ * number of parts a worker may load ahead of the delivered ones.
+ */
+
+#define PARALLEL_SHARD_SIZE     65536
+#define PARALLEL_WINDOW         1
+
+/*
+ * The size of arena blocks.  Blocks grow up to the maximum size as the arena
+ * fills.
+ */
+
+#define ARENA_BLOCK_SIZE        65536
+#define ARENA_MAX_BLOCK_SIZE    (ARENA_BLOCK_SIZE*64)
+
 /*
  * Buffer management.
  */
 
 #define BUFFER_INIT(context,buffer,size)                                        \
-  (((buffer).start = (yaml_char_t *)yaml_malloc(size)) ?                        \
+  (((buffer).start = (yaml_char_t *)yaml_malloc_with((context)->allocator,      \
+                size)) ?                                                        \
         ((buffer).last = (buffer).pointer = (buffer).start,                     \
          (buffer).end = (buffer).start+(size),                                  \
          1) :                                                                   \
@@ -98,7 +302,7 @@ yaml_parser_fetch_more_tokens(yaml_parser_t *parser);
          0))
 
 #define BUFFER_DEL(context,buffer)                                              \
-    (yaml_free((buffer).start),                                                 \
+    (yaml_free_with((context)->allocator, (buffer).start),                      \
      (buffer).start = (buffer).pointer = (buffer).end = 0)
 
 /*
@@ -112,11 +316,11 @@ typedef struct {
 } yaml_string_t;
 
 YAML_DECLARE(int)
-yaml_string_extend(yaml_char_t **start,
+yaml_string_extend(const yaml_allocator_t *allocator, yaml_char_t **start,
         yaml_char_t **pointer, yaml_char_t **end);
 
 YAML_DECLARE(int)
-yaml_string_join(
+yaml_string_join(const yaml_allocator_t *allocator,
         yaml_char_t **a_start, yaml_char_t **a_pointer, yaml_char_t **a_end,
         yaml_char_t **b_start, yaml_char_t **b_pointer, yaml_char_t **b_end);
 
@@ -130,7 +334,7 @@ yaml_string_join(
      (value).pointer = (string))
 
 #define STRING_INIT(context,string,size)                                        \
-    (((string).start = YAML_MALLOC(size)) ?                                     \
+    (((string).start = YAML_MALLOC_WITH((context)->allocator, size)) ?          \
         ((string).pointer = (string).start,                                     \
          (string).end = (string).start+(size),                                  \
          memset((string).start, 0, (size)),                                     \
@@ -139,12 +343,12 @@ yaml_string_join(
          0))
 
 #define STRING_DEL(context,string)                                              \
-    (yaml_free((string).start),                                                 \
+    (yaml_free_with((context)->allocator, (string).start),                      \
      (string).start = (string).pointer = (string).end = 0)
 
 #define STRING_EXTEND(context,string)                                           \
     ((((string).pointer+5 < (string).end)                                       \
-        || yaml_string_extend(&(string).start,                                  \
+        || yaml_string_extend((context)->allocator, &(string).start,            \
             &(string).pointer, &(string).end)) ?                                \
          1 :                                                                    \
         ((context)->error = YAML_MEMORY_ERROR,                                  \
@@ -155,7 +359,8 @@ yaml_string_join(
      memset((string).start, 0, (string).end-(string).start))
 
 #define JOIN(context,string_a,string_b)                                         \
-    ((yaml_string_join(&(string_a).start, &(string_a).pointer,                  \
+    ((yaml_string_join((context)->allocator,                                    \
+                       &(string_a).start, &(string_a).pointer,                  \
                        &(string_a).end, &(string_b).start,                      \
                        &(string_b).pointer, &(string_b).end)) ?                 \
         ((string_b).pointer = (string_b).start,                                 \
@@ -415,13 +620,16 @@ yaml_string_join(
  */
 
 YAML_DECLARE(int)
-yaml_stack_extend(void **start, void **top, void **end);
+yaml_stack_extend(const yaml_allocator_t *allocator,
+        void **start, void **top, void **end);
 
 YAML_DECLARE(int)
-yaml_queue_extend(void **start, void **head, void **tail, void **end);
+yaml_queue_extend(const yaml_allocator_t *allocator,
+        void **start, void **head, void **tail, void **end);
 
 #define STACK_INIT(context,stack,type)                                     \
-  (((stack).start = (type)yaml_malloc(INITIAL_STACK_SIZE*sizeof(*(stack).start))) ? \
+  (((stack).start = (type)yaml_malloc_with((context)->allocator,                \
+                INITIAL_STACK_SIZE*sizeof(*(stack).start))) ?                   \
         ((stack).top = (stack).start,                                           \
          (stack).end = (stack).start+INITIAL_STACK_SIZE,                        \
          1) :                                                                   \
@@ -429,7 +637,7 @@ yaml_queue_extend(void **start, void **head, void **tail, void **end);
          0))
 
 #define STACK_DEL(context,stack)                                                \
-    (yaml_free((stack).start),                                                  \
+    (yaml_free_with((context)->allocator, (stack).start),                       \
      (stack).start = (stack).top = (stack).end = 0)
 
 #define STACK_EMPTY(context,stack)                                              \
@@ -443,7 +651,7 @@ yaml_queue_extend(void **start, void **head, void **tail, void **end);
 
 #define PUSH(context,stack,value)                                               \
     (((stack).top != (stack).end                                                \
-      || yaml_stack_extend((void **)&(stack).start,                             \
+      || yaml_stack_extend((context)->allocator, (void **)&(stack).start,       \
               (void **)&(stack).top, (void **)&(stack).end)) ?                  \
         (*((stack).top++) = value,                                              \
          1) :                                                                   \
@@ -453,8 +661,32 @@ yaml_queue_extend(void **start, void **head, void **tail, void **end);
 #define POP(context,stack)                                                      \
     (*(--(stack).top))
 
+#define ARENA_STACK_INIT(context,arena,stack,type)                              \
+  (((stack).start = (type)yaml_arena_malloc((context)->allocator, &(arena),     \
+                INITIAL_STACK_SIZE*sizeof(*(stack).start))) ?                   \
+        ((stack).top = (stack).start,                                           \
+         (stack).end = (stack).start+INITIAL_STACK_SIZE,                        \
+         1) :                                                                   \
+        ((context)->error = YAML_MEMORY_ERROR,                                  \
+         0))
+
+#define ARENA_STACK_DEL(context,arena,stack)                                    \
+    (yaml_arena_free((context)->allocator, (arena), (stack).start),             \
+     (stack).start = (stack).top = (stack).end = 0)
+
+#define ARENA_PUSH(context,arena,stack,value)                                   \
+    (((stack).top != (stack).end                                                \
+      || yaml_arena_stack_extend((context)->allocator, &(arena),                \
+              (void **)&(stack).start,                                          \
+              (void **)&(stack).top, (void **)&(stack).end)) ?                  \
+        (*((stack).top++) = value,                                              \
+         1) :                                                                   \
+        ((context)->error = YAML_MEMORY_ERROR,                                  \
+         0))
+
 #define QUEUE_INIT(context,queue,size,type)                                     \
-  (((queue).start = (type)yaml_malloc((size)*sizeof(*(queue).start))) ?         \
+  (((queue).start = (type)yaml_malloc_with((context)->allocator,                \
+                (size)*sizeof(*(queue).start))) ?                               \
         ((queue).head = (queue).tail = (queue).start,                           \
          (queue).end = (queue).start+(size),                                    \
          1) :                                                                   \
@@ -462,7 +694,7 @@ yaml_queue_extend(void **start, void **head, void **tail, void **end);
          0))
 
 #define QUEUE_DEL(context,queue)                                                \
-    (yaml_free((queue).start),                                                  \
+    (yaml_free_with((context)->allocator, (queue).start),                       \
      (queue).start = (queue).head = (queue).tail = (queue).end = 0)
 
 #define QUEUE_EMPTY(context,queue)                                              \
@@ -470,7 +702,8 @@ yaml_queue_extend(void **start, void **head, void **tail, void **end);
 
 #define ENQUEUE(context,queue,value)                                            \
     (((queue).tail != (queue).end                                               \
-      || yaml_queue_extend((void **)&(queue).start, (void **)&(queue).head,     \
+      || yaml_queue_extend((context)->allocator,                                \
+            (void **)&(queue).start, (void **)&(queue).head,                    \
             (void **)&(queue).tail, (void **)&(queue).end)) ?                   \
         (*((queue).tail++) = value,                                             \
          1) :                                                                   \
@@ -482,7 +715,8 @@ yaml_queue_extend(void **start, void **head, void **tail, void **end);
 
 #define QUEUE_INSERT(context,queue,index,value)                                 \
     (((queue).tail != (queue).end                                               \
-      || yaml_queue_extend((void **)&(queue).start, (void **)&(queue).head,     \
+      || yaml_queue_extend((context)->allocator,                                \
+            (void **)&(queue).start, (void **)&(queue).head,                    \
             (void **)&(queue).tail, (void **)&(queue).end)) ?                   \
         (memmove((queue).head+(index)+1,(queue).head+(index),                   \
             ((queue).tail-(queue).head-(index))*sizeof(*(queue).start)),        \
@@ -682,3 +916,7 @@ yaml_queue_extend(void **start, void **head, void **tail, void **end);
 
 #define YAML_MALLOC_STATIC(type) (type*)yaml_malloc(sizeof(type))
 #define YAML_MALLOC(size)        (yaml_char_t *)yaml_malloc(size)
+#define YAML_MALLOC_STATIC_WITH(allocator,type)                                 \
+    (type*)yaml_malloc_with((allocator), sizeof(type))
+#define YAML_MALLOC_WITH(allocator,size)                                        \
+    (yaml_char_t *)yaml_malloc_with((allocator), (size))
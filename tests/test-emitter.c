@@ -0,0 +1,1121 @@
+#include <yaml.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <assert.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#define HAVE_FD_OUTPUT 1
+#endif
+
+/*
+ * A growing buffer that collects the output of an emitter.
+ */
+
+typedef struct {
+    unsigned char *start;
+    size_t length;
+    size_t size;
+} output_t;
+
+int write_output(void *data, unsigned char *buffer, size_t size)
+{
+    output_t *output = (output_t *)data;
+    if (output->length + size + 1 > output->size) {
+        size_t new_size = output->size ? output->size : 256;
+        while (output->length + size + 1 > new_size)
+            new_size *= 2;
+        output->start = (unsigned char *)realloc(output->start, new_size);
+        assert(output->start);
+        output->size = new_size;
+    }
+    memcpy(output->start + output->length, buffer, size);
+    output->length += size;
+    output->start[output->length] = '\0';
+    return 1;
+}
+
+void output_free(output_t *output)
+{
+    free(output->start);
+    output->start = NULL;
+    output->length = output->size = 0;
+}
+
+/*
+ * Dump a document to the output and return the result of yaml_emitter_dump().
+ */
+
+int dump_document(yaml_document_t *document, output_t *output, int max_depth,
+        yaml_emitter_t *emitter)
+{
+    int result;
+    yaml_emitter_initialize(emitter);
+    yaml_emitter_set_output(emitter, write_output, output);
+    yaml_emitter_set_max_depth(emitter, max_depth);
+    yaml_emitter_set_width(emitter, -1);
+    result = yaml_emitter_open(emitter) && yaml_emitter_dump(emitter, document)
+        && yaml_emitter_close(emitter) && yaml_emitter_flush(emitter);
+    return result;
+}
+
+/*
+ * Build a chain of flow collections that alternate between sequences and
+ * mappings and end with a scalar.
+ */
+
+void build_chain(yaml_document_t *document, int depth)
+{
+    int *nodes = (int *)malloc((depth + 1) * sizeof(int));
+    int key = 0;
+    int level;
+    assert(nodes);
+    yaml_document_initialize(document, NULL, NULL, NULL, 1, 1);
+    for (level = 0; level < depth; level++) {
+        nodes[level] = level % 2 ?
+            yaml_document_add_mapping(document, NULL, YAML_FLOW_MAPPING_STYLE) :
+            yaml_document_add_sequence(document, NULL, YAML_FLOW_SEQUENCE_STYLE);
+        assert(nodes[level]);
+    }
+    nodes[depth] = yaml_document_add_scalar(document, NULL,
+            (yaml_char_t *)"x", 1, YAML_PLAIN_SCALAR_STYLE);
+    assert(nodes[depth]);
+    for (level = 0; level < depth; level++) {
+        if (level % 2) {
+            key = yaml_document_add_scalar(document, NULL,
+                    (yaml_char_t *)"k", 1, YAML_PLAIN_SCALAR_STYLE);
+            assert(key && yaml_document_append_mapping_pair(document,
+                        nodes[level], key, nodes[level+1]));
+        }
+        else {
+            assert(yaml_document_append_sequence_item(document,
+                        nodes[level], nodes[level+1]));
+        }
+    }
+    free(nodes);
+}
+
+/*
+ * The text of a chain built by build_chain().
+ */
+
+char *chain_text(int depth)
+{
+    char *text = (char *)malloc(depth * 4 + 16);
+    size_t length = 0;
+    int level;
+    assert(text);
+    for (level = 0; level < depth; level++)
+        length += sprintf(text + length, level % 2 ? "{k: " : "[");
+    length += sprintf(text + length, "x");
+    for (level = depth - 1; level >= 0; level--)
+        length += sprintf(text + length, level % 2 ? "}" : "]");
+    sprintf(text + length, "\n");
+    return text;
+}
+
+int check_deep_documents(void)
+{
+    static int depths[] = { 1, 2, 3, 100, 300000 };
+    int failed = 0;
+    int k;
+    printf("checking deep documents...\n");
+
+    for (k = 0; k < (int)(sizeof(depths)/sizeof(*depths)); k++)
+    {
+        int depth = depths[k];
+        int limit;
+        char *expected = chain_text(depth);
+
+        /* Unlimited, exactly the depth of the document and one less. */
+        for (limit = 0; limit < 3; limit++)
+        {
+            yaml_document_t document;
+            yaml_emitter_t emitter;
+            output_t output = { NULL, 0, 0 };
+            int max_depth = limit ? depth - limit + 1 : 0;
+            int result;
+            if (limit == 2 && !max_depth)
+                continue;
+            build_chain(&document, depth);
+            result = dump_document(&document, &output, max_depth, &emitter);
+            if (limit < 2) {
+                if (!result || !output.start || strcmp((char *)output.start, expected)) {
+                    printf("\t- depth %d, limit %d: failed to dump (error %d)\n",
+                            depth, max_depth, emitter.error);
+                    failed++;
+                }
+            }
+            else if (result || emitter.error != YAML_EMITTER_ERROR
+                    || strcmp(emitter.problem, "exceeded the maximum nesting depth")) {
+                printf("\t- depth %d, limit %d: did not fail (error %d)\n",
+                        depth, max_depth, emitter.error);
+                failed++;
+            }
+            yaml_emitter_delete(&emitter);
+            output_free(&output);
+        }
+        free(expected);
+    }
+
+    printf("checking deep documents: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * Anchors are assigned in the order the recursive dumper used.
+ */
+
+int check_anchor_order(void)
+{
+    const char *expected =
+        "- &id003\n"
+        "  &id001 s: &id004 [&id002 c, *id001]\n"
+        "  *id002 : &id005\n"
+        "  - *id003\n"
+        "- *id004\n"
+        "- *id005\n"
+        "- *id002\n";
+    yaml_document_t document;
+    yaml_emitter_t emitter;
+    output_t output = { NULL, 0, 0 };
+    int failed = 0;
+    int root, a, b, c, s, t;
+    printf("checking anchor order...\n");
+
+    yaml_document_initialize(&document, NULL, NULL, NULL, 1, 1);
+    root = yaml_document_add_sequence(&document, NULL, YAML_BLOCK_SEQUENCE_STYLE);
+    a = yaml_document_add_mapping(&document, NULL, YAML_BLOCK_MAPPING_STYLE);
+    b = yaml_document_add_sequence(&document, NULL, YAML_FLOW_SEQUENCE_STYLE);
+    c = yaml_document_add_scalar(&document, NULL, (yaml_char_t *)"c", 1,
+            YAML_PLAIN_SCALAR_STYLE);
+    s = yaml_document_add_scalar(&document, NULL, (yaml_char_t *)"s", 1,
+            YAML_PLAIN_SCALAR_STYLE);
+    t = yaml_document_add_sequence(&document, NULL, YAML_BLOCK_SEQUENCE_STYLE);
+    assert(yaml_document_append_mapping_pair(&document, a, s, b));
+    assert(yaml_document_append_mapping_pair(&document, a, c, t));
+    assert(yaml_document_append_sequence_item(&document, b, c));
+    assert(yaml_document_append_sequence_item(&document, b, s));
+    assert(yaml_document_append_sequence_item(&document, t, a));
+    assert(yaml_document_append_sequence_item(&document, root, a));
+    assert(yaml_document_append_sequence_item(&document, root, b));
+    assert(yaml_document_append_sequence_item(&document, root, t));
+    assert(yaml_document_append_sequence_item(&document, root, c));
+
+    if (!dump_document(&document, &output, 0, &emitter)
+            || strcmp((char *)output.start, expected)) {
+        printf("\t- got\n%s\tinstead of\n%s", output.start ? (char *)output.start : "",
+                expected);
+        failed++;
+    }
+    yaml_emitter_delete(&emitter);
+    output_free(&output);
+
+    printf("checking anchor order: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * Streams that are written the same way with and without event lookahead.
+ */
+
+char *streams[] = {
+    "a\n",
+    "- a\n- b: c\n  d: [e, f]\n- {g: h}\n",
+    "key: value\nempty seq: []\nempty map: {}\nblock: !!seq []\n",
+    "- []\n- {}\n- [[]]\n- [{}]\n- - []\n  - {}\n",
+    "plain: text with words\nsingle: 'it''s'\ndouble: \"tab\\tnew\\nline\"\n",
+    "literal: |\n  line 1\n  line 2\nfolded: >-\n  folded\n  text\n\nkeep: |+\n  a\n\n",
+    "anchors: &a [1, 2]\nalias: *a\n&k key: &v value\n*k : *v\n",
+    "%TAG !e! tag:example.com,2000:\n---\n- !e!x a\n- !local b\n- !<tag:yaml.org,2002:str> c\n- !!int 1\n",
+    "--- a\n--- b\n...\n--- [c]\n",
+    "- \"\xc3\xa9\xe4\xb8\xad \\u2028 \\x85\"\n- '# not a comment'\n- ': colon'\n- '-'\n- '? q'\n",
+    "long: the quick brown fox jumps over the lazy dog the quick brown fox jumps over the lazy dog and so on\n",
+    "- - - deep\n    - [1, [2, [3]]]\n  - {a: {b: {c: d}}}\n",
+    "? a\n: b\n? ''\n: ''\n~: null\n",
+    "[a, b]: c\n{d: e}: [f]\n",
+    NULL
+};
+
+/*
+ * Parse a stream and write its events with yaml_emitter_emit() or with the
+ * borrowing functions.  The strings of borrowed events are overwritten as
+ * soon as the call returns, so any reference the emitter keeps shows up in
+ * the output.
+ */
+
+int reemit_stream(const char *input, int streaming, int borrowed,
+        output_t *output)
+{
+    yaml_parser_t parser;
+    yaml_emitter_t emitter;
+    yaml_event_t event;
+    int done = 0;
+    int result = 1;
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, (const unsigned char *)input,
+            strlen(input));
+    yaml_emitter_initialize(&emitter);
+    yaml_emitter_set_output(&emitter, write_output, output);
+    yaml_emitter_set_streaming(&emitter, streaming);
+    while (!done && result)
+    {
+        if (!yaml_parser_parse(&parser, &event)) {
+            result = 0;
+            break;
+        }
+        done = (event.type == YAML_STREAM_END_EVENT);
+        if (!borrowed) {
+            result = yaml_emitter_emit(&emitter, &event);
+            continue;
+        }
+        switch (event.type)
+        {
+            case YAML_ALIAS_EVENT:
+                result = yaml_emitter_emit_alias_borrowed(&emitter,
+                        event.data.alias.anchor);
+                break;
+            case YAML_SCALAR_EVENT:
+                result = yaml_emitter_emit_scalar_borrowed(&emitter,
+                        event.data.scalar.anchor, event.data.scalar.tag,
+                        event.data.scalar.value, (int)event.data.scalar.length,
+                        event.data.scalar.plain_implicit,
+                        event.data.scalar.quoted_implicit,
+                        event.data.scalar.style);
+                if (event.data.scalar.length)
+                    memset(event.data.scalar.value, '?', event.data.scalar.length);
+                break;
+            case YAML_SEQUENCE_START_EVENT:
+                result = yaml_emitter_emit_sequence_start_borrowed(&emitter,
+                        event.data.sequence_start.anchor,
+                        event.data.sequence_start.tag,
+                        event.data.sequence_start.implicit,
+                        event.data.sequence_start.style);
+                if (event.data.sequence_start.tag)
+                    memset(event.data.sequence_start.tag, '?',
+                            strlen((char *)event.data.sequence_start.tag));
+                break;
+            case YAML_MAPPING_START_EVENT:
+                result = yaml_emitter_emit_mapping_start_borrowed(&emitter,
+                        event.data.mapping_start.anchor,
+                        event.data.mapping_start.tag,
+                        event.data.mapping_start.implicit,
+                        event.data.mapping_start.style);
+                if (event.data.mapping_start.anchor)
+                    memset(event.data.mapping_start.anchor, '?',
+                            strlen((char *)event.data.mapping_start.anchor));
+                break;
+            default:
+                result = yaml_emitter_emit(&emitter, &event);
+                continue;
+        }
+        yaml_event_delete(&event);
+    }
+    if (!result) {
+        printf("\t- '%s': parser error %d, emitter error %d\n", input,
+                parser.error, emitter.error);
+    }
+    yaml_emitter_delete(&emitter);
+    yaml_parser_delete(&parser);
+    return result;
+}
+
+int check_emit_modes(void)
+{
+    int failed = 0;
+    int k;
+    printf("checking emit modes...\n");
+
+    for (k = 0; streams[k]; k++)
+    {
+        output_t expected = { NULL, 0, 0 };
+        int mode;
+        if (!reemit_stream(streams[k], 0, 0, &expected)) {
+            failed++;
+            continue;
+        }
+        for (mode = 1; mode < 4; mode++) {
+            output_t output = { NULL, 0, 0 };
+            if (!reemit_stream(streams[k], mode & 1, mode & 2, &output)
+                    || strcmp((char *)output.start, (char *)expected.start)) {
+                printf("\t- '%s' (streaming: %d, borrowed: %d):\n%s\tinstead of\n%s",
+                        streams[k], mode & 1, (mode & 2) >> 1,
+                        output.start ? (char *)output.start : "",
+                        (char *)expected.start);
+                failed++;
+            }
+            output_free(&output);
+        }
+        output_free(&expected);
+    }
+
+    /* An empty collection key is written as an explicit key in the streaming mode. */
+
+    for (k = 0; k < 4; k++) {
+        const char *input = "[]: c\n";
+        const char *expected = (k & 1) ? "? []\n: c\n" : "[]: c\n";
+        output_t output = { NULL, 0, 0 };
+        if (!reemit_stream(input, k & 1, k & 2, &output)
+                || strcmp((char *)output.start, expected)) {
+            printf("\t- collection key (streaming: %d, borrowed: %d):\n%s\tinstead of\n%s",
+                    k & 1, (k & 2) >> 1, output.start ? (char *)output.start : "",
+                    expected);
+            failed++;
+        }
+        output_free(&output);
+    }
+
+    printf("checking emit modes: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * Write a mapping of one key to a scalar with unlimited width.
+ */
+
+int emit_scalar(const char *value, size_t length, yaml_scalar_style_t style,
+        output_t *output)
+{
+    yaml_emitter_t emitter;
+    yaml_event_t event;
+    int result;
+    yaml_emitter_initialize(&emitter);
+    yaml_emitter_set_output(&emitter, write_output, output);
+    yaml_emitter_set_width(&emitter, -1);
+    yaml_emitter_set_unicode(&emitter, 1);
+    result = yaml_stream_start_event_initialize(&event, YAML_UTF8_ENCODING)
+        && yaml_emitter_emit(&emitter, &event)
+        && yaml_document_start_event_initialize(&event, NULL, NULL, NULL, 1)
+        && yaml_emitter_emit(&emitter, &event)
+        && yaml_mapping_start_event_initialize(&event, NULL, NULL, 1,
+                YAML_BLOCK_MAPPING_STYLE)
+        && yaml_emitter_emit(&emitter, &event)
+        && yaml_scalar_event_initialize(&event, NULL, NULL,
+                (yaml_char_t *)"k", 1, 1, 1, YAML_PLAIN_SCALAR_STYLE)
+        && yaml_emitter_emit(&emitter, &event)
+        && yaml_scalar_event_initialize(&event, NULL, NULL,
+                (yaml_char_t *)value, (int)length, 1, 1, style)
+        && yaml_emitter_emit(&emitter, &event)
+        && yaml_mapping_end_event_initialize(&event)
+        && yaml_emitter_emit(&emitter, &event)
+        && yaml_document_end_event_initialize(&event, 1)
+        && yaml_emitter_emit(&emitter, &event)
+        && yaml_stream_end_event_initialize(&event)
+        && yaml_emitter_emit(&emitter, &event);
+    yaml_emitter_delete(&emitter);
+    return result;
+}
+
+/*
+ * Check that the value of the key in the output is the given value.
+ */
+
+int check_round_trip(const unsigned char *output, const char *value,
+        size_t length)
+{
+    yaml_parser_t parser;
+    yaml_event_t event;
+    int scalars = 0;
+    int same = 0;
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, output, strlen((char *)output));
+    while (yaml_parser_parse(&parser, &event)) {
+        if (event.type == YAML_SCALAR_EVENT && ++scalars == 2) {
+            same = (event.data.scalar.length == length
+                    && !memcmp(event.data.scalar.value, value, length));
+        }
+        if (event.type == YAML_STREAM_END_EVENT) {
+            yaml_event_delete(&event);
+            break;
+        }
+        yaml_event_delete(&event);
+    }
+    yaml_parser_delete(&parser);
+    return same;
+}
+
+/*
+ * Emit a borrowed scalar in a stream of its own: at the top level in the
+ * streaming mode, and as both the key and the value of a mapping otherwise,
+ * where it waits in the event queue.
+ */
+
+int emit_borrowed(const yaml_char_t *value, size_t length,
+        yaml_scalar_style_t style, int streaming, int borrowed, output_t *output)
+{
+    int count = streaming ? 1 : 2;
+    int k;
+    yaml_emitter_t emitter;
+    yaml_event_t event;
+    int result;
+    yaml_emitter_initialize(&emitter);
+    yaml_emitter_set_output(&emitter, write_output, output);
+    yaml_emitter_set_streaming(&emitter, streaming);
+    yaml_emitter_set_width(&emitter, 5);
+    yaml_emitter_set_unicode(&emitter, 1);
+    result = yaml_stream_start_event_initialize(&event, YAML_UTF8_ENCODING)
+        && yaml_emitter_emit(&emitter, &event)
+        && yaml_document_start_event_initialize(&event, NULL, NULL, NULL, 1)
+        && yaml_emitter_emit(&emitter, &event);
+    if (result && count > 1) {
+        result = yaml_mapping_start_event_initialize(&event, NULL, NULL, 1,
+                YAML_ANY_MAPPING_STYLE)
+            && yaml_emitter_emit(&emitter, &event);
+    }
+    for (k = 0; result && k < count; k++) {
+        if (borrowed) {
+            result = yaml_emitter_emit_scalar_borrowed(&emitter, NULL, NULL,
+                    value, (int)length, 1, 1, style);
+        }
+        else {
+            result = yaml_scalar_event_initialize(&event, NULL, NULL,
+                    (yaml_char_t *)value, (int)length, 1, 1, style)
+                && yaml_emitter_emit(&emitter, &event);
+        }
+    }
+    if (result && count > 1) {
+        result = yaml_mapping_end_event_initialize(&event)
+            && yaml_emitter_emit(&emitter, &event);
+    }
+    result = result
+        && yaml_document_end_event_initialize(&event, 1)
+        && yaml_emitter_emit(&emitter, &event)
+        && yaml_stream_end_event_initialize(&event)
+        && yaml_emitter_emit(&emitter, &event);
+    yaml_emitter_delete(&emitter);
+    return result;
+}
+
+/*
+ * Borrowed values need not be NUL-terminated.  They are emitted from buffers
+ * of their exact size, and followed by octets that would change the output
+ * if the emitter read them.
+ */
+
+char *unterminated[] = {
+    "-", ".", "--", "..", "---", "...", "-a", ".a", "a", "a b", " a",
+    "a\n", "a\n\n", "a\n\n\n", "a\r\n", "a\xc2\x85", "a\xe2\x80\xa8",
+    "aaaaaa bbbbbb", "aaaaaa bbbbbb\n", "a\nb\n", "aaaaaa\n bbbbbb\n", NULL
+};
+
+char *tails[] = { "", "--", "..", "x", "\nx", "\n\n", " x", "  ", NULL };
+
+int check_unterminated_values(void)
+{
+    static yaml_scalar_style_t styles[] = { YAML_ANY_SCALAR_STYLE,
+        YAML_PLAIN_SCALAR_STYLE, YAML_SINGLE_QUOTED_SCALAR_STYLE,
+        YAML_DOUBLE_QUOTED_SCALAR_STYLE, YAML_LITERAL_SCALAR_STYLE,
+        YAML_FOLDED_SCALAR_STYLE };
+    int failed = 0;
+    int k, j, t, streaming;
+    printf("checking unterminated values...\n");
+    for (k = 0; unterminated[k]; k++) {
+        size_t length = strlen(unterminated[k]);
+        for (j = 0; j < (int)(sizeof(styles)/sizeof(*styles)); j++) {
+            for (streaming = 0; streaming < 2; streaming++) {
+                output_t expected = { NULL, 0, 0 };
+                assert(emit_borrowed((yaml_char_t *)unterminated[k], length,
+                            styles[j], streaming, 0, &expected));
+                for (t = 0; tails[t]; t++) {
+                    output_t output = { NULL, 0, 0 };
+                    size_t size = length + strlen(tails[t]);
+                    yaml_char_t *value = (yaml_char_t *)malloc(size);
+                    assert(value);
+                    memcpy(value, unterminated[k], length);
+                    memcpy(value + length, tails[t], size - length);
+                    if (!emit_borrowed(value, length, styles[j], streaming, 1,
+                                &output)
+                            || output.length != expected.length
+                            || memcmp(output.start, expected.start,
+                                expected.length)) {
+                        printf("\t- '%s' followed by '%s' (style %d, streaming %d)\n",
+                                unterminated[k], tails[t], (int)styles[j],
+                                streaming);
+                        failed++;
+                    }
+                    free(value);
+                    output_free(&output);
+                }
+                output_free(&expected);
+            }
+        }
+    }
+    printf("checking unterminated values: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * Characters that need attention in at least one scalar style.
+ */
+
+char *specials[] = {
+    " ", "  ", "#", " #", ": ", ":", "'", "\"", "\\", "\t", "\n", "\n\n",
+    "\r", "\x7f", "\x01", "-", "[", "]", "{", "}", ",", "&", "*", "!", "|",
+    ">", "%", "@", "`", "?", "\xc3\xa9", "\xe4\xb8\xad", "\xe2\x80\xa8",
+    "\xc2\x85", "\xef\xbb\xbf", "\xf0\x9f\x98\x80", "a", NULL
+};
+
+int check_bulk_scalars(void)
+{
+    static yaml_scalar_style_t styles[] = { YAML_PLAIN_SCALAR_STYLE,
+        YAML_SINGLE_QUOTED_SCALAR_STYLE, YAML_DOUBLE_QUOTED_SCALAR_STYLE,
+        YAML_LITERAL_SCALAR_STYLE, YAML_FOLDED_SCALAR_STYLE };
+    static int tails[] = { 0, 1, 17, 40 };
+    char *value = (char *)malloc(200);
+    char *expected = (char *)malloc(1000);
+    int failed = 0;
+    int k, style, n, m;
+    assert(value && expected);
+    printf("checking bulk scalars...\n");
+
+    for (k = 0; specials[k]; k++)
+    {
+        for (style = 0; style < 5; style++)
+        {
+            output_t base = { NULL, 0, 0 };
+            char *head, *tail;
+            size_t length = sprintf(value, "Q%sZ", specials[k]);
+            assert(emit_scalar(value, length, styles[style], &base));
+            head = strchr((char *)base.start, 'Q');
+            tail = strchr((char *)base.start, 'Z');
+            assert(head && tail && head < tail && !strchr(head+1, 'Q')
+                    && !strchr(tail+1, 'Z'));
+
+            /* Runs of every alignment around the special characters. */
+
+            for (n = 0; n < 70; n++)
+            {
+                for (m = 0; m < (int)(sizeof(tails)/sizeof(*tails)); m++)
+                {
+                    output_t output = { NULL, 0, 0 };
+                    size_t offset;
+                    length = 0;
+                    value[length++] = 'Q';
+                    memset(value + length, 'a', n);
+                    length += n;
+                    length += sprintf(value + length, "%s", specials[k]);
+                    memset(value + length, 'b', tails[m]);
+                    length += tails[m];
+                    value[length++] = 'Z';
+                    value[length] = '\0';
+
+                    offset = head + 1 - (char *)base.start;
+                    memcpy(expected, base.start, offset);
+                    memset(expected + offset, 'a', n);
+                    memcpy(expected + offset + n, head + 1, tail - head - 1);
+                    offset += n + (tail - head - 1);
+                    memset(expected + offset, 'b', tails[m]);
+                    strcpy(expected + offset + tails[m], tail);
+
+                    if (!emit_scalar(value, length, styles[style], &output)
+                            || strcmp((char *)output.start, expected)
+                            || !check_round_trip(output.start, value, length)) {
+                        printf("\t- special %d, style %d, runs %d and %d:\n%s\tinstead of\n%s",
+                                k, style, n, tails[m],
+                                output.start ? (char *)output.start : "", expected);
+                        failed++;
+                    }
+                    output_free(&output);
+                }
+            }
+            output_free(&base);
+        }
+    }
+
+    free(value);
+    free(expected);
+    printf("checking bulk scalars: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * Emit a document with a plain scalar of the given length or, if the length
+ * is negative, with a sequence of items.
+ */
+
+int emit_document(yaml_emitter_t *emitter, int seed, int length)
+{
+    yaml_event_t event;
+    char item[64];
+    int k;
+    if (!yaml_document_start_event_initialize(&event, NULL, NULL, NULL, 1)
+            || !yaml_emitter_emit(emitter, &event))
+        return 0;
+    if (length >= 0) {
+        char *value = (char *)malloc(length + 1);
+        int result;
+        assert(value);
+        memset(value, 'a' + seed % 26, length);
+        result = yaml_scalar_event_initialize(&event, NULL, NULL,
+                (yaml_char_t *)value, length, 1, 1, YAML_ANY_SCALAR_STYLE)
+            && yaml_emitter_emit(emitter, &event);
+        free(value);
+        if (!result)
+            return 0;
+    }
+    else {
+        if (!yaml_sequence_start_event_initialize(&event, NULL, NULL, 1,
+                    YAML_BLOCK_SEQUENCE_STYLE)
+                || !yaml_emitter_emit(emitter, &event))
+            return 0;
+        for (k = 0; k < -length; k++) {
+            int size = sprintf(item, "item %d of document %d", k, seed);
+            if (!yaml_scalar_event_initialize(&event, NULL, NULL,
+                        (yaml_char_t *)item, size, 1, 1, YAML_PLAIN_SCALAR_STYLE)
+                    || !yaml_emitter_emit(emitter, &event))
+                return 0;
+        }
+        if (!yaml_sequence_end_event_initialize(&event)
+                || !yaml_emitter_emit(emitter, &event))
+            return 0;
+    }
+    return yaml_document_end_event_initialize(&event, 1)
+        && yaml_emitter_emit(emitter, &event);
+}
+
+/*
+ * Start a stream on an emitter with a chunked or a handler output.
+ */
+
+void start_stream(yaml_emitter_t *emitter, output_t *output)
+{
+    yaml_event_t event;
+    yaml_emitter_initialize(emitter);
+    if (output)
+        yaml_emitter_set_output(emitter, write_output, output);
+    else
+        yaml_emitter_set_output_chunks(emitter);
+    yaml_emitter_set_width(emitter, -1);
+    assert(yaml_stream_start_event_initialize(&event, YAML_UTF8_ENCODING)
+            && yaml_emitter_emit(emitter, &event));
+}
+
+/*
+ * Compare the chunks of an emitter with the expected output.
+ */
+
+int check_chunks(const char *title, yaml_emitter_t *emitter,
+        const unsigned char *expected, size_t length)
+{
+    const yaml_output_chunk_t *chunks;
+    size_t count;
+    size_t offset = 0;
+    size_t k;
+    yaml_emitter_get_output_chunks(emitter, &chunks, &count);
+    for (k = 0; k < count; k++) {
+        if ((k && chunks[k].capacity != 2 * chunks[k-1].capacity)
+                || (k + 1 < count && chunks[k].size != chunks[k].capacity)
+                || offset + chunks[k].size > length
+                || memcmp(chunks[k].start, expected + offset, chunks[k].size)) {
+            printf("\t- %s: chunk %ld of %ld differs\n", title, (long)k, (long)count);
+            return 1;
+        }
+        offset += chunks[k].size;
+    }
+    if (offset != length) {
+        printf("\t- %s: %ld octets in %ld chunks instead of %ld\n", title,
+                (long)offset, (long)count, (long)length);
+        return 1;
+    }
+    return 0;
+}
+
+int check_output_chunks(void)
+{
+    yaml_emitter_t emitter, handler;
+    output_t expected = { NULL, 0, 0 };
+    const yaml_output_chunk_t *chunks;
+    const unsigned char *buffer;
+    unsigned char *first_chunks[16];
+    size_t count, size, overhead;
+    size_t first_count;
+    int failed = 0;
+    int k;
+    printf("checking output chunks...\n");
+
+    /* A document of exactly 16 KiB fits in the first chunk. */
+
+    start_stream(&handler, &expected);
+    assert(emit_document(&handler, 0, 1) && yaml_emitter_flush(&handler));
+    yaml_emitter_delete(&handler);
+    overhead = expected.length - 1;
+    output_free(&expected);
+
+    for (k = -1; k <= 1; k++)
+    {
+        int length = 16384 - (int)overhead + k;
+        start_stream(&handler, &expected);
+        start_stream(&emitter, NULL);
+        assert(emit_document(&handler, 0, length) && yaml_emitter_flush(&handler));
+        assert(emit_document(&emitter, 0, length) && yaml_emitter_flush(&emitter));
+        yaml_emitter_get_output_chunks(&emitter, &chunks, &count);
+        if (expected.length != (size_t)(16384 + k) || count != (k > 0 ? 2 : 1)) {
+            printf("\t- %ld octets in %ld chunks\n", (long)expected.length, (long)count);
+            failed++;
+        }
+        failed += check_chunks("16 KiB boundary", &emitter, expected.start,
+                expected.length);
+        yaml_emitter_delete(&handler);
+        yaml_emitter_delete(&emitter);
+        output_free(&expected);
+    }
+
+    /*
+     * Documents of about 700 KiB fill chunks of 16 KiB to 512 KiB.  After a
+     * reset, the next document refills the same chunks.
+     */
+
+    start_stream(&handler, &expected);
+    start_stream(&emitter, NULL);
+    first_count = 0;
+    for (k = 0; k < 3; k++)
+    {
+        size_t start = expected.length;
+        assert(emit_document(&handler, k, -25000) && yaml_emitter_flush(&handler));
+        assert(emit_document(&emitter, k, -25000) && yaml_emitter_flush(&emitter));
+        failed += check_chunks("large document", &emitter, expected.start + start,
+                expected.length - start);
+        yaml_emitter_get_output_chunks(&emitter, &chunks, &count);
+        if (!k) {
+            assert(count > 5 && count <= 16);
+            first_count = count;
+            for (size = 0; size < count; size++)
+                first_chunks[size] = chunks[size].start;
+        }
+        else {
+            for (size = 0; size < count && size < first_count; size++) {
+                if (chunks[size].start != first_chunks[size])
+                    break;
+            }
+            if (count != first_count || size != count) {
+                printf("\t- document %d: %ld chunks, %ld reused out of %ld\n",
+                        k, (long)count, (long)size, (long)first_count);
+                failed++;
+            }
+        }
+        yaml_emitter_reset_output_chunks(&emitter);
+    }
+
+    /*
+     * The contiguous buffer merges the chunks into one, which holds the
+     * following documents after a reset.
+     */
+
+    for (k = 3; k < 6; k++)
+    {
+        size_t start = expected.length;
+        const unsigned char *previous = NULL;
+        assert(emit_document(&handler, k, -25000) && yaml_emitter_flush(&handler));
+        assert(emit_document(&emitter, k, -25000) && yaml_emitter_flush(&emitter));
+        if (k > 3)
+            previous = buffer;
+        if (!yaml_emitter_get_output_buffer(&emitter, &buffer, &size)
+                || size != expected.length - start
+                || memcmp(buffer, expected.start + start, size)
+                || (previous && buffer != previous)) {
+            printf("\t- document %d: buffer of %ld octets differs\n", k, (long)size);
+            failed++;
+        }
+        yaml_emitter_get_output_chunks(&emitter, &chunks, &count);
+        if (count != 1) {
+            printf("\t- document %d: %ld chunks after merging\n", k, (long)count);
+            failed++;
+        }
+        yaml_emitter_reset_output_chunks(&emitter);
+    }
+    if (!yaml_emitter_get_output_buffer(&emitter, &buffer, &size) || size) {
+        printf("\t- %ld octets after a reset\n", (long)size);
+        failed++;
+    }
+
+    yaml_emitter_delete(&handler);
+    yaml_emitter_delete(&emitter);
+    output_free(&expected);
+    printf("checking output chunks: %d fail(s)\n", failed);
+    return failed;
+}
+
+#ifdef HAVE_FD_OUTPUT
+
+/*
+ * Emit a document with a sequence of items, optionally followed by the end of
+ * the stream.
+ */
+
+int emit_items(yaml_emitter_t *emitter, int count, int stream_end)
+{
+    yaml_event_t event;
+    char item[64];
+    int k;
+    if (!yaml_stream_start_event_initialize(&event, YAML_UTF8_ENCODING)
+            || !yaml_emitter_emit(emitter, &event)
+            || !yaml_document_start_event_initialize(&event, NULL, NULL, NULL, 0)
+            || !yaml_emitter_emit(emitter, &event)
+            || !yaml_sequence_start_event_initialize(&event, NULL, NULL, 1,
+                YAML_BLOCK_SEQUENCE_STYLE)
+            || !yaml_emitter_emit(emitter, &event))
+        return 0;
+    for (k = 0; k < count; k++) {
+        int length = sprintf(item, "item %d of a document written to a descriptor", k);
+        if (!yaml_scalar_event_initialize(&event, NULL, NULL, (yaml_char_t *)item,
+                    length, 1, 1, YAML_PLAIN_SCALAR_STYLE)
+                || !yaml_emitter_emit(emitter, &event))
+            return 0;
+    }
+    if (!yaml_sequence_end_event_initialize(&event)
+            || !yaml_emitter_emit(emitter, &event)
+            || !yaml_document_end_event_initialize(&event, 0)
+            || !yaml_emitter_emit(emitter, &event))
+        return 0;
+    if (stream_end) {
+        if (!yaml_stream_end_event_initialize(&event)
+                || !yaml_emitter_emit(emitter, &event))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Read a whole file.
+ */
+
+unsigned char *read_file(const char *path, size_t *length)
+{
+    FILE *file = fopen(path, "rb");
+    unsigned char *content;
+    size_t size = 4096;
+    size_t count;
+    assert(file);
+    content = (unsigned char *)malloc(size);
+    assert(content);
+    *length = 0;
+    while ((count = fread(content + *length, 1, size - *length - 1, file)) > 0) {
+        *length += count;
+        if (size - *length - 1 == 0) {
+            size *= 2;
+            content = (unsigned char *)realloc(content, size);
+            assert(content);
+        }
+    }
+    content[*length] = '\0';
+    fclose(file);
+    return content;
+}
+
+/*
+ * Compare a file with the expected output.
+ */
+
+int check_file(const char *title, const char *path, output_t *expected)
+{
+    size_t length;
+    unsigned char *content = read_file(path, &length);
+    int failed = 0;
+    if (length != expected->length || memcmp(content, expected->start, length)) {
+        printf("\t- %s: %ld octets written instead of %ld\n", title,
+                (long)length, (long)expected->length);
+        failed = 1;
+    }
+    free(content);
+    return failed;
+}
+
+volatile sig_atomic_t interrupts;
+
+void count_interrupt(int signum)
+{
+    int saved_errno = errno;
+    (void)signum;
+    interrupts = 1;
+    errno = saved_errno;
+}
+
+int check_fd_output(void)
+{
+    static size_t buffer_sizes[] = { 0, 100, 16384, 1 << 20 };
+    const char *path = "test-emitter.tmp";
+    const char *copy_path = "test-emitter-copy.tmp";
+    output_t expected = { NULL, 0, 0 };
+    output_t document = { NULL, 0, 0 };
+    yaml_emitter_t emitter;
+    int failed = 0;
+    int background;
+    int k;
+    printf("checking descriptor output...\n");
+
+    yaml_emitter_initialize(&emitter);
+    yaml_emitter_set_output(&emitter, write_output, &expected);
+    assert(emit_items(&emitter, 20000, 1));
+    yaml_emitter_delete(&emitter);
+    yaml_emitter_initialize(&emitter);
+    yaml_emitter_set_output(&emitter, write_output, &document);
+    assert(emit_items(&emitter, 20000, 0) && yaml_emitter_flush(&emitter));
+    yaml_emitter_delete(&emitter);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    for (background = 0; background < 2; background++)
+    {
+        /* Buffer sizes below, at and above the default. */
+
+        for (k = 0; k < (int)(sizeof(buffer_sizes)/sizeof(*buffer_sizes)); k++)
+        {
+            size_t size = buffer_sizes[k] > 16384 ? buffer_sizes[k] : 16384;
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            assert(fd >= 0);
+            yaml_emitter_initialize(&emitter);
+            if (!yaml_emitter_set_output_fd(&emitter, fd, buffer_sizes[k], background)
+                    || (size_t)(emitter.buffer.end - emitter.buffer.start) != size
+                    || !emit_items(&emitter, 20000, 1)) {
+                printf("\t- buffer size %ld, background %d: error %d\n",
+                        (long)buffer_sizes[k], background, emitter.error);
+                failed++;
+            }
+            yaml_emitter_delete(&emitter);
+            close(fd);
+            failed += check_file("file output", path, &expected);
+        }
+
+        /* Deleting the emitter writes what was flushed at the document end. */
+
+        {
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            assert(fd >= 0);
+            yaml_emitter_initialize(&emitter);
+            if (!yaml_emitter_set_output_fd(&emitter, fd, 0, background)
+                    || !emit_items(&emitter, 20000, 0)) {
+                printf("\t- delete without flush, background %d: error %d\n",
+                        background, emitter.error);
+                failed++;
+            }
+            yaml_emitter_delete(&emitter);
+            close(fd);
+            failed += check_file("delete without flush", path, &document);
+        }
+
+        /*
+         * Short writes: a slow reader empties a pipe while a timer interrupts
+         * the blocked writes, which then return early.
+         */
+
+        {
+            struct sigaction action;
+            struct itimerval timer;
+            sigset_t alarm_set;
+            int fds[2];
+            int status;
+            pid_t child;
+            assert(pipe(fds) == 0);
+            child = fork();
+            assert(child >= 0);
+            if (!child) {
+                FILE *copy = fopen(copy_path, "wb");
+                unsigned char buffer[1000];
+                ssize_t count;
+                close(fds[1]);
+                while ((count = read(fds[0], buffer, sizeof(buffer))) > 0) {
+                    fwrite(buffer, 1, count, copy);
+                    usleep(100);
+                }
+                fclose(copy);
+                _exit(0);
+            }
+            close(fds[0]);
+            memset(&action, 0, sizeof(action));
+            action.sa_handler = count_interrupt;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGALRM, &action, NULL);
+            sigemptyset(&alarm_set);
+            sigaddset(&alarm_set, SIGALRM);
+            timer.it_interval.tv_sec = timer.it_value.tv_sec = 0;
+            timer.it_interval.tv_usec = timer.it_value.tv_usec = 500;
+            interrupts = 0;
+            yaml_emitter_initialize(&emitter);
+            if (!yaml_emitter_set_output_fd(&emitter, fds[1], 0, background)) {
+                printf("\t- short writes, background %d: error %d\n",
+                        background, emitter.error);
+                failed++;
+            }
+
+            /* Let the signals interrupt the writer thread only. */
+
+            if (background)
+                sigprocmask(SIG_BLOCK, &alarm_set, NULL);
+            setitimer(ITIMER_REAL, &timer, NULL);
+            if (!emit_items(&emitter, 20000, 1)) {
+                printf("\t- short writes, background %d: error %d\n",
+                        background, emitter.error);
+                failed++;
+            }
+            yaml_emitter_delete(&emitter);
+            timer.it_interval.tv_usec = timer.it_value.tv_usec = 0;
+            setitimer(ITIMER_REAL, &timer, NULL);
+            if (background)
+                sigprocmask(SIG_UNBLOCK, &alarm_set, NULL);
+            signal(SIGALRM, SIG_DFL);
+            close(fds[1]);
+            while (waitpid(child, &status, 0) < 0) {}
+            if (!interrupts) {
+                printf("\t- short writes, background %d: no interrupts\n", background);
+                failed++;
+            }
+            failed += check_file("short writes", copy_path, &expected);
+        }
+
+        /* A pipe with no reader fails, in the thread on the next flush. */
+
+        {
+            int fds[2];
+            int result;
+            assert(pipe(fds) == 0);
+            close(fds[0]);
+            yaml_emitter_initialize(&emitter);
+            result = yaml_emitter_set_output_fd(&emitter, fds[1], 0, background);
+            assert(result);
+            result = emit_items(&emitter, 20000, 0);
+            if (background && result)
+                result = yaml_emitter_flush(&emitter);
+            if (result || emitter.error != YAML_WRITER_ERROR
+                    || strcmp(emitter.problem, "write error")) {
+                printf("\t- closed pipe, background %d: result %d, error %d\n",
+                        background, result, emitter.error);
+                failed++;
+            }
+            yaml_emitter_delete(&emitter);
+            close(fds[1]);
+        }
+    }
+
+    signal(SIGPIPE, SIG_DFL);
+    remove(path);
+    remove(copy_path);
+    output_free(&expected);
+    output_free(&document);
+    printf("checking descriptor output: %d fail(s)\n", failed);
+    return failed;
+}
+
+#endif
+
+int
+main(void)
+{
+    int failed = check_deep_documents() + check_anchor_order()
+        + check_emit_modes() + check_bulk_scalars() + check_output_chunks()
+        + check_unterminated_values();
+#ifdef HAVE_FD_OUTPUT
+    failed += check_fd_output();
+#endif
+    return failed;
+}
@@ -0,0 +1,986 @@
+#include <yaml.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <assert.h>
+
+char *documents[] = {
+    "a scalar",
+    "--- !!str\n'a single quoted\n  scalar'\n...\n",
+    "- 1\n- [2, 3]\n- {4: 5, ? 6 : 7}\n- &a anchored\n- *a\n",
+    "%YAML 1.1\n%TAG !e! tag:example.com,2000:\n--- !e!map\nkey: |\n  literal\n  text\nother: >\n  folded\n  text\n",
+    "--- &m\na: &s [x, y]\nb: *s\n---\n- &m 1\n- *m\n",
+    "---\n- \"double \\\"quoted\\\"\\n\\u263A\"\n- !local { plain key: plain value }\n- ~\n",
+    "---\n...\n--- {}\n--- []\n",
+    NULL
+};
+
+/*
+ * Compare the nodes, the directives and the marks of two documents.
+ */
+
+int compare_documents(yaml_document_t *a, yaml_document_t *b)
+{
+    int k;
+    if (a->nodes.top - a->nodes.start != b->nodes.top - b->nodes.start)
+        return 0;
+    if (!a->version_directive != !b->version_directive
+            || (a->version_directive
+                && memcmp(a->version_directive, b->version_directive,
+                    sizeof(yaml_version_directive_t))))
+        return 0;
+    if (a->tag_directives.end - a->tag_directives.start
+            != b->tag_directives.end - b->tag_directives.start)
+        return 0;
+    for (k = 0; a->tag_directives.start + k < a->tag_directives.end; k++) {
+        if (strcmp((char *)a->tag_directives.start[k].handle,
+                    (char *)b->tag_directives.start[k].handle)
+                || strcmp((char *)a->tag_directives.start[k].prefix,
+                    (char *)b->tag_directives.start[k].prefix))
+            return 0;
+    }
+    if (a->start_implicit != b->start_implicit
+            || a->end_implicit != b->end_implicit
+            || a->start_mark.index != b->start_mark.index
+            || a->end_mark.index != b->end_mark.index)
+        return 0;
+    for (k = 0; a->nodes.start + k < a->nodes.top; k++) {
+        yaml_node_t *x = a->nodes.start + k;
+        yaml_node_t *y = b->nodes.start + k;
+        if (x->type != y->type || strcmp((char *)x->tag, (char *)y->tag)
+                || x->start_mark.index != y->start_mark.index
+                || x->end_mark.index != y->end_mark.index
+                || x->start_mark.line != y->start_mark.line
+                || x->start_mark.column != y->start_mark.column)
+            return 0;
+        switch (x->type) {
+            case YAML_SCALAR_NODE:
+                if (x->data.scalar.length != y->data.scalar.length
+                        || memcmp(x->data.scalar.value, y->data.scalar.value,
+                            x->data.scalar.length)
+                        || x->data.scalar.style != y->data.scalar.style)
+                    return 0;
+                break;
+            case YAML_SEQUENCE_NODE:
+                if (x->data.sequence.items.top - x->data.sequence.items.start
+                        != y->data.sequence.items.top - y->data.sequence.items.start
+                        || memcmp(x->data.sequence.items.start,
+                            y->data.sequence.items.start,
+                            (x->data.sequence.items.top - x->data.sequence.items.start)
+                            * sizeof(yaml_node_item_t))
+                        || x->data.sequence.style != y->data.sequence.style)
+                    return 0;
+                break;
+            case YAML_MAPPING_NODE:
+                if (x->data.mapping.pairs.top - x->data.mapping.pairs.start
+                        != y->data.mapping.pairs.top - y->data.mapping.pairs.start
+                        || memcmp(x->data.mapping.pairs.start,
+                            y->data.mapping.pairs.start,
+                            (x->data.mapping.pairs.top - x->data.mapping.pairs.start)
+                            * sizeof(yaml_node_pair_t))
+                        || x->data.mapping.style != y->data.mapping.style)
+                    return 0;
+                break;
+            default:
+                return 0;
+        }
+    }
+    return 1;
+}
+
+int check_arena_documents(void)
+{
+    int failed = 0;
+    int k;
+    printf("checking arena documents...\n");
+    for (k = 0; documents[k]; k++) {
+        yaml_parser_t parser, aparser;
+        yaml_document_t document, adocument;
+        int count = 0;
+        yaml_parser_initialize(&parser);
+        yaml_parser_set_input_string(&parser, (unsigned char *)documents[k],
+                strlen(documents[k]));
+        yaml_parser_initialize(&aparser);
+        yaml_parser_set_input_string(&aparser, (unsigned char *)documents[k],
+                strlen(documents[k]));
+        yaml_parser_set_document_arena(&aparser, 1);
+        while (1) {
+            int result = yaml_parser_load(&parser, &document);
+            int aresult = yaml_parser_load(&aparser, &adocument);
+            assert(result && aresult);
+            if (!adocument.arena && adocument.nodes.start != adocument.nodes.top) {
+                printf("\t- document %d.%d is not arena-backed\n", k, count);
+                failed++;
+            }
+            if (!compare_documents(&document, &adocument)) {
+                printf("\t- document %d.%d differs\n", k, count);
+                failed++;
+            }
+            if (!yaml_document_get_root_node(&document)) {
+                yaml_document_delete(&document);
+                yaml_document_delete(&adocument);
+                break;
+            }
+            /* The arena-backed nodes may grow with the document API. */
+            {
+                int root = 1;
+                int scalar = yaml_document_add_scalar(&adocument, NULL,
+                        (yaml_char_t *)"added", -1, YAML_ANY_SCALAR_STYLE);
+                int sequence = yaml_document_add_sequence(&adocument, NULL,
+                        YAML_ANY_SEQUENCE_STYLE);
+                int mapping = yaml_document_add_mapping(&adocument, NULL,
+                        YAML_ANY_MAPPING_STYLE);
+                int j;
+                assert(scalar && sequence && mapping);
+                for (j = 0; j < 100; j++) {
+                    assert(yaml_document_append_sequence_item(&adocument,
+                                sequence, scalar));
+                    assert(yaml_document_append_mapping_pair(&adocument,
+                                mapping, scalar, sequence));
+                }
+                if (adocument.nodes.start[0].type == YAML_SEQUENCE_NODE) {
+                    assert(yaml_document_append_sequence_item(&adocument,
+                                root, mapping));
+                }
+                else if (adocument.nodes.start[0].type == YAML_MAPPING_NODE) {
+                    assert(yaml_document_append_mapping_pair(&adocument,
+                                root, scalar, mapping));
+                }
+            }
+            yaml_document_delete(&document);
+            yaml_document_delete(&adocument);
+            count++;
+        }
+        yaml_parser_delete(&parser);
+        yaml_parser_delete(&aparser);
+    }
+    printf("checking arena documents: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * An allocator that counts the live blocks and fails after a budget.
+ */
+
+typedef struct {
+    long calls;
+    long live;
+    long budget;
+} counter_t;
+
+void *counting_malloc(void *data, size_t size)
+{
+    counter_t *counter = (counter_t *)data;
+    counter->calls++;
+    if (counter->budget == 0) return NULL;
+    if (counter->budget > 0) counter->budget--;
+    counter->live++;
+    return malloc(size);
+}
+
+void *counting_realloc(void *data, void *ptr, size_t size)
+{
+    counter_t *counter = (counter_t *)data;
+    counter->calls++;
+    if (counter->budget == 0) return NULL;
+    if (counter->budget > 0) counter->budget--;
+    if (!ptr) counter->live++;
+    return realloc(ptr, size);
+}
+
+void counting_free(void *data, void *ptr)
+{
+    counter_t *counter = (counter_t *)data;
+    if (ptr) counter->live--;
+    free(ptr);
+}
+
+/*
+ * Load and dump a stream.  Returns 1 on success and 0 on an error, which must
+ * be a memory error.
+ */
+
+int load_and_dump(const yaml_allocator_t *allocator, const char *input,
+        unsigned char *output, size_t size, size_t *written, int arena)
+{
+    yaml_parser_t parser;
+    yaml_emitter_t emitter;
+    yaml_document_t document;
+    int result = 1;
+    if (!yaml_parser_initialize_with_allocator(&parser, allocator))
+        return 0;
+    if (!yaml_emitter_initialize_with_allocator(&emitter, allocator)) {
+        yaml_parser_delete(&parser);
+        return 0;
+    }
+    yaml_parser_set_input_string(&parser, (unsigned char *)input, strlen(input));
+    yaml_parser_set_document_arena(&parser, arena);
+    yaml_emitter_set_output_string(&emitter, output, size, written);
+    if (!yaml_emitter_open(&emitter)) {
+        assert(emitter.error == YAML_MEMORY_ERROR);
+        result = 0;
+    }
+    while (result) {
+        if (!yaml_parser_load(&parser, &document)) {
+            assert(parser.error == YAML_MEMORY_ERROR);
+            result = 0;
+            break;
+        }
+        if (!yaml_document_get_root_node(&document)) {
+            yaml_document_delete(&document);
+            break;
+        }
+        if (!yaml_emitter_dump(&emitter, &document)) {
+            assert(emitter.error == YAML_MEMORY_ERROR);
+            result = 0;
+        }
+    }
+    if (result && !yaml_emitter_close(&emitter)) {
+        assert(emitter.error == YAML_MEMORY_ERROR);
+        result = 0;
+    }
+    yaml_emitter_delete(&emitter);
+    yaml_parser_delete(&parser);
+    return result;
+}
+
+int check_allocator(void)
+{
+    int failed = 0;
+    int k;
+    int arena;
+    printf("checking allocators...\n");
+    for (k = 0; documents[k]; k++) {
+        for (arena = 0; arena < 2; arena++) {
+            counter_t counter = { 0, 0, -1 };
+            yaml_allocator_t allocator;
+            unsigned char output[1024], coutput[1024];
+            size_t written, cwritten;
+            long budget;
+            allocator.malloc_handler = counting_malloc;
+            allocator.realloc_handler = counting_realloc;
+            allocator.free_handler = counting_free;
+            allocator.data = &counter;
+            assert(load_and_dump(NULL, documents[k], output, sizeof(output),
+                        &written, arena));
+            assert(load_and_dump(&allocator, documents[k], coutput,
+                        sizeof(coutput), &cwritten, arena));
+            if (!counter.calls || counter.live
+                    || written != cwritten || memcmp(output, coutput, written)) {
+                printf("\t- stream %d (arena=%d): %ld call(s), %ld live block(s)\n",
+                        k, arena, counter.calls, counter.live);
+                failed++;
+                continue;
+            }
+            /* Fail every allocation in turn. */
+            for (budget = 0; budget < counter.calls; budget++) {
+                counter_t limited = { 0, 0, 0 };
+                int result;
+                limited.budget = budget;
+                allocator.data = &limited;
+                result = load_and_dump(&allocator, documents[k], coutput,
+                        sizeof(coutput), &cwritten, arena);
+                if (limited.live) {
+                    printf("\t- stream %d (arena=%d), budget %ld: %ld live block(s)\n",
+                            k, arena, budget, limited.live);
+                    failed++;
+                    break;
+                }
+                if (result)
+                    break;
+            }
+        }
+    }
+    printf("checking allocators: %d fail(s)\n", failed);
+    return failed;
+}
+
+typedef struct {
+    char *title;
+    char *input;
+    char *problem;
+    int context_line;
+    int context_column;
+    int problem_line;
+    int problem_column;
+} anchor_case;
+
+anchor_case anchor_errors[] = {
+    {"duplicate anchor", "- &a 1\n- &b 2\n-   &a 3\n", "second occurrence", 0, 2, 2, 4},
+    {"duplicate collection anchor", "&x {a: &y [1], b: &x 2}", "second occurrence", 0, 0, 0, 18},
+    {"undefined alias", "- &a 1\n- *b\n", "found undefined alias", 0, 0, 1, 2},
+    {"alias to a previous document", "--- &a 1\n--- *a\n", "found undefined alias", 0, 0, 1, 4},
+    {NULL, NULL, NULL, 0, 0, 0, 0}
+};
+
+int check_anchors(void)
+{
+    yaml_parser_t parser;
+    yaml_document_t document;
+    int failed = 0;
+    int k;
+    char *input;
+    size_t length = 0;
+    printf("checking anchors...\n");
+    for (k = 0; anchor_errors[k].title; k++) {
+        anchor_case *test = anchor_errors + k;
+        int result = 1;
+        yaml_parser_initialize(&parser);
+        yaml_parser_set_input_string(&parser, (unsigned char *)test->input,
+                strlen(test->input));
+        while (result) {
+            result = yaml_parser_load(&parser, &document);
+            if (!result)
+                break;
+            if (!yaml_document_get_root_node(&document)) {
+                yaml_document_delete(&document);
+                break;
+            }
+            yaml_document_delete(&document);
+        }
+        if (result || parser.error != YAML_COMPOSER_ERROR
+                || strcmp(parser.problem, test->problem)
+                || (int)parser.problem_mark.line != test->problem_line
+                || (int)parser.problem_mark.column != test->problem_column
+                || (parser.context
+                    && ((int)parser.context_mark.line != test->context_line
+                        || (int)parser.context_mark.column != test->context_column))) {
+            printf("\t- %s: '%s' at (%d, %d), context at (%d, %d)\n",
+                    test->title, parser.problem ? parser.problem : "no error",
+                    (int)parser.problem_mark.line, (int)parser.problem_mark.column,
+                    (int)parser.context_mark.line, (int)parser.context_mark.column);
+            failed++;
+        }
+        yaml_parser_delete(&parser);
+    }
+
+    /* Many anchors, each redefined in the next document. */
+    input = (char *)malloc(2*5000*40);
+    assert(input);
+    for (k = 0; k < 2; k++) {
+        int j;
+        length += sprintf(input+length, "---\n");
+        for (j = 0; j < 5000; j++)
+            length += sprintf(input+length, "- &anchor%d %d\n", j, j);
+        for (j = 0; j < 5000; j += 7)
+            length += sprintf(input+length, "- *anchor%d\n", j);
+    }
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, (unsigned char *)input, length);
+    for (k = 0; k < 2; k++) {
+        yaml_node_t *root;
+        int j;
+        assert(yaml_parser_load(&parser, &document));
+        root = yaml_document_get_root_node(&document);
+        assert(root && root->type == YAML_SEQUENCE_NODE);
+        for (j = 5000; root->data.sequence.items.start + j
+                < root->data.sequence.items.top; j++) {
+            if (root->data.sequence.items.start[j]
+                    != root->data.sequence.items.start[(j-5000)*7]) {
+                printf("\t- alias %d resolves to node %d\n", j,
+                        root->data.sequence.items.start[j]);
+                failed++;
+                break;
+            }
+        }
+        yaml_document_delete(&document);
+    }
+    yaml_parser_delete(&parser);
+    free(input);
+    printf("checking anchors: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * Build a stream of many documents that exercises the split points of the
+ * parallel loader: document start markers within block and quoted scalars,
+ * directives after document end markers, and comments between documents.
+ */
+
+char *parallel_documents[] = {
+    "---\n- a\n- {b: c, d: [e, f]}\n- &x anchored\n- *x\n",
+    "--- |\n  literal\n  --- not a marker\n  ...\n---\n",
+    "--- 'quoted\n  --- not a marker'\n",
+    "--- \"double\n  --- not a marker\\\n  \"\n",
+    "...\n%YAML 1.1\n%TAG !e! tag:example.com,2000:\n--- !e!x\nk: v\n...\n",
+    "# a comment\n---\n>\n folded\n\n text\n",
+    "---\nkey: value\n",
+    NULL
+};
+
+char *build_stream(int count, const char *error, int error_index, size_t *length)
+{
+    size_t size = 0;
+    char *input;
+    int k;
+    for (k = 0; parallel_documents[k]; k++)
+        size += strlen(parallel_documents[k]) + 64;
+    size = size * count + (error ? strlen(error) : 0);
+    input = (char *)malloc(size);
+    assert(input);
+    *length = 0;
+    for (k = 0; k < count; k++) {
+        const char *document = parallel_documents[k % 7];
+        if (error && k == error_index) {
+            *length += sprintf(input + *length, "%s", error);
+        }
+        *length += sprintf(input + *length, "%s", document);
+        if (k % 7 == 6)
+            *length += sprintf(input + *length, "--- [padding %d]\n", k);
+    }
+    return input;
+}
+
+typedef struct {
+    yaml_document_t *documents;
+    int count;
+    int delivered;
+    int failed;
+    int stop_at;
+} delivery_t;
+
+int deliver_document(void *data, yaml_document_t *document)
+{
+    delivery_t *delivery = (delivery_t *)data;
+    if (delivery->delivered >= delivery->count
+            || !compare_documents(delivery->documents + delivery->delivered,
+                document)) {
+        if (!delivery->failed)
+            printf("\t- document %d is delivered out of order or differs\n",
+                    delivery->delivered);
+        delivery->failed = 1;
+    }
+    delivery->delivered++;
+    yaml_document_delete(document);
+    return delivery->delivered != delivery->stop_at;
+}
+
+int check_parallel_case(const char *title, const char *input, size_t length,
+        int stop_at, const yaml_parser_limits_t *limits)
+{
+    yaml_parser_t parser, pparser;
+    delivery_t delivery;
+    int result, presult;
+    int size = 256;
+    int failed = 0;
+    memset(&delivery, 0, sizeof(delivery));
+    delivery.documents = (yaml_document_t *)malloc(size*sizeof(yaml_document_t));
+    delivery.stop_at = stop_at;
+    assert(delivery.documents);
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, (unsigned char *)input, length);
+    if (limits)
+        yaml_parser_set_limits(&parser, limits);
+    while (1) {
+        if (delivery.count == size) {
+            size *= 2;
+            delivery.documents = (yaml_document_t *)realloc(delivery.documents,
+                    size*sizeof(yaml_document_t));
+            assert(delivery.documents);
+        }
+        result = yaml_parser_load(&parser, delivery.documents + delivery.count);
+        if (!result)
+            break;
+        if (!yaml_document_get_root_node(delivery.documents + delivery.count)) {
+            yaml_document_delete(delivery.documents + delivery.count);
+            break;
+        }
+        delivery.count++;
+        if (delivery.count == stop_at) {
+            result = 0;
+            break;
+        }
+    }
+    yaml_parser_initialize(&pparser);
+    yaml_parser_set_input_string(&pparser, (unsigned char *)input, length);
+    if (limits)
+        yaml_parser_set_limits(&pparser, limits);
+    presult = yaml_stream_load_parallel(&pparser, 4, deliver_document, &delivery);
+    if (result != presult || delivery.failed || delivery.delivered != delivery.count
+            || parser.error != pparser.error
+            || (parser.error && (strcmp(parser.problem, pparser.problem)
+                    || parser.problem_mark.index != pparser.problem_mark.index
+                    || parser.problem_mark.line != pparser.problem_mark.line
+                    || parser.problem_mark.column != pparser.problem_mark.column
+                    || parser.context_mark.index != pparser.context_mark.index))) {
+        printf("\t- %s: result %d/%d, %d/%d document(s), error '%s'/'%s' at %ld/%ld\n",
+                title, result, presult, delivery.count, delivery.delivered,
+                parser.problem ? parser.problem : "no error",
+                pparser.problem ? pparser.problem : "no error",
+                (long)parser.problem_mark.index, (long)pparser.problem_mark.index);
+        failed = 1;
+    }
+    while (delivery.count)
+        yaml_document_delete(delivery.documents + --delivery.count);
+    free(delivery.documents);
+    yaml_parser_delete(&parser);
+    yaml_parser_delete(&pparser);
+    return failed;
+}
+
+int check_parallel_loader(void)
+{
+    int failed = 0;
+    char *input;
+    size_t length;
+    printf("checking the parallel loader...\n");
+    input = build_stream(20000, NULL, 0, &length);
+    failed += check_parallel_case("valid stream", input, length, 0, NULL);
+    failed += check_parallel_case("stopped by the handler", input, length, 1234, NULL);
+    failed += check_parallel_case("short stream", input, 2000, 0, NULL);
+    free(input);
+    input = build_stream(20000, "--- [unclosed, flow\n", 17500, &length);
+    failed += check_parallel_case("scanner error", input, length, 0, NULL);
+    free(input);
+    input = build_stream(20000, "--- 'a\n--- b'\n", 2000, &length);
+    failed += check_parallel_case("marker within a quoted scalar", input, length, 0, NULL);
+    free(input);
+    input = build_stream(20000, "--- *undefined\n", 19900, &length);
+    failed += check_parallel_case("composer error", input, length, 0, NULL);
+    free(input);
+    input = build_stream(20000, "--- |\n  block\n---\nnot: a block\n", 10000, &length);
+    failed += check_parallel_case("marker ending a block scalar", input, length, 0, NULL);
+    free(input);
+    printf("checking the parallel loader: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * Load a stream with the limits and return the number of documents.
+ */
+
+int load_with_limits(const char *input, const yaml_parser_limits_t *limits,
+        yaml_parser_t *parser)
+{
+    yaml_document_t document;
+    int count = 0;
+    yaml_parser_initialize(parser);
+    yaml_parser_set_input_string(parser, (const unsigned char *)input,
+            strlen(input));
+    yaml_parser_set_limits(parser, limits);
+    while (yaml_parser_load(parser, &document)) {
+        int empty = !yaml_document_get_root_node(&document);
+        yaml_document_delete(&document);
+        if (empty)
+            break;
+        count++;
+    }
+    return count;
+}
+
+int check_load_limit(const char *title, const char *input,
+        const yaml_parser_limits_t *limits, const char *problem,
+        int line, int column)
+{
+    yaml_parser_t parser;
+    int failed = 0;
+    load_with_limits(input, limits, &parser);
+    if (problem ? (parser.error != YAML_LIMIT_ERROR
+                || strcmp(parser.problem, problem)
+                || (int)parser.problem_mark.line != line
+                || (int)parser.problem_mark.column != column)
+            : parser.error != YAML_NO_ERROR) {
+        printf("\t- %s: error %d '%s' at (%d,%d)\n", title, parser.error,
+                parser.problem ? parser.problem : "",
+                (int)parser.problem_mark.line, (int)parser.problem_mark.column);
+        failed = 1;
+    }
+    yaml_parser_delete(&parser);
+    return failed;
+}
+
+int check_load_limits(void)
+{
+    yaml_parser_limits_t limits = { 0, 0, 0, 0, 0 };
+    char *input = (char *)malloc(100000);
+    size_t length;
+    int failed = 0;
+    int k;
+    assert(input);
+    printf("checking load limits...\n");
+
+    /* One anchor and a hundred aliases. */
+
+    length = sprintf(input, "- &a x\n");
+    for (k = 0; k < 100; k++)
+        length += sprintf(input + length, "- *a\n");
+    limits.max_alias_references = 100;
+    failed += check_load_limit("100 aliases", input, &limits, NULL, 0, 0);
+    limits.max_alias_references = 99;
+    failed += check_load_limit("100 aliases, limit 99", input, &limits,
+            "exceeded the maximum number of alias references", 100, 2);
+
+    /* Aliases that expand exponentially are counted once each. */
+
+    length = sprintf(input, "a: &a [x, x, x, x, x, x, x, x, x, x]\n");
+    length += sprintf(input + length, "b: &b [*a, *a, *a, *a, *a, *a, *a, *a, *a, *a]\n");
+    length += sprintf(input + length, "c: &c [*b, *b, *b, *b, *b, *b, *b, *b, *b, *b]\n");
+    length += sprintf(input + length, "d: [*c, *c, *c, *c, *c, *c, *c, *c, *c, *c]\n");
+    limits.max_alias_references = 30;
+    failed += check_load_limit("nested aliases", input, &limits, NULL, 0, 0);
+    limits.max_alias_references = 25;
+    failed += check_load_limit("nested aliases, limit 25", input, &limits,
+            "exceeded the maximum number of alias references", 3, 24);
+
+    /* The count starts over with every document. */
+
+    length = 0;
+    for (k = 0; k < 3; k++)
+        length += sprintf(input + length, "--- [&a x, *a, *a]\n");
+    limits.max_alias_references = 2;
+    failed += check_load_limit("aliases in three documents", input, &limits,
+            NULL, 0, 0);
+    limits.max_alias_references = 0;
+
+    /* A sequence and a hundred scalars. */
+
+    length = sprintf(input, "[a");
+    for (k = 1; k < 100; k++)
+        length += sprintf(input + length, ", a");
+    length += sprintf(input + length, "]\n");
+    limits.max_nodes = 101;
+    failed += check_load_limit("101 nodes", input, &limits, NULL, 0, 0);
+    limits.max_nodes = 100;
+    failed += check_load_limit("101 nodes, limit 100", input, &limits,
+            "exceeded the maximum number of nodes", 0, 298);
+
+    /* The limits apply to each document of the parallel loader. */
+
+    limits.max_nodes = 0;
+    limits.max_alias_references = 2;
+    length = 0;
+    for (k = 0; k < 5000; k++)
+        length += sprintf(input + length, k == 3000 ? "--- [&a x, *a, *a, *a, y]\n"
+                : "--- [&a x, *a, *a]\n");
+    failed += check_parallel_case("alias limit", input, length, 0, &limits);
+    limits.max_alias_references = 0;
+    limits.max_nodes = 2;
+    failed += check_parallel_case("node limit", input, length, 0, &limits);
+
+    free(input);
+    printf("checking load limits: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * Compare a compact document with the document it was made of.
+ */
+
+int compare_compact(yaml_document_t *document, yaml_compact_document_t *compact,
+        int marks)
+{
+    int count = (int)(document->nodes.top - document->nodes.start);
+    int id, k;
+    if (compact->nodes.end - compact->nodes.start != count
+            || yaml_compact_document_get_root(compact) != (count ? 1 : 0)
+            || yaml_compact_node_type(compact, 0) != YAML_NO_NODE
+            || yaml_compact_node_type(compact, count + 1) != YAML_NO_NODE
+            || yaml_compact_node_tag(compact, count + 1))
+        return 0;
+    for (id = 1; id <= count; id++) {
+        yaml_node_t *node = document->nodes.start + id - 1;
+        yaml_mark_t start_mark, end_mark;
+        const yaml_char_t *value;
+        size_t length;
+        if (yaml_compact_node_type(compact, id) != node->type
+                || strcmp((char *)yaml_compact_node_tag(compact, id),
+                    (char *)node->tag))
+            return 0;
+        if (yaml_compact_node_marks(compact, id, &start_mark, &end_mark)
+                != marks
+                || (marks && (start_mark.index != node->start_mark.index
+                        || end_mark.index != node->end_mark.index
+                        || start_mark.line || end_mark.column)))
+            return 0;
+        value = yaml_compact_node_value(compact, id, &length);
+        switch (node->type) {
+            case YAML_SCALAR_NODE:
+                if (!value || length != node->data.scalar.length
+                        || memcmp(value, node->data.scalar.value, length)
+                        || value[length]
+                        || yaml_compact_node_style(compact, id)
+                            != (int)node->data.scalar.style
+                        || yaml_compact_node_size(compact, id)
+                        || yaml_compact_node_item(compact, id, 0))
+                    return 0;
+                break;
+            case YAML_SEQUENCE_NODE:
+                if (value || yaml_compact_node_size(compact, id)
+                        != node->data.sequence.items.top
+                            - node->data.sequence.items.start
+                        || yaml_compact_node_style(compact, id)
+                            != (int)node->data.sequence.style)
+                    return 0;
+                for (k = 0; node->data.sequence.items.start + k
+                        < node->data.sequence.items.top; k++) {
+                    if (yaml_compact_node_item(compact, id, k)
+                            != node->data.sequence.items.start[k])
+                        return 0;
+                }
+                if (yaml_compact_node_item(compact, id, k)
+                        || yaml_compact_node_item(compact, id, -1))
+                    return 0;
+                break;
+            case YAML_MAPPING_NODE:
+                if (value || yaml_compact_node_size(compact, id)
+                        != node->data.mapping.pairs.top
+                            - node->data.mapping.pairs.start
+                        || yaml_compact_node_style(compact, id)
+                            != (int)node->data.mapping.style)
+                    return 0;
+                for (k = 0; node->data.mapping.pairs.start + k
+                        < node->data.mapping.pairs.top; k++) {
+                    if (yaml_compact_node_item(compact, id, 2*k)
+                            != node->data.mapping.pairs.start[k].key
+                            || yaml_compact_node_item(compact, id, 2*k+1)
+                            != node->data.mapping.pairs.start[k].value)
+                        return 0;
+                }
+                if (yaml_compact_node_item(compact, id, 2*k))
+                    return 0;
+                break;
+            default:
+                return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Compact a document with the marks or without, and expand it back.
+ */
+
+int check_compact_case(const char *title, yaml_document_t *document)
+{
+    int failed = 0;
+    int marks;
+    for (marks = 0; marks < 2; marks++) {
+        yaml_compact_document_t compact;
+        yaml_document_t expanded;
+        yaml_node_t *node;
+        if (!yaml_document_compact(document, &compact, marks)) {
+            printf("\t- %s, marks %d: not compacted\n", title, marks);
+            failed++;
+            continue;
+        }
+        if (!compare_compact(document, &compact, marks)
+                || (marks ? !compact.marks : compact.marks != NULL)) {
+            printf("\t- %s, marks %d: compact document differs\n", title, marks);
+            failed++;
+        }
+        assert(yaml_compact_document_expand(&compact, &expanded));
+        yaml_compact_document_delete(&compact);
+
+        /* The expanded nodes have only the index of their marks, if any. */
+
+        for (node = document->nodes.start; node != document->nodes.top; node++) {
+            node->start_mark.line = node->start_mark.column = 0;
+            node->end_mark.line = node->end_mark.column = 0;
+            if (!marks)
+                node->start_mark.index = node->end_mark.index = 0;
+        }
+        if (!compare_documents(document, &expanded)) {
+            printf("\t- %s, marks %d: expanded document differs\n", title, marks);
+            failed++;
+        }
+        yaml_document_delete(&expanded);
+    }
+    return failed;
+}
+
+/*
+ * Compact a document made of the given nodes.  Returns the result, which must
+ * leave no memory allocated on failure.
+ */
+
+int compact_nodes(yaml_node_t *nodes, int count, int marks)
+{
+    counter_t counter = { 0, 0, -1 };
+    yaml_allocator_t allocator;
+    yaml_document_t document;
+    yaml_compact_document_t compact;
+    int result;
+    allocator.malloc_handler = counting_malloc;
+    allocator.realloc_handler = counting_realloc;
+    allocator.free_handler = counting_free;
+    allocator.data = &counter;
+    memset(&document, 0, sizeof(document));
+    document.nodes.start = nodes;
+    document.nodes.top = document.nodes.end = nodes + count;
+    document.allocator = &allocator;
+    result = yaml_document_compact(&document, &compact, marks);
+    if (result) {
+        yaml_compact_document_delete(&compact);
+    }
+    else if (compact.nodes.start || compact.strings.start || compact.marks) {
+        result = -1;
+    }
+    return counter.live ? -1 : result;
+}
+
+int check_compact_documents(void)
+{
+    yaml_char_t *str = (yaml_char_t *)YAML_STR_TAG;
+    yaml_char_t *seq = (yaml_char_t *)YAML_SEQ_TAG;
+    yaml_char_t value[] = "value";
+    yaml_node_t nodes[2];
+    int failed = 0;
+    int k;
+    printf("checking compact documents...\n");
+
+    for (k = 0; documents[k]; k++) {
+        yaml_parser_t parser;
+        yaml_document_t document;
+        int count = 0;
+        yaml_parser_initialize(&parser);
+        yaml_parser_set_input_string(&parser, (unsigned char *)documents[k],
+                strlen(documents[k]));
+        while (1) {
+            char title[32];
+            assert(yaml_parser_load(&parser, &document));
+            sprintf(title, "document %d.%d", k, count++);
+            failed += check_compact_case(title, &document);
+            if (!yaml_document_get_root_node(&document)) {
+                yaml_document_delete(&document);
+                break;
+            }
+            yaml_document_delete(&document);
+        }
+        yaml_parser_delete(&parser);
+    }
+
+    /*
+     * The tags are stored once, whether few tags are shared by many nodes or
+     * every node has a tag of its own.
+     */
+
+    {
+        int distinct[] = { 1, 37, 5000 };
+        size_t j;
+        for (j = 0; j < sizeof(distinct)/sizeof(*distinct); j++) {
+            yaml_document_t document;
+            yaml_compact_document_t compact;
+            size_t strings = strlen(YAML_SEQ_TAG) + 1;
+            char tag[32];
+            int root, id;
+            assert(yaml_document_initialize(&document, NULL, NULL, NULL, 1, 1));
+            root = yaml_document_add_sequence(&document, NULL,
+                    YAML_BLOCK_SEQUENCE_STYLE);
+            for (k = 0; k < 10000; k++) {
+                sprintf(tag, "!tag%d", k % distinct[j]);
+                if (k < distinct[j])
+                    strings += strlen(tag) + 1;
+                id = yaml_document_add_scalar(&document, (yaml_char_t *)tag,
+                        value, 5, YAML_PLAIN_SCALAR_STYLE);
+                assert(id && yaml_document_append_sequence_item(&document,
+                            root, id));
+                strings += 6;
+            }
+            failed += check_compact_case("tagged scalars", &document);
+            assert(yaml_document_compact(&document, &compact, 0));
+            for (id = 2; id <= 10001 && !failed; id++) {
+                if (yaml_compact_node_tag(&compact, id)
+                        != yaml_compact_node_tag(&compact,
+                            2 + (id - 2) % distinct[j])) {
+                    printf("\t- %d tags: node %d has a copy of its tag\n",
+                            distinct[j], id);
+                    failed++;
+                }
+            }
+            if (compact.tags.end - compact.tags.start != distinct[j] + 1
+                    || (size_t)(compact.strings.end - compact.strings.start)
+                        != strings) {
+                printf("\t- %d tags: %ld tags, %ld octets of strings\n",
+                        distinct[j], (long)(compact.tags.end - compact.tags.start),
+                        (long)(compact.strings.end - compact.strings.start));
+                failed++;
+            }
+            yaml_compact_document_delete(&compact);
+            yaml_document_delete(&document);
+        }
+    }
+
+    /*
+     * Documents that do not fit the 32-bit offsets and ids are refused.  The
+     * lengths are only measured before the copy, so the nodes are faked.
+     */
+
+    memset(nodes, 0, sizeof(nodes));
+    for (k = 0; k < 2; k++) {
+        nodes[k].type = YAML_SCALAR_NODE;
+        nodes[k].tag = str;
+        nodes[k].data.scalar.value = value;
+        nodes[k].data.scalar.length = 5;
+    }
+    if (compact_nodes(nodes, 2, 1) != 1) {
+        printf("\t- fake scalars not compacted\n");
+        failed++;
+    }
+    if (sizeof(size_t) > sizeof(unsigned int))
+    {
+        yaml_node_item_t *items;
+        yaml_node_t *sequences;
+        int count = 65537;
+
+        nodes[0].data.scalar.length = (size_t)UINT_MAX;
+        if (compact_nodes(nodes, 1, 0) != 0) {
+            printf("\t- a scalar of UINT_MAX octets is not refused\n");
+            failed++;
+        }
+        nodes[0].data.scalar.length = nodes[1].data.scalar.length
+            = (size_t)UINT_MAX / 2 + 1;
+        if (compact_nodes(nodes, 2, 0) != 0) {
+            printf("\t- scalars of UINT_MAX+1 octets are not refused\n");
+            failed++;
+        }
+        nodes[0].data.scalar.length = nodes[1].data.scalar.length = 5;
+
+        nodes[1].start_mark.index = (size_t)UINT_MAX;
+        nodes[1].end_mark.index = (size_t)UINT_MAX + 1;
+        if (compact_nodes(nodes, 2, 1) != 0 || compact_nodes(nodes, 2, 0) != 1) {
+            printf("\t- a mark beyond UINT_MAX is not refused with marks only\n");
+            failed++;
+        }
+        nodes[1].end_mark.index = (size_t)UINT_MAX;
+        if (compact_nodes(nodes, 2, 1) != 1) {
+            printf("\t- a mark at UINT_MAX is refused\n");
+            failed++;
+        }
+
+        /* The sequences share their items, 65537 times 65536 of them. */
+
+        items = (yaml_node_item_t *)calloc(65536, sizeof(yaml_node_item_t));
+        sequences = (yaml_node_t *)calloc(count, sizeof(yaml_node_t));
+        assert(items && sequences);
+        for (k = 0; k < count; k++) {
+            sequences[k].type = YAML_SEQUENCE_NODE;
+            sequences[k].tag = seq;
+            sequences[k].data.sequence.items.start = items;
+            sequences[k].data.sequence.items.top = items + 65536;
+            sequences[k].data.sequence.items.end = items + 65536;
+        }
+        if (compact_nodes(sequences, count, 0) != 0) {
+            printf("\t- more than UINT_MAX items are not refused\n");
+            failed++;
+        }
+        free(sequences);
+        free(items);
+    }
+
+    printf("checking compact documents: %d fail(s)\n", failed);
+    return failed;
+}
+
+int
+main(void)
+{
+    return check_arena_documents() + check_allocator() + check_anchors()
+        + check_parallel_loader() + check_load_limits()
+        + check_compact_documents();
+}
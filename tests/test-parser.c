@@ -0,0 +1,1802 @@
+#include <yaml.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <assert.h>
+
+/*
+ * A growing text buffer that collects the description of an event stream.
+ */
+
+typedef struct {
+    char *start;
+    size_t length;
+    size_t size;
+} text_t;
+
+void text_append(text_t *text, const char *value, size_t length)
+{
+    if (text->length + length + 1 > text->size) {
+        while (text->length + length + 1 > text->size)
+            text->size = text->size ? text->size*2 : 256;
+        text->start = (char *)realloc(text->start, text->size);
+        assert(text->start);
+    }
+    memcpy(text->start + text->length, value, length);
+    text->length += length;
+    text->start[text->length] = '\0';
+}
+
+void text_print(text_t *text, const char *format, long a, long b, long c)
+{
+    char buffer[128];
+    sprintf(buffer, format, a, b, c);
+    text_append(text, buffer, strlen(buffer));
+}
+
+void text_string(text_t *text, const char *prefix, const yaml_char_t *value,
+        size_t length)
+{
+    text_append(text, prefix, strlen(prefix));
+    if (value) {
+        text_append(text, (const char *)value, length);
+    }
+}
+
+void text_free(text_t *text)
+{
+    free(text->start);
+    text->start = NULL;
+    text->length = text->size = 0;
+}
+
+/*
+ * Describe an event with its marks.
+ */
+
+void describe_event(text_t *text, yaml_event_t *event)
+{
+    text_print(text, "%ld (%ld,", (long)event->type,
+            (long)event->start_mark.index, (long)event->start_mark.line);
+    text_print(text, "%ld)-(%ld,%ld,", (long)event->start_mark.column,
+            (long)event->end_mark.index, (long)event->end_mark.line);
+    text_print(text, "%ld)", (long)event->end_mark.column, 0, 0);
+    switch (event->type) {
+        case YAML_DOCUMENT_START_EVENT:
+        {
+            yaml_tag_directive_t *tag;
+            if (event->data.document_start.version_directive)
+                text_print(text, " %%YAML %ld.%ld",
+                        (long)event->data.document_start.version_directive->major,
+                        (long)event->data.document_start.version_directive->minor, 0);
+            for (tag = event->data.document_start.tag_directives.start;
+                    tag != event->data.document_start.tag_directives.end; tag++) {
+                text_string(text, " %TAG ", tag->handle, strlen((char *)tag->handle));
+                text_string(text, " ", tag->prefix, strlen((char *)tag->prefix));
+            }
+            text_print(text, " implicit=%ld", (long)event->data.document_start.implicit, 0, 0);
+            break;
+        }
+        case YAML_DOCUMENT_END_EVENT:
+            text_print(text, " implicit=%ld", (long)event->data.document_end.implicit, 0, 0);
+            break;
+        case YAML_ALIAS_EVENT:
+            text_string(text, " *", event->data.alias.anchor,
+                    strlen((char *)event->data.alias.anchor));
+            break;
+        case YAML_SCALAR_EVENT:
+            if (event->data.scalar.anchor)
+                text_string(text, " &", event->data.scalar.anchor,
+                        strlen((char *)event->data.scalar.anchor));
+            if (event->data.scalar.tag)
+                text_string(text, " <", event->data.scalar.tag,
+                        strlen((char *)event->data.scalar.tag));
+            text_print(text, " %ld%ld%ld '", (long)event->data.scalar.plain_implicit,
+                    (long)event->data.scalar.quoted_implicit,
+                    (long)event->data.scalar.style);
+            text_string(text, "", event->data.scalar.value, event->data.scalar.length);
+            text_append(text, "'", 1);
+            break;
+        case YAML_SEQUENCE_START_EVENT:
+            if (event->data.sequence_start.anchor)
+                text_string(text, " &", event->data.sequence_start.anchor,
+                        strlen((char *)event->data.sequence_start.anchor));
+            if (event->data.sequence_start.tag)
+                text_string(text, " <", event->data.sequence_start.tag,
+                        strlen((char *)event->data.sequence_start.tag));
+            text_print(text, " %ld%ld", (long)event->data.sequence_start.implicit,
+                    (long)event->data.sequence_start.style, 0);
+            break;
+        case YAML_MAPPING_START_EVENT:
+            if (event->data.mapping_start.anchor)
+                text_string(text, " &", event->data.mapping_start.anchor,
+                        strlen((char *)event->data.mapping_start.anchor));
+            if (event->data.mapping_start.tag)
+                text_string(text, " <", event->data.mapping_start.tag,
+                        strlen((char *)event->data.mapping_start.tag));
+            text_print(text, " %ld%ld", (long)event->data.mapping_start.implicit,
+                    (long)event->data.mapping_start.style, 0);
+            break;
+        default:
+            break;
+    }
+    text_append(text, "\n", 1);
+}
+
+/*
+ * Describe the error of a parser.
+ */
+
+void describe_error(text_t *text, yaml_parser_t *parser)
+{
+    text_print(text, "ERROR %ld offset=%ld value=%ld", (long)parser->error,
+            (long)parser->problem_offset, (long)parser->problem_value);
+    text_string(text, " problem=", (yaml_char_t *)parser->problem,
+            parser->problem ? strlen(parser->problem) : 0);
+    text_print(text, " (%ld,%ld,%ld)", (long)parser->problem_mark.index,
+            (long)parser->problem_mark.line, (long)parser->problem_mark.column);
+    text_string(text, " context=", (yaml_char_t *)parser->context,
+            parser->context ? strlen(parser->context) : 0);
+    text_print(text, " (%ld,%ld,%ld)\n", (long)parser->context_mark.index,
+            (long)parser->context_mark.line, (long)parser->context_mark.column);
+}
+
+/*
+ * Parse a stream to the end or to the first error and describe it.
+ */
+
+void describe_stream(text_t *text, yaml_parser_t *parser)
+{
+    yaml_event_t event;
+    while (1) {
+        if (!yaml_parser_parse(parser, &event)) {
+            describe_error(text, parser);
+            break;
+        }
+        describe_event(text, &event);
+        if (event.type == YAML_STREAM_END_EVENT) {
+            yaml_event_delete(&event);
+            break;
+        }
+        yaml_event_delete(&event);
+    }
+}
+
+/*
+ * Parse a string and return the first tag of the stream or the problem.
+ */
+
+char *first_tag(const char *input, char *result)
+{
+    yaml_parser_t parser;
+    yaml_event_t event;
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, (unsigned char *)input, strlen(input));
+    strcpy(result, "no tag");
+    while (1) {
+        yaml_char_t *tag = NULL;
+        if (!yaml_parser_parse(&parser, &event)) {
+            strcpy(result, parser.problem);
+            break;
+        }
+        if (event.type == YAML_SCALAR_EVENT)
+            tag = event.data.scalar.tag;
+        if (event.type == YAML_SEQUENCE_START_EVENT)
+            tag = event.data.sequence_start.tag;
+        if (event.type == YAML_MAPPING_START_EVENT)
+            tag = event.data.mapping_start.tag;
+        if (tag) {
+            strcpy(result, (char *)tag);
+        }
+        if (tag || event.type == YAML_STREAM_END_EVENT) {
+            yaml_event_delete(&event);
+            break;
+        }
+        yaml_event_delete(&event);
+    }
+    yaml_parser_delete(&parser);
+    return result;
+}
+
+typedef struct {
+    char *input;
+    char *result;
+} tag_case;
+
+tag_case tags[] = {
+    {"!local x", "!local"},
+    {"!!str x", "tag:yaml.org,2002:str"},
+    {"!<tag:example.com,2000:verbatim> x", "tag:example.com,2000:verbatim"},
+    {"%TAG !e! tag:example.com,2000:app/\n--- !e!foo x", "tag:example.com,2000:app/foo"},
+    {"%TAG ! tag:example.com,2000:\n--- !foo x", "tag:example.com,2000:foo"},
+    {"%TAG !! tag:example.com,2000:\n--- !!int x", "tag:example.com,2000:int"},
+    {"%TAG !e! tag:a:\n%TAG !f! tag:b:\n--- !f!x [!e!y z]", "tag:b:x"},
+    {"%TAG !e! tag:a:\n%TAG !e! tag:b:\n--- x", "found duplicate %TAG directive"},
+    {"--- !e!foo x", "found undefined tag handle"},
+    {"%TAG !e! tag:a:\n--- !e!x y\n--- z", "tag:a:x"},
+    {"%TAG !e! tag:a:\n--- x\n--- !e!foo x", "found undefined tag handle"},
+    {"%TAG !e! tag:a:\n--- x\n...\n--- !e!foo x", "found undefined tag handle"},
+    {NULL, NULL}
+};
+
+int check_tag_directives(void)
+{
+    yaml_parser_t parser;
+    yaml_event_t event;
+    int failed = 0;
+    int k;
+    char result[256];
+    char *input;
+    size_t length = 0;
+    printf("checking tag directives...\n");
+    for (k = 0; tags[k].input; k++) {
+        if (strcmp(first_tag(tags[k].input, result), tags[k].result)) {
+            printf("\t- '%s': '%s' instead of '%s'\n", tags[k].input,
+                    result, tags[k].result);
+            failed++;
+        }
+    }
+
+    /* Enough handles to grow the index several times. */
+    input = (char *)malloc(1000*64);
+    assert(input);
+    for (k = 0; k < 1000; k++)
+        length += sprintf(input+length, "%%TAG !h%d! tag:example.com,2000:%d/\n", k, k);
+    length += sprintf(input+length, "---\n");
+    for (k = 0; k < 1000; k++)
+        length += sprintf(input+length, "- !h%d!t%d x\n", (k*7) % 1000, k);
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, (unsigned char *)input, length);
+    k = 0;
+    while (1) {
+        assert(yaml_parser_parse(&parser, &event));
+        if (event.type == YAML_STREAM_END_EVENT) {
+            yaml_event_delete(&event);
+            break;
+        }
+        if (event.type == YAML_DOCUMENT_START_EVENT
+                && event.data.document_start.tag_directives.end
+                - event.data.document_start.tag_directives.start != 1000) {
+            printf("\t- the document has %d directive(s)\n",
+                    (int)(event.data.document_start.tag_directives.end
+                        - event.data.document_start.tag_directives.start));
+            failed++;
+        }
+        if (event.type == YAML_SCALAR_EVENT) {
+            sprintf(result, "tag:example.com,2000:%d/t%d", (k*7) % 1000, k);
+            if (strcmp((char *)event.data.scalar.tag, result)) {
+                printf("\t- '%s' instead of '%s'\n",
+                        (char *)event.data.scalar.tag, result);
+                failed++;
+            }
+            k++;
+        }
+        yaml_event_delete(&event);
+    }
+    if (k != 1000) {
+        printf("\t- %d scalar(s) instead of 1000\n", k);
+        failed++;
+    }
+    yaml_parser_delete(&parser);
+    free(input);
+    printf("checking tag directives: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * The streams for the comparisons of the parsing modes.  The test inputs are
+ * these streams, all their prefixes, and copies with an octet replaced by one
+ * of the indicators, so most of them are malformed.
+ */
+
+char *streams[] = {
+    "a plain scalar",
+    "'single' \"double\"",
+    "- a\n- b\n-   - c\n    - d\n- e: f\n  g: h\n",
+    "key: value\nseq:\n- 1\n- 2\nmap: {a: b, c: [d, e]}\n? complex\n: value\n",
+    "--- |\n  literal\n   text\n\n--- >-\n  folded\n  text\n...\n",
+    "%YAML 1.1\n%TAG !e! tag:example.com,2000:\n--- !e!map\n&a x: !!str *a\n",
+    "[a, [b, c], {d: e}, f: g, 'h', \"i\\tj\"]\n",
+    "{ ? a : b, c: , : d }\n",
+    "a:\n  b:\n    c: d\n  e: f\ng: h\n",
+    "# comment\n- 'multi\n  line' # comment\n- \"multi\\\n  line\"\n- plain\n  multi line\n",
+    "--- &anchor !tag\n- *anchor\n- !<verbatim> x\n- ! nonspecific\n",
+    "a: b\r\nc:\r\n  - d\r\n  - e\r\n",
+    "\xef\xbb\xbfkey: \xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82\n",
+    "- - - deep\n    - x\n  - y\n- z\n",
+    "key: |2\n    indented\n  text\nother: >+\n  kept\n\n",
+    "---\n---\n...\n--- a\n... # end\n",
+    NULL
+};
+
+char *indicators = ":-'\"[]{},#&*!|>%@`? \t\n\xd0";
+
+typedef struct {
+    unsigned char *start;
+    size_t length;
+    int owned;
+} input_t;
+
+input_t *inputs;
+int inputs_count;
+
+void build_inputs(void)
+{
+    int k, size = 0;
+    if (inputs)
+        return;
+    for (k = 0; streams[k]; k++) {
+        size_t length = strlen(streams[k]);
+        size += (int)(length + 1) + (int)(length/3 + 1) * (int)strlen(indicators);
+    }
+    inputs = (input_t *)malloc(size * sizeof(input_t));
+    assert(inputs);
+    for (k = 0; streams[k]; k++) {
+        size_t length = strlen(streams[k]);
+        size_t j;
+        const char *indicator;
+        for (j = 0; j <= length; j++) {
+            inputs[inputs_count].start = (unsigned char *)streams[k];
+            inputs[inputs_count].owned = 0;
+            inputs[inputs_count++].length = j;
+        }
+        for (j = 0; j < length; j += 3) {
+            for (indicator = indicators; *indicator; indicator++) {
+                unsigned char *copy = (unsigned char *)malloc(length);
+                assert(copy);
+                memcpy(copy, streams[k], length);
+                copy[j] = *indicator;
+                inputs[inputs_count].start = copy;
+                inputs[inputs_count].owned = 1;
+                inputs[inputs_count++].length = length;
+            }
+        }
+    }
+    assert(inputs_count <= size);
+}
+
+void free_inputs(void)
+{
+    int k;
+    for (k = 0; k < inputs_count; k++) {
+        if (inputs[k].owned)
+            free(inputs[k].start);
+    }
+    free(inputs);
+    inputs = NULL;
+    inputs_count = 0;
+}
+
+/*
+ * Describe a stream parsed with yaml_parser_parse().
+ */
+
+void describe_input(text_t *text, input_t *input)
+{
+    yaml_parser_t parser;
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, input->start, input->length);
+    describe_stream(text, &parser);
+    yaml_parser_delete(&parser);
+}
+
+int check_parse_batch(void)
+{
+    size_t capacities[] = { 1, 2, 3, 7, 64 };
+    int failed = 0;
+    int k;
+    size_t j;
+    printf("checking batch parsing...\n");
+    build_inputs();
+    for (k = 0; k < inputs_count; k++) {
+        text_t expected = { NULL, 0, 0 };
+        describe_input(&expected, inputs + k);
+        for (j = 0; j <= sizeof(capacities)/sizeof(*capacities); j++) {
+            yaml_parser_t parser;
+            yaml_event_t events[64];
+            text_t text = { NULL, 0, 0 };
+            int done = 0;
+            int alternate = (j == sizeof(capacities)/sizeof(*capacities));
+            size_t capacity = alternate ? 5 : capacities[j];
+            yaml_parser_initialize(&parser);
+            yaml_parser_set_input_string(&parser, inputs[k].start, inputs[k].length);
+            while (!done) {
+                size_t count = 0, i;
+                int result;
+                if (alternate && (text.length & 1)) {
+                    result = yaml_parser_parse(&parser, events);
+                    count = result;
+                }
+                else {
+                    result = yaml_parser_parse_batch(&parser, events, capacity, &count);
+                }
+                assert(count <= capacity);
+                for (i = 0; i < count; i++) {
+                    describe_event(&text, events + i);
+                    if (events[i].type == YAML_STREAM_END_EVENT)
+                        done = 1;
+                    yaml_event_delete(events + i);
+                }
+                if (!result) {
+                    describe_error(&text, &parser);
+                    done = 1;
+                }
+                else if (!count) {
+                    done = 1;
+                }
+            }
+            if (strcmp(text.start, expected.start)) {
+                printf("\t- input %d, capacity %d:\n%s\ninstead of\n%s\n", k,
+                        (int)capacity, text.start, expected.start);
+                failed++;
+            }
+            yaml_parser_delete(&parser);
+            text_free(&text);
+        }
+        text_free(&expected);
+        if (failed > 10)
+            break;
+    }
+    printf("checking batch parsing: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * Describe the token types of a stream, one code per token.
+ */
+
+void describe_tokens(text_t *text, const char *input, size_t length)
+{
+    static const char *codes[] = { "", "<", ">", "%Y", "%T", "---", "...",
+        "bs", "bm", "be", "[", "]", "{", "}", "-", ",", "?", ":", "*", "&",
+        "!", "s" };
+    yaml_parser_t parser;
+    yaml_token_t token;
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, (unsigned char *)input, length);
+    while (1) {
+        if (!yaml_parser_scan(&parser, &token)) {
+            text_string(text, "error: ", (yaml_char_t *)parser.problem,
+                    strlen(parser.problem));
+            text_print(text, " (%ld,%ld)", (long)parser.problem_mark.line,
+                    (long)parser.problem_mark.column, 0);
+            break;
+        }
+        text_string(text, codes[token.type], (yaml_char_t *)" ", 1);
+        if (token.type == YAML_STREAM_END_TOKEN) {
+            yaml_token_delete(&token);
+            break;
+        }
+        yaml_token_delete(&token);
+    }
+    yaml_parser_delete(&parser);
+}
+
+typedef struct {
+    char *input;
+    char *tokens;
+} token_case;
+
+token_case simple_keys[] = {
+    {"{a: [b, c: d], e: f}", "< { ? s : [ s , ? s : s ] , ? s : s } > "},
+    {"[a, [b: c, [d, e: f]], g: h]", "< [ s , [ ? s : s , [ s , ? s : s ] ] , ? s : s ] > "},
+    {"[[[a: b]], c: d]", "< [ [ [ ? s : s ] ] , ? s : s ] > "},
+    {"{a\n: b}", "< { s : s } > "},
+    {"[a\n: b]", "< [ s : s ] > "},
+    {"a\n: b", "< s bm : s be > "},
+    {"{[a, b]: c}", "< { ? [ s , s ] : s } > "},
+    {"[{a: b}: c]", "< [ ? { ? s : s } : s ] > "},
+    {"a: {b: [c\n, d: e]}", "< bm ? s : { ? s : [ s , ? s : s ] } be > "},
+    {"- [a, b\n  : c]", "< bs - [ s , s : s ] be > "},
+    {"{a: b, c}", "< { ? s : s , s } > "},
+    {"[a: b: c]", "< [ ? s : s : s ] > "},
+    {"a:\n  b\n  c: d", "< bm ? s : s error: mapping values are not allowed in this context (2,3)"},
+    {"- a\n  b: c", "< bs - s error: mapping values are not allowed in this context (1,3)"},
+    {"? a\n: b\nc: d", "< bm ? s : s ? s : s be > "},
+    {"a: b\n  c: d", "< bm ? s : s error: mapping values are not allowed in this context (1,3)"},
+    {"[a, {b: c, d}, e: f\n]", "< [ s , { ? s : s , s } , ? s : s ] > "},
+    {"\"a\nb\": c", "< s error: mapping values are not allowed in this context (1,2)"},
+    {"'a': b", "< bm ? s : s be > "},
+    {NULL, NULL}
+};
+
+int check_simple_keys(void)
+{
+    int failed = 0;
+    int k;
+    char *input = (char *)malloc(30000);
+    char *expected = (char *)malloc(60000);
+    char *key = (char *)malloc(1101);
+    assert(input && expected && key);
+    printf("checking simple keys...\n");
+    for (k = 0; simple_keys[k].input; k++) {
+        text_t text = { NULL, 0, 0 };
+        describe_tokens(&text, simple_keys[k].input, strlen(simple_keys[k].input));
+        if (strcmp(text.start, simple_keys[k].tokens)) {
+            printf("\t- '%s': '%s' instead of '%s'\n", simple_keys[k].input,
+                    text.start, simple_keys[k].tokens);
+            failed++;
+        }
+        text_free(&text);
+    }
+
+    /* A simple key is limited to 1024 characters outside flow collections. */
+    memset(key, 'k', 1100);
+    key[1100] = '\0';
+    for (k = 0; k < 4; k++) {
+        text_t text = { NULL, 0, 0 };
+        switch (k) {
+            case 0:
+                sprintf(input, "%s: v", key);
+                strcpy(expected, "< s error: mapping values are not allowed in this context (0,1100)");
+                break;
+            case 1:
+                sprintf(input, "%s: v", key+100);
+                strcpy(expected, "< bm ? s : s be > ");
+                break;
+            case 2:
+                sprintf(input, "[%s: v]", key);
+                strcpy(expected, "< [ s : s ] > ");
+                break;
+            case 3:
+                sprintf(input, "{a: [%s: v], b: c}", key+100);
+                strcpy(expected, "< { ? s : [ ? s : s ] , ? s : s } > ");
+                break;
+        }
+        describe_tokens(&text, input, strlen(input));
+        if (strcmp(text.start, expected)) {
+            printf("\t- long key %d: '%s' instead of '%s'\n", k, text.start, expected);
+            failed++;
+        }
+        text_free(&text);
+    }
+
+    /* Keys on every level of deeply nested flow collections. */
+    for (k = 0; k < 2; k++) {
+        text_t text = { NULL, 0, 0 };
+        size_t length = 0, elength = 0;
+        int j;
+        elength += sprintf(expected+elength, "< ");
+        for (j = 0; j < 5000; j++) {
+            length += sprintf(input+length, k ? "[k: " : "[");
+            elength += sprintf(expected+elength, k ? "[ ? s : " : "[ ");
+        }
+        length += sprintf(input+length, "{a: b}");
+        elength += sprintf(expected+elength, "{ ? s : s } ");
+        for (j = 0; j < 5000; j++) {
+            length += sprintf(input+length, "]");
+            elength += sprintf(expected+elength, "] ");
+        }
+        elength += sprintf(expected+elength, "> ");
+        describe_tokens(&text, input, length);
+        if (strcmp(text.start, expected)) {
+            printf("\t- nested keys %d differ\n", k);
+            failed++;
+        }
+        text_free(&text);
+    }
+    free(input);
+    free(expected);
+    free(key);
+    printf("checking simple keys: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * JSON texts that are scanned the same way in the JSON and the YAML mode.
+ */
+
+char *json_texts[] = {
+    "{}",
+    "[]",
+    "0",
+    "-0",
+    "-12.5e+10",
+    "1E-3",
+    "true",
+    "false",
+    "null",
+    "\"\"",
+    "\"a\\\"b\\\\c\\/d\\b\\f\\n\\r\\t\\u00e9\\u4e2d\"",
+    "\"\xd0\x90\xe4\xb8\xad\"",
+    "  {\"a\" : 1 , \"b\":[true,false,null] }  ",
+    "{\"\":\"\",\"a\":{\"b\":{\"c\":[]}}}",
+    "[1,[2,[3,{\"d\":[4]}]],\"e\"]\n",
+    "\r\n[\r\n  1,\r\n  {\"a\":\r\n  2}\r\n]\r\n",
+    " [\t1,\t2\t]\t",
+    "[\"a\\u0000b\", 1.0, -0.5e-5]",
+    NULL
+};
+
+/*
+ * Non-JSON input, with the reported problem and position.
+ */
+
+typedef struct {
+    char *input;
+    char *problem;
+    int line;
+    int column;
+} json_error;
+
+json_error json_errors[] = {
+    {"", "found unexpected end of stream", 0, 0},
+    {"[1,]", "did not find expected node content", 0, 3},
+    {"[1,,2]", "did not find expected node content", 0, 3},
+    {"{\"a\":1,}", "did not find expected key", 0, 7},
+    {"[1 2]", "did not find expected ',' or ']'", 0, 3},
+    {"{\"a\":1 \"b\":2}", "did not find expected ',' or '}'", 0, 7},
+    {"{a: 1}", "did not find expected key", 0, 1},
+    {"{1:2}", "did not find expected key", 0, 1},
+    {"{\"a\" 1}", "did not find expected ':'", 0, 5},
+    {"{\"a\"}", "did not find expected ':'", 0, 4},
+    {"01", "did not find expected <stream end>", 0, 1},
+    {"1 2", "did not find expected <stream end>", 0, 2},
+    {"[1]]", "did not find expected <stream end>", 0, 3},
+    {"-", "did not find expected digit", 0, 1},
+    {"1.", "did not find expected digit", 0, 2},
+    {"1e", "did not find expected digit", 0, 2},
+    {"+1", "did not find expected node content", 0, 0},
+    {".5", "did not find expected node content", 0, 0},
+    {"tru", "did not find expected 'true', 'false' or 'null'", 0, 0},
+    {"nul", "did not find expected 'true', 'false' or 'null'", 0, 0},
+    {"\"a\tb\"", "found unexpected control character", 0, 2},
+    {"\"a\nb\"", "found unexpected control character", 0, 2},
+    {"\"\\x41\"", "found unknown escape character", 0, 1},
+    {"\"\\u12\"", "did not find expected hexdecimal number", 0, 1},
+    {"\"\\ud83d\"", "found invalid Unicode character escape code", 0, 7},
+    {"\"\\ude00\"", "found invalid Unicode character escape code", 0, 7},
+    {"[1", "found unexpected end of stream", 0, 2},
+    {"{\"a\":", "found unexpected end of stream", 0, 5},
+    {"}", "did not find expected node content", 0, 0},
+    {"'a'", "did not find expected node content", 0, 0},
+    {"# c\n1", "did not find expected node content", 0, 0},
+    {"- 1", "did not find expected digit", 0, 1},
+    {"--- 1", "did not find expected digit", 0, 1},
+    {"%YAML 1.1\n--- 1", "did not find expected node content", 0, 0},
+    {NULL, NULL, 0, 0}
+};
+
+/*
+ * A read handler that returns one octet at a time.
+ */
+
+typedef struct {
+    const unsigned char *start;
+    size_t length;
+    size_t offset;
+} octet_source;
+
+int read_octet(void *data, unsigned char *buffer, size_t size, size_t *size_read)
+{
+    octet_source *source = (octet_source *)data;
+    *size_read = 0;
+    if (size && source->offset < source->length) {
+        buffer[0] = source->start[source->offset++];
+        *size_read = 1;
+    }
+    return 1;
+}
+
+/*
+ * Describe the events of a text parsed as JSON or YAML.
+ */
+
+void describe_json(text_t *text, const char *input, size_t length, int json,
+        int borrowed, int octets)
+{
+    yaml_parser_t parser;
+    octet_source source;
+    source.start = (const unsigned char *)input;
+    source.length = length;
+    source.offset = 0;
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_json_mode(&parser, json);
+    yaml_parser_set_borrowed_scalars(&parser, borrowed);
+    if (octets)
+        yaml_parser_set_input(&parser, read_octet, &source);
+    else
+        yaml_parser_set_input_string(&parser, (const unsigned char *)input, length);
+    describe_stream(text, &parser);
+    yaml_parser_delete(&parser);
+}
+
+int check_json_text(const char *title, const char *input, size_t length)
+{
+    int failed = 0;
+    int mode;
+    text_t expected = { NULL, 0, 0 };
+    describe_json(&expected, input, length, 0, 0, 0);
+    for (mode = 0; mode < 4; mode++) {
+        text_t text = { NULL, 0, 0 };
+        describe_json(&text, input, length, 1, mode & 1, mode & 2);
+        if (strcmp(text.start, expected.start)) {
+            printf("\t- %s (borrowed: %d, octets: %d):\n%s\tinstead of\n%s",
+                    title, mode & 1, (mode & 2) >> 1, text.start, expected.start);
+            failed++;
+        }
+        text_free(&text);
+    }
+    text_free(&expected);
+    return failed;
+}
+
+int check_json_mode(void)
+{
+    int failed = 0;
+    int k;
+    size_t length;
+    char *input = (char *)malloc(100000);
+    assert(input);
+    printf("checking JSON mode...\n");
+
+    for (k = 0; json_texts[k]; k++) {
+        failed += check_json_text(json_texts[k], json_texts[k], strlen(json_texts[k]));
+    }
+
+    /* Long strings and arrays cross the input buffer boundaries. */
+    length = 0;
+    length += sprintf(input+length, "{\"long\":\"");
+    for (k = 0; k < 5000; k++)
+        length += sprintf(input+length, k % 10 ? "abcd" : "\\n\\u00e9");
+    length += sprintf(input+length, "\",\"numbers\":[");
+    for (k = 0; k < 5000; k++)
+        length += sprintf(input+length, "%s%d.%de%d", k ? "," : "", -k, k, k % 7);
+    length += sprintf(input+length, "]}");
+    failed += check_json_text("long text", input, length);
+
+    /* Deeply nested collections. */
+    length = 0;
+    for (k = 0; k < 5000; k++)
+        length += sprintf(input+length, k % 2 ? "{\"k\":" : "[");
+    length += sprintf(input+length, "null");
+    for (k = 4999; k >= 0; k--)
+        length += sprintf(input+length, k % 2 ? "}" : "]");
+    failed += check_json_text("nested collections", input, length);
+
+    /* Surrogate pairs are combined. */
+    {
+        yaml_parser_t parser;
+        yaml_event_t event;
+        const char *pair = "[\"\\ud83d\\ude00\"]";
+        int found = 0;
+        yaml_parser_initialize(&parser);
+        yaml_parser_set_json_mode(&parser, 1);
+        yaml_parser_set_input_string(&parser, (const unsigned char *)pair, strlen(pair));
+        while (yaml_parser_parse(&parser, &event)) {
+            if (event.type == YAML_SCALAR_EVENT) {
+                found = (event.data.scalar.length == 4
+                        && !memcmp(event.data.scalar.value, "\xf0\x9f\x98\x80", 4));
+            }
+            if (event.type == YAML_STREAM_END_EVENT) {
+                yaml_event_delete(&event);
+                break;
+            }
+            yaml_event_delete(&event);
+        }
+        if (!found || parser.error != YAML_NO_ERROR) {
+            printf("\t- surrogate pair is not combined\n");
+            failed++;
+        }
+        yaml_parser_delete(&parser);
+    }
+
+    for (k = 0; json_errors[k].input; k++) {
+        yaml_parser_t parser;
+        yaml_event_t event;
+        json_error *error = json_errors + k;
+        yaml_parser_initialize(&parser);
+        yaml_parser_set_json_mode(&parser, 1);
+        yaml_parser_set_input_string(&parser, (const unsigned char *)error->input,
+                strlen(error->input));
+        while (yaml_parser_parse(&parser, &event)) {
+            if (event.type == YAML_STREAM_END_EVENT) {
+                yaml_event_delete(&event);
+                break;
+            }
+            yaml_event_delete(&event);
+        }
+        if (parser.error != YAML_SCANNER_ERROR || !parser.problem
+                || strcmp(parser.problem, error->problem)
+                || (int)parser.problem_mark.line != error->line
+                || (int)parser.problem_mark.column != error->column) {
+            printf("\t- '%s': error %d '%s' (%d,%d) instead of '%s' (%d,%d)\n",
+                    error->input, parser.error,
+                    parser.problem ? parser.problem : "",
+                    (int)parser.problem_mark.line, (int)parser.problem_mark.column,
+                    error->problem, error->line, error->column);
+            failed++;
+        }
+        yaml_parser_delete(&parser);
+    }
+
+    free(input);
+    printf("checking JSON mode: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * Return the value and the end column of the second scalar of a stream.
+ */
+
+int second_scalar(const char *input, size_t length, text_t *value, long *column)
+{
+    yaml_parser_t parser;
+    yaml_event_t event;
+    int count = 0;
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, (const unsigned char *)input, length);
+    while (yaml_parser_parse(&parser, &event)) {
+        if (event.type == YAML_SCALAR_EVENT && ++count == 2) {
+            text_string(value, "", event.data.scalar.value,
+                    event.data.scalar.length);
+            *column = (long)event.end_mark.column;
+        }
+        if (event.type == YAML_STREAM_END_EVENT) {
+            yaml_event_delete(&event);
+            break;
+        }
+        yaml_event_delete(&event);
+    }
+    yaml_parser_delete(&parser);
+    return count >= 2;
+}
+
+/*
+ * The octets that follow a run of plain scalar characters, and the part of
+ * them that belongs to the scalar.
+ */
+
+typedef struct {
+    char *tail;
+    char *value;
+    long width;
+} run_end;
+
+run_end run_ends[] = {
+    {"\nz: 1\n", "", 0},
+    {"\r\nz: 1\n", "", 0},
+    {" # a comment\twith tabs \xc3\xa9\nz: 1\n", "", 0},
+    {"\t\nz: 1\n", "", 0},
+    {" more words\n", " more words", 11},
+    {"\xc3\xa9tail\n", "\xc3\xa9tail", 5},
+    {": v\n", NULL, 0},
+    {":b\n", ":b", 2},
+    {",b\n", ",b", 2},
+    {"#b\n", "#b", 2},
+    {"[]{}\n", "[]{}", 4},
+    {NULL, NULL, 0}
+};
+
+int check_bulk_scanning(void)
+{
+    int failed = 0;
+    int n, k, mode;
+    char *input = (char *)malloc(1000);
+    char *run = (char *)malloc(200);
+    assert(input && run);
+    printf("checking bulk scanning...\n");
+
+    for (n = 1; n < 100; n++)
+    {
+        /* A run of every printable character that can not end the scalar. */
+        run[0] = 'a';
+        for (k = 1; k < n; k++) {
+            char ch = (char)(0x21 + (k * 7) % 94);
+            run[k] = (ch == ':' || ch == ',' || ch == '#' || ch == '['
+                    || ch == ']' || ch == '{' || ch == '}') ? 'b' : ch;
+        }
+        run[n] = '\0';
+
+        for (k = 0; run_ends[k].tail; k++)
+        {
+            run_end *end = run_ends + k;
+            text_t expected = { NULL, 0, 0 };
+            text_t value = { NULL, 0, 0 };
+            long column = -1;
+            size_t length;
+
+            /* Block context, flow context and comments. */
+            for (mode = 0; mode < 3; mode++)
+            {
+                text_t text = { NULL, 0, 0 };
+                int variant;
+                if (mode == 0)
+                    length = sprintf(input, "k: %s%s", run, end->tail);
+                else if (mode == 1)
+                    length = sprintf(input, "[k, %s %s]", run, end->tail);
+                else
+                    length = sprintf(input, "# %s%s%s\nk: v%*s# %s\n",
+                            run, run, end->tail, n, "", run);
+                describe_json(&text, input, length, 0, 0, 0);
+                for (variant = 1; variant < 4; variant++) {
+                    text_t other = { NULL, 0, 0 };
+                    describe_json(&other, input, length, 0, variant & 1, variant & 2);
+                    if (strcmp(text.start, other.start)) {
+                        printf("\t- run of %d, tail %d, mode %d, variant %d:\n%s\tinstead of\n%s",
+                                n, k, mode, variant, other.start, text.start);
+                        failed++;
+                    }
+                    text_free(&other);
+                }
+                text_free(&text);
+            }
+
+            if (!end->value)
+                continue;
+            length = sprintf(input, "k: %s%s", run, end->tail);
+            text_string(&expected, run, (const yaml_char_t *)end->value,
+                    strlen(end->value));
+            if (!second_scalar(input, length, &value, &column)
+                    || strcmp(value.start, expected.start)
+                    || column != 3 + n + end->width) {
+                printf("\t- run of %d, tail %d: '%s' ending at %ld instead of '%s' ending at %ld\n",
+                        n, k, value.start ? value.start : "", column,
+                        expected.start, 3 + n + end->width);
+                failed++;
+            }
+            text_free(&expected);
+            text_free(&value);
+        }
+    }
+
+    free(input);
+    free(run);
+    printf("checking bulk scanning: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * An allocator that tracks the peak number of allocated bytes.
+ */
+
+typedef struct {
+    size_t live;
+    size_t peak;
+} usage_t;
+
+typedef union {
+    size_t size;
+    double align;
+    void *pointer;
+} block_header;
+
+void *usage_malloc(void *data, size_t size)
+{
+    usage_t *usage = (usage_t *)data;
+    block_header *block = (block_header *)malloc(sizeof(block_header) + size);
+    if (!block) return NULL;
+    block->size = size;
+    usage->live += size;
+    if (usage->live > usage->peak)
+        usage->peak = usage->live;
+    return block + 1;
+}
+
+void *usage_realloc(void *data, void *ptr, size_t size)
+{
+    usage_t *usage = (usage_t *)data;
+    block_header *block = (block_header *)ptr - 1;
+    size_t old_size = block->size;
+    block = (block_header *)realloc(block, sizeof(block_header) + size);
+    if (!block) return NULL;
+    block->size = size;
+    usage->live += size - old_size;
+    if (usage->live > usage->peak)
+        usage->peak = usage->live;
+    return block + 1;
+}
+
+void usage_free(void *data, void *ptr)
+{
+    usage_t *usage = (usage_t *)data;
+    block_header *block = (block_header *)ptr - 1;
+    usage->live -= block->size;
+    free(block);
+}
+
+/*
+ * A read handler that produces a head, a pattern repeated many times and a
+ * tail without keeping the whole input in memory.
+ */
+
+typedef struct {
+    const char *head;
+    const char *pattern;
+    size_t count;
+    const char *tail;
+    size_t offset;
+} pattern_source;
+
+int read_pattern(void *data, unsigned char *buffer, size_t size, size_t *size_read)
+{
+    pattern_source *source = (pattern_source *)data;
+    size_t head = strlen(source->head);
+    size_t pattern = strlen(source->pattern);
+    size_t body = pattern * source->count;
+    size_t tail = strlen(source->tail);
+    size_t length = 0;
+    while (length < size && source->offset < head + body + tail) {
+        size_t offset = source->offset;
+        if (offset < head)
+            buffer[length] = source->head[offset];
+        else if (offset < head + body)
+            buffer[length] = source->pattern[(offset - head) % pattern];
+        else
+            buffer[length] = source->tail[offset - head - body];
+        source->offset ++;
+        length ++;
+    }
+    *size_read = length;
+    return 1;
+}
+
+/*
+ * A stream that exceeds a limit, the problem and the position of the error.
+ */
+
+typedef struct {
+    char *head;
+    char *pattern;
+    char *tail;
+    int json;
+    int document;
+    char *problem;
+    int line;
+    int column;
+} limit_case;
+
+limit_case limit_cases[] = {
+    {"k: ", "a", "\n", 0, 0, "exceeded the maximum scalar length", 0, 3},
+    {"k: a", "\n  a", "\n", 0, 0, "exceeded the maximum scalar length", 0, 3},
+    {"k: a", " b", "\n", 0, 0, "exceeded the maximum scalar length", 0, 3},
+    {"k: \"", "a", "\"\n", 0, 0, "exceeded the maximum scalar length", 0, 3},
+    {"k: \"", "\\t", "\"\n", 0, 0, "exceeded the maximum scalar length", 0, 3},
+    {"[k, '", "a b\n ", "']\n", 0, 0, "exceeded the maximum scalar length", 0, 4},
+    {"k: |\n  ", "a", "\n", 0, 0, "exceeded the maximum scalar length", 0, 3},
+    {"- >\n  ", "a\n  ", "\n", 0, 0, "exceeded the maximum scalar length", 0, 2},
+    {"[\"", "a", "\"]", 1, 0, "exceeded the maximum scalar length", 0, 1},
+    {"{\"k\": 1", "0", "}", 1, 0, "exceeded the maximum scalar length", 0, 6},
+    {"k: ", "a", "\n", 0, 1, "exceeded the maximum document length", -1, -1},
+    {"k: \"a", " ", "b\"\n", 0, 1, "exceeded the maximum document length", -1, -1},
+    {"k: a", "\n", "  b\n", 0, 1, "exceeded the maximum document length", -1, -1},
+    {"k: |\n", "\n", "  a\n", 0, 1, "exceeded the maximum document length", -1, -1},
+    {"--- a\n--- |\n", "\n", "  a\n", 0, 1, "exceeded the maximum document length", -1, -1},
+    {NULL, NULL, NULL, 0, 0, NULL, 0, 0}
+};
+
+/*
+ * Parse a generated stream with the limits and return the peak memory use.
+ */
+
+size_t parse_pattern(pattern_source *source, yaml_parser_limits_t *limits,
+        int json, yaml_parser_t *parser)
+{
+    static usage_t usage;
+    static yaml_allocator_t allocator = { usage_malloc, usage_realloc,
+        usage_free, &usage };
+    yaml_event_t event;
+    usage.live = usage.peak = 0;
+    source->offset = 0;
+    yaml_parser_initialize_with_allocator(parser, &allocator);
+    yaml_parser_set_limits(parser, limits);
+    yaml_parser_set_json_mode(parser, json);
+    yaml_parser_set_input(parser, read_pattern, source);
+    while (yaml_parser_parse(parser, &event)) {
+        if (event.type == YAML_STREAM_END_EVENT) {
+            yaml_event_delete(&event);
+            break;
+        }
+        yaml_event_delete(&event);
+    }
+    return usage.peak;
+}
+
+int check_scanner_limits(void)
+{
+    const size_t limit = 1 << 20;
+    int failed = 0;
+    int k;
+    printf("checking scanner limits...\n");
+
+    for (k = 0; limit_cases[k].head; k++)
+    {
+        limit_case *test = limit_cases + k;
+        yaml_parser_limits_t limits = { 0, 0, 0, 0, 0 };
+        pattern_source source;
+        yaml_parser_t parser;
+        size_t peak;
+        size_t index;
+
+        /*
+         * A 200 MB scalar stops at the limit with bounded memory.  The bulk
+         * plain scanner checks the limits once per buffered run.
+         */
+
+        if (test->document)
+            limits.max_document_length = limit;
+        else
+            limits.max_scalar_length = limit;
+        source.head = test->head;
+        source.pattern = test->pattern;
+        source.count = (200 << 20) / strlen(test->pattern);
+        source.tail = test->tail;
+        peak = parse_pattern(&source, &limits, test->json, &parser);
+        index = parser.problem_mark.index;
+        if (parser.error != YAML_LIMIT_ERROR
+                || strcmp(parser.problem, test->problem)
+                || (test->line >= 0
+                    && ((int)parser.problem_mark.line != test->line
+                        || (int)parser.problem_mark.column != test->column))
+                || (test->line < 0 && (index <= limit || index > limit + 65536))
+                || peak > 4 * limit
+                || source.offset > 4 * limit) {
+            printf("\t- '%s%s...': error %d '%s' at %ld (%ld,%ld), %ld bytes allocated, %ld read\n",
+                    test->head, test->pattern, parser.error,
+                    parser.problem ? parser.problem : "", (long)index,
+                    (long)parser.problem_mark.line, (long)parser.problem_mark.column,
+                    (long)peak, (long)source.offset);
+            failed++;
+        }
+        yaml_parser_delete(&parser);
+    }
+
+    /* A scalar at the limit is accepted and one octet more is not. */
+
+    for (k = 0; k < 2; k++)
+    {
+        yaml_parser_limits_t limits = { 0, 1000, 0, 0, 0 };
+        pattern_source source;
+        yaml_parser_t parser;
+        source.head = "k: ";
+        source.pattern = "a";
+        source.count = 1000 + k;
+        source.tail = "\n";
+        parse_pattern(&source, &limits, 0, &parser);
+        if (parser.error != (k ? YAML_LIMIT_ERROR : YAML_NO_ERROR)) {
+            printf("\t- scalar of %d octets: error %d\n", 1000 + k, parser.error);
+            failed++;
+        }
+        yaml_parser_delete(&parser);
+    }
+
+    printf("checking scanner limits: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * Streams parsed with a nesting depth limit of 3 and the error position.
+ */
+
+typedef struct {
+    char *input;
+    int line;
+    int column;
+} depth_case;
+
+depth_case depth_cases[] = {
+    {"[[[a]]]", -1, -1},
+    {"[[[[a]]]]", 0, 3},
+    {"- - - a", -1, -1},
+    {"- - - - a", 0, 6},
+    {"a:\n b:\n  c: d", -1, -1},
+    {"a:\n b:\n  c:\n   d: e", 3, 3},
+    {"- [{a: b}]", -1, -1},
+    {"- [{a: [b]}]", 0, 7},
+    {"- a\n- [b]\n- {c: [d]}", -1, -1},
+    {"{a: [b], c: {d: [e]}}", -1, -1},
+    {"? [[a]]\n: b", -1, -1},
+    {"? [[[a]]]\n: b", 0, 4},
+    {NULL, 0, 0}
+};
+
+int check_depth_limit(void)
+{
+    int failed = 0;
+    int k;
+    printf("checking depth limit...\n");
+
+    for (k = 0; depth_cases[k].input; k++)
+    {
+        depth_case *test = depth_cases + k;
+        yaml_parser_t parser;
+        yaml_event_t event;
+        int limited = (test->line >= 0);
+        yaml_parser_initialize(&parser);
+        yaml_parser_set_max_depth(&parser, 3);
+        yaml_parser_set_input_string(&parser, (const unsigned char *)test->input,
+                strlen(test->input));
+        while (yaml_parser_parse(&parser, &event)) {
+            if (event.type == YAML_STREAM_END_EVENT) {
+                yaml_event_delete(&event);
+                break;
+            }
+            yaml_event_delete(&event);
+        }
+        if (parser.error != (limited ? YAML_LIMIT_ERROR : YAML_NO_ERROR)
+                || (limited && (strcmp(parser.problem, "exceeded the maximum nesting depth")
+                        || (int)parser.problem_mark.line != test->line
+                        || (int)parser.problem_mark.column != test->column))) {
+            printf("\t- '%s': error %d at (%d,%d)\n", test->input, parser.error,
+                    (int)parser.problem_mark.line, (int)parser.problem_mark.column);
+            failed++;
+        }
+        yaml_parser_delete(&parser);
+    }
+
+    /* A million open collections stop at the limit. */
+
+    {
+        yaml_parser_limits_t limits = { 1000, 0, 0, 0, 0 };
+        pattern_source source;
+        yaml_parser_t parser;
+        size_t peak;
+        source.head = "";
+        source.pattern = "[";
+        source.count = 1000000;
+        source.tail = "";
+        peak = parse_pattern(&source, &limits, 0, &parser);
+        if (parser.error != YAML_LIMIT_ERROR
+                || parser.problem_mark.column != 1000 || peak > (1 << 20)) {
+            printf("\t- a million open collections: error %d at %ld, %ld bytes allocated\n",
+                    parser.error, (long)parser.problem_mark.column, (long)peak);
+            failed++;
+        }
+        yaml_parser_delete(&parser);
+    }
+
+    printf("checking depth limit: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * Feed a stream in chunks and describe it as describe_stream() does.  With
+ * early set, the parser is asked for an event before the first chunk.  The
+ * number of events produced before the last chunk is saved in before_last.
+ */
+
+void describe_fed(text_t *text, const unsigned char *input, size_t length,
+        size_t chunk, int early, int *before_last)
+{
+    yaml_parser_t parser;
+    yaml_event_t event;
+    size_t offset = 0;
+    int events = 0;
+    int done = 0;
+    yaml_parser_initialize(&parser);
+    if (early) {
+        yaml_parser_set_input_feed(&parser);
+        if (yaml_parser_parse(&parser, &event) || parser.error)
+            text_append(text, "EARLY\n", 6);
+    }
+    while (!done) {
+        size_t size = chunk < length - offset ? chunk : length - offset;
+        int last = (offset + size == length);
+        if (last && before_last)
+            *before_last = events;
+        assert(yaml_parser_feed(&parser, input + offset, size, last));
+        offset += size;
+        while (1) {
+            if (!yaml_parser_parse(&parser, &event)) {
+                if (parser.error) {
+                    describe_error(text, &parser);
+                    done = 1;
+                }
+                else if (last) {
+                    text_append(text, "STALL\n", 6);
+                    done = 1;
+                }
+                break;
+            }
+            if (parser.problem || parser.problem_offset || parser.problem_value
+                    || parser.problem_mark.index || parser.context
+                    || parser.context_mark.index)
+                text_append(text, "STALE ERROR\n", 12);
+            describe_event(text, &event);
+            events++;
+            if (event.type == YAML_STREAM_END_EVENT) {
+                yaml_event_delete(&event);
+                done = 1;
+                break;
+            }
+            yaml_event_delete(&event);
+        }
+    }
+    yaml_parser_delete(&parser);
+}
+
+/*
+ * Compare a fed stream with the same stream parsed from a string.
+ */
+
+int check_fed_stream(const char *title, const unsigned char *input,
+        size_t length, size_t chunk, int early, int *before_last)
+{
+    text_t expected = { NULL, 0, 0 };
+    text_t text = { NULL, 0, 0 };
+    yaml_parser_t parser;
+    int failed = 0;
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, input, length);
+    describe_stream(&expected, &parser);
+    describe_fed(&text, input, length, chunk, early, before_last);
+
+    /*
+     * The string reader decodes the whole input before the first token, so
+     * it reports an invalid octet that the fed input reaches only later.
+     */
+
+    if (parser.error == YAML_READER_ERROR) {
+        char *error = strstr(expected.start, "ERROR");
+        size_t prefix = error - expected.start;
+        if (text.length >= expected.length
+                && !memcmp(text.start, expected.start, prefix)
+                && !strcmp(text.start + text.length - (expected.length - prefix),
+                    error)) {
+            text_free(&text);
+            text_append(&text, expected.start, expected.length);
+        }
+    }
+    if (strcmp(text.start, expected.start)) {
+        printf("\t- %s, chunk %ld:\n%s\ninstead of\n%s\n", title, (long)chunk,
+                text.start, expected.start);
+        failed++;
+    }
+    yaml_parser_delete(&parser);
+    text_free(&expected);
+    text_free(&text);
+    return failed;
+}
+
+/*
+ * Streams on which the scanner fails after closing block collections, so the
+ * BLOCK-END tokens are queued by the failing fetch.
+ */
+
+char *deferred_errors[] = {
+    "a:\n  - b\n'c",
+    "a:\n  b:\n    c: d\n\"e",
+    "- - a\n  - b\n@c",
+    "a:\n  b: c\n%d",
+    "a:\n  b: c\nd: e: f\n",
+    "- a\n- b:\n    c\n`",
+    "a:\n  b:\n  - c\n!<d",
+    "- a:\n    b\n&\n",
+    NULL
+};
+
+int check_push_parsing(void)
+{
+    size_t chunks[] = { 1, 7, 4096 };
+    int failed = 0;
+    int k;
+    size_t j;
+    printf("checking push parsing...\n");
+
+    /* Well-formed and malformed streams in chunks of several sizes. */
+
+    build_inputs();
+    for (k = 0; k < inputs_count && failed < 10; k++) {
+        char title[32];
+        sprintf(title, "input %d", k);
+        for (j = 0; j < sizeof(chunks)/sizeof(*chunks); j++) {
+            failed += check_fed_stream(title, inputs[k].start, inputs[k].length,
+                    chunks[j], (int)(k + j) & 1, NULL);
+        }
+    }
+
+    for (k = 0; deferred_errors[k]; k++) {
+        yaml_parser_t parser;
+        text_t text = { NULL, 0, 0 };
+        size_t length = strlen(deferred_errors[k]);
+        yaml_parser_initialize(&parser);
+        yaml_parser_set_input_string(&parser,
+                (const unsigned char *)deferred_errors[k], length);
+        describe_stream(&text, &parser);
+        assert(parser.error == YAML_SCANNER_ERROR);
+        yaml_parser_delete(&parser);
+        text_free(&text);
+        for (j = 0; j < sizeof(chunks)/sizeof(*chunks); j++) {
+            failed += check_fed_stream(deferred_errors[k],
+                    (const unsigned char *)deferred_errors[k], length,
+                    chunks[j], 0, NULL);
+        }
+    }
+
+    /* UTF-16 streams wait for the last chunk. */
+
+    for (k = 0; streams[k]; k++) {
+        size_t length = strlen(streams[k]);
+        unsigned char *input = (unsigned char *)malloc(2*length + 2);
+        int big_endian;
+        assert(input);
+        for (big_endian = 0; big_endian <= 1; big_endian++) {
+            int before_last = 0;
+            size_t i;
+            input[big_endian] = 0xFF;
+            input[!big_endian] = 0xFE;
+            for (i = 0; i < length; i++) {
+                if ((unsigned char)streams[k][i] >= 0x80)
+                    break;
+                input[2 + 2*i + big_endian] = 0;
+                input[2 + 2*i + !big_endian] = streams[k][i];
+            }
+            if (i < length)
+                break;
+            failed += check_fed_stream(streams[k], input, 2*length + 2, 3, 0,
+                    &before_last);
+            if (before_last > 1) {
+                printf("\t- %s: %d UTF-16 events before the last chunk\n",
+                        streams[k], before_last);
+                failed++;
+            }
+        }
+        free(input);
+    }
+
+    /*
+     * Long streams are rewound in the middle of their tokens, and the buffer
+     * drops the scanned input as it goes.
+     */
+
+    {
+        text_t input = { NULL, 0, 0 };
+        for (k = 0; k < 3000; k++) {
+            text_print(&input, "key %ld: 'value %ld'\nseq %ld:\n", k, k, k);
+            text_print(&input, "- [a, {b: c}]\n- |\n  literal %ld\n- \"%ld\\t\"\n", k, k, 0);
+        }
+        for (k = 0; k < 50000; k++)
+            text_append(&input, k % 10 ? "x" : " ", 1);
+        text_append(&input, "\n", 1);
+        for (j = 0; j < sizeof(chunks)/sizeof(*chunks); j++) {
+            failed += check_fed_stream("long stream",
+                    (const unsigned char *)input.start, input.length,
+                    chunks[j], 0, NULL);
+        }
+        text_free(&input);
+    }
+
+    printf("checking push parsing: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * The inputs of the pipeline comparisons.
+ */
+
+#define STRING_INPUT    0
+#define ZEROCOPY_INPUT  1
+#define BORROWED_INPUT  2
+#define FILE_INPUT      3
+#define PATH_INPUT      4
+
+char *input_kinds[] = { "string", "zerocopy", "borrowed", "file", "path" };
+
+const char *pipeline_path = "test-parser.tmp";
+
+void write_input(const unsigned char *input, size_t length)
+{
+    FILE *file = fopen(pipeline_path, "wb");
+    assert(file);
+    assert(fwrite(input, 1, length, file) == length);
+    assert(!fclose(file));
+}
+
+/*
+ * Set an input of a kind; the file inputs read the last written input.
+ */
+
+FILE *set_input(yaml_parser_t *parser, const unsigned char *input,
+        size_t length, int kind)
+{
+    FILE *file = NULL;
+    switch (kind) {
+        case STRING_INPUT:
+            yaml_parser_set_input_string(parser, input, length);
+            break;
+        case ZEROCOPY_INPUT:
+            yaml_parser_set_input_buffer_zerocopy(parser, input, length);
+            break;
+        case BORROWED_INPUT:
+            yaml_parser_set_input_buffer_zerocopy(parser, input, length);
+            yaml_parser_set_borrowed_scalars(parser, 1);
+            break;
+        case FILE_INPUT:
+            file = fopen(pipeline_path, "rb");
+            assert(file);
+            yaml_parser_set_input_file(parser, file);
+            break;
+        case PATH_INPUT:
+            assert(yaml_parser_set_input_path(parser, pipeline_path));
+            break;
+    }
+    return file;
+}
+
+void describe_pipelined(text_t *text, const unsigned char *input,
+        size_t length, int kind, int pipelined)
+{
+    yaml_parser_t parser;
+    FILE *file;
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_pipelined(&parser, pipelined);
+    file = set_input(&parser, input, length, kind);
+    describe_stream(text, &parser);
+    yaml_parser_delete(&parser);
+    if (file)
+        fclose(file);
+}
+
+int check_pipelined_stream(const char *title, const unsigned char *input,
+        size_t length)
+{
+    int failed = 0;
+    int kind;
+    write_input(input, length);
+    for (kind = STRING_INPUT; kind <= PATH_INPUT; kind++) {
+        text_t expected = { NULL, 0, 0 };
+        text_t text = { NULL, 0, 0 };
+        describe_pipelined(&expected, input, length, kind, 0);
+        describe_pipelined(&text, input, length, kind, 1);
+        if (strcmp(text.start, expected.start)) {
+            printf("\t- %s, %s input:\n%s\ninstead of\n%s\n", title,
+                    input_kinds[kind], text.start, expected.start);
+            failed++;
+        }
+        text_free(&expected);
+        text_free(&text);
+    }
+    return failed;
+}
+
+/*
+ * Build a block sequence of plain scalars, two tokens per item, that ends with
+ * the given tail.
+ */
+
+void build_sequence(text_t *text, int items, const char *tail)
+{
+    int k;
+    text->length = 0;
+    for (k = 0; k < items; k++)
+        text_print(text, "- item %ld\n", k, 0, 0);
+    text_append(text, tail, strlen(tail));
+}
+
+int check_pipeline(void)
+{
+    text_t input = { NULL, 0, 0 };
+    int failed = 0;
+    int k;
+    printf("checking pipelined parsing...\n");
+
+    /* The batch test inputs, most of them malformed. */
+
+    build_inputs();
+    for (k = 0; k < inputs_count && failed < 10; k++) {
+        char title[32];
+        sprintf(title, "input %d", k);
+        failed += check_pipelined_stream(title, inputs[k].start, inputs[k].length);
+    }
+
+    /*
+     * Streams that wrap around the ring of batches, with errors in the first,
+     * the second and a later batch.
+     */
+
+    {
+        int items[] = { 100, 150, 2000 };
+        char *tails[] = { "", "- 'unterminated\n", "- @\n", "a: b\n" };
+        size_t i, j;
+        for (i = 0; i < sizeof(items)/sizeof(*items); i++) {
+            for (j = 0; j < sizeof(tails)/sizeof(*tails); j++) {
+                build_sequence(&input, items[i], tails[j]);
+                failed += check_pipelined_stream("long sequence",
+                        (const unsigned char *)input.start, input.length);
+            }
+        }
+        text_free(&input);
+        for (k = 0; k < 3000; k++) {
+            text_print(&input, "key %ld: 'value %ld'\nseq %ld:\n", k, k, k);
+            text_print(&input, "- [a, {b: c}]\n- |\n  literal %ld\n- \"%ld\\t\"\n", k, k, 0);
+        }
+        failed += check_pipelined_stream("long mapping",
+                (const unsigned char *)input.start, input.length);
+    }
+
+    /*
+     * The parser may be deleted while the thread is scanning ahead, blocked on
+     * a full ring or in the middle of a batch.
+     */
+
+    {
+        int events[] = { 0, 1, 2, 300, 1000, 5000 };
+        size_t i;
+        int kind;
+        build_sequence(&input, 100000, "");
+        write_input((const unsigned char *)input.start, input.length);
+        for (kind = STRING_INPUT; kind <= PATH_INPUT; kind++) {
+            for (i = 0; i < sizeof(events)/sizeof(*events); i++) {
+                yaml_parser_t parser;
+                yaml_event_t event;
+                FILE *file;
+                yaml_parser_initialize(&parser);
+                yaml_parser_set_pipelined(&parser, 1);
+                file = set_input(&parser, (const unsigned char *)input.start,
+                        input.length, kind);
+                for (k = 0; k < events[i]; k++) {
+                    if (!yaml_parser_parse(&parser, &event)) {
+                        printf("\t- early delete, %s input: error %d\n",
+                                input_kinds[kind], parser.error);
+                        failed++;
+                        break;
+                    }
+                    yaml_event_delete(&event);
+                }
+                yaml_parser_delete(&parser);
+                if (file)
+                    fclose(file);
+            }
+        }
+    }
+
+    text_free(&input);
+    remove(pipeline_path);
+    printf("checking pipelined parsing: %d fail(s)\n", failed);
+    return failed;
+}
+
+/*
+ * The marks of a stream, resolved from their index.
+ */
+
+typedef struct {
+    yaml_mark_t *start;
+    size_t length;
+    size_t size;
+} marks_t;
+
+void marks_append(marks_t *marks, yaml_mark_t mark)
+{
+    if (marks->length == marks->size) {
+        marks->size = marks->size ? marks->size*2 : 64;
+        marks->start = (yaml_mark_t *)realloc(marks->start,
+                marks->size * sizeof(yaml_mark_t));
+        assert(marks->start);
+    }
+    marks->start[marks->length++] = mark;
+}
+
+/*
+ * Check that the marks of the events and of the error of a stream are
+ * resolved to their line and column.  At the end of an input with no final
+ * line break, the scanner moves the marks to a new line, while the index
+ * resolves them at the end of the last line.
+ */
+
+int check_resolved_marks(const char *title, const unsigned char *input,
+        size_t length, int pipelined)
+{
+    yaml_parser_t parser;
+    yaml_event_t event;
+    marks_t marks = { NULL, 0, 0 };
+    size_t characters = 0;
+    size_t k;
+    int failed = 0;
+
+    for (k = 0; k < length; k++) {
+        if ((input[k] & 0xC0) != 0x80)
+            characters++;
+    }
+    if (length >= 3 && !memcmp(input, "\xef\xbb\xbf", 3))
+        characters--;
+
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_line_index(&parser, 1);
+    yaml_parser_set_pipelined(&parser, pipelined);
+    yaml_parser_set_input_string(&parser, input, length);
+    while (yaml_parser_parse(&parser, &event)) {
+        marks_append(&marks, event.start_mark);
+        marks_append(&marks, event.end_mark);
+        if (event.type == YAML_STREAM_END_EVENT) {
+            yaml_event_delete(&event);
+            break;
+        }
+        yaml_event_delete(&event);
+    }
+    if (parser.error == YAML_SCANNER_ERROR || parser.error == YAML_PARSER_ERROR) {
+        marks_append(&marks, parser.problem_mark);
+        if (parser.context)
+            marks_append(&marks, parser.context_mark);
+    }
+
+    for (k = 0; k < marks.length && !failed; k++) {
+        yaml_mark_t *mark = marks.start + k;
+        yaml_mark_t resolved = { 0, 0, 0 };
+        resolved.index = mark->index;
+        resolved.line = resolved.column = (size_t)-1;
+        if (!yaml_parser_mark_resolve(&parser, &resolved)) {
+            printf("\t- %s: mark %ld not resolved\n", title, (long)mark->index);
+            failed++;
+        }
+        else if ((resolved.line != mark->line || resolved.column != mark->column)
+                && !(mark->index == characters && mark->column == 0
+                    && resolved.line + 1 == mark->line && resolved.column)) {
+            printf("\t- %s, pipelined %d: mark %ld (%ld,%ld) resolved to (%ld,%ld)\n",
+                    title, pipelined, (long)mark->index, (long)mark->line,
+                    (long)mark->column, (long)resolved.line, (long)resolved.column);
+            failed++;
+        }
+    }
+
+    yaml_parser_delete(&parser);
+    free(marks.start);
+    return failed;
+}
+
+int check_line_index(void)
+{
+    char *breaks[] = { "\r\n", "\r", "\xc2\x85", "\xe2\x80\xa8" };
+    text_t input = { NULL, 0, 0 };
+    int failed = 0;
+    int k;
+    size_t i, j;
+    printf("checking line index...\n");
+
+    /* The batch test inputs, with and without a pipeline. */
+
+    build_inputs();
+    for (k = 0; k < inputs_count && failed < 10; k++) {
+        char title[32];
+        sprintf(title, "input %d", k);
+        failed += check_resolved_marks(title, inputs[k].start, inputs[k].length, 0);
+        failed += check_resolved_marks(title, inputs[k].start, inputs[k].length, 1);
+    }
+
+    /* The test streams and their prefixes with other line breaks. */
+
+    for (k = 0; streams[k] && failed < 10; k++) {
+        for (i = 0; i < sizeof(breaks)/sizeof(*breaks); i++) {
+            const char *chr;
+            input.length = 0;
+            for (chr = streams[k]; *chr; chr++) {
+                if (*chr == '\n')
+                    text_append(&input, breaks[i], strlen(breaks[i]));
+                else
+                    text_append(&input, chr, 1);
+            }
+            for (j = 0; j <= input.length; j++) {
+                failed += check_resolved_marks(streams[k],
+                        (const unsigned char *)input.start, j, (int)j & 1);
+            }
+        }
+    }
+
+    /* A long stream spans many batches of a pipeline. */
+
+    build_sequence(&input, 20000, "- a\r\n- b: c\r\n  d: e");
+    failed += check_resolved_marks("long sequence",
+            (const unsigned char *)input.start, input.length, 0);
+    failed += check_resolved_marks("long sequence",
+            (const unsigned char *)input.start, input.length, 1);
+
+    text_free(&input);
+    printf("checking line index: %d fail(s)\n", failed);
+    return failed;
+}
+
+int
+main(void)
+{
+    int failed = check_tag_directives() + check_parse_batch()
+        + check_simple_keys() + check_json_mode() + check_bulk_scanning()
+        + check_scanner_limits() + check_depth_limit() + check_push_parsing()
+        + check_pipeline() + check_line_index();
+    free_inputs();
+    return failed;
+}
@@ -6,6 +6,11 @@ yaml_parser_update_buffer(yaml_parser_t *parser, size_t length);
 #include <stdlib.h>
 #include <stdio.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define HAVE_PIPE_PATH 1
+#endif
+
 #ifdef NDEBUG
 #undef NDEBUG
 #endif
@@ -347,8 +352,285 @@ int check_long_utf16(void)
     return failed;
 }
 
+int check_long_ascii(void)
+{
+    yaml_parser_t parser;
+    int k;
+    int failed = 0;
+    size_t positions[] = { 0, 1, 15, 16, 17, 31, 32, 33, 1000, 16383, 16384, 16385, LONG-1 };
+    char *pattern = "key: value\t\r\n- [1, {a: b}] # ~!@$%^&*()_+=|\\/?<>,.'\"`";
+    unsigned char *buffer = (unsigned char *)malloc(LONG+4);
+    assert(buffer);
+    printf("checking a long ascii sequence...\n");
+    for (k = 0; k < LONG; k ++) {
+        buffer[k] = pattern[k % strlen(pattern)];
+    }
+    buffer[LONG/2] = '\xd0';
+    buffer[LONG/2+1] = '\xaf';
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, buffer, LONG);
+    for (k = 0; k < LONG-1; k++) {
+        if (!parser.unread) {
+            if (!yaml_parser_update_buffer(&parser, 1)) {
+                printf("\treader error: %s at %ld\n", parser.problem, (long)parser.problem_offset);
+                failed = 1;
+                break;
+            }
+        }
+        if (parser.buffer.pointer[0] != buffer[k]
+                || (k == LONG/2 && parser.buffer.pointer[1] != buffer[k+1])) {
+            printf("\tincorrect character at %d: %X instead of %X\n",
+                    k, (int)parser.buffer.pointer[0], (int)buffer[k]);
+            failed = 1;
+            break;
+        }
+        parser.buffer.pointer += (k == LONG/2) ? 2 : 1;
+        parser.unread -= 1;
+        if (k == LONG/2) k++;
+    }
+    yaml_parser_delete(&parser);
+    for (k = 0; !failed && k < (int)(sizeof(positions)/sizeof(*positions)); k++) {
+        unsigned char saved = buffer[positions[k]];
+        buffer[positions[k]] = '\x7f';
+        yaml_parser_initialize(&parser);
+        yaml_parser_set_input_string(&parser, buffer, LONG);
+        while (yaml_parser_update_buffer(&parser, 1) && !parser.eof) {
+            parser.buffer.pointer = parser.buffer.last;
+            parser.unread = 0;
+        }
+        if (parser.error != YAML_READER_ERROR
+                || parser.problem_offset != positions[k]
+                || parser.problem_value != 0x7f) {
+            printf("\texpected a control character error at %ld, got '%s' at %ld\n",
+                    (long)positions[k], parser.problem ? parser.problem : "no error",
+                    (long)parser.problem_offset);
+            failed = 1;
+        }
+        yaml_parser_delete(&parser);
+        buffer[positions[k]] = saved;
+    }
+    free(buffer);
+    printf("checking a long ascii sequence: %d fail(s)\n", failed);
+    return failed;
+}
+
+int read_all(yaml_parser_t *parser, unsigned char *output, size_t *size)
+{
+    *size = 0;
+    while (1) {
+        if (!yaml_parser_update_buffer(parser, 1))
+            return 0;
+        if (!parser->unread)
+            return 1;
+        memcpy(output + *size, parser->buffer.pointer,
+                parser->buffer.last - parser->buffer.pointer);
+        *size += parser->buffer.last - parser->buffer.pointer;
+        parser->buffer.pointer = parser->buffer.last;
+        parser->unread = 0;
+    }
+}
+
+int check_zerocopy_case(const unsigned char *input, size_t size)
+{
+    yaml_parser_t parser, zparser;
+    int result, zresult;
+    size_t length, zlength;
+    int failed = 0;
+    unsigned char *output = (unsigned char *)malloc(size*2+1);
+    unsigned char *zoutput = (unsigned char *)malloc(size*2+1);
+    assert(output && zoutput);
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, input, size);
+    yaml_parser_initialize(&zparser);
+    yaml_parser_set_input_buffer_zerocopy(&zparser, input, size);
+    result = read_all(&parser, output, &length);
+    zresult = read_all(&zparser, zoutput, &zlength);
+    if (result != zresult || length != zlength
+            || parser.problem != zparser.problem
+            || parser.problem_offset != zparser.problem_offset
+            || parser.problem_value != zparser.problem_value) {
+        printf("\t- result %d/%d, length %ld/%ld, error '%s'/'%s' at %ld/%ld\n",
+                result, zresult, (long)length, (long)zlength,
+                parser.problem ? parser.problem : "no error",
+                zparser.problem ? zparser.problem : "no error",
+                (long)parser.problem_offset, (long)zparser.problem_offset);
+        failed = 1;
+    }
+    else if (memcmp(output, zoutput, length) != 0) {
+        printf("\t- different buffer contents\n");
+        failed = 1;
+    }
+    yaml_parser_delete(&parser);
+    yaml_parser_delete(&zparser);
+    free(output);
+    free(zoutput);
+    return failed;
+}
+
+int check_zerocopy(void)
+{
+    int failed = 0;
+    int k;
+    unsigned char *buffer = (unsigned char *)malloc(LONG);
+    assert(buffer);
+    printf("checking zero-copy input...\n");
+    for (k = 0; utf8_sequences[k].test; k++) {
+        char *start = utf8_sequences[k].test;
+        char *end = start;
+        while (1) {
+            while (*end != '|' && *end != '!') end++;
+            failed += check_zerocopy_case((unsigned char *)start, end-start);
+            if (*end == '!') break;
+            start = ++end;
+        }
+    }
+    for (k = 0; boms[k].test; k++) {
+        char *end = boms[k].test;
+        while (*end != '!') end++;
+        failed += check_zerocopy_case((unsigned char *)boms[k].test, end-boms[k].test);
+    }
+    for (k = 0; k < LONG; k++) {
+        buffer[k] = (k % 80 == 79) ? '\n' : 'a' + k % 26;
+    }
+    failed += check_zerocopy_case(buffer, LONG);
+    buffer[40000] = '\xd0';
+    failed += check_zerocopy_case(buffer, LONG);
+    buffer[LONG-1] = '\xd0';
+    failed += check_zerocopy_case(buffer, LONG);
+    free(buffer);
+    printf("checking zero-copy input: %d fail(s)\n", failed);
+    return failed;
+}
+
+int check_input_path_case(const unsigned char *input, size_t size)
+{
+    yaml_parser_t parser, pparser;
+    int result, presult;
+    size_t length, plength;
+    int failed = 0;
+    FILE *file;
+    unsigned char *output = (unsigned char *)malloc(size*2+1);
+    unsigned char *poutput = (unsigned char *)malloc(size*2+1);
+    assert(output && poutput);
+    file = fopen("test-reader.tmp", "wb");
+    assert(file);
+    assert(fwrite(input, 1, size, file) == size);
+    fclose(file);
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, input, size);
+    yaml_parser_initialize(&pparser);
+    assert(yaml_parser_set_input_path(&pparser, "test-reader.tmp"));
+    result = read_all(&parser, output, &length);
+    presult = read_all(&pparser, poutput, &plength);
+    if (result != presult || length != plength
+            || parser.problem != pparser.problem
+            || parser.problem_offset != pparser.problem_offset
+            || parser.problem_value != pparser.problem_value) {
+        printf("\t- result %d/%d, length %ld/%ld, error '%s'/'%s' at %ld/%ld\n",
+                result, presult, (long)length, (long)plength,
+                parser.problem ? parser.problem : "no error",
+                pparser.problem ? pparser.problem : "no error",
+                (long)parser.problem_offset, (long)pparser.problem_offset);
+        failed = 1;
+    }
+    else if (memcmp(output, poutput, length) != 0) {
+        printf("\t- different buffer contents\n");
+        failed = 1;
+    }
+    yaml_parser_delete(&parser);
+    yaml_parser_delete(&pparser);
+    remove("test-reader.tmp");
+    free(output);
+    free(poutput);
+    return failed;
+}
+
+#ifdef HAVE_PIPE_PATH
+
+int check_input_path_pipe(const unsigned char *input, size_t size)
+{
+    yaml_parser_t parser, pparser;
+    int fds[2];
+    char path[64];
+    int result, presult;
+    size_t length, plength;
+    int failed = 0;
+    unsigned char *output = (unsigned char *)malloc(size*2+1);
+    unsigned char *poutput = (unsigned char *)malloc(size*2+1);
+    assert(output && poutput);
+    assert(pipe(fds) == 0);
+    assert(write(fds[1], input, size) == (long)size);
+    close(fds[1]);
+    sprintf(path, "/dev/fd/%d", fds[0]);
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_string(&parser, input, size);
+    yaml_parser_initialize(&pparser);
+    if (!yaml_parser_set_input_path(&pparser, path)) {
+        printf("\t- cannot open %s\n", path);
+        failed = 1;
+    }
+    else if (pparser.input_path.map || !pparser.input_path.file) {
+        printf("\t- a pipe is not read with stdio\n");
+        failed = 1;
+    }
+    else {
+        result = read_all(&parser, output, &length);
+        presult = read_all(&pparser, poutput, &plength);
+        if (result != presult || length != plength
+                || memcmp(output, poutput, length) != 0) {
+            printf("\t- result %d/%d, length %ld/%ld\n",
+                    result, presult, (long)length, (long)plength);
+            failed = 1;
+        }
+    }
+    yaml_parser_delete(&parser);
+    yaml_parser_delete(&pparser);
+    close(fds[0]);
+    free(output);
+    free(poutput);
+    return failed;
+}
+
+#endif
+
+int check_input_path(void)
+{
+    yaml_parser_t parser;
+    int failed = 0;
+    int k;
+    unsigned char *buffer = (unsigned char *)malloc(LONG);
+    assert(buffer);
+    printf("checking path input...\n");
+    for (k = 0; boms[k].test; k++) {
+        char *end = boms[k].test;
+        while (*end != '!') end++;
+        failed += check_input_path_case((unsigned char *)boms[k].test, end-boms[k].test);
+    }
+    failed += check_input_path_case((unsigned char *)"", 0);
+    for (k = 0; k < LONG; k++) {
+        buffer[k] = (k % 80 == 79) ? '\n' : 'a' + k % 26;
+    }
+    failed += check_input_path_case(buffer, LONG);
+    buffer[40000] = '\xd0';
+    failed += check_input_path_case(buffer, LONG);
+#ifdef HAVE_PIPE_PATH
+    failed += check_input_path_pipe(buffer, 4000);
+    failed += check_input_path_pipe((unsigned char *)boms[2].test, 28);
+#endif
+    yaml_parser_initialize(&parser);
+    if (yaml_parser_set_input_path(&parser, "test-reader.missing")) {
+        printf("\t- a missing file is opened\n");
+        failed++;
+    }
+    yaml_parser_delete(&parser);
+    free(buffer);
+    printf("checking path input: %d fail(s)\n", failed);
+    return failed;
+}
+
 int
 main(void)
 {
-    return check_utf8_sequences() + check_boms() + check_long_utf8() + check_long_utf16();
+    return check_utf8_sequences() + check_boms() + check_long_utf8() + check_long_utf16() + check_long_ascii()
+        + check_zerocopy() + check_input_path();
 }